@@ -0,0 +1,53 @@
+/*-------------------------------
+# SPDX-License-Identifier: ISC
+#
+# Copyright © 2022 Daniel Wolf <<nephatrine@gmail.com>>
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+# REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+# AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+# INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+# LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+# OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+# -----------------------------*/
+
+#ifndef Q2A_BENCH_H
+#define Q2A_BENCH_H 1
+
+#include "g_local.h"
+
+// Each benchmark gets an iteration count and must do that much work. The
+// runner keeps doubling the count until one run takes long enough to time and
+// then prints one JSON object per line on stdout.
+typedef void ( *bench_fn )( void * ctx, long iterations );
+
+void bench_run( const char * suite, const char * name, bench_fn fn, void * ctx );
+
+// Checks run once, count the cases they compared and return 0 on a mismatch
+// after describing it on stderr, which stops the run with exit status 1.
+typedef int ( *bench_check_fn )( void * ctx, long * cases );
+
+void bench_check( const char * suite, const char * name, bench_check_fn fn, void * ctx );
+
+// Fake client slots the suites can fill in.
+#define BENCH_CLIENTS 16
+
+extern edict_t   bench_edicts[BENCH_CLIENTS + 1];
+extern gclient_t bench_gclients[BENCH_CLIENTS];
+
+void bench_set_client( int client, const char * name, const char * ip );
+
+// TagFree calls on blocks gi.FreeTags had already released
+extern int bench_freed_twice;
+void bench_set_args( const char * line );
+
+// suites
+void bench_log();
+void bench_match();
+
+#endif
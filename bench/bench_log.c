@@ -0,0 +1,235 @@
+/*-------------------------------
+# SPDX-License-Identifier: ISC
+#
+# Copyright © 2022 Daniel Wolf <<nephatrine@gmail.com>>
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+# REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+# AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+# INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+# LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+# OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+# -----------------------------*/
+
+#define _GNU_SOURCE
+
+#include "bench.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Formats modelled on the shipped q2adminlog.txt. Only the last one has a time
+// code, so the others measure formatting rather than the C library clock.
+#define BENCH_FMT_CHAT "Chat: Name \"#n\" Ping \"#p\" IP \"#i\" Rate \"#r\" Skin \"#s\" \"#m\""
+#define BENCH_FMT_CMDS "Cmd: Name \"#n\" IP \"#i\" Number \"#e\" Cmd \"#m\""
+#define BENCH_FMT_CONNECT "Connect: Time \"#t\" Name \"#n\"  Ping \"#p\" IP \"#i\""
+
+typedef struct
+{
+	int          ltype;
+	const char * format;
+	const char * message;
+	int          number;
+} bench_log_ctx_t;
+
+// The interpreter logEvent used before formats were compiled, kept here as
+// the baseline.
+static void legacyConvertToLogLine( char * dest, const char * format, int client, edict_t * ent, const char * message, int number, float number2 )
+{
+	const char * cp;
+	char         timebuf[64];
+	time_t       now;
+
+	while( *format )
+	{
+		if( *format == '#' )
+		{
+			format++;
+
+			if( *format == 'n' )
+			{
+				if( ent )
+				{
+					cp = proxyinfo[client].name;
+					while( *cp ) *dest++ = *cp++;
+				}
+			}
+			else if( *format == 'p' )
+			{
+				if( ent )
+				{
+					sprintf( dest, "%d", ent->client->ping );
+					while( *dest ) dest++;
+				}
+			}
+			else if( *format == 'i' )
+			{
+				if( ent )
+				{
+					cp = proxyinfo[client].ipaddress;
+					while( *cp ) *dest++ = *cp++;
+				}
+			}
+			else if( *format == 'r' )
+			{
+				if( ent )
+				{
+					sprintf( dest, "%d", proxyinfo[client].rate );
+					while( *dest ) dest++;
+				}
+			}
+			else if( *format == 's' )
+			{
+				if( ent )
+				{
+					cp = proxyinfo[client].skin;
+					while( *cp ) *dest++ = *cp++;
+				}
+			}
+			else if( *format == 't' )
+			{
+				time( &now );
+				snprintf( timebuf, sizeof( timebuf ), "%s", ctime( &now ) );
+
+				for( cp = timebuf; *cp && *cp != '\n'; ) *dest++ = *cp++;
+			}
+			else if( *format == 'm' )
+			{
+				if( message )
+				{
+					for( cp = message; *cp; cp++ )
+						if( *cp != '\n' ) *dest++ = *cp;
+				}
+			}
+			else if( *format == 'e' )
+			{
+				sprintf( dest, "%d", number );
+				while( *dest ) dest++;
+			}
+			else if( *format == 'f' )
+			{
+				sprintf( dest, "%g", number2 );
+				while( *dest ) dest++;
+			}
+			else
+			{
+				*dest++ = '#';
+				if( *format ) *dest++ = *format;
+			}
+
+			if( *format ) format++;
+		}
+		else
+			*dest++ = *format++;
+	}
+	*dest = 0;
+}
+
+static void bench_log_legacy( void * ctx, long iterations )
+{
+	bench_log_ctx_t * c = (bench_log_ctx_t *)ctx;
+	static char       line[4096];
+	long              i;
+
+	for( i = 0; i < iterations; ++i ) legacyConvertToLogLine( line, c->format, (int)( i & 7 ), &bench_edicts[( i & 7 ) + 1], c->message, c->number + (int)i, 0.0f );
+}
+
+static void bench_log_compiled( void * ctx, long iterations )
+{
+	bench_log_ctx_t * c = (bench_log_ctx_t *)ctx;
+	static char       line[4096];
+	long              i;
+
+	for( i = 0; i < iterations; ++i ) convertToLogLine( line, sizeof( line ), c->ltype, (int)( i & 7 ), &bench_edicts[( i & 7 ) + 1], (char *)c->message, c->number + (int)i, 0.0f );
+}
+
+// Whole logEvent calls, text formatting versus BINARY records. Both go through
+// the same (unthreaded here) writer so the difference is the game thread cost.
+static void bench_log_event( void * ctx, long iterations )
+{
+	bench_log_ctx_t * c = (bench_log_ctx_t *)ctx;
+	long              i;
+
+	for( i = 0; i < iterations; ++i ) logEvent( c->ltype, (int)( i & 7 ), &bench_edicts[( i & 7 ) + 1], (char *)c->message, c->number + (int)i, 0.0f );
+}
+
+static void bench_log_escape( FILE * fp, const char * format )
+{
+	for( ; *format; format++ )
+	{
+		if( *format == '"' ) fputc( '\\', fp );
+		fputc( *format, fp );
+	}
+}
+
+void bench_log()
+{
+	char   dir[] = "/tmp/q2a-bench-XXXXXX";
+	char   path[256], textlog[256], binlog[256];
+	char   legacy[4096], compiled[4096];
+	FILE * fp;
+	int    i;
+
+	bench_log_ctx_t chat = { LT_CHAT, BENCH_FMT_CHAT, "gg everyone, that rail was totally luck and you know it", 0 };
+	bench_log_ctx_t cmds = { LT_CLIENTCMDS, BENCH_FMT_CMDS, "use Rocket Launcher", 1000 };
+	bench_log_ctx_t conn = { LT_CLIENTCONNECT, BENCH_FMT_CONNECT, NULL, 0 };
+	bench_log_ctx_t text = { LT_CHAT, BENCH_FMT_CHAT, chat.message, 0 };
+	bench_log_ctx_t bin  = { LT_ADMINLOG, BENCH_FMT_CHAT, chat.message, 0 };
+
+	if( mkdtemp( dir ) == NULL ) return;
+
+	snprintf( path, sizeof( path ), "%s/q2adminlog.txt", dir );
+	fp = fopen( path, "w" );
+	if( fp == NULL ) return;
+	fprintf( fp, "LOGFILE: 1 \"bench.log\"\nLOGFILE: 2 BINARY \"bench.bin\"\nCHAT: YES 1 \"" );
+	bench_log_escape( fp, BENCH_FMT_CHAT );
+	fprintf( fp, "\"\nCLIENTCMDS: YES 1 \"" );
+	bench_log_escape( fp, BENCH_FMT_CMDS );
+	fprintf( fp, "\"\nCLIENTCONNECT: YES 1 \"" );
+	bench_log_escape( fp, BENCH_FMT_CONNECT );
+	fprintf( fp, "\"\nADMINLOG: YES 2 \"" );
+	bench_log_escape( fp, BENCH_FMT_CHAT );
+	fprintf( fp, "\"\n" );
+	fclose( fp );
+
+	gi.cvar_set( "basepath", dir );
+	gi.cvar_set( "savepath", dir );
+	loadLogList();
+
+	for( i = 0; i < 8; ++i )
+	{
+		char name[16], ip[16];
+
+		snprintf( name, sizeof( name ), "Player%d", i );
+		snprintf( ip, sizeof( ip ), "10.0.%d.%d", i, 100 + i );
+		bench_set_client( i, name, ip );
+	}
+
+	// both paths must agree before their timings mean anything
+	legacyConvertToLogLine( legacy, chat.format, 3, &bench_edicts[4], chat.message, 7, 0.0f );
+	convertToLogLine( compiled, sizeof( compiled ), LT_CHAT, 3, &bench_edicts[4], (char *)chat.message, 7, 0.0f );
+	if( strcmp( legacy, compiled ) != 0 ) fprintf( stderr, "log format mismatch:\n  %s\n  %s\n", legacy, compiled );
+
+	bench_run( "log", "format_chat_legacy", bench_log_legacy, &chat );
+	bench_run( "log", "format_chat_compiled", bench_log_compiled, &chat );
+	bench_run( "log", "format_clientcmds_legacy", bench_log_legacy, &cmds );
+	bench_run( "log", "format_clientcmds_compiled", bench_log_compiled, &cmds );
+	bench_run( "log", "format_connect_legacy", bench_log_legacy, &conn );
+	bench_run( "log", "format_connect_compiled", bench_log_compiled, &conn );
+	bench_run( "log", "event_chat_text", bench_log_event, &text );
+	bench_run( "log", "event_chat_binary", bench_log_event, &bin );
+
+	q2l_detach_all();
+	snprintf( textlog, sizeof( textlog ), "%s/bench.log", dir );
+	snprintf( binlog, sizeof( binlog ), "%s/bench.bin", dir );
+	unlink( textlog );
+	unlink( binlog );
+	unlink( path );
+	rmdir( dir );
+}
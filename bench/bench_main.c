@@ -0,0 +1,321 @@
+/*-------------------------------
+# SPDX-License-Identifier: ISC
+#
+# Copyright © 2022 Daniel Wolf <<nephatrine@gmail.com>>
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+# REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+# AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+# INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+# LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+# OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+# -----------------------------*/
+
+#define _GNU_SOURCE
+
+#include "bench.h"
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+edict_t   bench_edicts[BENCH_CLIENTS + 1];
+gclient_t bench_gclients[BENCH_CLIENTS];
+
+static const char * bench_filter   = NULL;
+static double       bench_min_time = 0.25;
+
+//
+// Engine Stubs
+//
+
+#define BENCH_CVARS 64
+
+static cvar_t bench_cvars[BENCH_CVARS];
+static int    bench_num_cvars = 0;
+
+static cvar_t * bench_cvar( char * name, char * value, int flags )
+{
+	int i;
+
+	for( i = 0; i < bench_num_cvars; ++i )
+		if( strcmp( bench_cvars[i].name, name ) == 0 ) return &bench_cvars[i];
+
+	if( bench_num_cvars >= BENCH_CVARS ) abort();
+
+	cvar_t * cvar = &bench_cvars[bench_num_cvars++];
+	cvar->name    = strdup( name );
+	cvar->string  = strdup( value );
+	cvar->flags   = flags;
+	cvar->value   = (float)atof( value );
+	return cvar;
+}
+
+static cvar_t * bench_cvar_set( char * name, char * value )
+{
+	cvar_t * cvar = bench_cvar( name, value, 0 );
+
+	free( cvar->string );
+	cvar->string = strdup( value );
+	cvar->value  = (float)atof( value );
+	return cvar;
+}
+
+static void bench_print( char * fmt, ... ) { (void)fmt; }
+static void bench_bprint( int level, char * fmt, ... ) { (void)level, (void)fmt; }
+static void bench_cprint( edict_t * ent, int level, char * fmt, ... ) { (void)ent, (void)level, (void)fmt; }
+
+static void bench_error( char * fmt, ... )
+{
+	va_list args;
+
+	va_start( args, fmt );
+	vfprintf( stderr, fmt, args );
+	va_end( args );
+	exit( 1 );
+}
+
+// TagMalloc blocks carry their tag so FreeTags can release a level the way
+// the engine does. What it releases is poisoned and kept rather than freed,
+// so a later TagFree of the same block is counted instead of corrupting the
+// heap.
+#define BENCH_BLOCK_LIVE 0x51A7B10C
+#define BENCH_BLOCK_GONE 0xDEADB10C
+
+typedef struct bench_block_s
+{
+	struct bench_block_s * prev;
+	struct bench_block_s * next;
+	size_t                 size;
+	int                    tag;
+	unsigned int           magic;
+} bench_block_t;
+
+static bench_block_t * bench_blocks = NULL;
+static bench_block_t * bench_gone   = NULL;
+
+int bench_freed_twice = 0;
+
+static void bench_unlink_block( bench_block_t * block )
+{
+	if( block->prev ) block->prev->next = block->next;
+	else
+		bench_blocks = block->next;
+	if( block->next ) block->next->prev = block->prev;
+}
+
+static void * bench_malloc( int size, int tag )
+{
+	bench_block_t * block = calloc( 1, sizeof( bench_block_t ) + (size_t)size );
+
+	if( block == NULL ) return NULL;
+
+	block->size  = (size_t)size;
+	block->tag   = tag;
+	block->magic = BENCH_BLOCK_LIVE;
+	block->next  = bench_blocks;
+	if( bench_blocks ) bench_blocks->prev = block;
+	bench_blocks = block;
+	return block + 1;
+}
+
+static void bench_free( void * ptr )
+{
+	bench_block_t * block = (bench_block_t *)ptr - 1;
+
+	if( block->magic != BENCH_BLOCK_LIVE )
+	{
+		bench_freed_twice++;
+		return;
+	}
+
+	bench_unlink_block( block );
+	free( block );
+}
+
+static void bench_free_tags( int tag )
+{
+	bench_block_t * block, *next;
+
+	for( block = bench_blocks; block; block = next )
+	{
+		next = block->next;
+		if( block->tag != tag ) continue;
+
+		bench_unlink_block( block );
+		memset( block + 1, 0xDD, block->size );
+		block->magic = BENCH_BLOCK_GONE;
+		block->prev  = NULL;
+		block->next  = bench_gone;
+		bench_gone   = block;
+	}
+}
+static void bench_command( char * text ) { (void)text; }
+static void bench_write( int c ) { (void)c; }
+static void bench_write_string( char * s ) { (void)s; }
+static void bench_unicast( edict_t * ent, qboolean reliable ) { (void)ent, (void)reliable; }
+static void bench_link( edict_t * ent ) { (void)ent; }
+static void bench_configstring( int num, char * string ) { (void)num, (void)string; }
+
+#define BENCH_ARGS 32
+
+static char   bench_argbuf[1024];
+static char   bench_argsline[1024];
+static char * bench_argv[BENCH_ARGS];
+static int    bench_argc = 0;
+
+static int    bench_get_argc() { return bench_argc; }
+static char * bench_get_argv( int n ) { return ( n < bench_argc ) ? bench_argv[n] : ""; }
+static char * bench_get_args() { return bench_argsline; }
+
+void bench_set_args( const char * line )
+{
+	char * cp;
+
+	snprintf( bench_argbuf, sizeof( bench_argbuf ), "%s", line );
+	bench_argc        = 0;
+	bench_argsline[0] = 0;
+
+	for( cp = strtok( bench_argbuf, " " ); cp && bench_argc < BENCH_ARGS; cp = strtok( NULL, " " ) ) bench_argv[bench_argc++] = cp;
+
+	if( ( cp = strchr( line, ' ' ) ) != NULL ) snprintf( bench_argsline, sizeof( bench_argsline ), "%s", cp + 1 );
+}
+
+void bench_set_client( int client, const char * name, const char * ip )
+{
+	proxyinfo[client].inuse = 1;
+	snprintf( proxyinfo[client].name, sizeof( proxyinfo[client].name ), "%s", name );
+	snprintf( proxyinfo[client].ipaddress, sizeof( proxyinfo[client].ipaddress ), "%s", ip );
+	sscanf( ip, "%hhu.%hhu.%hhu.%hhu", &proxyinfo[client].ipaddressBinary[0], &proxyinfo[client].ipaddressBinary[1], &proxyinfo[client].ipaddressBinary[2],
+	        &proxyinfo[client].ipaddressBinary[3] );
+	snprintf( proxyinfo[client].skin, sizeof( proxyinfo[client].skin ), "male/grunt" );
+	proxyinfo[client].rate             = 25000;
+	bench_gclients[client].ping        = 42 + client;
+	bench_edicts[client + 1].client    = &bench_gclients[client];
+	bench_edicts[client + 1].inuse     = true;
+}
+
+static void bench_setup()
+{
+	memset( &gi, 0, sizeof( gi ) );
+	gi.bprintf          = bench_bprint;
+	gi.dprintf          = bench_print;
+	gi.cprintf          = bench_cprint;
+	gi.error            = bench_error;
+	gi.TagMalloc        = bench_malloc;
+	gi.TagFree          = bench_free;
+	gi.FreeTags         = bench_free_tags;
+	gi.cvar             = bench_cvar;
+	gi.cvar_set         = bench_cvar_set;
+	gi.cvar_forceset    = bench_cvar_set;
+	gi.argc             = bench_get_argc;
+	gi.argv             = bench_get_argv;
+	gi.args             = bench_get_args;
+	gi.AddCommandString = bench_command;
+	gi.WriteByte        = bench_write;
+	gi.WriteString      = bench_write_string;
+	gi.unicast          = bench_unicast;
+	gi.linkentity       = bench_link;
+	gi.unlinkentity     = bench_link;
+	gi.configstring     = bench_configstring;
+
+	maxclients = gi.cvar( "maxclients", "16", 0 );
+	port       = gi.cvar( "port", "27910", 0 );
+	basepath   = gi.cvar( "basepath", ".", 0 );
+	savepath   = gi.cvar( "savepath", ".", 0 );
+	q2a_strcpy( moddir, "baseq2" );
+
+	globals.edicts     = bench_edicts;
+	globals.edict_size = sizeof( edict_t );
+	globals.num_edicts = globals.max_edicts = BENCH_CLIENTS + 1;
+
+	proxyinfoBase = gi.TagMalloc( ( BENCH_CLIENTS + 1 ) * sizeof( proxyinfo_t ), TAG_GAME );
+	proxyinfo     = proxyinfoBase + 1;
+	proxyinfo[-1].inuse = 1;
+
+	dllloaded      = TRUE;
+	q2adminrunmode = 100;
+}
+
+//
+// Runner
+//
+
+static double bench_now()
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+void bench_run( const char * suite, const char * name, bench_fn fn, void * ctx )
+{
+	long   iterations = 1;
+	double elapsed    = 0.0;
+	double start;
+
+	if( bench_filter && strstr( suite, bench_filter ) == NULL && strstr( name, bench_filter ) == NULL ) return;
+
+	fn( ctx, 1 ); // warm up
+
+	for( ;; )
+	{
+		start = bench_now();
+		fn( ctx, iterations );
+		elapsed = bench_now() - start;
+
+		if( elapsed >= bench_min_time || iterations >= ( 1L << 40 ) ) break;
+
+		iterations = ( elapsed > 0.001 ) ? (long)( iterations * ( bench_min_time * 1.2 / elapsed ) ) + 1 : iterations * 10;
+	}
+
+	printf( "{\"suite\":\"%s\",\"name\":\"%s\",\"iterations\":%ld,\"seconds\":%.6f,\"ns_per_op\":%.2f}\n", suite, name, iterations, elapsed, elapsed * 1e9 / (double)iterations );
+	fflush( stdout );
+}
+
+void bench_check( const char * suite, const char * name, bench_check_fn fn, void * ctx )
+{
+	long cases = 0;
+
+	if( bench_filter && strstr( suite, bench_filter ) == NULL && strstr( name, bench_filter ) == NULL ) return;
+
+	if( !fn( ctx, &cases ) )
+	{
+		printf( "{\"suite\":\"%s\",\"name\":\"%s\",\"cases\":%ld,\"passed\":false}\n", suite, name, cases );
+		fflush( stdout );
+		exit( 1 );
+	}
+
+	printf( "{\"suite\":\"%s\",\"name\":\"%s\",\"cases\":%ld,\"passed\":true}\n", suite, name, cases );
+	fflush( stdout );
+}
+
+int main( int argc, char ** argv )
+{
+	int i;
+
+	for( i = 1; i < argc; ++i )
+	{
+		if( strcmp( argv[i], "--min-time" ) == 0 && i + 1 < argc ) bench_min_time = atof( argv[++i] ) / 1000.0;
+		else if( strcmp( argv[i], "--filter" ) == 0 && i + 1 < argc )
+			bench_filter = argv[++i];
+		else
+		{
+			fprintf( stderr, "usage: %s [--filter text] [--min-time ms]\n", argv[0] );
+			return 1;
+		}
+	}
+
+	bench_setup();
+	bench_log();
+	bench_match();
+
+	return 0;
+}
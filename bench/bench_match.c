@@ -0,0 +1,757 @@
+/*-------------------------------
+# SPDX-License-Identifier: ISC
+#
+# Copyright © 2022 Daniel Wolf <<nephatrine@gmail.com>>
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+# REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+# AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+# INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+# LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+# OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+# -----------------------------*/
+
+#define _GNU_SOURCE
+
+#include "bench.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Synthetic corpora. Names and chat are built from pieces that look like what
+// shows up on public servers, and none of them are banned by the generated
+// lists, so every check scans the whole list the way it does for most players.
+#define BENCH_NAMES 64
+#define BENCH_CHATS 32
+
+static const char * bench_tags[]     = { "", "", "", "[OMG]", "=DK=", "{SoF}", "-=FA=-", "|RO|" };
+static const char * bench_words[]    = { "Frag", "Rail", "Rocket", "Quad", "Camper", "Sniper", "Blaster", "Hyper", "Gibber", "Strafe", "Doom", "Grunt", "Cyborg", "Viper", "Razor", "Ghost" };
+static const char * bench_suffixes[] = { "", "Master", "Boy", "King", "er", "Jr", "2k", "_", "69", "007", "Z", "X" };
+
+static const char * bench_chat_lines[BENCH_CHATS] = {
+	"gg",
+	"nice shot",
+	"lol that rail was totally luck",
+	"anyone want to 1v1 after this map?",
+	"quad is up in 10",
+	"who keeps camping the rocket launcher",
+	"brb",
+	"my ping is terrible tonight, sorry",
+	"rocket on the left, mega on the right",
+	"gl hf everyone",
+	"can we vote q2dm1 next",
+	"that was a sick airshot",
+	"stop spawn killing dude",
+	"ok last map for me",
+	"is the server lagging or is it just me",
+	"hahaha",
+	"team blue needs one more",
+	"where did you get the bfg from",
+	"thx",
+	"rofl you fell in the lava again",
+	"pls no grenade spam",
+	"does anyone know a good config for 144hz",
+	"wp",
+	"i was typing!",
+	"ns",
+	"mega health respawns in 20",
+	"ffs the hyperblaster on this map",
+	"see you all tomorrow",
+	"how do i turn off the hud clock",
+	"lol",
+	"2v2 anyone?",
+	"that lag spike killed me",
+};
+
+static char bench_names[BENCH_NAMES][16];
+
+static const char * bench_userinfo = "\\rate\\25000\\msg\\1\\fov\\90\\skin\\male/grunt\\spectator\\0\\hand\\2\\gender\\male\\name\\[OMG]RailMaster\\ip\\10.0.3.103:27901";
+static const char * bench_cmdline  = "say_team \"rocket on the left, mega on the right\" // callout\nvote map \"q2dm1\" 30";
+static const char * bench_cfgvalue = "Welcome to \\\"Frag Fest\\\"\\nPlay nice and have fun\" MSG \"trailing field\"";
+
+// Commands the clients send between chats, mostly ones the lists do not name
+// like on a real server. The flood list is only checked against the first word.
+static const char * bench_commands[] = { "inven", "use", "score", "help", "invnext", "play_team", "wave", "putaway", "weapnext", "vote", "kill", "drop" };
+#define BENCH_COMMANDS ( sizeof( bench_commands ) / sizeof( bench_commands[0] ) )
+
+typedef struct
+{
+	const char * key;
+} bench_match_ctx_t;
+
+static void bench_make_names()
+{
+	unsigned int seed = 12345;
+	int          i;
+
+	for( i = 0; i < BENCH_NAMES; ++i )
+	{
+		seed = seed * 1103515245u + 12345u;
+		snprintf( bench_names[i], sizeof( bench_names[i] ), "%s%s%s", bench_tags[( seed >> 8 ) & 7], bench_words[( seed >> 12 ) & 15], bench_suffixes[( seed >> 16 ) % 12] );
+	}
+}
+
+//
+// String Kernels
+//
+
+static void bench_match_startcontains( void * ctx, long iterations )
+{
+	long i;
+	int  hits = 0;
+
+	(void)ctx;
+	for( i = 0; i < iterations; ++i ) hits += startContains( bench_names[i & ( BENCH_NAMES - 1 )], "[OMG]" );
+	if( hits < 0 ) abort();
+}
+
+static void bench_match_stringcontains( void * ctx, long iterations )
+{
+	long i;
+	int  hits = 0;
+
+	(void)ctx;
+	for( i = 0; i < iterations; ++i ) hits += stringContains( (char *)bench_chat_lines[i & ( BENCH_CHATS - 1 )], "camp" );
+	if( hits < 0 ) abort();
+}
+
+static void bench_match_stricmp( void * ctx, long iterations )
+{
+	long i;
+	int  hits = 0;
+
+	(void)ctx;
+	for( i = 0; i < iterations; ++i ) hits += !Q_stricmp( bench_names[i & ( BENCH_NAMES - 1 )], bench_names[( i + 1 ) & ( BENCH_NAMES - 1 )] );
+	if( hits < 0 ) abort();
+}
+
+static void bench_match_strupr( void * ctx, long iterations )
+{
+	char         line[256];
+	const char * src;
+	long         i;
+
+	(void)ctx;
+	for( i = 0; i < iterations; ++i )
+	{
+		src = bench_chat_lines[i & ( BENCH_CHATS - 1 )];
+		q2a_strcpy( line, src );
+		q_strupr( line );
+	}
+}
+
+//
+// Parsers
+//
+
+static void bench_match_infovalue( void * ctx, long iterations )
+{
+	bench_match_ctx_t * c = (bench_match_ctx_t *)ctx;
+	long                i;
+	size_t              total = 0;
+
+	for( i = 0; i < iterations; ++i ) total += q2a_strlen( Info_ValueForKey( (char *)bench_userinfo, (char *)c->key ) );
+	if( total == (size_t)-1 ) abort();
+}
+
+static void bench_match_comparse( void * ctx, long iterations )
+{
+	char * data;
+	long   i;
+
+	(void)ctx;
+	for( i = 0; i < iterations; ++i )
+	{
+		data = (char *)bench_cmdline;
+		while( data ) COM_Parse( &data, NULL );
+	}
+}
+
+static void bench_match_processstring( void * ctx, long iterations )
+{
+	char output[256];
+	long i;
+
+	(void)ctx;
+	for( i = 0; i < iterations; ++i ) processstring( output, (char *)bench_cfgvalue, sizeof( output ) - 1, '\"' );
+}
+
+//
+// Ban Lists
+//
+
+static void bench_match_banlist( void * ctx, long iterations )
+{
+	long i;
+	int  banned = 0;
+
+	(void)ctx;
+	for( i = 0; i < iterations; ++i ) banned += checkBanList( &bench_edicts[( i & 15 ) + 1], (int)( i & 15 ) );
+	if( banned ) abort();
+}
+
+// a different address every time so the decision cache never hits
+static void bench_match_banlist_miss( void * ctx, long iterations )
+{
+	long i;
+	int  banned = 0, client;
+
+	(void)ctx;
+	for( i = 0; i < iterations; ++i )
+	{
+		client                               = (int)( i & 15 );
+		proxyinfo[client].ipaddressBinary[3] = (byte)( i >> 4 );
+		banned += checkBanList( &bench_edicts[client + 1], client );
+	}
+	for( client = 0; client < 16; ++client ) proxyinfo[client].ipaddressBinary[3] = (byte)( 100 + client );
+	if( banned ) abort();
+}
+
+static void bench_match_chatban( void * ctx, long iterations )
+{
+	char line[256];
+	long i;
+	int  banned = 0;
+
+	(void)ctx;
+	for( i = 0; i < iterations; ++i )
+	{
+		q2a_strcpy( line, bench_chat_lines[i & ( BENCH_CHATS - 1 )] );
+		banned += checkCheckIfChatBanned( line );
+	}
+	if( banned ) abort();
+}
+
+static void bench_match_readbans( void * ctx, long iterations )
+{
+	long i;
+
+	(void)ctx;
+	for( i = 0; i < iterations; ++i ) readBanLists();
+	if( !banhead ) abort();
+}
+
+static void bench_match_floodcmds( void * ctx, long iterations )
+{
+	long i;
+	int  hits = 0;
+
+	(void)ctx;
+	for( i = 0; i < iterations; ++i ) hits += checkforfloodcmds( (char *)bench_commands[i % BENCH_COMMANDS] );
+	if( hits < 0 ) abort();
+}
+
+static void bench_match_disabled( void * ctx, long iterations )
+{
+	long i;
+	int  hits = 0;
+
+	(void)ctx;
+	for( i = 0; i < iterations; ++i ) hits += checkDisabledCommand( (char *)bench_commands[i % BENCH_COMMANDS] );
+	if( hits < 0 ) abort();
+}
+
+//
+// Ban Lookup Equivalence
+//
+
+// The list walk checkBanList did before the lookup index: the first entry in
+// banhead order that applies to the client, stepping over timed out ones.
+static baninfo_t * bench_ban_linear( int client )
+{
+	char        strbuffer[256];
+	baninfo_t * entry;
+	byte        mask;
+	int         snm, i;
+
+	for( entry = banhead; entry; entry = entry->next )
+	{
+		if( entry->type == NOTUSED || ( entry->timeout && entry->timeout < ltime ) ) continue;
+
+		if( entry->type != NICKALL )
+		{
+			if( !NickBanning_Enable ) continue;
+			if( entry->type == NICKEQ && Q_stricmp( proxyinfo[client].name, entry->nick ) ) continue;
+			if( entry->type == NICKLIKE && !stringContains( proxyinfo[client].name, entry->nick ) ) continue;
+			if( entry->type == NICKBLANK && !isBlank( proxyinfo[client].name ) ) continue;
+
+			if( entry->type == NICKRE )
+			{
+				q2a_strcpy( strbuffer, proxyinfo[client].name );
+				q_strupr( strbuffer );
+				if( !entry->r || q2a_regexec( entry->r, strbuffer ) == REG_NOMATCH ) continue;
+			}
+		}
+
+		if( IPBanning_Enable )
+		{
+			for( snm = entry->subnetmask, i = 0; i < 4 && snm; ++i, snm -= 8 )
+			{
+				mask = snm < 8 ? (byte)( 0xFF << ( 8 - snm ) ) : 0xFF;
+				if( ( entry->ip[i] & mask ) != ( proxyinfo[client].ipaddressBinary[i] & mask ) ) break;
+			}
+
+			if( snm > 0 ) continue;
+		}
+		else if( entry->subnetmask )
+			continue;
+
+		return entry;
+	}
+
+	return NULL;
+}
+
+// Compares the two for one client under every IPBanning/NickBanning setting,
+// looking up twice so the second answer comes from the decision cache.
+static int bench_ban_compare( int client, long * cases )
+{
+	qboolean    ipban = IPBanning_Enable, nickban = NickBanning_Enable;
+	baninfo_t * want, *got;
+	int         flags, pass, ok = 1;
+
+	for( flags = 0; flags < 4; ++flags )
+	{
+		IPBanning_Enable   = ( flags & 1 ) ? TRUE : FALSE;
+		NickBanning_Enable = ( flags & 2 ) ? TRUE : FALSE;
+		want               = bench_ban_linear( client );
+
+		for( pass = 0; pass < 2; ++pass )
+		{
+			got = banIndexLookup( client );
+			( *cases )++;
+
+			if( got != want )
+			{
+				fprintf( stderr, "banIndexLookup: \"%s\" %s (ip %d, name %d, pass %d) found ban %ld, the list walk %ld\n", proxyinfo[client].name, proxyinfo[client].ipaddress, flags & 1, flags >> 1, pass,
+				         got ? got->bannum : -1L, want ? want->bannum : -1L );
+				ok = 0;
+			}
+		}
+	}
+
+	IPBanning_Enable   = ipban;
+	NickBanning_Enable = nickban;
+	return ok;
+}
+
+static void bench_ban_probe( const char * name, const byte * ip )
+{
+	char address[16];
+
+	snprintf( address, sizeof( address ), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3] );
+	bench_set_client( 0, name, address );
+}
+
+// The bench clients, then players picked to hit a spread of the loaded bans:
+// the exact name in another case, a name containing the LIKE pattern and an
+// address somewhere inside each range.
+static int bench_check_banindex( void * ctx, long * cases )
+{
+	baninfo_t * entry;
+	char        name[16], saved[16], savedip[16];
+	byte        ip[4];
+	long        count = 0, step, n = 0;
+	int         client, ok = 1, i, bits;
+
+	(void)ctx;
+
+	for( client = 0; client < BENCH_CLIENTS; ++client ) ok &= bench_ban_compare( client, cases );
+
+	for( entry = banhead; entry; entry = entry->next ) count++;
+	step = count / ( count > 10000 ? 32 : 256 ) + 1;
+
+	q2a_strcpy( saved, proxyinfo[0].name );
+	q2a_strcpy( savedip, proxyinfo[0].ipaddress );
+
+	for( entry = banhead; entry; entry = entry->next )
+	{
+		if( n++ % step ) continue;
+
+		q2a_memcpy( ip, proxyinfo[1].ipaddressBinary, sizeof( ip ) );
+		q2a_strcpy( name, bench_names[n & ( BENCH_NAMES - 1 )] );
+
+		if( entry->type == NICKEQ )
+		{
+			snprintf( name, sizeof( name ), "%.*s", (int)sizeof( name ) - 1, entry->nick );
+			for( i = 0; name[i]; ++i ) name[i] = (char)( ( i & 1 ) ? tolower( (unsigned char)name[i] ) : toupper( (unsigned char)name[i] ) );
+		}
+		else if( entry->type == NICKLIKE )
+			snprintf( name, sizeof( name ), "x%.*sy", (int)sizeof( name ) - 3, entry->nick );
+
+		if( entry->subnetmask )
+		{
+			for( i = 0, bits = entry->subnetmask; i < 4; ++i, bits -= 8 )
+				ip[i] = bits >= 8 ? entry->ip[i] : (byte)( ( entry->ip[i] & ( bits > 0 ? 0xFF << ( 8 - bits ) : 0 ) ) | ( 0xA5 & ( bits > 0 ? 0xFF >> bits : 0xFF ) ) );
+		}
+
+		bench_ban_probe( name, ip );
+		ok &= bench_ban_compare( 0, cases );
+	}
+
+	bench_set_client( 0, saved, savedip );
+	return ok;
+}
+
+// Rules that overlap on purpose: includes inside excluded ranges and the other
+// way round, NAME LIKE patterns that contain each other, name and address in
+// one rule, and timed rules that run out between two lookups of the same
+// player so the cached answer has to be thrown away.
+static int bench_check_banprecedence( void * ctx, long * cases )
+{
+	static const char * names[] = { "[OMG]FragKing", "[omg]fragking", "RailMaster", "xRailx", "GhostZ", "Gh0st", "CamperJr", "Camp", "SniperBoy", "Frag", "   " };
+	static const char * ips[]   = { "10.9.1.5", "10.9.1.6", "10.9.2.1", "10.9.3.7", "10.9.250.1", "10.10.0.1", "192.168.0.1" };
+	static const float  later[] = { 0.0f, 90.0f, 900.0f };
+	const char *        banpath = (const char *)ctx;
+	FILE *              fp      = fopen( banpath, "w" );
+	float               start   = ltime;
+	unsigned int        n, i, t;
+	long                soon = (long)time( NULL ) + 60, late = (long)time( NULL ) + 600;
+	int                 ok   = 1;
+
+	if( fp == NULL ) return 0;
+
+	fprintf( fp, "BAN: IP 10.9.0.0/16 MSG \"range\"\n"
+	             "BAN: + IP 10.9.1.0/24\n"
+	             "BAN: NAME LIKE \"Rail\"\n"
+	             "BAN: + NAME LIKE \"RailMaster\" PASSWORD \"pw\"\n"
+	             "BAN: NAME \"[omg]fragking\"\n"
+	             "BAN: + NAME \"[OMG]FragKing\" IP 10.9.1.5\n"
+	             "BAN: NAME RE \"^GH[O0]ST\"\n"
+	             "BAN: NAME BLANK\n"
+	             "BAN: + ALL IP 10.9.2.0/24 MAX 2\n"
+	             "BAN: NAME LIKE \"Sniper\" IP 10.9.0.0/16\n"
+	             "BAN: NAME LIKE \"Camp\" EXPIRES %ld\n"
+	             "BAN: + NAME LIKE \"Camper\" EXPIRES %ld\n"
+	             "BAN: IP 10.9.3.0/24 EXPIRES %ld\n"
+	             "BAN: + IP 10.9.3.7 EXPIRES %ld\n"
+	             "BAN: NAME \"Frag\" IP 10.10.0.0/16 EXPIRES %ld\n",
+	         late, soon, late, soon, soon );
+	fclose( fp );
+
+	readBanLists();
+
+	for( t = 0; t < sizeof( later ) / sizeof( later[0] ); ++t )
+	{
+		ltime = start + later[t];
+
+		for( n = 0; n < sizeof( names ) / sizeof( names[0] ); ++n )
+		{
+			for( i = 0; i < sizeof( ips ) / sizeof( ips[0] ); ++i )
+			{
+				bench_set_client( (int)( n & 15 ), names[n], ips[i] );
+				ok &= bench_ban_compare( (int)( n & 15 ), cases );
+			}
+		}
+	}
+
+	ltime = start;
+
+	for( i = 0; i < BENCH_CLIENTS; ++i )
+	{
+		char ip[16];
+
+		snprintf( ip, sizeof( ip ), "10.0.%u.%u", i, 100 + i );
+		bench_set_client( (int)i, bench_names[i * 3], ip );
+	}
+
+	return ok;
+}
+
+// A map change with clients counted against MAX rules, one of them a rule that
+// was deleted while they were in. The lists are freed, gi.FreeTags drops the
+// level's memory as the mod's SpawnEntities does, and the lists are read back
+// in; the clients must be counted against the same rules again and leaving
+// must not touch anything the level took with it.
+static int bench_check_banmapchange( void * ctx, long * cases )
+{
+	const char * banpath = (const char *)ctx;
+	FILE *       fp      = fopen( banpath, "w" );
+	int          freed   = bench_freed_twice;
+	int          client, ok = 1;
+	baninfo_t *  held[3];
+
+	if( fp == NULL ) return 0;
+
+	// client 2 is the newer name rule, the others the address range
+	fprintf( fp, "BAN: + IP 10.0.0.0/16 MAX 3\nBAN: + NAME \"%s\" MAX 1\n", proxyinfo[2].name );
+	fclose( fp );
+
+	readBanLists();
+
+	for( client = 0; client < 3; ++client ) ok &= !checkCheckIfBanned( &bench_edicts[client + 1], client ) && proxyinfo[client].baninfo;
+	( *cases )++;
+	if( !ok ) fprintf( stderr, "map change: MAX rules did not let the clients in\n" );
+
+	if( ok ) removeBan( proxyinfo[2].baninfo );
+
+	freeBanLists();
+	gi.FreeTags( TAG_LEVEL );
+	readBanLists();
+
+	for( client = 0; ok && client < 3; ++client ) held[client] = proxyinfo[client].baninfo;
+
+	( *cases )++;
+	if( ok && ( !held[0] || held[0] != held[1] || held[0]->maxnumberofconnects != 3 || held[0]->numberofconnects != 2 || !held[2] || held[2]->maxnumberofconnects != 1 ||
+	            held[2]->numberofconnects != 1 ) )
+	{
+		fprintf( stderr, "map change: clients were not counted against their MAX rules again\n" );
+		ok = 0;
+	}
+
+	for( client = 0; client < 3; ++client ) releaseBanInfo( client );
+
+	( *cases )++;
+	if( ok && ( held[0]->numberofconnects || held[2]->numberofconnects ) )
+	{
+		fprintf( stderr, "map change: leaving did not give the MAX places back\n" );
+		ok = 0;
+	}
+
+	// a reload without a map change keeps the memory, the holds move the same way
+	for( client = 0; client < 3; ++client ) checkCheckIfBanned( &bench_edicts[client + 1], client );
+	readBanLists();
+	for( client = 0; client < 3; ++client ) releaseBanInfo( client );
+
+	( *cases )++;
+	if( bench_freed_twice != freed )
+	{
+		fprintf( stderr, "map change: %d bans freed again after the level was released\n", bench_freed_twice - freed );
+		ok = 0;
+	}
+
+	return ok;
+}
+
+// 40% NAME, 25% NAME LIKE, 5% NAME RE and 30% IP/CIDR, roughly the mix of a
+// long lived public server ban file.
+static int bench_write_bans( const char * path, int count )
+{
+	FILE * fp = fopen( path, "w" );
+	int    i, slot;
+
+	if( fp == NULL ) return 0;
+
+	for( i = 0; i < count; ++i )
+	{
+		slot = i % 20;
+
+		if( slot < 8 ) fprintf( fp, "BAN: NAME \"Cheater%05d\" MSG \"banned for cheating\"\n", i );
+		else if( slot < 13 )
+			fprintf( fp, "BAN: NAME LIKE \"wallhax%d\"\n", i );
+		else if( slot < 14 )
+			fprintf( fp, "BAN: NAME RE \"^AIMB[O0]T%d[0-9]*$\"\n", i );
+		else
+			fprintf( fp, "BAN: IP %d.%d.%d.0/%d\n", 100 + ( i >> 16 ) % 100, ( i >> 8 ) & 255, i & 255, ( slot & 1 ) ? 24 : 16 );
+	}
+
+	fclose( fp );
+	return 1;
+}
+
+// IP/CIDR only, like a list imported from a shared ban feed. Some ranges sit
+// next to the clients' 10.0.0.0/16 so lookups go a few levels down the trie.
+static int bench_write_ipbans( const char * path, int count )
+{
+	FILE * fp = fopen( path, "w" );
+	int    i;
+
+	if( fp == NULL ) return 0;
+
+	for( i = 0; i < count; ++i )
+	{
+		if( i % 10 == 0 ) fprintf( fp, "BAN: IP 10.%d.%d.0/24\n", 1 + ( i >> 8 ) % 255, i & 255 );
+		else
+			fprintf( fp, "BAN: IP %d.%d.%d.%d/%d\n", 100 + ( i >> 16 ) % 100, ( i >> 8 ) & 255, i & 255, ( i * 7 ) & 255, 24 + i % 9 );
+	}
+
+	fclose( fp );
+	return 1;
+}
+
+// Reserved clan names, each only allowed in with its password.
+static int bench_write_namebans( const char * path, int count )
+{
+	FILE * fp = fopen( path, "w" );
+	int    i;
+
+	if( fp == NULL ) return 0;
+
+	for( i = 0; i < count; ++i ) fprintf( fp, "BAN: + NAME \"[clan%d]player%d\" PASSWORD \"pw%d\"\n", i / 20, i % 20, i );
+
+	fclose( fp );
+	return 1;
+}
+
+// 80% LIKE and 20% RE.
+static int bench_write_chatbans( const char * path, int count )
+{
+	FILE * fp = fopen( path, "w" );
+	int    i;
+
+	if( fp == NULL ) return 0;
+
+	for( i = 0; i < count; ++i )
+	{
+		if( i % 5 < 4 ) fprintf( fp, "CHATBAN: LIKE \"spamword%d\"\n", i );
+		else
+			fprintf( fp, "CHATBAN: RE \"fr[e3][e3] *sk[i1]ns%d\" MSG \"no advertising\"\n", i );
+	}
+
+	fclose( fp );
+	return 1;
+}
+
+// A swear word filter, LIKE only.
+static int bench_write_chatwords( const char * path, int count )
+{
+	FILE * fp = fopen( path, "w" );
+	int    i;
+
+	if( fp == NULL ) return 0;
+
+	for( i = 0; i < count; ++i ) fprintf( fp, "CHATBAN: LIKE \"badword%d\"\n", i );
+
+	fclose( fp );
+	return 1;
+}
+
+static void bench_write_lines( const char * path, const char * text )
+{
+	FILE * fp = fopen( path, "w" );
+
+	if( fp == NULL ) return;
+	fputs( text, fp );
+	fclose( fp );
+}
+
+void bench_match()
+{
+	char               dir[] = "/tmp/q2a-bench-XXXXXX";
+	char               banpath[256], imagepath[256 + 4], floodpath[256], disablepath[256];
+	char               banfile[] = BANLISTFILE;
+	char               name[64];
+	bench_match_ctx_t  key_first = { "rate" }, key_last = { "ip" }, key_missing = { "pw" };
+	static const int   bansizes[] = { 10, 1000, 100000 };
+	static const char * bannames[] = { "10", "1k", "100k" };
+	static const int   chatsizes[] = { 100, 1000 };
+	static const char * chatnames[] = { "100", "1k" };
+	unsigned int       i;
+
+	bench_make_names();
+
+	bench_run( "match", "startContains", bench_match_startcontains, NULL );
+	bench_run( "match", "stringContains", bench_match_stringcontains, NULL );
+	bench_run( "match", "Q_stricmp", bench_match_stricmp, NULL );
+	bench_run( "match", "q_strupr", bench_match_strupr, NULL );
+	bench_run( "match", "Info_ValueForKey_first", bench_match_infovalue, &key_first );
+	bench_run( "match", "Info_ValueForKey_last", bench_match_infovalue, &key_last );
+	bench_run( "match", "Info_ValueForKey_missing", bench_match_infovalue, &key_missing );
+	bench_run( "match", "COM_Parse", bench_match_comparse, NULL );
+	bench_run( "match", "processstring", bench_match_processstring, NULL );
+
+	if( mkdtemp( dir ) == NULL ) return;
+
+	gi.cvar_set( "basepath", dir );
+	gi.cvar_set( "savepath", dir );
+	snprintf( banpath, sizeof( banpath ), "%s/" BANLISTFILE, dir );
+	snprintf( floodpath, sizeof( floodpath ), "%s/q2adminflood.txt", dir );
+	snprintf( disablepath, sizeof( disablepath ), "%s/q2admindisable.txt", dir );
+
+	for( i = 0; i < BENCH_CLIENTS; ++i )
+	{
+		char ip[16];
+
+		snprintf( ip, sizeof( ip ), "10.0.%u.%u", i, 100 + i );
+		bench_set_client( (int)i, bench_names[i * 3], ip );
+	}
+
+	IPBanning_Enable   = TRUE;
+	NickBanning_Enable = TRUE;
+	ChatBanning_Enable = TRUE;
+
+	for( i = 0; i < sizeof( bansizes ) / sizeof( bansizes[0] ); ++i )
+	{
+		if( !bench_write_bans( banpath, bansizes[i] ) ) break;
+		readBanLists();
+		snprintf( name, sizeof( name ), "banIndexLookup_equivalence_%s", bannames[i] );
+		bench_check( "match", name, bench_check_banindex, NULL );
+		snprintf( name, sizeof( name ), "checkBanList_%s", bannames[i] );
+		bench_run( "match", name, bench_match_banlist, NULL );
+		snprintf( name, sizeof( name ), "checkBanList_%s_miss", bannames[i] );
+		bench_run( "match", name, bench_match_banlist_miss, NULL );
+	}
+
+	if( bench_write_ipbans( banpath, 100000 ) )
+	{
+		readBanLists();
+		bench_check( "match", "banIndexLookup_equivalence_ip100k", bench_check_banindex, NULL );
+		bench_run( "match", "checkBanList_ip100k", bench_match_banlist, NULL );
+		bench_run( "match", "checkBanList_ip100k_miss", bench_match_banlist_miss, NULL );
+	}
+
+	if( bench_write_namebans( banpath, 10000 ) )
+	{
+		readBanLists();
+		bench_check( "match", "banIndexLookup_equivalence_names10k", bench_check_banindex, NULL );
+		bench_run( "match", "checkBanList_names10k", bench_match_banlist, NULL );
+	}
+
+	bench_check( "match", "banIndexLookup_equivalence_precedence", bench_check_banprecedence, banpath );
+	bench_check( "match", "banMaxMapChange", bench_check_banmapchange, banpath );
+
+	// startup cost of a big ban file, parsed and then from a compiled image
+	if( bench_write_bans( banpath, 60000 ) )
+	{
+		bench_run( "match", "readBanLists_text60k", bench_match_readbans, NULL );
+
+		snprintf( imagepath, sizeof( imagepath ), "%s.bin", banpath );
+		freeBanLists();
+		banImageRecordSources();
+		if( ReadBanFile( banfile ) && banImageWrite( imagepath ) ) bench_run( "match", "readBanLists_image60k", bench_match_readbans, NULL );
+
+		unlink( imagepath );
+	}
+
+	for( i = 0; i < sizeof( chatsizes ) / sizeof( chatsizes[0] ); ++i )
+	{
+		if( !bench_write_chatbans( banpath, chatsizes[i] ) ) break;
+		readBanLists();
+		snprintf( name, sizeof( name ), "checkCheckIfChatBanned_%s", chatnames[i] );
+		bench_run( "match", name, bench_match_chatban, NULL );
+	}
+
+	if( bench_write_chatwords( banpath, 500 ) )
+	{
+		readBanLists();
+		bench_run( "match", "checkCheckIfChatBanned_words500", bench_match_chatban, NULL );
+	}
+
+	freeBanLists();
+
+	// shaped like the shipped examples, but full
+	bench_write_lines( floodpath, "SW:play_\nEX:wfplay\nRE:^voice.*\nSW:wave\nEX:flashlight\nSW:taunt\nRE:^radio_.*\nEX:sound\nSW:boot\nEX:id\n"
+	                              "SW:laser\nSW:menu_\nRE:^cmd_[a-z]*$\nEX:hook\nEX:unhook\nSW:gesture\nEX:speech\nSW:shout\nRE:^emote[0-9]*\nEX:team\n" );
+	bench_write_lines( disablepath, "EX:god\nEX:noclip\nEX:notarget\nSW:give\nEX:setskin\nSW:cheat\nRE:^spawn_.*\nEX:fov_force\nSW:changeteam_\nEX:kickme\n"
+	                                "SW:debug_\nEX:where\nRE:^edict[0-9]*\nEX:botmenu\nSW:sv_\nEX:wfplay\nSW:admin_\nEX:flagtrack\nRE:^map_.*$\nEX:observe\n" );
+	readFloodLists();
+	readDisableLists();
+
+	bench_run( "match", "checkforfloodcmds", bench_match_floodcmds, NULL );
+	bench_run( "match", "checkDisabledCommand", bench_match_disabled, NULL );
+
+	freeFloodLists();
+	freeDisableLists();
+	unlink( banpath );
+	unlink( floodpath );
+	unlink( disablepath );
+	rmdir( dir );
+}
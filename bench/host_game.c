@@ -0,0 +1,195 @@
+/*-------------------------------
+# SPDX-License-Identifier: ISC
+#
+# Copyright © 2022 Daniel Wolf <<nephatrine@gmail.com>>
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+# REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+# AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+# INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+# LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+# OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+# -----------------------------*/
+
+// A stand-in for the "real" game module q2admin proxies. It does about as
+// little as a mod can while still behaving like one (client slots, a chat
+// command, a bit of movement per usercmd), so q2admin-host measures the proxy
+// rather than the game behind it.
+
+#include "host_game.h"
+
+#if defined( _WIN32 )
+#	define HOSTGAME_EXPORT __declspec( dllexport )
+#else
+#	define HOSTGAME_EXPORT __attribute__( ( visibility( "default" ) ) )
+#endif
+
+#define HOSTGAME_ENTITIES 64 // non-client entities spawned by SpawnEntities
+
+// the values the real game uses, the engine frees them by tag
+#define TAG_GAME 765
+#define TAG_LEVEL 766
+
+static game_import_t gi;
+static game_export_t ge;
+
+static hg_edict_t * hg_edicts;
+static gclient_t *  hg_clients;
+static int          hg_maxclients;
+static long         hg_framenum;
+
+static const char * hg_classnames[] = { "info_player_deathmatch", "weapon_railgun", "item_armor_body", "misc_teleporter", "func_door" };
+
+static edict_t * hg_edict( int n ) { return &hg_edicts[n].e; }
+static int       hg_number( edict_t * ent ) { return (int)( (hg_edict_t *)ent - hg_edicts ); }
+
+static void hg_Init()
+{
+	hg_maxclients = (int)gi.cvar( "maxclients", "16", 0 )->value;
+	if( hg_maxclients < 1 ) hg_maxclients = 1;
+	if( hg_maxclients > MAX_CLIENTS ) hg_maxclients = MAX_CLIENTS;
+
+	ge.max_edicts = hg_maxclients + 1 + HOSTGAME_ENTITIES;
+	hg_edicts     = gi.TagMalloc( ge.max_edicts * (int)sizeof( hg_edict_t ), TAG_GAME );
+	hg_clients    = gi.TagMalloc( hg_maxclients * (int)sizeof( gclient_t ), TAG_GAME );
+
+	ge.edicts     = &hg_edicts[0].e;
+	ge.edict_size = sizeof( hg_edict_t );
+	ge.num_edicts = hg_maxclients + 1;
+}
+
+static void hg_Shutdown() { gi.FreeTags( TAG_GAME ); }
+
+static void hg_SpawnEntities( char * mapname, char * entstring, char * spawnpoint )
+{
+	int i;
+
+	(void)mapname, (void)entstring, (void)spawnpoint;
+
+	gi.FreeTags( TAG_LEVEL );
+	hg_framenum = 0;
+
+	for( i = 0; i < ge.max_edicts; ++i )
+	{
+		edict_t * ent = hg_edict( i );
+
+		if( i == 0 ) hg_edicts[i].classname = "worldspawn";
+		if( i > 0 && i <= hg_maxclients )
+		{
+			ent->client            = &hg_clients[i - 1];
+			hg_edicts[i].classname = "player";
+		}
+		if( i > hg_maxclients )
+		{
+			hg_edicts[i].classname = (char *)hg_classnames[i % ( sizeof( hg_classnames ) / sizeof( hg_classnames[0] ) )];
+			ent->inuse             = true;
+			ent->s.origin[0] = (float)i;
+			gi.linkentity( ent );
+		}
+	}
+
+	ge.num_edicts = ge.max_edicts;
+}
+
+static void hg_WriteGame( char * filename, qboolean autosave ) { (void)filename, (void)autosave; }
+static void hg_ReadGame( char * filename ) { (void)filename; }
+static void hg_WriteLevel( char * filename ) { (void)filename; }
+static void hg_ReadLevel( char * filename ) { (void)filename; }
+
+static qboolean hg_ClientConnect( edict_t * ent, char * userinfo )
+{
+	(void)userinfo;
+
+	ent->client = &hg_clients[hg_number( ent ) - 1];
+	memset( ent->client, 0, sizeof( gclient_t ) );
+	return true;
+}
+
+static void hg_ClientBegin( edict_t * ent )
+{
+	ent->inuse = true;
+	gi.linkentity( ent );
+}
+
+static void hg_ClientUserinfoChanged( edict_t * ent, char * userinfo ) { (void)ent, (void)userinfo; }
+
+static void hg_ClientDisconnect( edict_t * ent )
+{
+	gi.unlinkentity( ent );
+	ent->inuse = false;
+}
+
+static void hg_ClientCommand( edict_t * ent )
+{
+	char * cmd = gi.argv( 0 );
+
+	if( strcmp( cmd, "say" ) == 0 || strcmp( cmd, "say_team" ) == 0 )
+		gi.bprintf( PRINT_CHAT, "player%d: %s\n", hg_number( ent ), gi.args() );
+	else
+		gi.cprintf( ent, PRINT_HIGH, "Unknown command \"%s\"\n", cmd );
+}
+
+static void hg_ClientThink( edict_t * ent, usercmd_t * cmd )
+{
+	pmove_state_t * pm = &ent->client->ps.pmove;
+	int             i;
+
+	// integrate the move the way pmove would, only without the world
+	pm->pm_type = PM_NORMAL;
+	pm->velocity[0] += (short)( cmd->forwardmove * cmd->msec / 1000 );
+	pm->velocity[1] += (short)( cmd->sidemove * cmd->msec / 1000 );
+	for( i = 0; i < 3; ++i )
+	{
+		pm->origin[i] += (short)( pm->velocity[i] * cmd->msec / 1000 );
+		ent->client->ps.viewangles[i] = SHORT2ANGLE( cmd->angles[i] );
+	}
+
+	ent->s.origin[0] = pm->origin[0] * 0.125f;
+	ent->s.origin[1] = pm->origin[1] * 0.125f;
+	ent->s.origin[2] = pm->origin[2] * 0.125f;
+}
+
+static void hg_RunFrame()
+{
+	int i;
+
+	hg_framenum++;
+
+	for( i = hg_maxclients + 1; i < ge.num_edicts; ++i )
+	{
+		edict_t * ent = hg_edict( i );
+
+		if( ent->inuse ) ent->s.angles[YAW] = (float)( ( hg_framenum + i ) % 360 );
+	}
+}
+
+static void hg_ServerCommand() { gi.cprintf( NULL, PRINT_HIGH, "Unknown server command \"%s\"\n", gi.argv( 1 ) ); }
+
+HOSTGAME_EXPORT game_export_t * GetGameAPI( game_import_t * import )
+{
+	gi = *import;
+
+	ge.apiversion            = GAME_API_VERSION;
+	ge.Init                  = hg_Init;
+	ge.Shutdown              = hg_Shutdown;
+	ge.SpawnEntities         = hg_SpawnEntities;
+	ge.WriteGame             = hg_WriteGame;
+	ge.ReadGame              = hg_ReadGame;
+	ge.WriteLevel            = hg_WriteLevel;
+	ge.ReadLevel             = hg_ReadLevel;
+	ge.ClientConnect         = hg_ClientConnect;
+	ge.ClientBegin           = hg_ClientBegin;
+	ge.ClientUserinfoChanged = hg_ClientUserinfoChanged;
+	ge.ClientDisconnect      = hg_ClientDisconnect;
+	ge.ClientCommand         = hg_ClientCommand;
+	ge.ClientThink           = hg_ClientThink;
+	ge.RunFrame              = hg_RunFrame;
+	ge.ServerCommand         = hg_ServerCommand;
+
+	return &ge;
+}
@@ -0,0 +1,39 @@
+/*-------------------------------
+# SPDX-License-Identifier: ISC
+#
+# Copyright © 2022 Daniel Wolf <<nephatrine@gmail.com>>
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+# REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+# AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+# INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+# LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+# OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+# -----------------------------*/
+
+#ifndef Q2A_HOST_GAME_H
+#define Q2A_HOST_GAME_H 1
+
+#include "q_shared.h"
+#include "game.h"
+
+// The stand-in game's entities. The fields after the engine's part are in the
+// same order as the real game's, so q2admin finds classname the same way
+// (q2admin-host sets entity_classname_offset from this layout).
+typedef struct
+{
+	edict_t e;
+	int     movetype;
+	int     flags;
+	char *  model;
+	float   freetime;
+	char *  message;
+	char *  classname;
+} hg_edict_t;
+
+#endif
@@ -0,0 +1,858 @@
+/*-------------------------------
+# SPDX-License-Identifier: ISC
+#
+# Copyright © 2022 Daniel Wolf <<nephatrine@gmail.com>>
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+# REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+# AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+# INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+# LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+# OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+# -----------------------------*/
+
+// q2admin-host loads the built proxy module the way a Quake II server does,
+// with bench/host_game.c as the "real" game behind it, and plays a scripted
+// server: clients connect, send usercmds, chat, change names and run admin
+// commands. Frames are run back to back on simulated time, so runs are
+// repeatable and only the CPU matters. Every hook call is timed and one JSON
+// object per hook is printed on stdout.
+//
+// With --replay it plays a recording made by the module's record command
+// instead, as fast as it can or (--paced) at the pace it was recorded.
+
+#define _GNU_SOURCE
+
+#include "host_game.h"
+#include "zb_recordformat.h"
+
+#include <dlfcn.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef Q2HOST_MODULE
+#	define Q2HOST_MODULE "./game.so"
+#endif
+#ifndef Q2HOST_GAMEDIR
+#	define Q2HOST_GAMEDIR "./hostgame"
+#endif
+
+#define HOST_FRAMETIME 0.1 // the server runs at 10 Hz whatever the clients do
+#define HOST_PASSWORD "host"
+
+//
+// Hook Timing
+//
+
+enum host_hook_e
+{
+	HOST_CLIENTCONNECT,
+	HOST_CLIENTBEGIN,
+	HOST_CLIENTUSERINFOCHANGED,
+	HOST_CLIENTCOMMAND,
+	HOST_CLIENTTHINK,
+	HOST_RUNFRAME,
+	HOST_SERVERCOMMAND,
+	HOST_CLIENTDISCONNECT,
+	HOST_HOOKS
+};
+
+static const char * host_hook_names[HOST_HOOKS] = {
+      "ClientConnect", "ClientBegin", "ClientUserinfoChanged", "ClientCommand", "ClientThink", "G_RunFrame", "ServerCommand", "ClientDisconnect",
+};
+
+typedef struct
+{
+	uint32_t * samples; // nanoseconds
+	size_t     count;
+	size_t     size;
+	uint64_t   total;
+} host_timing_t;
+
+static host_timing_t host_timings[HOST_HOOKS];
+
+static uint64_t host_now()
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void host_record( int hook, uint64_t start )
+{
+	host_timing_t * t  = &host_timings[hook];
+	uint64_t        ns = host_now() - start;
+
+	if( t->count == t->size )
+	{
+		t->size    = t->size ? t->size * 2 : 4096;
+		t->samples = realloc( t->samples, t->size * sizeof( uint32_t ) );
+		if( !t->samples ) abort();
+	}
+
+	t->samples[t->count++] = ns > UINT32_MAX ? UINT32_MAX : (uint32_t)ns;
+	t->total += ns;
+}
+
+#define HOST_CALL( hook, call )            \
+	do                                     \
+	{                                      \
+		uint64_t host_start_ = host_now(); \
+		call;                              \
+		host_record( hook, host_start_ );  \
+	} while( 0 )
+
+static int host_compare( const void * a, const void * b )
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static uint32_t host_percentile( host_timing_t * t, double p )
+{
+	size_t i = (size_t)( p * (double)( t->count - 1 ) + 0.5 );
+
+	return t->samples[i];
+}
+
+//
+// Engine Side
+//
+
+static game_export_t * ge;
+
+static int host_verbose = 0;
+
+#define HOST_CVARS 256
+
+static cvar_t host_cvars[HOST_CVARS];
+static int    host_num_cvars = 0;
+
+static cvar_t * host_cvar( char * name, char * value, int flags )
+{
+	cvar_t * cvar;
+	int      i;
+
+	for( i = 0; i < host_num_cvars; ++i )
+		if( strcmp( host_cvars[i].name, name ) == 0 ) return &host_cvars[i];
+
+	if( host_num_cvars >= HOST_CVARS ) abort();
+
+	cvar         = &host_cvars[host_num_cvars++];
+	cvar->name   = strdup( name );
+	cvar->string = strdup( value );
+	cvar->flags  = flags;
+	cvar->value  = (float)atof( value );
+	return cvar;
+}
+
+static cvar_t * host_cvar_set( char * name, char * value )
+{
+	cvar_t * cvar = host_cvar( name, value, 0 );
+
+	free( cvar->string );
+	cvar->string = strdup( value );
+	cvar->value  = (float)atof( value );
+	return cvar;
+}
+
+static void host_vprint( const char * fmt, va_list args )
+{
+	if( host_verbose ) vfprintf( stderr, fmt, args );
+}
+
+static void host_dprintf( char * fmt, ... )
+{
+	va_list args;
+
+	va_start( args, fmt );
+	host_vprint( fmt, args );
+	va_end( args );
+}
+
+static void host_bprintf( int level, char * fmt, ... )
+{
+	va_list args;
+
+	(void)level;
+	va_start( args, fmt );
+	host_vprint( fmt, args );
+	va_end( args );
+}
+
+static void host_cprintf( edict_t * ent, int level, char * fmt, ... )
+{
+	va_list args;
+
+	(void)ent, (void)level;
+	va_start( args, fmt );
+	host_vprint( fmt, args );
+	va_end( args );
+}
+
+static void host_centerprintf( edict_t * ent, char * fmt, ... ) { (void)ent, (void)fmt; }
+
+static void host_error( char * fmt, ... )
+{
+	va_list args;
+
+	va_start( args, fmt );
+	vfprintf( stderr, fmt, args );
+	va_end( args );
+	fputc( '\n', stderr );
+	exit( 1 );
+}
+
+// TagMalloc blocks carry their tag in front so FreeTags can find them
+typedef struct host_block_s
+{
+	struct host_block_s * prev;
+	struct host_block_s * next;
+	int                   tag;
+	int                   pad;
+} host_block_t;
+
+static host_block_t host_blocks = { &host_blocks, &host_blocks, 0, 0 };
+
+static void * host_malloc( int size, int tag )
+{
+	host_block_t * b = calloc( 1, sizeof( host_block_t ) + (size_t)size );
+
+	if( !b ) host_error( "TagMalloc: out of memory" );
+
+	b->tag                 = tag;
+	b->next                = host_blocks.next;
+	b->prev                = &host_blocks;
+	host_blocks.next->prev = b;
+	host_blocks.next       = b;
+	return b + 1;
+}
+
+static void host_free( void * block )
+{
+	host_block_t * b = (host_block_t *)block - 1;
+
+	b->prev->next = b->next;
+	b->next->prev = b->prev;
+	free( b );
+}
+
+static void host_free_tags( int tag )
+{
+	host_block_t *b, *next;
+
+	for( b = host_blocks.next; b != &host_blocks; b = next )
+	{
+		next = b->next;
+		if( b->tag == tag ) host_free( b + 1 );
+	}
+}
+
+static unsigned long host_commands = 0; // AddCommandString calls from the module
+
+static void host_command( char * text )
+{
+	host_commands++;
+	if( host_verbose ) fprintf( stderr, "] %s", text );
+}
+
+#define HOST_ARGS 32
+
+static char   host_argbuf[1024];
+static char   host_argsline[1024];
+static char * host_argv[HOST_ARGS];
+static int    host_argc = 0;
+
+static int    host_get_argc() { return host_argc; }
+static char * host_get_argv( int n ) { return ( n >= 0 && n < host_argc ) ? host_argv[n] : ""; }
+static char * host_get_args() { return host_argsline; }
+
+// a recorded command, tokenised by the server that recorded it
+static void host_set_argv( int argc, char ** argv, const char * args )
+{
+	int i;
+
+	host_argc = argc < HOST_ARGS ? argc : HOST_ARGS;
+	for( i = 0; i < host_argc; ++i ) host_argv[i] = argv[i];
+	snprintf( host_argsline, sizeof( host_argsline ), "%s", args );
+}
+
+static void host_set_args( const char * line )
+{
+	const char * cp;
+	char *       token;
+
+	snprintf( host_argbuf, sizeof( host_argbuf ), "%s", line );
+	host_argc        = 0;
+	host_argsline[0] = 0;
+
+	for( token = strtok( host_argbuf, " " ); token && host_argc < HOST_ARGS; token = strtok( NULL, " " ) ) host_argv[host_argc++] = token;
+
+	if( ( cp = strchr( line, ' ' ) ) != NULL ) snprintf( host_argsline, sizeof( host_argsline ), "%s", cp + 1 );
+}
+
+static void     host_sound( edict_t * ent, int channel, int soundindex, float volume, float attenuation, float timeofs ) { (void)ent, (void)channel, (void)soundindex, (void)volume, (void)attenuation, (void)timeofs; }
+static void     host_positioned_sound( vec3_t origin, edict_t * ent, int channel, int soundindex, float volume, float attenuation, float timeofs ) { (void)origin, (void)ent, (void)channel, (void)soundindex, (void)volume, (void)attenuation, (void)timeofs; }
+static void     host_configstring( int num, char * string ) { (void)num, (void)string; }
+static int      host_index( char * name ) { return name ? 1 : 0; }
+static void     host_setmodel( edict_t * ent, char * name ) { (void)ent, (void)name; }
+static int      host_pointcontents( vec3_t point ) { return (void)point, 0; }
+static qboolean host_inpvs( vec3_t p1, vec3_t p2 ) { return (void)p1, (void)p2, true; }
+static void     host_areaportal( int portalnum, qboolean open ) { (void)portalnum, (void)open; }
+static qboolean host_areas_connected( int area1, int area2 ) { return (void)area1, (void)area2, true; }
+static void     host_link( edict_t * ent ) { (void)ent; }
+static int      host_box_edicts( vec3_t mins, vec3_t maxs, edict_t ** list, int maxcount, int areatype ) { return (void)mins, (void)maxs, (void)list, (void)maxcount, (void)areatype, 0; }
+static void     host_pmove( pmove_t * pm ) { (void)pm; }
+static void     host_multicast( vec3_t origin, multicast_t to ) { (void)origin, (void)to; }
+static void     host_unicast( edict_t * ent, qboolean reliable ) { (void)ent, (void)reliable; }
+static void     host_write_int( int c ) { (void)c; }
+static void     host_write_float( float f ) { (void)f; }
+static void     host_write_string( char * s ) { (void)s; }
+static void     host_write_vec( vec3_t v ) { (void)v; }
+static void     host_debuggraph( float value, int color ) { (void)value, (void)color; }
+
+static trace_t host_trace( vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, edict_t * passent, int contentmask )
+{
+	trace_t tr;
+
+	(void)start, (void)mins, (void)maxs, (void)passent, (void)contentmask;
+	memset( &tr, 0, sizeof( tr ) );
+	tr.fraction = 1.0f;
+	VectorCopy( end, tr.endpos );
+	return tr;
+}
+
+static void host_setup_import( game_import_t * gi )
+{
+	memset( gi, 0, sizeof( *gi ) );
+	gi->bprintf            = host_bprintf;
+	gi->dprintf            = host_dprintf;
+	gi->cprintf            = host_cprintf;
+	gi->centerprintf       = host_centerprintf;
+	gi->sound              = host_sound;
+	gi->positioned_sound   = host_positioned_sound;
+	gi->configstring       = host_configstring;
+	gi->error              = host_error;
+	gi->modelindex         = host_index;
+	gi->soundindex         = host_index;
+	gi->imageindex         = host_index;
+	gi->setmodel           = host_setmodel;
+	gi->trace              = host_trace;
+	gi->pointcontents      = host_pointcontents;
+	gi->inPVS              = host_inpvs;
+	gi->inPHS              = host_inpvs;
+	gi->SetAreaPortalState = host_areaportal;
+	gi->AreasConnected     = host_areas_connected;
+	gi->linkentity         = host_link;
+	gi->unlinkentity       = host_link;
+	gi->BoxEdicts          = host_box_edicts;
+	gi->Pmove              = host_pmove;
+	gi->multicast          = host_multicast;
+	gi->unicast            = host_unicast;
+	gi->WriteChar          = host_write_int;
+	gi->WriteByte          = host_write_int;
+	gi->WriteShort         = host_write_int;
+	gi->WriteLong          = host_write_int;
+	gi->WriteFloat         = host_write_float;
+	gi->WriteString        = host_write_string;
+	gi->WritePosition      = host_write_vec;
+	gi->WriteDir           = host_write_vec;
+	gi->WriteAngle         = host_write_float;
+	gi->TagMalloc          = host_malloc;
+	gi->TagFree            = host_free;
+	gi->FreeTags           = host_free_tags;
+	gi->cvar               = host_cvar;
+	gi->cvar_set           = host_cvar_set;
+	gi->cvar_forceset      = host_cvar_set;
+	gi->argc               = host_get_argc;
+	gi->argv               = host_get_argv;
+	gi->args               = host_get_args;
+	gi->AddCommandString   = host_command;
+	gi->DebugGraph         = host_debuggraph;
+}
+
+//
+// Workload
+//
+
+static int          host_clients = 256;
+static int          host_seconds = 60;
+static int          host_hz      = 60;
+static const char * host_config  = NULL;
+static const char * host_module  = Q2HOST_MODULE;
+static const char * host_gamedir = Q2HOST_GAMEDIR;
+
+static const char * host_chat[]  = { "gg", "nice shot", "anyone want to 1v1 after this map?", "lag", "that rail was totally luck and you know it" };
+static const char * host_admin[] = { "!stats", "!perf", "!logtail 5", "!listbans" };
+
+static edict_t * host_edict( int n ) { return (edict_t *)( (char *)ge->edicts + ge->edict_size * n ); }
+
+static void host_userinfo( char * userinfo, size_t size, int client, int generation )
+{
+	char name[32];
+
+	if( generation )
+		snprintf( name, sizeof( name ), "Player%d_%d", client, generation );
+	else
+		snprintf( name, sizeof( name ), "Player%d", client );
+
+	snprintf( userinfo, size, "\\name\\%s\\skin\\male/grunt\\rate\\25000\\msg\\1\\fov\\90\\hand\\0\\ip\\10.%d.%d.%d:27901", name, ( client >> 8 ) & 255, client & 255, 1 + client % 250 );
+}
+
+static void host_client_command( int client, const char * line )
+{
+	host_set_args( line );
+	HOST_CALL( HOST_CLIENTCOMMAND, ge->ClientCommand( host_edict( client + 1 ) ) );
+}
+
+static void host_connect( int client )
+{
+	char userinfo[MAX_INFO_STRING];
+
+	host_userinfo( userinfo, sizeof( userinfo ), client, 0 );
+
+	{
+		qboolean allowed = false;
+
+		HOST_CALL( HOST_CLIENTCONNECT, allowed = ge->ClientConnect( host_edict( client + 1 ), userinfo ) );
+		if( !allowed ) fprintf( stderr, "client %d was refused\n", client );
+	}
+
+	HOST_CALL( HOST_CLIENTBEGIN, ge->ClientBegin( host_edict( client + 1 ) ) );
+}
+
+static void host_frame( long frame, double * cmdtime )
+{
+	char      line[256];
+	usercmd_t cmd;
+	int       client, n, cmds;
+
+	// usercmds are spread over frames the way 60 Hz clients land on a 10 Hz server
+	*cmdtime += host_hz * HOST_FRAMETIME;
+	cmds = (int)*cmdtime;
+	*cmdtime -= cmds;
+
+	for( client = 0; client < host_clients; ++client )
+	{
+		edict_t * ent = host_edict( client + 1 );
+
+		for( n = 0; n < cmds; ++n )
+		{
+			memset( &cmd, 0, sizeof( cmd ) );
+			cmd.msec        = (byte)( 1000 / host_hz );
+			cmd.buttons     = ( frame + client ) % 7 == 0 ? BUTTON_ATTACK : 0;
+			cmd.angles[YAW] = (short)( ( frame * 91 + client * 1000 + n * 13 ) & 0xFFFF );
+			cmd.forwardmove = 400;
+			cmd.sidemove    = ( frame / 20 + client ) & 1 ? 200 : -200;
+			HOST_CALL( HOST_CLIENTTHINK, ge->ClientThink( ent, &cmd ) );
+		}
+
+		// everyone says something every 5 seconds and changes name every 30
+		if( ( frame + client * 7 ) % 50 == 0 )
+		{
+			snprintf( line, sizeof( line ), "say %s", host_chat[( frame / 50 + client ) % ( sizeof( host_chat ) / sizeof( host_chat[0] ) )] );
+			host_client_command( client, line );
+		}
+
+		if( frame && ( frame + client * 13 ) % 300 == 0 )
+		{
+			char userinfo[MAX_INFO_STRING];
+
+			host_userinfo( userinfo, sizeof( userinfo ), client, (int)( frame / 300 ) + 1 );
+			HOST_CALL( HOST_CLIENTUSERINFOCHANGED, ge->ClientUserinfoChanged( ent, userinfo ) );
+		}
+	}
+
+	// the first client is an admin running a command every 2 seconds, and the
+	// server console runs one every 10
+	if( frame % 20 == 10 ) host_client_command( 0, host_admin[( frame / 20 ) % ( sizeof( host_admin ) / sizeof( host_admin[0] ) )] );
+
+	if( frame % 100 == 50 )
+	{
+		host_set_args( "sv !stats" );
+		HOST_CALL( HOST_SERVERCOMMAND, ge->ServerCommand() );
+	}
+
+	HOST_CALL( HOST_RUNFRAME, ge->RunFrame() );
+}
+
+//
+// Replay
+//
+
+static const char *  host_replay_file    = NULL;
+static int           host_replay_paced   = 0;
+static FILE *        host_replay_fp      = NULL;
+static double        host_replay_time    = 0.0; // seconds of recorded server time
+static unsigned long host_replay_records = 0;
+
+static int host_replay_open()
+{
+	unsigned char header[Q2R_FILE_HEADER_SIZE];
+
+	if( ( host_replay_fp = fopen( host_replay_file, "rb" ) ) == NULL )
+	{
+		fprintf( stderr, "unable to open %s\n", host_replay_file );
+		return 0;
+	}
+
+	if( fread( header, 1, sizeof( header ), host_replay_fp ) != sizeof( header ) || memcmp( header, Q2R_MAGIC, 4 ) != 0 || q2lb_get16( header + 4 ) != Q2R_VERSION )
+	{
+		fprintf( stderr, "%s is not a version %d q2admin recording\n", host_replay_file, Q2R_VERSION );
+		return 0;
+	}
+
+	host_clients = q2lb_get16( header + 6 );
+	if( host_clients < 1 || host_clients > MAX_CLIENTS )
+	{
+		fprintf( stderr, "%s was recorded with maxclients %d\n", host_replay_file, host_clients );
+		return 0;
+	}
+
+	return 1;
+}
+
+// next NUL terminated string in a payload, "" once it runs out
+static char * host_replay_string( char ** cp, char * end )
+{
+	char * s = *cp;
+
+	if( s >= end ) return "";
+
+	*cp = s + strlen( s ) + 1;
+	return s;
+}
+
+static void host_replay_command( int kind, int client, char * cp, char * end )
+{
+	char * argv[HOST_ARGS];
+	int    argc, i;
+
+	if( end - cp < 2 ) return;
+
+	argc = q2lb_get16( (unsigned char *)cp );
+	cp += 2;
+
+	for( i = 0; i < argc; ++i )
+	{
+		char * arg = host_replay_string( &cp, end );
+
+		if( i < HOST_ARGS ) argv[i] = arg;
+	}
+
+	host_set_argv( argc, argv, host_replay_string( &cp, end ) );
+
+	if( kind == Q2R_KIND_SERVERCMD )
+		HOST_CALL( HOST_SERVERCOMMAND, ge->ServerCommand() );
+	else
+		HOST_CALL( HOST_CLIENTCOMMAND, ge->ClientCommand( host_edict( client + 1 ) ) );
+}
+
+static void host_replay_think( int client, const unsigned char * p )
+{
+	usercmd_t cmd;
+
+	cmd.msec        = p[0];
+	cmd.buttons     = p[1];
+	cmd.angles[0]   = (short)q2lb_get16( p + 2 );
+	cmd.angles[1]   = (short)q2lb_get16( p + 4 );
+	cmd.angles[2]   = (short)q2lb_get16( p + 6 );
+	cmd.forwardmove = (short)q2lb_get16( p + 8 );
+	cmd.sidemove    = (short)q2lb_get16( p + 10 );
+	cmd.upmove      = (short)q2lb_get16( p + 12 );
+	cmd.impulse     = p[14];
+	cmd.lightlevel  = p[15];
+	HOST_CALL( HOST_CLIENTTHINK, ge->ClientThink( host_edict( client + 1 ), &cmd ) );
+}
+
+static void host_replay_wait( uint64_t start, uint64_t offset )
+{
+	uint64_t        now = host_now() - start;
+	struct timespec ts;
+
+	if( now >= offset ) return;
+
+	ts.tv_sec  = (time_t)( ( offset - now ) / 1000000000ull );
+	ts.tv_nsec = (long)( ( offset - now ) % 1000000000ull );
+	nanosleep( &ts, NULL );
+}
+
+// returns the number of frames run
+static long host_replay( uint64_t start )
+{
+	unsigned char header[Q2R_HEADER_SIZE];
+	char          userinfo[MAX_INFO_STRING];
+	char *        payload  = NULL;
+	size_t        capacity = 0;
+	long          frames   = 0;
+
+	while( fread( header, 1, sizeof( header ), host_replay_fp ) == sizeof( header ) )
+	{
+		int    kind   = header[0];
+		int    client = (int16_t)q2lb_get16( header + 2 );
+		size_t length = q2lb_get32( header + 8 );
+		char * cp;
+		char * end;
+
+		if( length + 1 > capacity )
+		{
+			capacity = length + 1 > 4096 ? length + 1 : 4096;
+			if( ( payload = realloc( payload, capacity ) ) == NULL ) abort();
+		}
+
+		if( fread( payload, 1, length, host_replay_fp ) != length ) break;
+
+		payload[length] = 0;
+		cp              = payload;
+		end             = payload + length;
+		host_replay_records++;
+
+		// client records for slots this server does not have are skipped
+		if( kind != Q2R_KIND_FRAME && kind != Q2R_KIND_SPAWN && kind != Q2R_KIND_SERVERCMD && ( client < 0 || client >= host_clients ) ) continue;
+
+		switch( kind )
+		{
+		case Q2R_KIND_FRAME:
+			if( length >= 8 )
+			{
+				uint64_t offset = q2lb_get64( (unsigned char *)payload );
+
+				if( host_replay_paced ) host_replay_wait( start, offset );
+				host_replay_time = offset / 1e9;
+			}
+
+			HOST_CALL( HOST_RUNFRAME, ge->RunFrame() );
+			frames++;
+			break;
+
+		case Q2R_KIND_SPAWN:
+		{
+			char * mapname  = host_replay_string( &cp, end );
+			char * entities = host_replay_string( &cp, end );
+
+			ge->SpawnEntities( mapname, entities, host_replay_string( &cp, end ) );
+			break;
+		}
+
+		case Q2R_KIND_CONNECT:
+		{
+			qboolean allowed = false;
+
+			snprintf( userinfo, sizeof( userinfo ), "%s", payload );
+			HOST_CALL( HOST_CLIENTCONNECT, allowed = ge->ClientConnect( host_edict( client + 1 ), userinfo ) );
+			if( !allowed && host_verbose ) fprintf( stderr, "client %d was refused\n", client );
+			break;
+		}
+
+		case Q2R_KIND_USERINFO:
+			snprintf( userinfo, sizeof( userinfo ), "%s", payload );
+			HOST_CALL( HOST_CLIENTUSERINFOCHANGED, ge->ClientUserinfoChanged( host_edict( client + 1 ), userinfo ) );
+			break;
+
+		case Q2R_KIND_BEGIN:
+			HOST_CALL( HOST_CLIENTBEGIN, ge->ClientBegin( host_edict( client + 1 ) ) );
+			break;
+
+		case Q2R_KIND_DISCONNECT:
+			HOST_CALL( HOST_CLIENTDISCONNECT, ge->ClientDisconnect( host_edict( client + 1 ) ) );
+			break;
+
+		case Q2R_KIND_COMMAND:
+		case Q2R_KIND_SERVERCMD:
+			host_replay_command( kind, client, cp, end );
+			break;
+
+		case Q2R_KIND_THINK:
+			if( length >= Q2R_USERCMD_SIZE ) host_replay_think( client, (unsigned char *)payload );
+			break;
+		}
+	}
+
+	free( payload );
+	fclose( host_replay_fp );
+	return frames;
+}
+
+//
+// Setup
+//
+
+static int host_write_config( const char * dir )
+{
+	char   path[MAX_OSPATH];
+	char   buffer[4096];
+	FILE * in  = NULL;
+	FILE * out = NULL;
+	size_t len;
+
+	snprintf( path, sizeof( path ), "%s/q2admin.txt", dir );
+	if( ( out = fopen( path, "w" ) ) == NULL ) return 0;
+
+	if( host_config )
+	{
+		if( ( in = fopen( host_config, "r" ) ) == NULL )
+		{
+			fclose( out );
+			return 0;
+		}
+
+		while( ( len = fread( buffer, 1, sizeof( buffer ), in ) ) > 0 ) fwrite( buffer, 1, len, out );
+		fclose( in );
+		fprintf( out, "\n" );
+	}
+
+	// the scripted clients never answer the proxy checks, so they must not be kicked for it
+	fprintf( out, "adminpassword \"%s\"\ndisconnectuser \"No\"\n", HOST_PASSWORD );
+	fprintf( out, "entity_classname_offset \"%d\"\n", (int)offsetof( hg_edict_t, classname ) );
+	fclose( out );
+	return 1;
+}
+
+static void host_usage( const char * name )
+{
+	fprintf( stderr, "usage: %s [--clients n] [--seconds n] [--hz n] [--config q2admin.txt] [--module file] [--gamedir dir] [--verbose]\n", name );
+	fprintf( stderr, "       %s --replay file [--paced] [--config q2admin.txt] [--module file] [--gamedir dir] [--verbose]\n", name );
+	exit( 1 );
+}
+
+int main( int argc, char ** argv )
+{
+	char          workdir[] = "/tmp/q2admin-host-XXXXXX";
+	char          value[64];
+	game_import_t import;
+	game_export_t * ( *getapi )( game_import_t * );
+	void *   module;
+	long     frame, frames;
+	double   cmdtime = 0.0;
+	double   gametime;
+	uint64_t start, elapsed;
+	int      i;
+
+	for( i = 1; i < argc; ++i )
+	{
+		if( strcmp( argv[i], "--clients" ) == 0 && i + 1 < argc )
+			host_clients = atoi( argv[++i] );
+		else if( strcmp( argv[i], "--seconds" ) == 0 && i + 1 < argc )
+			host_seconds = atoi( argv[++i] );
+		else if( strcmp( argv[i], "--hz" ) == 0 && i + 1 < argc )
+			host_hz = atoi( argv[++i] );
+		else if( strcmp( argv[i], "--config" ) == 0 && i + 1 < argc )
+			host_config = argv[++i];
+		else if( strcmp( argv[i], "--module" ) == 0 && i + 1 < argc )
+			host_module = argv[++i];
+		else if( strcmp( argv[i], "--gamedir" ) == 0 && i + 1 < argc )
+			host_gamedir = argv[++i];
+		else if( strcmp( argv[i], "--replay" ) == 0 && i + 1 < argc )
+			host_replay_file = argv[++i];
+		else if( strcmp( argv[i], "--paced" ) == 0 )
+			host_replay_paced = 1;
+		else if( strcmp( argv[i], "--verbose" ) == 0 )
+			host_verbose = 1;
+		else
+			host_usage( argv[0] );
+	}
+
+	if( host_clients < 1 || host_clients > MAX_CLIENTS || host_seconds < 1 || host_hz < 10 || host_hz > 1000 ) host_usage( argv[0] );
+	if( host_replay_file && !host_replay_open() ) return 1;
+
+	if( mkdtemp( workdir ) == NULL || !host_write_config( workdir ) )
+	{
+		fprintf( stderr, "unable to set up %s\n", workdir );
+		return 1;
+	}
+
+	fprintf( stderr, "logs and config in %s\n", workdir );
+
+	// q2admin looks for <game>/<GAMENAME>.real<GAMEEXT>
+	snprintf( value, sizeof( value ), "%d", host_clients );
+	host_cvar( "maxclients", value, 0 );
+	host_cvar( "game", (char *)host_gamedir, 0 );
+	host_cvar( "basepath", workdir, 0 );
+	host_cvar( "savepath", workdir, 0 );
+	host_cvar( "port", "27910", 0 );
+	host_cvar( "deathmatch", "1", 0 );
+
+	if( ( module = dlopen( host_module, RTLD_NOW | RTLD_LOCAL ) ) == NULL )
+	{
+		fprintf( stderr, "%s\n", dlerror() );
+		return 1;
+	}
+
+	if( ( getapi = (game_export_t * ( * )( game_import_t * )) dlsym( module, "GetGameAPI" ) ) == NULL )
+	{
+		fprintf( stderr, "no GetGameAPI in %s\n", host_module );
+		return 1;
+	}
+
+	host_setup_import( &import );
+	ge = getapi( &import );
+
+	if( !ge || ge->apiversion != GAME_API_VERSION )
+	{
+		fprintf( stderr, "%s has the wrong game API version\n", host_module );
+		return 1;
+	}
+
+	ge->Init();
+
+	if( host_replay_file )
+	{
+		// the recording starts with its own SpawnEntities
+		start    = host_now();
+		frames   = host_replay( start );
+		gametime = host_replay_time;
+	}
+	else
+	{
+		ge->SpawnEntities( "q2dm1", "{\n\"classname\" \"worldspawn\"\n}\n", "" );
+
+		start = host_now();
+
+		for( i = 0; i < host_clients; ++i ) host_connect( i );
+		host_client_command( 0, "!setadmin " HOST_PASSWORD );
+
+		frames = (long)( host_seconds / HOST_FRAMETIME );
+		for( frame = 0; frame < frames; ++frame ) host_frame( frame, &cmdtime );
+
+		for( i = 0; i < host_clients; ++i ) HOST_CALL( HOST_CLIENTDISCONNECT, ge->ClientDisconnect( host_edict( i + 1 ) ) );
+
+		gametime = host_seconds;
+	}
+
+	elapsed = host_now() - start;
+
+	ge->Shutdown();
+	dlclose( module );
+
+	for( i = 0; i < HOST_HOOKS; ++i )
+	{
+		host_timing_t * t = &host_timings[i];
+
+		if( !t->count ) continue;
+
+		qsort( t->samples, t->count, sizeof( uint32_t ), host_compare );
+		printf( "{\"hook\":\"%s\",\"calls\":%zu,\"seconds\":%.6f,\"calls_per_sec\":%.0f,\"p50_ns\":%u,\"p90_ns\":%u,\"p99_ns\":%u,\"max_ns\":%u}\n", host_hook_names[i], t->count, t->total / 1e9,
+		        t->total ? t->count * 1e9 / (double)t->total : 0.0, host_percentile( t, 0.5 ), host_percentile( t, 0.9 ), host_percentile( t, 0.99 ), t->samples[t->count - 1] );
+		free( t->samples );
+	}
+
+	printf( "{\"hook\":\"all\",\"clients\":%d,\"frames\":%ld,\"seconds\":%.6f,\"frames_per_sec\":%.1f,\"realtime\":%.1f,\"module_commands\":%lu", host_clients, frames, elapsed / 1e9, frames * 1e9 / (double)elapsed,
+	        gametime * 1e9 / (double)elapsed, host_commands );
+	if( host_replay_file ) printf( ",\"replay_records\":%lu", host_replay_records );
+	printf( "}\n" );
+
+	return 0;
+}
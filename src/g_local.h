@@ -49,6 +49,12 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #endif
 
 #include "zb_discord.h"
+#include "zb_logwriter.h"
+#include "zb_perf.h"
+#include "zb_record.h"
+#include "zb_shared.h"
+#include "zb_stats.h"
+#include "zb_trace.h"
 FILE *q2a_fopen(char *filename, const size_t n, const char *mode);
 
 //*** UPDATE START ***
@@ -474,11 +480,21 @@ typedef struct banstruct
 	char    password[80];
 	char    *msg;
 	long    maxnumberofconnects;
-	long    numberofconnects;
+	long    numberofconnects;	// clients whose proxyinfo baninfo points here
 	long    bannum;
 	float    timeout;
+	time_t    expires;	// wall clock end of a saved TIME ban, 0 for none
+	byte    store;	// BANSTORE_* it was loaded from or saved to, 0 for none
+	long    storeline;	// its line in what was loaded, the file's then the journal's
+	unsigned long storeid;	// banStoreId of its line, which the journal names it by
 	struct chatflood_s floodinfo;
 	struct banstruct *next;
+	struct banstruct *prev;
+	struct banstruct *ixnext;	// position in the ban index (zb_banindex.c)
+	struct banstruct *ixprev;
+	struct banstruct **ixhead;
+	int     heapslot;	// 1 + position in the expiry heap, 0 when not in it
+	qboolean  dead;	// off the list, freed when the last client lets go
 }
 
 baninfo_t;
@@ -493,15 +509,25 @@ baninfo_t;
 #define LT_PERM   1
 #define LT_TEMP   2
 
+#define BANSTORE_NONE  0
+#define BANSTORE_BASE  1	// the ban file in the Quake2 directory
+#define BANSTORE_MOD  2	// the ban file in the mod directory
+
 typedef struct chatbanstruct
 {
 	regex_t     *r;
 	byte     type;
 	byte     loadType;
 	long     bannum;
+	byte     store;
+	long     storeline;
+	unsigned long  storeid;
 	char     chat[256];
 	char     *msg;
 	struct chatbanstruct *next;
+	struct chatbanstruct *ixnext;	// position in the chat ban index (zb_banindex.c)
+	struct chatbanstruct *ixprev;
+	struct chatbanstruct **ixhead;
 } chatbaninfo_t;
 
 #define CNOTUSED  0
@@ -525,6 +551,23 @@ typedef struct timers_s
 
 //*** UPDATE END ***
 
+// !logquery state, one line is printed per frame like !displaylogfile while
+// the search itself runs in the log writer
+typedef struct
+{
+	int    lognum;
+} logquery_t;
+
+// !logtail state, printed one line per frame from the in-memory ring
+typedef struct
+{
+	unsigned long cursor;  // next ring sequence number to look at
+	unsigned long end;
+	int    remaining;
+	int    type;           // -1 for any
+	char   player[40];     // upper case name part or IP start, "" for any
+} logtail_t;
+
 typedef struct proxyinfo_s
 {
 	qboolean  admin;
@@ -532,12 +575,16 @@ typedef struct proxyinfo_s
 	unsigned char rbotretries;
 	CMDQUEUE  cmdQueue[ALLOWED_MAXCMDS]; // command queue - UPDATE
 	int    maxCmds;
+	int    maxCmdsPeak; // queue high-water mark for !stats
+	unsigned long long stuffcmdbytes;
 	unsigned long clientcommand; // internal proxy commands
 	char   teststr[9];
 	int    charindex;
 	//long   logfilereadpos;
 	int    logfilenum;
 	long   logfilecheckpos;
+	logquery_t logquery;
+	logtail_t logtail;
 	char   buffer[256]; // log buffer
 	char   ipaddress[40];
 	byte   ipaddressBinary[4];
@@ -668,6 +715,8 @@ enum _commands
 	QCMD_DISPLOGFILE,
 	QCMD_DISPLOGFILELIST,
 	QCMD_DISPLOGEVENTLIST,
+	QCMD_LOGQUERY,
+	QCMD_LOGTAIL,
 	QCMD_CONNECTCMD,
 	QCMD_LOGTOFILE1,
 	QCMD_LOGTOFILE2,
@@ -958,6 +1007,7 @@ extern struct   chatflood_s floodinfo;
 
 extern baninfo_t  *banhead;
 extern chatbaninfo_t *cbanhead;
+extern chatbaninfo_t *chatbanhead;
 
 extern qboolean   IPBanning_Enable;
 extern qboolean   NickBanning_Enable;
@@ -1005,6 +1055,8 @@ extern char    lanip[256];    // UPDATE
 extern int    reconnect_time;
 extern int    reconnect_checklevel;
 extern int    entity_classname_offset;
+extern qboolean  entstats_enable;
+extern int    entstats_interval;
 extern int    checkvar_poll_time;
 
 typedef struct
@@ -1044,42 +1096,58 @@ str++; \
 
 //#pragma warning (disable: 4701) // Potientially uninitialized local variable warning
 
-#define INITPERFORMANCE(instance) unsigned long performancetimer##instance = 0
+// The hook timers read a nanosecond monotonic clock.  With perf_enable on
+// RECORDPERFORMANCE(hook) after STOPPERFORMANCE*(1) feeds the !perf histograms
+// with the mod call (instance 2) and q2admin's own part (1 minus 2).  The
+// PERFORMANCEMONITOR log event still logs each sample (in seconds) as before.
+#define INITPERFORMANCE(instance) unsigned long long performancetimer##instance = 0
 #define INITPERFORMANCE_2(instance) \
-unsigned long performancetimer##instance = 0; \
-static unsigned long totalperformancetimer##instance = 0; \
+unsigned long long performancetimer##instance = 0; \
+static unsigned long long totalperformancetimer##instance = 0; \
 static int countperformancetimer##instance = 0
 
 #define STARTPERFORMANCE(instance) \
-if(isLogEvent(LT_PERFORMANCEMONITOR)) \
+if(perf_enable || isLogEvent(LT_PERFORMANCEMONITOR)) \
 { \
-performancetimer##instance = clock(); \
+performancetimer##instance = q2p_now(); \
 }
 
+// these leave the elapsed nanoseconds in performancetimer
 #define STOPPERFORMANCE(instance, function, client, ent) \
-if(isLogEvent(LT_PERFORMANCEMONITOR)) \
-{ \
-performancetimer##instance = clock() - performancetimer##instance; \
 if(performancetimer##instance) \
 { \
-logEvent(LT_PERFORMANCEMONITOR, client, ent, function, 0, (double)performancetimer##instance / CLOCKS_PER_SEC); \
+performancetimer##instance = q2p_now() - performancetimer##instance; \
+if(isLogEvent(LT_PERFORMANCEMONITOR)) \
+{ \
+logEvent(LT_PERFORMANCEMONITOR, client, ent, function, 0, (double)performancetimer##instance / 1e9); \
 } \
 }
 
 #define STOPPERFORMANCE_2(instance, function, client, ent) \
+if(performancetimer##instance) \
+{ \
+performancetimer##instance = q2p_now() - performancetimer##instance; \
 if(isLogEvent(LT_PERFORMANCEMONITOR)) \
 { \
-totalperformancetimer##instance += clock() - performancetimer##instance; \
+totalperformancetimer##instance += performancetimer##instance; \
 countperformancetimer##instance++; \
 if(countperformancetimer##instance >= 100) \
 { \
-if(totalperformancetimer##instance) \
-{ \
-logEvent(LT_PERFORMANCEMONITOR, client, ent, function, 0, (double)totalperformancetimer##instance / (100.0 * CLOCKS_PER_SEC)); \
-} \
+logEvent(LT_PERFORMANCEMONITOR, client, ent, function, 0, (double)totalperformancetimer##instance / (100.0 * 1e9)); \
 totalperformancetimer##instance = 0; \
 countperformancetimer##instance = 0; \
 } \
+} \
+}
+
+#define RECORDPERFORMANCE(hook) \
+if(perf_enable && performancetimer1) \
+{ \
+if(performancetimer2) \
+{ \
+q2p_record(hook, Q2P_MOD, performancetimer2); \
+} \
+q2p_record(hook, Q2P_Q2ADMIN, performancetimer1 - performancetimer2); \
 }
 
 // zb_clib.c
@@ -1136,6 +1204,7 @@ edict_t  *getClientFromArg(int client, edict_t *ent, int *cleintret, char *cp, c
 
 // zb_util.c
 void  stuffcmd(edict_t *e, char *s);
+int   q2a_regexec(regex_t *r, char *s);
 int   Q_stricmp (const char *s1, const char *s2);
 char  *Info_ValueForKey (char *s, char *key);
 void  copyDllInfo(void);
@@ -1148,11 +1217,28 @@ qboolean getLogicalValue(char *arg);
 int   getLastLine(char *buffer, FILE *dumpfile, long *fpos);
 void  q_strupr(char *c);
 
+enum zb_timestampenum
+{
+	TS_CTIME,
+	TS_ISO8601,
+	TS_EPOCHMS,
+	TS_DATE,
+	TS_MAX
+};
+
+void  updateTimestamp(void);
+char  *getTimestamp(enum zb_timestampenum style, size_t *len);
+long long getTimestampMs(void);
+
 // zb_ban.c
 void  banRun(int startarg, edict_t *ent, int client);
 void  reloadbanfileRun(int startarg, edict_t *ent, int client);
 void  readBanLists(void);
+void  ReadBanStream(FILE *banfile, char *bfname);
+qboolean ReadBanFile(char *bfname);
+int   checkBanList(edict_t *ent, int client);
 int   checkCheckIfBanned(edict_t *ent, int client);
+void  checkAllClientsBanned(void);
 void  listbansRun(int startarg, edict_t *ent, int client);
 void  displayNextBan(edict_t *ent, int client, long bannum);
 void  delbanRun(int startarg, edict_t *ent, int client);
@@ -1162,6 +1248,62 @@ void  listchatbansRun(int startarg, edict_t *ent, int client);
 void  displayNextChatBan(edict_t *ent, int client, long chatbannum);
 void  delchatbanRun(int startarg, edict_t *ent, int client);
 void  freeBanLists(void);
+void  addBan(baninfo_t *entry);
+void  addChatBan(chatbaninfo_t *entry);
+void  removeBan(baninfo_t *entry);
+void  removeChatBan(chatbaninfo_t *entry, chatbaninfo_t *prev);
+void  releaseBanInfo(int client);
+
+// zb_banimage.c
+qboolean ReadBanImage(char *bfname);
+void  banImageRecordSources(void);
+void  banImageNoteSource(char *bfname, FILE *fp);
+qboolean banImageWrite(const char *path);
+
+// zb_banstore.c
+extern int  banjournal_compact;
+extern byte  banLoadStore;
+extern long  banLoadLineBase;
+extern long  banLoadLines;
+void  banStoreInitialize(void);
+void  banStoreShutdown(void);
+qboolean banStoreLoad(int store, char *bfname);
+unsigned long banStoreId(const char *line);
+unsigned long banStoreAdd(int store, char *line);
+void  banStoreRemove(int store, unsigned long id, qboolean expired);
+float  banStoreTimeout(time_t expires);
+
+// zb_shared.c
+extern char   sharedstore_name[256];
+void  sharedInitialize(void);
+void  sharedShutdown(void);
+void  sharedFrame(void);
+void  sharedReload(void);
+void  sharedPublishBan(baninfo_t *entry, qboolean saved);
+void  sharedPublishMute(int client, int seconds);
+void  sharedPublishKick(int client);
+void  sharedCheckMute(int client);
+void  sharedReceive(const sanction_t *record, qboolean live);
+uint32_t sharedOriginId(void);
+
+// zb_sync.c
+extern char   sync_address[256];
+extern char   sync_key[256];
+void  syncInitialize(void);
+void  syncShutdown(void);
+void  syncFrame(void);
+void  syncPublish(const sanction_t *record);
+
+// zb_banindex.c
+void  banIndexAdd(baninfo_t *entry);
+void  banIndexRemove(baninfo_t *entry);
+void  banIndexClear(void);
+baninfo_t *banIndexLookup(int client);
+void  banIndexExpire(void);
+void  chatbanIndexAdd(chatbaninfo_t *entry);
+void  chatbanIndexRemove(chatbaninfo_t *entry);
+void  chatbanIndexClear(void);
+chatbaninfo_t *chatbanIndexLookup(char *txt);
 
 // zb_lrcon.c
 void  readLRconLists(void);
@@ -1205,6 +1347,9 @@ void  removeClientCommands(int client);
 
 // zb_log.c
 void  loadLogList(void);
+void  getLogFileName(int lognum, char *logname);
+void  compileLogFormat(unsigned int lt);
+size_t  convertToLogLine(char *dest, size_t size, unsigned int lt, int client, edict_t *ent, char *message, int number, float number2);
 qboolean isLogEvent(enum zb_logtypesenum ltype);
 void  logEvent(enum zb_logtypesenum ltype, int client, edict_t *ent, char *message, int number, float number2);
 void  displaylogfileRun(int startarg, edict_t *ent, int client);
@@ -1214,6 +1359,42 @@ void  logfileRun(int startarg, edict_t *ent, int client);
 void  displayLogFileListCont(edict_t *ent, int client, long logfilenum);
 void  logeventRun(int startarg, edict_t *ent, int client);
 void  displayLogEventListCont(edict_t *ent, int client, long logevent, qboolean onetimeonly);
+void  logqueryRun(int startarg, edict_t *ent, int client);
+void  logQueryCont(edict_t *ent, int client);
+void  logtailRun(int startarg, edict_t *ent, int client);
+void  logTailCont(edict_t *ent, int client);
+void  initLogTail(void);
+void  logSuppressedSummary(qboolean all);
+void  freeLogTail(void);
+
+// zb_logwriter.c
+extern int   logbuffer_size;
+extern int   logflush_bytes;
+extern int   logflush_time;
+extern qboolean  logbuffer_block;
+
+// zb_perf.c
+extern qboolean  perf_enable;
+extern int   hitch_frames;
+extern int   hitch_threshold;
+extern char   hitch_file[256];
+void  perfRun(int startarg, edict_t *ent, int client);
+
+// zb_record.c
+void  recordRun(int startarg, edict_t *ent, int client);
+
+// zb_stats.c
+extern int   stats_interval;
+extern char   stats_file[256];
+void  statsRun(int startarg, edict_t *ent, int client);
+
+// zb_trace.c
+extern int   trace_events;
+void  traceRun(int startarg, edict_t *ent, int client);
+void  q2t_shutdown(void);
+
+// zb_log.c
+extern int   logtail_size;
 
 // zb_flood.c
 void  freeFloodLists(void);
@@ -1248,6 +1429,9 @@ void  spawncmdRun(int startarg, edict_t *ent, int client);
 void  spawnDelRun(int startarg, edict_t *ent, int client);
 void  linkentity_internal(edict_t *ent);
 void  unlinkentity_internal(edict_t *ent);
+void  entstatsFrame(void);
+void  entstatsFlush(void);
+void  entstatsRun(int startarg, edict_t *ent, int client);
 
 // zb_vote.c
 void  freeVoteLists(void);
@@ -87,6 +87,7 @@ void ShutdownGame (void)
 
 	if (q2adminrunmode)
 		{
+			entstatsFlush();
 			STARTPERFORMANCE(1);
 			logEvent(LT_SERVEREND, 0, NULL, NULL, 0, 0.0);
 			STARTPERFORMANCE(2);
@@ -99,6 +100,16 @@ void ShutdownGame (void)
 #ifdef USE_DISCORD
 	q2d_shutdown();
 #endif
+	q2t_shutdown();
+	q2s_shutdown();
+	q2r_shutdown();
+	banStoreShutdown();
+	syncShutdown();
+	sharedShutdown();
+	logSuppressedSummary(TRUE);
+	q2l_shutdown();
+	freeLogTail();
+	q2p_hitch_shutdown();
 	
 	if (q2adminrunmode)
 		{
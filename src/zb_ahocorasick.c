@@ -0,0 +1,405 @@
+/*-------------------------------
+# SPDX-License-Identifier: ISC
+#
+# Copyright © 2022 Daniel Wolf <<nephatrine@gmail.com>>
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+# REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+# AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+# INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+# LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+# OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+# -----------------------------*/
+
+#include "zb_ahocorasick.h"
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define Q2AC_ROOT 0
+#define Q2AC_NONE -1
+#define Q2AC_MAX_NODES 0xFFFFFF // node index and byte share a 32 bit edge key
+#define Q2AC_NO_EDGE 0xFFFFFFFFu
+
+typedef struct
+{
+	int           parent;
+	int           fail;
+	int           output;  // nearest node down the failure chain that ends a pattern
+	int           entries; // payloads of the pattern ending here, highest key first
+	int           depth;
+	unsigned char c;
+	unsigned char terminal; // a pattern has ended here, it stays set after removal
+} q2ac_node_t;
+
+typedef struct
+{
+	long   key;
+	void * payload;
+	int    next;
+} q2ac_entry_t;
+
+struct q2ac_s
+{
+	q2ac_node_t * nodes;
+	int *         order; // scratch for the relink, nodes sorted by depth
+	int           numnodes;
+	int           maxnodes;
+
+	int * depthstart; // scratch for the relink, one slot per depth plus one
+	int   maxdepth;
+	int   depthcap;
+
+	uint32_t * edgekeys; // parent << 8 | byte, open addressing
+	int *      edgenodes;
+	uint32_t   edgecap; // a power of two
+	uint32_t   numedges;
+	int        rootnext[256];
+
+	q2ac_entry_t * entries;
+	int            numentries;
+	int            maxentries;
+	int            freeentry;
+
+	int stale; // failure links need rebuilding
+};
+
+//
+// Edges
+//
+
+static uint32_t q2ac_hash( uint32_t key )
+{
+	key ^= key >> 16;
+	key *= 0x45d9f3bu;
+	key ^= key >> 16;
+	return key;
+}
+
+static int q2ac_edge( const q2ac_t * ac, int node, unsigned char c )
+{
+	uint32_t key, slot;
+
+	if( node == Q2AC_ROOT ) return ac->rootnext[c];
+
+	key = ( (uint32_t)node << 8 ) | c;
+
+	for( slot = q2ac_hash( key ) & ( ac->edgecap - 1 ); ac->edgekeys[slot] != Q2AC_NO_EDGE; slot = ( slot + 1 ) & ( ac->edgecap - 1 ) )
+		if( ac->edgekeys[slot] == key ) return ac->edgenodes[slot];
+
+	return Q2AC_NONE;
+}
+
+static void q2ac_put_edge( uint32_t * keys, int * nodes, uint32_t cap, uint32_t key, int child )
+{
+	uint32_t slot = q2ac_hash( key ) & ( cap - 1 );
+
+	while( keys[slot] != Q2AC_NO_EDGE ) slot = ( slot + 1 ) & ( cap - 1 );
+
+	keys[slot]  = key;
+	nodes[slot] = child;
+}
+
+static void q2ac_set_edge( q2ac_t * ac, int node, unsigned char c, int child )
+{
+	if( node == Q2AC_ROOT )
+		ac->rootnext[c] = child;
+	else
+	{
+		q2ac_put_edge( ac->edgekeys, ac->edgenodes, ac->edgecap, ( (uint32_t)node << 8 ) | c, child );
+		ac->numedges++;
+	}
+}
+
+//
+// Storage
+//
+
+// makes room for count more nodes and edges and one more entry, so an add
+// that got past this cannot fail halfway
+static int q2ac_reserve( q2ac_t * ac, int count, int depth )
+{
+	if( ac->numnodes + count > Q2AC_MAX_NODES ) return 0;
+
+	if( ac->numnodes + count > ac->maxnodes )
+	{
+		int           max   = ac->maxnodes * 2 > ac->numnodes + count ? ac->maxnodes * 2 : ac->numnodes + count;
+		q2ac_node_t * nodes = realloc( ac->nodes, (size_t)max * sizeof( q2ac_node_t ) );
+		int *         order;
+
+		if( nodes == NULL ) return 0;
+		ac->nodes = nodes;
+
+		if( ( order = realloc( ac->order, (size_t)max * sizeof( int ) ) ) == NULL ) return 0;
+		ac->order = order;
+
+		ac->maxnodes = max;
+	}
+
+	if( depth + 2 > ac->depthcap )
+	{
+		int * start = realloc( ac->depthstart, (size_t)( depth + 2 ) * sizeof( int ) );
+
+		if( start == NULL ) return 0;
+		ac->depthstart = start;
+		ac->depthcap   = depth + 2;
+	}
+
+	// keep the edge table at most half full
+	if( ( ac->numedges + (uint32_t)count ) * 2 > ac->edgecap )
+	{
+		uint32_t   cap = ac->edgecap ? ac->edgecap : 256;
+		uint32_t * keys;
+		int *      nodes;
+		uint32_t   i;
+
+		while( ( ac->numedges + (uint32_t)count ) * 2 > cap ) cap *= 2;
+
+		keys  = malloc( cap * sizeof( uint32_t ) );
+		nodes = malloc( cap * sizeof( int ) );
+		if( keys == NULL || nodes == NULL )
+		{
+			free( keys );
+			free( nodes );
+			return 0;
+		}
+
+		memset( keys, 0xFF, cap * sizeof( uint32_t ) );
+		for( i = 0; i < ac->edgecap; i++ )
+			if( ac->edgekeys[i] != Q2AC_NO_EDGE ) q2ac_put_edge( keys, nodes, cap, ac->edgekeys[i], ac->edgenodes[i] );
+
+		free( ac->edgekeys );
+		free( ac->edgenodes );
+		ac->edgekeys  = keys;
+		ac->edgenodes = nodes;
+		ac->edgecap   = cap;
+	}
+
+	if( ac->freeentry == Q2AC_NONE && ac->numentries == ac->maxentries )
+	{
+		int            max     = ac->maxentries ? ac->maxentries * 2 : 64;
+		q2ac_entry_t * entries = realloc( ac->entries, (size_t)max * sizeof( q2ac_entry_t ) );
+
+		if( entries == NULL ) return 0;
+		ac->entries    = entries;
+		ac->maxentries = max;
+	}
+
+	return 1;
+}
+
+static int q2ac_new_node( q2ac_t * ac, int parent, unsigned char c )
+{
+	int           index = ac->numnodes++;
+	q2ac_node_t * node  = &ac->nodes[index];
+
+	node->parent   = parent;
+	node->fail     = Q2AC_ROOT;
+	node->output   = Q2AC_NONE;
+	node->entries  = Q2AC_NONE;
+	node->depth    = parent == Q2AC_NONE ? 0 : ac->nodes[parent].depth + 1;
+	node->c        = c;
+	node->terminal = 0;
+
+	if( node->depth > ac->maxdepth ) ac->maxdepth = node->depth;
+
+	return index;
+}
+
+q2ac_t * q2ac_create( void )
+{
+	q2ac_t * ac = calloc( 1, sizeof( q2ac_t ) );
+	int      i;
+
+	if( ac == NULL ) return NULL;
+
+	for( i = 0; i < 256; i++ ) ac->rootnext[i] = Q2AC_NONE;
+	ac->freeentry = Q2AC_NONE;
+
+	if( !q2ac_reserve( ac, 1, 0 ) )
+	{
+		q2ac_destroy( ac );
+		return NULL;
+	}
+
+	q2ac_new_node( ac, Q2AC_NONE, 0 );
+	return ac;
+}
+
+void q2ac_destroy( q2ac_t * ac )
+{
+	if( ac == NULL ) return;
+
+	free( ac->nodes );
+	free( ac->order );
+	free( ac->depthstart );
+	free( ac->edgekeys );
+	free( ac->edgenodes );
+	free( ac->entries );
+	free( ac );
+}
+
+//
+// Patterns
+//
+
+int q2ac_add( q2ac_t * ac, const char * pattern, long key, void * payload )
+{
+	int    length = (int)strlen( pattern );
+	int    node   = Q2AC_ROOT, next, entry, *link;
+	size_t i;
+
+	if( !q2ac_reserve( ac, length, length ) ) return 0;
+
+	for( i = 0; pattern[i]; i++ )
+	{
+		unsigned char c = (unsigned char)toupper( (unsigned char)pattern[i] );
+
+		if( ( next = q2ac_edge( ac, node, c ) ) == Q2AC_NONE )
+		{
+			next = q2ac_new_node( ac, node, c );
+			q2ac_set_edge( ac, node, c, next );
+			ac->stale = 1;
+		}
+
+		node = next;
+	}
+
+	if( !ac->nodes[node].terminal )
+	{
+		ac->nodes[node].terminal = 1;
+		ac->stale                = 1;
+	}
+
+	if( ac->freeentry != Q2AC_NONE )
+	{
+		entry         = ac->freeentry;
+		ac->freeentry = ac->entries[entry].next;
+	}
+	else
+		entry = ac->numentries++;
+
+	ac->entries[entry].key     = key;
+	ac->entries[entry].payload = payload;
+
+	// new rules usually carry the highest key, so this stops at the front
+	for( link = &ac->nodes[node].entries; *link != Q2AC_NONE && ac->entries[*link].key > key; link = &ac->entries[*link].next ) {}
+
+	ac->entries[entry].next = *link;
+	*link                   = entry;
+	return 1;
+}
+
+void q2ac_remove( q2ac_t * ac, const char * pattern, void * payload )
+{
+	int    node = Q2AC_ROOT, *link;
+	size_t i;
+
+	for( i = 0; pattern[i] && node != Q2AC_NONE; i++ ) node = q2ac_edge( ac, node, (unsigned char)toupper( (unsigned char)pattern[i] ) );
+
+	if( node == Q2AC_NONE ) return;
+
+	for( link = &ac->nodes[node].entries; *link != Q2AC_NONE; link = &ac->entries[*link].next )
+	{
+		if( ac->entries[*link].payload == payload )
+		{
+			int entry = *link;
+
+			*link                   = ac->entries[entry].next;
+			ac->entries[entry].next = ac->freeentry;
+			ac->freeentry           = entry;
+			return;
+		}
+	}
+}
+
+//
+// Matching
+//
+
+// Failure links are worked out in order of depth, so the links of every
+// shallower node are already known when a node is reached.
+static void q2ac_relink( q2ac_t * ac )
+{
+	int i, d, total = 0;
+
+	for( d = 0; d <= ac->maxdepth + 1; d++ ) ac->depthstart[d] = 0;
+	for( i = 0; i < ac->numnodes; i++ ) ac->depthstart[ac->nodes[i].depth + 1]++;
+
+	for( d = 0; d <= ac->maxdepth; d++ )
+	{
+		int count         = ac->depthstart[d + 1];
+		ac->depthstart[d] = total;
+		total += count;
+	}
+
+	for( i = 0; i < ac->numnodes; i++ ) ac->order[ac->depthstart[ac->nodes[i].depth]++] = i;
+
+	ac->nodes[Q2AC_ROOT].fail   = Q2AC_ROOT;
+	ac->nodes[Q2AC_ROOT].output = Q2AC_NONE;
+
+	for( i = 1; i < ac->numnodes; i++ )
+	{
+		q2ac_node_t * node = &ac->nodes[ac->order[i]];
+		int           fail = Q2AC_ROOT;
+
+		if( node->parent != Q2AC_ROOT )
+		{
+			int f = ac->nodes[node->parent].fail, next;
+
+			for( ;; )
+			{
+				if( ( next = q2ac_edge( ac, f, node->c ) ) != Q2AC_NONE )
+				{
+					fail = next;
+					break;
+				}
+
+				if( f == Q2AC_ROOT ) break;
+				f = ac->nodes[f].fail;
+			}
+		}
+
+		node->fail   = fail;
+		node->output = fail != Q2AC_ROOT && ac->nodes[fail].terminal ? fail : ac->nodes[fail].output;
+	}
+
+	ac->stale = 0;
+}
+
+static int q2ac_better( const q2ac_t * ac, int best, int entry )
+{
+	if( entry == Q2AC_NONE ) return best;
+	if( best == Q2AC_NONE || ac->entries[entry].key > ac->entries[best].key ) return entry;
+	return best;
+}
+
+void * q2ac_search( q2ac_t * ac, const char * text )
+{
+	const unsigned char * p     = (const unsigned char *)text;
+	int                   state = Q2AC_ROOT, next, out;
+	int                   best  = ac->nodes[Q2AC_ROOT].entries; // an empty pattern is in every text
+
+	if( ac->stale ) q2ac_relink( ac );
+
+	for( ; *p; p++ )
+	{
+		unsigned char c = (unsigned char)toupper( *p );
+
+		while( ( next = q2ac_edge( ac, state, c ) ) == Q2AC_NONE && state != Q2AC_ROOT ) state = ac->nodes[state].fail;
+
+		state = next == Q2AC_NONE ? Q2AC_ROOT : next;
+
+		for( out = ac->nodes[state].terminal ? state : ac->nodes[state].output; out != Q2AC_NONE && out != Q2AC_ROOT; out = ac->nodes[out].output )
+			best = q2ac_better( ac, best, ac->nodes[out].entries );
+	}
+
+	return best == Q2AC_NONE ? NULL : ac->entries[best].payload;
+}
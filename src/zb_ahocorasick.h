@@ -0,0 +1,42 @@
+/*-------------------------------
+# SPDX-License-Identifier: ISC
+#
+# Copyright © 2022 Daniel Wolf <<nephatrine@gmail.com>>
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+# REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+# AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+# INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+# LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+# OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+# -----------------------------*/
+
+#ifndef ZB_AHOCORASICK_H
+#define ZB_AHOCORASICK_H 1
+
+// Case-insensitive multi-pattern substring matcher (Aho-Corasick). Patterns
+// are folded with toupper like q_strupr, each carries a payload and a key, and
+// a search reports the payload with the highest key among all patterns found
+// anywhere in the text, in one pass over the text.
+//
+// Adding a pattern only extends the trie and marks the failure links stale,
+// they are rebuilt on the next search. Removing one just drops its payload.
+
+typedef struct q2ac_s q2ac_t;
+
+q2ac_t * q2ac_create( void );
+void     q2ac_destroy( q2ac_t * ac );
+
+// returns 0 when out of memory, the matcher is left as it was
+int  q2ac_add( q2ac_t * ac, const char * pattern, long key, void * payload );
+void q2ac_remove( q2ac_t * ac, const char * pattern, void * payload );
+
+// the payload with the highest key whose pattern occurs in text, or NULL
+void * q2ac_search( q2ac_t * ac, const char * text );
+
+#endif
@@ -46,22 +46,55 @@ char *currentBanMsg;
 
 long banNumUpto = 0;
 long chatBanNumUpto = 0;
+
+// clients that held an include ban when the lists were freed, they are
+// counted against the same rule again once the lists are read back in
+static byte banHoldLost[MAX_CLIENTS];
 char defaultChatBanMsg[256];
 
-qboolean ReadBanFile(char *bfname)
+
+
+// numbers a new ban and inserts it at the head of the list
+void addBan(baninfo_t *entry)
+{
+	entry->bannum = banNumUpto;
+	banNumUpto++;
+	
+	entry->next = banhead;
+	entry->prev = NULL;
+	if(banhead)
+		{
+			banhead->prev = entry;
+		}
+	banhead = entry;
+	banIndexAdd(entry);
+}
+
+
+
+void addChatBan(chatbaninfo_t *entry)
+{
+	entry->bannum = chatBanNumUpto;
+	chatBanNumUpto++;
+	
+	entry->next = chatbanhead;
+	chatbanhead = entry;
+	chatbanIndexAdd(entry);
+}
+
+
+
+// reads the ban lines in an open file, bfname is only for messages
+void ReadBanStream(FILE *banfile, char *bfname)
 {
-	FILE *banfile;
 	baninfo_t *newentry;
 	chatbaninfo_t *cnewentry;
 	char strbuffer[256];
 	unsigned int uptoLine = 0;
+	unsigned long lineid;
+	qboolean continued = FALSE;
+	byte store;
 	
-	banfile = q2a_fopen(bfname, 0, "rt");
-	if(!banfile)
-		{
-			return FALSE;
-		}
-		
 	while(fgets(buffer, 256, banfile))
 		{
 			char *cp = buffer;
@@ -69,12 +102,20 @@ qboolean ReadBanFile(char *bfname)
 			unsigned int i;
 			qboolean like, re, all;
 			
-			SKIPBLANK(cp);
+			// lines are numbered as they are in the file, however long they are
+			if(!continued)
+				{
+					uptoLine++;
+				}
+			continued = (buffer[0] && buffer[q2a_strlen(buffer) - 1] != '\n');
 			
-			uptoLine++;
+			SKIPBLANK(cp);
 			
 			if(!(cp[0] == ';' || cp[0] == '\n' || isBlank (cp)))
 				{
+					// the store names a ban by what its line says
+					lineid = banLoadStore ? banStoreId(cp) : 0;
+					
 					if(startContains(cp, "BAN:"))
 						{
 							// create include / exclude ban.
@@ -85,6 +126,7 @@ qboolean ReadBanFile(char *bfname)
 							
 							newentry->loadType = LT_PERM;
 							newentry->timeout = 0.0;
+							newentry->expires = 0;
 							newentry->r = 0;
 							
 							cp += 4;
@@ -467,6 +509,19 @@ qboolean ReadBanFile(char *bfname)
 									newentry->msg = NULL;
 								}
 								
+							// get EXPIRES, the end of a saved TIME ban
+							if(startContains(cp, "EXPIRES"))
+								{
+									cp += 7;
+									
+									SKIPBLANK(cp);
+									
+									newentry->expires = (time_t)strtol(cp, &cp, 10);
+									newentry->timeout = banStoreTimeout(newentry->expires);
+									
+									SKIPBLANK(cp);
+								}
+								
 							// do you have a valid ban record?
 							if(newentry->type == NOTUSED ||
 								(!all && newentry->type == NICKALL && newentry->subnetmask == 0 && newentry->maxnumberofconnects == 0) ||
@@ -490,12 +545,10 @@ qboolean ReadBanFile(char *bfname)
 							else
 								{
 									// we have the ban record...
-									// insert at the head of the correct list.
-									newentry->bannum = banNumUpto;
-									banNumUpto++;
-									
-									newentry->next = banhead;
-									banhead = newentry;
+									newentry->store = banLoadStore;
+									newentry->storeline = banLoadStore ? banLoadLineBase + uptoLine : 0;
+									newentry->storeid = lineid;
+									addBan(newentry);
 								}
 						}
 					else if(startContains(cp, "CHATBAN:"))
@@ -631,12 +684,10 @@ qboolean ReadBanFile(char *bfname)
 							else
 								{
 									// we have the ban record...
-									// insert at the head of the correct list.
-									cnewentry->bannum = chatBanNumUpto;
-									chatBanNumUpto++;
-									
-									cnewentry->next = chatbanhead;
-									chatbanhead = cnewentry;
+									cnewentry->store = banLoadStore;
+									cnewentry->storeline = banLoadStore ? banLoadLineBase + uptoLine : 0;
+									cnewentry->storeid = lineid;
+									addChatBan(cnewentry);
 								}
 						}
 					else if(startContains(cp, "INCLUDE:"))
@@ -655,7 +706,11 @@ qboolean ReadBanFile(char *bfname)
 									
 									if(strbuffer[0])
 										{
+											// an included file is not part of the ban store
+											store = banLoadStore;
+											banLoadStore = BANSTORE_NONE;
 											ReadBanFile(strbuffer);
+											banLoadStore = store;
 										}
 									else
 										{
@@ -674,6 +729,26 @@ qboolean ReadBanFile(char *bfname)
 				}
 		}
 		
+	if(banLoadStore)
+		{
+			banLoadLines = uptoLine;
+		}
+}
+
+
+
+qboolean ReadBanFile(char *bfname)
+{
+	FILE *banfile;
+	
+	banfile = q2a_fopen(bfname, 0, "rt");
+	banImageNoteSource(bfname, banfile);
+	if(!banfile)
+		{
+			return FALSE;
+		}
+		
+	ReadBanStream(banfile, bfname);
 	fclose(banfile);
 	
 	return TRUE;
@@ -681,24 +756,46 @@ qboolean ReadBanFile(char *bfname)
 
 
 
+static void freeBan(baninfo_t *entry)
+{
+	if(entry->msg)
+		{
+			gi.TagFree(entry->msg);
+		}
+		
+	if(entry->r)
+		{
+			regfree(entry->r);
+			gi.TagFree(entry->r);
+		}
+	gi.TagFree(entry);
+}
+
+
+
 void freeBanLists(void)
 {
+	int client;
+	
+	banIndexClear();
+	chatbanIndexClear();
+	
+	// bans are level memory and a map change frees them all after this, so
+	// nothing may be left holding one (dead bans held by clients included)
+	for(client = 0; client < maxclients->value && client < MAX_CLIENTS; client++)
+		{
+			if(proxyinfo[client].baninfo)
+				{
+					banHoldLost[client] = 1;
+					releaseBanInfo(client);
+				}
+		}
+		
 	while(banhead)
 		{
 			baninfo_t *freeentry = banhead;
 			banhead = banhead->next;
-			
-			if(freeentry->msg)
-				{
-					gi.TagFree(freeentry->msg);
-				}
-				
-			if(freeentry->r)
-				{
-					regfree(freeentry->r);
-					gi.TagFree(freeentry->r);
-				}
-			gi.TagFree(freeentry);
+			freeBan(freeentry);
 		}
 		
 	while(chatbanhead)
@@ -729,6 +826,7 @@ void readBanLists(void)
 {
 	char cfgFile[100];
 	qboolean ret;
+	int client;
 	
 	if(!q2adminbantxt || isBlank(q2adminbantxt->string))
 		{
@@ -741,19 +839,43 @@ void readBanLists(void)
 		
 	freeBanLists();
 	
-	ret = ReadBanFile(cfgFile);
+	ret = banStoreLoad(BANSTORE_BASE, cfgFile);
 	
 	sprintf(buffer, "%s/%s", moddir, cfgFile);
-	if(ReadBanFile(buffer))
+	if(banStoreLoad(BANSTORE_MOD, buffer))
 		{
 			ret = TRUE;
 		}
 		
+	sharedReload();
+	
 	if(!ret)
 		{
 			gi.dprintf ("WARNING: " BANLISTFILE " could not be found\n");
 			logEvent(LT_INTERNALWARN, 0, NULL, BANLISTFILE " could not be found", IW_BANSETUPLOAD, 0.0);
 		}
+		
+	// clients already in keep their place under MAX, even past the limit
+	for(client = 0; client < maxclients->value && client < MAX_CLIENTS; client++)
+		{
+			if(!banHoldLost[client])
+				{
+					continue;
+				}
+				
+			banHoldLost[client] = 0;
+			
+			if(proxyinfo[client].inuse && !proxyinfo[client].baninfo && (IPBanning_Enable || NickBanning_Enable))
+				{
+					baninfo_t *entry = banIndexLookup(client);
+					
+					if(entry && !entry->exclude && entry->maxnumberofconnects)
+						{
+							proxyinfo[client].baninfo = entry;
+							entry->numberofconnects++;
+						}
+				}
+		}
 }
 
 
@@ -786,6 +908,10 @@ void banRun(int startarg, edict_t *ent, int client)
 	// allocate memory for ban record
 	newentry = gi.TagMalloc (sizeof(baninfo_t), TAG_LEVEL);
 	newentry->r = 0;
+	newentry->expires = 0;
+	newentry->store = BANSTORE_NONE;
+	newentry->storeline = 0;
+	newentry->storeid = 0;
 	
 	q2a_strcpy(savecmd, "BAN: ");
 	
@@ -1551,22 +1677,11 @@ void banRun(int startarg, edict_t *ent, int client)
 	// get Save?
 	if(startContains(cp, "SAVE"))
 		{
+			// a saved TIME ban keeps its end time in the ban file
 			if(newentry->timeout >= 1.0)
 				{
-					gi.cprintf(ent, PRINT_HIGH, "UpTo: %s\n", savecmd);
-					gi.cprintf(ent, PRINT_HIGH, BANCMD_LAYOUT);
-					if(newentry->msg)
-						{
-							gi.TagFree(newentry->msg);
-						}
-						
-					if(newentry->r)
-						{
-							regfree(newentry->r);
-							gi.TagFree(newentry->r);
-						}
-					gi.TagFree(newentry);
-					return;
+					newentry->expires = time(NULL) + (time_t)(newentry->timeout - ltime);
+					sprintf(savecmd + q2a_strlen(savecmd), "EXPIRES %ld ", (long)newentry->expires);
 				}
 				
 			if(gi.argc() <= startarg)
@@ -1664,57 +1779,53 @@ void banRun(int startarg, edict_t *ent, int client)
 	else
 		{
 			// we have the ban record...
-			// insert at the head of the correct list.
-			newentry->bannum = banNumUpto;
-			banNumUpto++;
-			
-			newentry->next = banhead;
-			banhead = newentry;
+			addBan(newentry);
 			
 			gi.cprintf(ent, PRINT_HIGH, "Ban Added!!\n");
 			
 			if(save)
 				{
-					FILE *banlistfptr;
-					
-					if(save == 1)
-						{
-							q2a_strcpy(buffer, BANLISTFILE);
-						}
-					else
-						{
-							sprintf(buffer, "%s/%s", moddir, BANLISTFILE);
-						}
-						
-					banlistfptr = q2a_fopen(buffer, sizeof(buffer), "at");
-					if(!banlistfptr)
+					// journaled by the ban store, written out by its thread
+					newentry->storeid = banStoreAdd(save == 1 ? BANSTORE_BASE : BANSTORE_MOD, savecmd);
+					if(!newentry->storeid)
 						{
 							gi.cprintf(ent, PRINT_HIGH, "Error opening banfile!\n");
 						}
 					else
 						{
-							fprintf(banlistfptr, "%s\n", savecmd);
-							fclose(banlistfptr);
-							
+							newentry->store = (save == 1 ? BANSTORE_BASE : BANSTORE_MOD);
 							gi.cprintf(ent, PRINT_HIGH, "Ban stored.\n");
 						}
 				}
 				
+			// the other servers on this host get it too
+			sharedPublishBan(newentry, newentry->store != BANSTORE_NONE);
+			
 			if(!nocheck)
 				{
-					for(clienti = 0; clienti < maxclients->value; clienti++)
+					checkAllClientsBanned();
+				}
+		}
+}
+
+
+
+// kicks every connected client that is now banned
+void checkAllClientsBanned(void)
+{
+	int clienti;
+	
+	for(clienti = 0; clienti < maxclients->value; clienti++)
+		{
+			if(proxyinfo[clienti].inuse)
+				{
+					edict_t *enti = getEnt((clienti + 1));
+					if(checkCheckIfBanned(enti, clienti))
 						{
-							if(proxyinfo[clienti].inuse)
-								{
-									edict_t *enti = getEnt((clienti + 1));
-									if(checkCheckIfBanned(enti, clienti))
-										{
-											logEvent(LT_BAN, clienti, enti, currentBanMsg, 0, 0.0);
-											gi.cprintf (NULL, PRINT_HIGH, "%s: %s (IP = %s)\n", proxyinfo[clienti].name, currentBanMsg, proxyinfo[clienti].ipaddress);
-											gi.cprintf (enti, PRINT_HIGH, "%s: %s\n", proxyinfo[clienti].name, currentBanMsg);
-											addCmdQueue(clienti, QCMD_DISCONNECT, 1, 0, currentBanMsg);
-										}
-								}
+							logEvent(LT_BAN, clienti, enti, currentBanMsg, 0, 0.0);
+							gi.cprintf (NULL, PRINT_HIGH, "%s: %s (IP = %s)\n", proxyinfo[clienti].name, currentBanMsg, proxyinfo[clienti].ipaddress);
+							gi.cprintf (enti, PRINT_HIGH, "%s: %s\n", proxyinfo[clienti].name, currentBanMsg);
+							addCmdQueue(clienti, QCMD_DISCONNECT, 1, 0, currentBanMsg);
 						}
 				}
 		}
@@ -1733,219 +1844,158 @@ void reloadbanfileRun(int startarg, edict_t *ent, int client)
 
 
 
+// unlinks a ban from the list and the index and frees it, or leaves that to
+// releaseBanInfo while clients still hold it
+void removeBan(baninfo_t *entry)
+{
+	if(entry->prev)
+		{
+			entry->prev->next = entry->next;
+		}
+	else
+		{
+			banhead = entry->next;
+		}
+		
+	if(entry->next)
+		{
+			entry->next->prev = entry->prev;
+		}
+		
+	entry->next = entry->prev = NULL;
+	banIndexRemove(entry);
+	
+	if(entry->numberofconnects)
+		{
+			entry->dead = TRUE;
+			return;
+		}
+		
+	freeBan(entry);
+}
+
+
+
+// prev is the chat ban before entry in the list, NULL if entry is the head
+void removeChatBan(chatbaninfo_t *entry, chatbaninfo_t *prev)
+{
+	if(prev)
+		{
+			prev->next = entry->next;
+		}
+	else
+		{
+			chatbanhead = entry->next;
+		}
+		
+	chatbanIndexRemove(entry);
+	
+	if(entry->msg)
+		{
+			gi.TagFree(entry->msg);
+		}
+		
+	if(entry->r)
+		{
+			regfree(entry->r);
+			gi.TagFree(entry->r);
+		}
+	gi.TagFree(entry);
+}
+
+
+
+// drops the client's hold on its include ban
+void releaseBanInfo(int client)
+{
+	baninfo_t *entry = proxyinfo[client].baninfo;
+	
+	if(!entry)
+		{
+			return;
+		}
+		
+	proxyinfo[client].baninfo = NULL;
+	
+	if(entry->numberofconnects)
+		{
+			entry->numberofconnects--;
+		}
+		
+	if(entry->dead && !entry->numberofconnects)
+		{
+			freeBan(entry);
+		}
+}
+
+
+
 int checkBanList(edict_t *ent, int client)
 {
-	baninfo_t *checkentry = banhead, *prevcheckentry = NULL;
+	// the first ban in list order that applies to this client, if any
+	baninfo_t *checkentry = banIndexLookup(client);
 	char strbuffer[256];
 	
-	while(checkentry)
+	if(checkentry)
 		{
-			if(checkentry->type != NOTUSED)
+			if(checkentry->exclude)
 				{
-					if(checkentry->timeout && checkentry->timeout < ltime)
-						{
-							unsigned int clienti;
-							
-							// found dead ban, delete...
-							for(clienti = 0; clienti < maxclients->value; clienti++)
-								{
-									if(proxyinfo[clienti].baninfo == checkentry)
-										{
-											proxyinfo[clienti].baninfo = NULL;
-										}
-								}
-								
-							if(prevcheckentry)
-								{
-									prevcheckentry->next = checkentry->next;
-								}
-							else
-								{
-									banhead = checkentry->next;
-								}
-								
-							if(checkentry->msg)
-								{
-									gi.TagFree(checkentry->msg);
-								}
-								
-							if(checkentry->r)
-								{
-									regfree(checkentry->r);
-									gi.TagFree(checkentry->r);
-								}
-							gi.TagFree(checkentry);
-							
-							
-							if(prevcheckentry)
-								{
-									checkentry = prevcheckentry->next;
-								}
-							else
-								{
-									checkentry = banhead;
-								}
-								
-							continue;
-						}
-						
-					// check name...
-					if(checkentry->type != NICKALL)
-						{
-							if(!NickBanning_Enable)
-								{
-									prevcheckentry = checkentry;
-									checkentry = checkentry->next;
-									continue;
-								}
-								
-							switch(checkentry->type)
-								{
-								case NICKEQ:
-									if(Q_stricmp(proxyinfo[client].name, checkentry->nick))
-										{
-											prevcheckentry = checkentry;
-											checkentry = checkentry->next;
-											continue;
-										}
-									break;
-									
-								case NICKLIKE:
-									if(!stringContains(proxyinfo[client].name, checkentry->nick))
-										{
-											prevcheckentry = checkentry;
-											checkentry = checkentry->next;
-											continue;
-										}
-									break;
-									
-								case NICKRE:
-									q2a_strcpy(strbuffer, proxyinfo[client].name);
-									q_strupr(strbuffer);
-									
-									if(regexec(checkentry->r, strbuffer, 0, 0, 0) == REG_NOMATCH)
-										{
-											prevcheckentry = checkentry;
-											checkentry = checkentry->next;
-											continue;
-										}
-									break;
-									
-								case NICKBLANK:
-									if(!isBlank(proxyinfo[client].name))
-										{
-											prevcheckentry = checkentry;
-											checkentry = checkentry->next;
-											continue;
-										}
-									break;
-								}
-						}
-						
-					// check IP
-					if(IPBanning_Enable)
-						{
-							int snm = checkentry->subnetmask;
-							unsigned int i;
-							
-							for(i = 0; i < 4 && snm; i++)
-								{
-									if(snm < 8)
-										{
-											byte mask = 0xFF << (8 - snm);
-											
-											if((checkentry->ip[i] & mask) != (proxyinfo[client].ipaddressBinary[i] & mask))
-												{
-													break;
-												}
-										}
-									else
-										{
-											if(checkentry->ip[i] != proxyinfo[client].ipaddressBinary[i])
-												{
-													break;
-												}
-										}
-										
-									snm -= 8;
-								}
-								
-							if(snm > 0)
-								{
-									prevcheckentry = checkentry;
-									checkentry = checkentry->next;
-									continue;
-								}
-						}
-					else if(checkentry->subnetmask)
+					// ok, a ban situation..
+			
+					if(checkentry->msg)
 						{
-							prevcheckentry = checkentry;
-							checkentry = checkentry->next;
-							continue;
+							currentBanMsg = checkentry->msg;
 						}
-						
-					if(checkentry->exclude)
+				
+					return 1;
+				}
+
+			if(checkentry->password[0])
+				{
+					char *s = Info_ValueForKey (proxyinfo[client].userinfo, "pw");
+			
+//*** UPDATE START ***
+					sprintf(strbuffer,"INCLUDE - %s", s);
+					logEvent(LT_ADMINLOG, client, ent, strbuffer, 0, 0.0);
+					gi.dprintf("%s\n", strbuffer);
+//*** UPDATE END ***
+			
+					if(q2a_strcmp(checkentry->password, s))
 						{
-							// ok, a ban situation..
-							
 							if(checkentry->msg)
 								{
 									currentBanMsg = checkentry->msg;
 								}
-								
+						
 							return 1;
 						}
-
-					if(checkentry->password[0])
-						{
-							char *s = Info_ValueForKey (proxyinfo[client].userinfo, "pw");
-							
-//*** UPDATE START ***
-							sprintf(strbuffer,"INCLUDE - %s", s);
-							logEvent(LT_ADMINLOG, client, ent, strbuffer, 0, 0.0);
-							gi.dprintf("%s\n", strbuffer);
-//*** UPDATE END ***
-							
-							if(q2a_strcmp(checkentry->password, s))
-								{
-									if(checkentry->msg)
-										{
-											currentBanMsg = checkentry->msg;
-										}
-										
-									return 1;
-								}
-						}
-						
-					// check max connections..
-					if(checkentry->maxnumberofconnects)
+				}
+				
+			// check max connections..
+			if(checkentry->maxnumberofconnects)
+				{
+					if(checkentry->numberofconnects >= checkentry->maxnumberofconnects)
 						{
-							if(checkentry->numberofconnects >= checkentry->maxnumberofconnects)
+							if(checkentry->msg)
 								{
-									if(checkentry->msg)
-										{
-											currentBanMsg = checkentry->msg;
-										}
-										
-									return 1;
+									currentBanMsg = checkentry->msg;
 								}
-								
-							proxyinfo[client].baninfo = checkentry;
-							checkentry->numberofconnects++;
-						}
 						
-					// user included...  set user settings for this include ban
-					
-					if(checkentry->floodinfo.chatFloodProtect)
-						{
-							proxyinfo[client].floodinfo = checkentry->floodinfo;
+							return 1;
 						}
-						
-					return 0;
+				
+					proxyinfo[client].baninfo = checkentry;
+					checkentry->numberofconnects++;
+				}
+				
+			// user included...  set user settings for this include ban
+			
+			if(checkentry->floodinfo.chatFloodProtect)
+				{
+					proxyinfo[client].floodinfo = checkentry->floodinfo;
 				}
 				
-			prevcheckentry = checkentry;
-			checkentry = checkentry->next;
+			return 0;
 		}
 		
 	return 0;
@@ -1954,23 +2004,21 @@ int checkBanList(edict_t *ent, int client)
 
 int checkCheckIfBanned(edict_t *ent, int client)
 {
-	if(proxyinfo[client].baninfo)
-		{
-			if(proxyinfo[client].baninfo->numberofconnects)
-				{
-					proxyinfo[client].baninfo->numberofconnects--;
-				}
-				
-			proxyinfo[client].baninfo = NULL;
-		}
-		
+	int ret;
+	
+	releaseBanInfo(client);
+	
 	if(!IPBanning_Enable && !NickBanning_Enable)
 		{
 			return 0;
 		}
 		
 	currentBanMsg = defaultBanMsg;
-	return checkBanList(ent, client);
+	Q2T_BEGIN("checkBanList");
+	Q2S_INC(Q2S_BAN_CHECKS);
+	ret = checkBanList(ent, client);
+	Q2T_END("checkBanList");
+	return ret;
 }
 
 
@@ -2105,7 +2153,7 @@ void delbanRun(int startarg, edict_t *ent, int client)
 	if (gi.argc() > startarg)
 		{
 			int banToDelete = q2a_atoi(gi.argv(startarg));
-			baninfo_t *findentry = banhead, *prevban = NULL;
+			baninfo_t *findentry = banhead;
 			
 			while(findentry)
 				{
@@ -2114,43 +2162,17 @@ void delbanRun(int startarg, edict_t *ent, int client)
 							break;
 						}
 						
-					prevban = findentry;
 					findentry = findentry->next;
 				}
 				
 			if(findentry)
 				{
-					unsigned int clienti;
-					
-					for(clienti = 0; clienti < maxclients->value; clienti++)
+					if(findentry->store)
 						{
-							if(proxyinfo[clienti].baninfo == findentry)
-								{
-									proxyinfo[clienti].baninfo = NULL;
-								}
+							banStoreRemove(findentry->store, findentry->storeid, FALSE);
 						}
 						
-					if(prevban)
-						{
-							prevban->next = findentry->next;
-						}
-					else
-						{
-							banhead = findentry->next;
-						}
-						
-					if(findentry->msg)
-						{
-							gi.TagFree(findentry->msg);
-						}
-						
-					if(findentry->r)
-						{
-							regfree(findentry->r);
-							gi.TagFree(findentry->r);
-						}
-					gi.TagFree(findentry);
-					
+					removeBan(findentry);
 					gi.cprintf (ent, PRINT_HIGH, "Ban deleted.\n");
 				}
 			else
@@ -2189,6 +2211,9 @@ void chatbanRun(int startarg, edict_t *ent, int client)
 	// allocate memory for ban record
 	cnewentry = gi.TagMalloc (sizeof(chatbaninfo_t), TAG_LEVEL);
 	cnewentry->r = 0;
+	cnewentry->store = BANSTORE_NONE;
+	cnewentry->storeline = 0;
+	cnewentry->storeid = 0;
 	
 	q2a_strcpy(savecmd, "CHATBAN: ");
 	
@@ -2384,38 +2409,20 @@ void chatbanRun(int startarg, edict_t *ent, int client)
 		}
 		
 	// we have the chat ban record...
-	// insert at the head of the correct list.
-	cnewentry->bannum = chatBanNumUpto;
-	chatBanNumUpto++;
-	
-	cnewentry->next = chatbanhead;
-	chatbanhead = cnewentry;
+	addChatBan(cnewentry);
 	
 	gi.cprintf(ent, PRINT_HIGH, "Chatban added.\n");
 	
 	if(save)
 		{
-			FILE *banlistfptr;
-			
-			if(save == 1)
-				{
-					q2a_strcpy(buffer, BANLISTFILE);
-				}
-			else
-				{
-					sprintf(buffer, "%s/%s", moddir, BANLISTFILE);
-				}
-				
-			banlistfptr = q2a_fopen(buffer, sizeof(buffer), "at");
-			if(!banlistfptr)
+			cnewentry->storeid = banStoreAdd(save == 1 ? BANSTORE_BASE : BANSTORE_MOD, savecmd);
+			if(!cnewentry->storeid)
 				{
 					gi.cprintf(ent, PRINT_HIGH, "Error opening banfile!\n");
 				}
 			else
 				{
-					fprintf(banlistfptr, "%s\n", savecmd);
-					fclose(banlistfptr);
-					
+					cnewentry->store = (save == 1 ? BANSTORE_BASE : BANSTORE_MOD);
 					gi.cprintf(ent, PRINT_HIGH, "Chatban stored.\n");
 				}
 		}
@@ -2425,10 +2432,9 @@ void chatbanRun(int startarg, edict_t *ent, int client)
 
 
 
-int checkCheckIfChatBanned(char *txt)
+static int checkChatBanList(char *txt)
 {
-	chatbaninfo_t *checkentry = chatbanhead;
-	char strbuffer[4096];
+	chatbaninfo_t *checkentry;
 	
 	// filter out characters that are disallowed.
 	if(filternonprintabletext)
@@ -2454,30 +2460,11 @@ int checkCheckIfChatBanned(char *txt)
 		
 	currentBanMsg = defaultChatBanMsg;
 	
-	while(checkentry)
+	// the first chat ban in list order that matches, if any
+	checkentry = chatbanIndexLookup(txt);
+	
+	if(checkentry)
 		{
-			switch(checkentry->type)
-				{
-				case CHATLIKE:
-					if(!stringContains(txt, checkentry->chat))
-						{
-							checkentry = checkentry->next;
-							continue;
-						}
-					break;
-					
-				case CHATRE:
-					q2a_strcpy(strbuffer, txt);
-					q_strupr(strbuffer);
-					if(regexec(checkentry->r, strbuffer, 0, 0, 0) == REG_NOMATCH)
-						{
-							checkentry = checkentry->next;
-							continue;
-						}
-					break;
-				}
-				
-				
 			// ok, a ban situation..
 			if(checkentry->msg)
 				{
@@ -2490,6 +2477,17 @@ int checkCheckIfChatBanned(char *txt)
 	return 0;
 }
 
+int checkCheckIfChatBanned(char *txt)
+{
+	int ret;
+	
+	Q2T_BEGIN("checkCheckIfChatBanned");
+	Q2S_INC(Q2S_CHATBAN_CHECKS);
+	ret = checkChatBanList(txt);
+	Q2T_END("checkCheckIfChatBanned");
+	return ret;
+}
+
 
 
 void listchatbansRun(int startarg, edict_t *ent, int client)
@@ -2578,27 +2576,12 @@ void delchatbanRun(int startarg, edict_t *ent, int client)
 				
 			if(findentry)
 				{
-					if(prevban)
-						{
-							prevban->next = findentry->next;
-						}
-					else
+					if(findentry->store)
 						{
-							chatbanhead = findentry->next;
+							banStoreRemove(findentry->store, findentry->storeid, FALSE);
 						}
 						
-					if(findentry->msg)
-						{
-							gi.TagFree(findentry->msg);
-						}
-						
-					if(findentry->r)
-						{
-							regfree(findentry->r);
-							gi.TagFree(findentry->r);
-						}
-					gi.TagFree(findentry);
-					
+					removeChatBan(findentry, prevban);
 					gi.cprintf (ent, PRINT_HIGH, "Chat Ban deleted.\n");
 				}
 			else
@@ -0,0 +1,56 @@
+/*-------------------------------
+# SPDX-License-Identifier: ISC
+#
+# Copyright © 2022 Daniel Wolf <<nephatrine@gmail.com>>
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+# REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+# AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+# INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+# LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+# OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+# -----------------------------*/
+
+#ifndef ZB_BANFORMAT_H
+#define ZB_BANFORMAT_H 1
+
+#include "zb_logformat.h"
+
+// Layout of compiled ban images, written by q2admin-bancompile and read by the
+// module in place of "<banfile>.bin". All fields are little-endian.
+//
+// A file starts with a 24 byte header:
+//
+//   char magic[4]   "Q2AB"
+//   u16  version    Q2B_VERSION
+//   u16  sources    text files the image was compiled from, the ban file first
+//   u32  bans
+//   u32  chatbans
+//   u32  strings    bytes in the string table
+//   u32  lines      lines in the ban file, which journaled bans are numbered after
+//
+// followed by the source, BAN and CHATBAN records and then the string table.
+// Records refer to strings by their offset in the table, which starts with an
+// empty string so 0 means none. Bans and chat bans are in the order the text
+// lists them, INCLUDEs expanded, so loading them in order numbers them the
+// same way reading the text does. The id is the banStoreId of the ban's line,
+// which the ban file's journal names it by.
+//
+// The image is only used while every source still has the size and
+// modification time recorded here.
+
+#define Q2B_MAGIC "Q2AB"
+#define Q2B_VERSION 2
+
+#define Q2B_HEADER_SIZE 24
+#define Q2B_SOURCE_SIZE 24  // u64 size, i64 mtime (seconds since the epoch), u32 name, u32 reserved
+#define Q2B_BAN_SIZE 48     // u8 type, u8 exclude, u8 subnetmask, u8 flood protect, u8 ip[4], u32 nick, u32 password, u32 msg, i32 max,
+                            // i32 flood num, i32 flood sec, i32 flood silence, u32 id (0 if INCLUDEd), i64 expires (0 for none)
+#define Q2B_CHATBAN_SIZE 16 // u8 type, u8 reserved[3], u32 chat, u32 msg, u32 id (0 if INCLUDEd)
+
+#endif
@@ -0,0 +1,461 @@
+/*-------------------------------
+# SPDX-License-Identifier: ISC
+#
+# Copyright © 2022 Daniel Wolf <<nephatrine@gmail.com>>
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+# REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+# AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+# INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+# LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+# OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+# -----------------------------*/
+
+#include "g_local.h"
+#include "zb_banformat.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#if !defined( WIN32 )
+#	include <sys/mman.h>
+#endif
+
+// Compiled ban images (zb_banformat.h). q2admin-bancompile reads a ban file
+// the usual way with the sources being recorded, then writes out what it
+// loaded. At startup readBanLists tries "<banfile>.bin" first and copies its
+// records straight into the lists, falling back to the text whenever the
+// image is missing, damaged or older than any of its sources. The compiler
+// only keeps RE bans that compiled, so they are left for banCompileRE to
+// compile the first time they are needed.
+
+#define BANIMAGE_MAX_SOURCES 64
+#define BANIMAGE_MISSING UINT64_MAX // size recorded for an INCLUDE that was not found
+
+typedef struct
+{
+	char     name[MAX_OSPATH];
+	uint64_t size;
+	int64_t  mtime;
+} banimagesource_t;
+
+static banimagesource_t banImageSources[BANIMAGE_MAX_SOURCES];
+static int              banImageNumSources = -1; // -1 while not recording
+static qboolean         banImageOverflow   = FALSE;
+
+static void banImageStatFile( FILE * fp, uint64_t * size, int64_t * mtime )
+{
+	struct stat st;
+
+	if( fp && fstat( fileno( fp ), &st ) == 0 )
+	{
+		*size  = (uint64_t)st.st_size;
+		*mtime = (int64_t)st.st_mtime;
+	}
+	else
+	{
+		*size  = BANIMAGE_MISSING;
+		*mtime = 0;
+	}
+}
+
+void banImageRecordSources( void )
+{
+	banImageNumSources = 0;
+	banImageOverflow   = FALSE;
+}
+
+// called by ReadBanFile for every file it tries, fp is NULL if it was not found
+void banImageNoteSource( char * bfname, FILE * fp )
+{
+	banimagesource_t * source;
+
+	if( banImageNumSources < 0 ) return;
+
+	if( banImageNumSources >= BANIMAGE_MAX_SOURCES )
+	{
+		banImageOverflow = TRUE;
+		return;
+	}
+
+	source = &banImageSources[banImageNumSources++];
+	snprintf( source->name, sizeof( source->name ), "%s", bfname );
+	banImageStatFile( fp, &source->size, &source->mtime );
+}
+
+//
+// Writing
+//
+
+typedef struct
+{
+	char *   data;
+	size_t   length;
+	size_t   size;
+	qboolean failed;
+} banimagestrings_t;
+
+static uint32_t banImageAddString( banimagestrings_t * strings, const char * text )
+{
+	size_t   length;
+	uint32_t offset;
+
+	if( !text || !*text ) return 0;
+
+	length = strlen( text ) + 1;
+	if( strings->length + length > strings->size )
+	{
+		size_t size = strings->size ? strings->size * 2 : 4096;
+		char * data;
+
+		while( size < strings->length + length ) size *= 2;
+
+		if( ( data = realloc( strings->data, size ) ) == NULL )
+		{
+			strings->failed = TRUE;
+			return 0;
+		}
+
+		strings->data = data;
+		strings->size = size;
+	}
+
+	offset = (uint32_t)strings->length;
+	memcpy( strings->data + strings->length, text, length );
+	strings->length += length;
+	return offset;
+}
+
+// Writes the bans and chat bans loaded since banImageRecordSources was called
+// to path, through a temporary file so a running server never sees half of it,
+// and stops recording.
+qboolean banImageWrite( const char * path )
+{
+	banimagestrings_t strings = { NULL, 0, 0, FALSE };
+	chatbaninfo_t **  chatbans;
+	chatbaninfo_t *   centry;
+	baninfo_t *       entry;
+	unsigned char *   image, *p;
+	uint32_t          numBans = 0, numChatBans = 0, i;
+	size_t            size;
+	char              tmppath[MAX_OSPATH];
+	FILE *            fp;
+	qboolean          ok;
+	int               s;
+	int               numSources = banImageNumSources;
+
+	banImageNumSources = -1;
+	if( numSources <= 0 || banImageOverflow ) return FALSE;
+
+	// the string table starts with "" so that offset 0 means none
+	if( ( strings.data = malloc( 4096 ) ) == NULL ) return FALSE;
+
+	strings.data[0] = 0;
+	strings.length  = 1;
+	strings.size    = 4096;
+
+	for( entry = banhead; entry; entry = entry->next )
+		if( entry->loadType == LT_PERM ) numBans++;
+
+	for( centry = chatbanhead; centry; centry = centry->next )
+		if( centry->loadType == LT_PERM ) numChatBans++;
+
+	size  = Q2B_HEADER_SIZE + (size_t)numSources * Q2B_SOURCE_SIZE + (size_t)numBans * Q2B_BAN_SIZE + (size_t)numChatBans * Q2B_CHATBAN_SIZE;
+	image = calloc( 1, size );
+
+	// chat bans are only linked one way, the array puts them back in file order
+	chatbans = calloc( numChatBans + 1, sizeof( *chatbans ) );
+
+	if( !image || !chatbans )
+	{
+		free( image );
+		free( chatbans );
+		free( strings.data );
+		return FALSE;
+	}
+
+	p = image + Q2B_HEADER_SIZE;
+
+	for( s = 0; s < numSources; ++s, p += Q2B_SOURCE_SIZE )
+	{
+		q2lb_put64( p, banImageSources[s].size );
+		q2lb_put64( p + 8, (uint64_t)banImageSources[s].mtime );
+		q2lb_put32( p + 16, banImageAddString( &strings, banImageSources[s].name ) );
+	}
+
+	// banhead is newest first, so walk from the tail to get file order back
+	for( entry = banhead; entry && entry->next; entry = entry->next )
+		;
+
+	for( ; entry; entry = entry->prev )
+	{
+		if( entry->loadType != LT_PERM ) continue;
+
+		p[0] = entry->type;
+		p[1] = entry->exclude ? 1 : 0;
+		p[2] = entry->subnetmask;
+		p[3] = entry->floodinfo.chatFloodProtect ? 1 : 0;
+		memcpy( p + 4, entry->ip, 4 );
+		q2lb_put32( p + 8, banImageAddString( &strings, entry->nick ) );
+		q2lb_put32( p + 12, banImageAddString( &strings, entry->password ) );
+		q2lb_put32( p + 16, banImageAddString( &strings, entry->msg ) );
+		q2lb_put32( p + 20, (uint32_t)entry->maxnumberofconnects );
+		q2lb_put32( p + 24, (uint32_t)entry->floodinfo.chatFloodProtectNum );
+		q2lb_put32( p + 28, (uint32_t)entry->floodinfo.chatFloodProtectSec );
+		q2lb_put32( p + 32, (uint32_t)entry->floodinfo.chatFloodProtectSilence );
+		q2lb_put32( p + 36, (uint32_t)entry->storeid );
+		q2lb_put64( p + 40, (uint64_t)entry->expires );
+		p += Q2B_BAN_SIZE;
+	}
+
+	i = numChatBans;
+	for( centry = chatbanhead; centry; centry = centry->next )
+		if( centry->loadType == LT_PERM ) chatbans[--i] = centry;
+
+	for( i = 0; i < numChatBans; ++i, p += Q2B_CHATBAN_SIZE )
+	{
+		p[0] = chatbans[i]->type;
+		q2lb_put32( p + 4, banImageAddString( &strings, chatbans[i]->chat ) );
+		q2lb_put32( p + 8, banImageAddString( &strings, chatbans[i]->msg ) );
+		q2lb_put32( p + 12, (uint32_t)chatbans[i]->storeid );
+	}
+
+	memcpy( image, Q2B_MAGIC, 4 );
+	q2lb_put16( image + 4, Q2B_VERSION );
+	q2lb_put16( image + 6, (uint16_t)numSources );
+	q2lb_put32( image + 8, numBans );
+	q2lb_put32( image + 12, numChatBans );
+	q2lb_put32( image + 16, (uint32_t)strings.length );
+	q2lb_put32( image + 20, (uint32_t)banLoadLines );
+
+	snprintf( tmppath, sizeof( tmppath ), "%s.tmp", path );
+	ok = !strings.failed && ( fp = fopen( tmppath, "wb" ) ) != NULL;
+	if( ok )
+	{
+		ok = fwrite( image, 1, size, fp ) == size && fwrite( strings.data, 1, strings.length, fp ) == strings.length;
+		ok = ( fclose( fp ) == 0 ) && ok;
+	}
+
+	free( image );
+	free( chatbans );
+	free( strings.data );
+
+	if( !ok )
+	{
+		remove( tmppath );
+		return FALSE;
+	}
+
+#if defined( WIN32 )
+	remove( path );
+#endif
+
+	if( rename( tmppath, path ) != 0 )
+	{
+		remove( tmppath );
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+//
+// Loading
+//
+
+// string at offset in the table, NULL if it is out of range or too long
+static const char * banImageString( const char * table, uint32_t length, uint32_t offset, size_t max )
+{
+	if( offset >= length || strlen( table + offset ) >= max ) return NULL;
+
+	return table + offset;
+}
+
+static char * banImageCopyMsg( const char * msg )
+{
+	char * copy;
+
+	if( !*msg ) return NULL;
+
+	copy = gi.TagMalloc( (int)strlen( msg ) + 1, TAG_LEVEL );
+	q2a_strcpy( copy, msg );
+	return copy;
+}
+
+// whether every source still looks the way it did when the image was made
+static qboolean banImageCurrent( const unsigned char * p, int count, const char * table, uint32_t length, char * bfname )
+{
+	char     name[MAX_OSPATH];
+	uint64_t size;
+	int64_t  mtime;
+	FILE *   fp;
+	int      s;
+
+	for( s = 0; s < count; ++s, p += Q2B_SOURCE_SIZE )
+	{
+		const char * source = banImageString( table, length, q2lb_get32( p + 16 ), sizeof( name ) );
+
+		if( !source || ( s == 0 && strcmp( source, bfname ) ) ) return FALSE;
+
+		q2a_strcpy( name, source );
+		fp = q2a_fopen( name, 0, "rb" );
+		banImageStatFile( fp, &size, &mtime );
+		if( fp ) fclose( fp );
+
+		if( size != q2lb_get64( p ) || mtime != (int64_t)q2lb_get64( p + 8 ) ) return FALSE;
+	}
+
+	return TRUE;
+}
+
+// Checks every record before anything is added, so a damaged image loads nothing.
+static qboolean banImageValid( const unsigned char * records, uint32_t numBans, uint32_t numChatBans, const char * table, uint32_t length )
+{
+	const unsigned char * p = records;
+	uint32_t              i;
+
+	for( i = 0; i < numBans; ++i, p += Q2B_BAN_SIZE )
+	{
+		if( p[0] < NICKALL || p[0] > NICKBLANK || p[2] > 32 ) return FALSE;
+
+		if( !banImageString( table, length, q2lb_get32( p + 8 ), sizeof( ( (baninfo_t *)0 )->nick ) ) ||
+		    !banImageString( table, length, q2lb_get32( p + 12 ), sizeof( ( (baninfo_t *)0 )->password ) ) ||
+		    !banImageString( table, length, q2lb_get32( p + 16 ), sizeof( buffer2 ) ) )
+			return FALSE;
+	}
+
+	for( i = 0; i < numChatBans; ++i, p += Q2B_CHATBAN_SIZE )
+	{
+		if( p[0] < CHATLIKE || p[0] > CHATRE ) return FALSE;
+
+		if( !banImageString( table, length, q2lb_get32( p + 4 ), sizeof( ( (chatbaninfo_t *)0 )->chat ) ) ||
+		    !banImageString( table, length, q2lb_get32( p + 8 ), sizeof( buffer2 ) ) )
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void banImageLoad( const unsigned char * records, uint32_t numBans, uint32_t numChatBans, const char * table )
+{
+	const unsigned char * p = records;
+	baninfo_t *           entry;
+	chatbaninfo_t *       centry;
+	uint32_t              i;
+
+	for( i = 0; i < numBans; ++i, p += Q2B_BAN_SIZE )
+	{
+		entry = gi.TagMalloc( sizeof( baninfo_t ), TAG_LEVEL );
+		q2a_memset( entry, 0x0, sizeof( baninfo_t ) );
+
+		entry->loadType                          = LT_PERM;
+		entry->type                              = p[0];
+		entry->exclude                           = p[1] ? TRUE : FALSE;
+		entry->subnetmask                        = p[2];
+		entry->floodinfo.chatFloodProtect        = p[3] ? TRUE : FALSE;
+		entry->maxnumberofconnects               = (int32_t)q2lb_get32( p + 20 );
+		entry->floodinfo.chatFloodProtectNum     = (int32_t)q2lb_get32( p + 24 );
+		entry->floodinfo.chatFloodProtectSec     = (int32_t)q2lb_get32( p + 28 );
+		entry->floodinfo.chatFloodProtectSilence = (int32_t)q2lb_get32( p + 32 );
+		memcpy( entry->ip, p + 4, 4 );
+		q2a_strcpy( entry->nick, table + q2lb_get32( p + 8 ) );
+		q2a_strcpy( entry->password, table + q2lb_get32( p + 12 ) );
+		entry->msg = banImageCopyMsg( table + q2lb_get32( p + 16 ) );
+		entry->expires   = (time_t)q2lb_get64( p + 40 );
+		if( entry->expires ) entry->timeout = banStoreTimeout( entry->expires );
+		if( ( entry->storeid = q2lb_get32( p + 36 ) ) != 0 ) entry->store = banLoadStore;
+		addBan( entry );
+	}
+
+	for( i = 0; i < numChatBans; ++i, p += Q2B_CHATBAN_SIZE )
+	{
+		centry = gi.TagMalloc( sizeof( chatbaninfo_t ), TAG_LEVEL );
+		q2a_memset( centry, 0x0, sizeof( chatbaninfo_t ) );
+
+		centry->loadType = LT_PERM;
+		centry->type     = p[0];
+		q2a_strcpy( centry->chat, table + q2lb_get32( p + 4 ) );
+		centry->msg = banImageCopyMsg( table + q2lb_get32( p + 8 ) );
+		if( ( centry->storeid = q2lb_get32( p + 12 ) ) != 0 ) centry->store = banLoadStore;
+		addChatBan( centry );
+	}
+}
+
+// Loads "<bfname>.bin" in place of bfname. Returns FALSE, having added nothing,
+// if there is no usable image and the text has to be read instead.
+qboolean ReadBanImage( char * bfname )
+{
+	const unsigned char * image;
+	const char *          table;
+	uint32_t              numSources, numBans, numChatBans, length;
+	size_t                records;
+	uint64_t              tableOffset;
+	struct stat           st;
+	char                  imagename[MAX_OSPATH];
+	FILE *                fp;
+	qboolean              ret = FALSE;
+
+	snprintf( imagename, sizeof( imagename ), "%s.bin", bfname );
+	if( ( fp = q2a_fopen( imagename, 0, "rb" ) ) == NULL ) return FALSE;
+
+	if( fstat( fileno( fp ), &st ) != 0 || st.st_size < Q2B_HEADER_SIZE || (uint64_t)st.st_size > UINT32_MAX )
+	{
+		fclose( fp );
+		return FALSE;
+	}
+
+#if defined( WIN32 )
+	image = malloc( (size_t)st.st_size );
+	if( image && fread( (void *)image, 1, (size_t)st.st_size, fp ) != (size_t)st.st_size )
+	{
+		free( (void *)image );
+		image = NULL;
+	}
+#else
+	image = mmap( NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fileno( fp ), 0 );
+	if( image == MAP_FAILED ) image = NULL;
+#endif
+
+	fclose( fp );
+
+	if( !image ) return FALSE;
+
+	numSources  = q2lb_get16( image + 6 );
+	numBans     = q2lb_get32( image + 8 );
+	numChatBans = q2lb_get32( image + 12 );
+	length      = q2lb_get32( image + 16 );
+	records     = Q2B_HEADER_SIZE + (size_t)numSources * Q2B_SOURCE_SIZE;
+	tableOffset = (uint64_t)records + (uint64_t)numBans * Q2B_BAN_SIZE + (uint64_t)numChatBans * Q2B_CHATBAN_SIZE;
+	table       = ( tableOffset < (uint64_t)st.st_size ) ? (const char *)image + tableOffset : NULL;
+
+	if( memcmp( image, Q2B_MAGIC, 4 ) || q2lb_get16( image + 4 ) != Q2B_VERSION || !numSources || !table || tableOffset + length != (uint64_t)st.st_size ||
+	    table[length - 1] != 0 || !banImageValid( image + records, numBans, numChatBans, table, length ) )
+	{
+		gi.dprintf( "WARNING: ban image %s is damaged, reading %s instead\n", imagename, bfname );
+	}
+	else if( !banImageCurrent( image + Q2B_HEADER_SIZE, (int)numSources, table, length, bfname ) )
+	{
+		gi.dprintf( "Ban image %s is out of date, reading %s instead\n", imagename, bfname );
+	}
+	else
+	{
+		banImageLoad( image + records, numBans, numChatBans, table );
+		banLoadLines = q2lb_get32( image + 20 );
+		ret = TRUE;
+	}
+
+#if defined( WIN32 )
+	free( (void *)image );
+#else
+	munmap( (void *)image, (size_t)st.st_size );
+#endif
+
+	return ret;
+}
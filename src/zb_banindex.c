@@ -0,0 +1,661 @@
+/*-------------------------------
+# SPDX-License-Identifier: ISC
+#
+# Copyright © 2022 Daniel Wolf <<nephatrine@gmail.com>>
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+# REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+# AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+# INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+# LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+# OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+# -----------------------------*/
+
+#include "g_local.h"
+#include "zb_ahocorasick.h"
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Ban lookup index. banhead stays the list that is displayed, numbered and
+// saved, and its order (newest first, so descending bannum) is what decides
+// which rule wins. Every entry is also filed in exactly one place here:
+//
+//   - bans with an IP or subnet go in a path-compressed binary trie keyed on
+//     the masked address, one node per distinct prefix
+//   - exact name bans go in a hash table keyed on the case-folded name
+//   - NAME LIKE bans go in one Aho-Corasick matcher over all their patterns
+//   - everything else stays on a sequential list
+//
+// A lookup collects the candidates that could match the client from each
+// place and keeps the one with the highest bannum, which is the one the old
+// list walk would have stopped at.
+//
+// Timed bans are also kept in a min-heap on their timeout and deleted from
+// G_RunFrame a few at a time, so lookups only have to step over them.
+//
+// Chat bans get the same treatment with just the matcher, for LIKE rules, and
+// the sequential list.
+//
+// Lookups are cached by address and case-folded name, since the same players
+// reconnect on every map change. Every change to the indexed bans bumps
+// banGeneration, which makes all cached results stale at once.
+
+typedef struct banipnode_s
+{
+	uint32_t             prefix; // address with the bits past the prefix cleared
+	int                  bits;   // prefix length, 0-32
+	struct banipnode_s * child[2];
+	baninfo_t *          bans; // entries with exactly this prefix, newest first
+} banipnode_t;
+
+static banipnode_t * banipRoot = NULL;
+static baninfo_t **  banNickTable = NULL;
+static unsigned int  banNickSize  = 0; // buckets, a power of two
+static unsigned int  banNickCount = 0;
+static q2ac_t *      banLike      = NULL;
+static baninfo_t *   banOthers    = NULL;
+
+static baninfo_t ** banHeap      = NULL; // timed bans, soonest timeout on top
+static int          banHeapCount = 0;
+static int          banHeapSize  = 0;
+
+#define BAN_EXPIRE_PER_FRAME 16
+
+#define BAN_CACHE_SETS 64 // of BAN_CACHE_WAYS entries each, least recently used replaced
+#define BAN_CACHE_WAYS 4
+
+typedef struct
+{
+	uint32_t    generation; // banGeneration when filled, 0 for empty
+	uint32_t    used;       // banCacheClock when last used
+	uint32_t    address;
+	int         enabled; // IPBanning_Enable and NickBanning_Enable when filled
+	char        name[16]; // upper case
+	baninfo_t * entry;    // what the lookup found, NULL for nothing
+} bancache_t;
+
+static bancache_t banCache[BAN_CACHE_SETS][BAN_CACHE_WAYS];
+static uint32_t   banGeneration = 1;
+static uint32_t   banCacheClock = 0;
+
+static q2ac_t *        chatbanLike   = NULL;
+static chatbaninfo_t * chatbanOthers = NULL;
+
+static uint32_t banMask( int bits ) { return bits ? 0xFFFFFFFFu << ( 32 - bits ) : 0; }
+static int      banBit( uint32_t address, int bit ) { return ( address >> ( 31 - bit ) ) & 1; }
+
+static uint32_t banAddress( const byte * ip ) { return ( (uint32_t)ip[0] << 24 ) | ( (uint32_t)ip[1] << 16 ) | ( (uint32_t)ip[2] << 8 ) | ip[3]; }
+
+static int banCommonBits( uint32_t a, uint32_t b, int limit )
+{
+	uint32_t diff = a ^ b;
+	int      bits = 0;
+
+	while( bits < limit && !( diff & ( 0x80000000u >> bits ) ) ) bits++;
+
+	return bits;
+}
+
+static banipnode_t * banipNode( uint32_t prefix, int bits )
+{
+	banipnode_t * node = gi.TagMalloc( sizeof( banipnode_t ), TAG_LEVEL );
+
+	q2a_memset( node, 0, sizeof( *node ) );
+	node->prefix = prefix;
+	node->bits   = bits;
+	return node;
+}
+
+// finds or makes the node for prefix/bits
+static banipnode_t * banipInsert( uint32_t prefix, int bits )
+{
+	banipnode_t ** link = &banipRoot;
+	banipnode_t *  node, *split;
+	int            common;
+
+	prefix &= banMask( bits );
+
+	while( ( node = *link ) != NULL )
+	{
+		common = banCommonBits( prefix, node->prefix, bits < node->bits ? bits : node->bits );
+
+		if( common < node->bits )
+		{
+			if( common == bits )
+			{
+				// the new prefix sits above this node
+				split                                      = banipNode( prefix, bits );
+				split->child[banBit( node->prefix, bits )] = node;
+				*link                                      = split;
+				return split;
+			}
+
+			// the two part ways below a branch point that has no bans of its own
+			split                                        = banipNode( prefix & banMask( common ), common );
+			split->child[banBit( node->prefix, common )] = node;
+			*link                                        = split;
+			link                                         = &split->child[banBit( prefix, common )];
+			break;
+		}
+
+		if( node->bits == bits ) return node;
+
+		link = &node->child[banBit( prefix, node->bits )];
+	}
+
+	*link = banipNode( prefix, bits );
+	return *link;
+}
+
+static void banipFree( banipnode_t * node )
+{
+	if( !node ) return;
+
+	banipFree( node->child[0] );
+	banipFree( node->child[1] );
+	gi.TagFree( node );
+}
+
+//
+// Entry Lists
+//
+
+static void banListPush( baninfo_t ** head, baninfo_t * entry )
+{
+	entry->ixhead = head;
+	entry->ixprev = NULL;
+	entry->ixnext = *head;
+	if( *head ) ( *head )->ixprev = entry;
+	*head = entry;
+}
+
+//
+// Expiry Heap
+//
+
+static void banHeapSet( int slot, baninfo_t * entry )
+{
+	banHeap[slot]   = entry;
+	entry->heapslot = slot + 1;
+}
+
+static void banHeapUp( int slot )
+{
+	baninfo_t * entry = banHeap[slot];
+
+	while( slot > 0 && banHeap[( slot - 1 ) / 2]->timeout > entry->timeout )
+	{
+		banHeapSet( slot, banHeap[( slot - 1 ) / 2] );
+		slot = ( slot - 1 ) / 2;
+	}
+
+	banHeapSet( slot, entry );
+}
+
+static void banHeapDown( int slot )
+{
+	baninfo_t * entry = banHeap[slot];
+	int         child;
+
+	while( ( child = slot * 2 + 1 ) < banHeapCount )
+	{
+		if( child + 1 < banHeapCount && banHeap[child + 1]->timeout < banHeap[child]->timeout ) child++;
+		if( entry->timeout <= banHeap[child]->timeout ) break;
+
+		banHeapSet( slot, banHeap[child] );
+		slot = child;
+	}
+
+	banHeapSet( slot, entry );
+}
+
+// a ban that does not fit is still skipped by lookups once it times out, it
+// just stays on the list
+static void banHeapPush( baninfo_t * entry )
+{
+	if( banHeapCount == banHeapSize )
+	{
+		int          size = banHeapSize ? banHeapSize * 2 : 64;
+		baninfo_t ** heap = realloc( banHeap, (size_t)size * sizeof( baninfo_t * ) );
+
+		if( heap == NULL ) return;
+		banHeap     = heap;
+		banHeapSize = size;
+	}
+
+	banHeap[banHeapCount] = entry;
+	banHeapUp( banHeapCount++ );
+}
+
+static void banHeapRemove( baninfo_t * entry )
+{
+	int         slot = entry->heapslot - 1;
+	baninfo_t * last = banHeap[--banHeapCount];
+
+	entry->heapslot = 0;
+	if( last == entry ) return;
+
+	banHeapSet( slot, last );
+	banHeapUp( slot );
+	banHeapDown( last->heapslot - 1 );
+}
+
+// Deletes up to BAN_EXPIRE_PER_FRAME bans that have timed out, the rest wait
+// for the next frame.
+void banIndexExpire( void )
+{
+	int count;
+
+	for( count = 0; count < BAN_EXPIRE_PER_FRAME && banHeapCount && banHeap[0]->timeout < ltime; count++ )
+	{
+		Q2S_INC( Q2S_BAN_EXPIRED );
+		if( banHeap[0]->store ) banStoreRemove( banHeap[0]->store, banHeap[0]->storeid, TRUE );
+		removeBan( banHeap[0] );
+	}
+}
+
+//
+// Name Table
+//
+
+// FNV-1a over the name folded the same way Q_stricmp folds it
+static uint32_t banNickHash( const char * name )
+{
+	uint32_t hash = 2166136261u;
+
+	while( *name ) hash = ( hash ^ (unsigned char)tolower( (unsigned char)*name++ ) ) * 16777619u;
+
+	return hash;
+}
+
+static baninfo_t ** banNickBucket( const char * name ) { return &banNickTable[banNickHash( name ) & ( banNickSize - 1 )]; }
+
+// doubles the table, keeping every bucket newest first
+static void banNickGrow( void )
+{
+	baninfo_t ** old     = banNickTable;
+	unsigned int oldsize = banNickSize, i;
+	baninfo_t *  entry;
+
+	banNickSize  = oldsize ? oldsize * 2 : 64;
+	banNickTable = gi.TagMalloc( banNickSize * sizeof( baninfo_t * ), TAG_LEVEL );
+	q2a_memset( banNickTable, 0, banNickSize * sizeof( baninfo_t * ) );
+
+	for( i = 0; i < oldsize; i++ )
+	{
+		// push oldest first so the newest ends up in front again
+		for( entry = old[i]; entry && entry->ixnext; entry = entry->ixnext ) {}
+
+		while( entry )
+		{
+			baninfo_t * prev = entry->ixprev;
+
+			banListPush( banNickBucket( entry->nick ), entry );
+			entry = prev;
+		}
+	}
+
+	if( old ) gi.TagFree( old );
+}
+
+// files a NAME LIKE ban in the matcher, FALSE when out of memory
+static qboolean banLikeAdd( baninfo_t * entry )
+{
+	if( !banLike && ( banLike = q2ac_create() ) == NULL ) return FALSE;
+
+	return q2ac_add( banLike, entry->nick, entry->bannum, entry ) ? TRUE : FALSE;
+}
+
+// forgets every cached lookup
+static void banCacheInvalidate( void )
+{
+	if( ++banGeneration == 0 ) banGeneration = 1;
+}
+
+void banIndexAdd( baninfo_t * entry )
+{
+	banCacheInvalidate();
+
+	if( entry->timeout ) banHeapPush( entry );
+
+	// a mask past /32 never matched anything, so it is not filed at all
+	if( entry->subnetmask > 32 ) return;
+
+	if( entry->subnetmask )
+		banListPush( &banipInsert( banAddress( entry->ip ), entry->subnetmask )->bans, entry );
+	else if( entry->type == NICKEQ )
+	{
+		if( banNickCount >= banNickSize ) banNickGrow();
+
+		banListPush( banNickBucket( entry->nick ), entry );
+		banNickCount++;
+	}
+	else if( entry->type != NICKLIKE || !banLikeAdd( entry ) )
+		banListPush( &banOthers, entry );
+}
+
+void banIndexRemove( baninfo_t * entry )
+{
+	banCacheInvalidate();
+
+	if( entry->heapslot ) banHeapRemove( entry );
+
+	if( !entry->ixhead )
+	{
+		if( banLike && entry->type == NICKLIKE && !entry->subnetmask ) q2ac_remove( banLike, entry->nick, entry );
+		return;
+	}
+
+	if( entry->ixprev )
+		entry->ixprev->ixnext = entry->ixnext;
+	else
+		*entry->ixhead = entry->ixnext;
+
+	if( entry->ixnext ) entry->ixnext->ixprev = entry->ixprev;
+
+	if( entry->type == NICKEQ && !entry->subnetmask ) banNickCount--;
+
+	entry->ixhead = NULL;
+	entry->ixprev = entry->ixnext = NULL;
+}
+
+// Empty trie nodes are kept until the lists are reloaded, a prefix that was
+// banned once tends to be banned again.
+void banIndexClear( void )
+{
+	banCacheInvalidate();
+
+	banipFree( banipRoot );
+	banipRoot = NULL;
+
+	if( banNickTable ) gi.TagFree( banNickTable );
+	banNickTable = NULL;
+	banNickSize = banNickCount = 0;
+
+	q2ac_destroy( banLike );
+	banLike = NULL;
+
+	banHeapCount = 0;
+
+	banOthers = NULL;
+}
+
+//
+// Lookup
+//
+
+// Compiles an RE ban pattern the way ReadBanFile does. Bans loaded from a
+// compiled image come without one until they are first tested.
+static regex_t * banCompileRE( const char * pattern )
+{
+	char      strbuffer[256];
+	regex_t * r;
+
+	q2a_strcpy( strbuffer, pattern );
+	q_strupr( strbuffer );
+	r = gi.TagMalloc( sizeof( *r ), TAG_LEVEL );
+	q2a_memset( r, 0x0, sizeof( *r ) );
+	if( regcomp( r, strbuffer, 0 ) )
+	{
+		gi.TagFree( r );
+		return NULL;
+	}
+
+	return r;
+}
+
+// whether entry applies to client, the per-entry test the list walk used
+static qboolean banMatches( baninfo_t * entry, int client )
+{
+	char strbuffer[256];
+
+	if( entry->type == NOTUSED ) return FALSE;
+
+	if( entry->type != NICKALL )
+	{
+		if( !NickBanning_Enable ) return FALSE;
+
+		switch( entry->type )
+		{
+		case NICKEQ:
+			if( Q_stricmp( proxyinfo[client].name, entry->nick ) ) return FALSE;
+			break;
+
+		case NICKLIKE:
+			if( !stringContains( proxyinfo[client].name, entry->nick ) ) return FALSE;
+			break;
+
+		case NICKRE:
+			if( !entry->r && ( entry->r = banCompileRE( entry->nick ) ) == NULL ) return FALSE;
+
+			q2a_strcpy( strbuffer, proxyinfo[client].name );
+			q_strupr( strbuffer );
+			if( q2a_regexec( entry->r, strbuffer ) == REG_NOMATCH ) return FALSE;
+			break;
+
+		case NICKBLANK:
+			if( !isBlank( proxyinfo[client].name ) ) return FALSE;
+			break;
+		}
+	}
+
+	// the trie only hands out entries whose prefix covers the address
+	if( entry->subnetmask && !IPBanning_Enable ) return FALSE;
+
+	return TRUE;
+}
+
+// Walks one newest-first list until it reaches an entry older than best or one
+// that matches. Timed out bans that banIndexExpire has not got to are skipped.
+static baninfo_t * banScan( baninfo_t * entry, baninfo_t * best, int client )
+{
+	for( ; entry; entry = entry->ixnext )
+	{
+		if( best && entry->bannum < best->bannum ) break;
+
+		Q2S_INC( Q2S_BAN_SCANNED );
+
+		if( entry->timeout && entry->timeout < ltime ) continue;
+
+		if( banMatches( entry, client ) ) return entry;
+	}
+
+	return best;
+}
+
+// The matcher only hands out the newest NAME LIKE ban that matches, so one that
+// has timed out is deleted early, which costs no more than in banIndexExpire,
+// and the search run again.
+static baninfo_t * banLikeScan( baninfo_t * best, int client )
+{
+	baninfo_t * entry;
+
+	while( ( entry = q2ac_search( banLike, proxyinfo[client].name ) ) != NULL )
+	{
+		if( best && entry->bannum < best->bannum ) break;
+
+		Q2S_INC( Q2S_BAN_SCANNED );
+
+		if( entry->timeout && entry->timeout < ltime )
+		{
+			removeBan( entry );
+			continue;
+		}
+
+		return entry;
+	}
+
+	return best;
+}
+
+static baninfo_t * banIndexSearch( int client )
+{
+	baninfo_t *   best = NULL;
+	banipnode_t * node;
+	uint32_t      address;
+
+	if( IPBanning_Enable )
+	{
+		address = banAddress( proxyinfo[client].ipaddressBinary );
+
+		for( node = banipRoot; node; node = node->child[banBit( address, node->bits )] )
+		{
+			if( ( address ^ node->prefix ) & banMask( node->bits ) ) break;
+
+			best = banScan( node->bans, best, client );
+
+			if( node->bits == 32 ) break;
+		}
+	}
+
+	if( NickBanning_Enable && banNickCount ) best = banScan( *banNickBucket( proxyinfo[client].name ), best, client );
+
+	if( NickBanning_Enable && banLike ) best = banLikeScan( best, client );
+
+	return banScan( banOthers, best, client );
+}
+
+baninfo_t * banIndexLookup( int client )
+{
+	bancache_t * set, *slot;
+	uint32_t     address = banAddress( proxyinfo[client].ipaddressBinary );
+	int          enabled = ( IPBanning_Enable ? 1 : 0 ) | ( NickBanning_Enable ? 2 : 0 );
+	char         name[sizeof( slot->name )];
+	int          i;
+
+	q2a_strncpy( name, proxyinfo[client].name, sizeof( name ) - 1 );
+	name[sizeof( name ) - 1] = 0;
+	q_strupr( name );
+
+	set  = banCache[( banNickHash( name ) ^ address * 2654435761u ) & ( BAN_CACHE_SETS - 1 )];
+	slot = &set[0];
+
+	for( i = 0; i < BAN_CACHE_WAYS; ++i )
+	{
+		if( set[i].generation == banGeneration && set[i].address == address && set[i].enabled == enabled && !strcmp( set[i].name, name ) )
+		{
+			// a timed ban that has run out but not been reaped yet is looked up again
+			if( set[i].entry && set[i].entry->timeout && set[i].entry->timeout < ltime ) break;
+
+			Q2S_INC( Q2S_BAN_CACHE_HITS );
+			set[i].used = ++banCacheClock;
+			return set[i].entry;
+		}
+
+		if( slot->generation == banGeneration && ( set[i].generation != banGeneration || set[i].used < slot->used ) ) slot = &set[i];
+	}
+
+	if( i < BAN_CACHE_WAYS ) slot = &set[i];
+
+	// a NAME LIKE ban that has run out is deleted during the search, so the
+	// generation is only read once it is done
+	slot->entry      = banIndexSearch( client );
+	slot->generation = banGeneration;
+	slot->used       = ++banCacheClock;
+	slot->address    = address;
+	slot->enabled    = enabled;
+	strcpy( slot->name, name );
+
+	return slot->entry;
+}
+
+//
+// Chat Bans
+//
+
+void chatbanIndexAdd( chatbaninfo_t * entry )
+{
+	entry->ixhead = NULL;
+
+	if( entry->type == CHATLIKE )
+	{
+		if( !chatbanLike ) chatbanLike = q2ac_create();
+
+		if( chatbanLike && q2ac_add( chatbanLike, entry->chat, entry->bannum, entry ) ) return;
+	}
+
+	entry->ixhead = &chatbanOthers;
+	entry->ixprev = NULL;
+	entry->ixnext = chatbanOthers;
+	if( chatbanOthers ) chatbanOthers->ixprev = entry;
+	chatbanOthers = entry;
+}
+
+void chatbanIndexRemove( chatbaninfo_t * entry )
+{
+	if( !entry->ixhead )
+	{
+		if( chatbanLike ) q2ac_remove( chatbanLike, entry->chat, entry );
+		return;
+	}
+
+	if( entry->ixprev )
+		entry->ixprev->ixnext = entry->ixnext;
+	else
+		*entry->ixhead = entry->ixnext;
+
+	if( entry->ixnext ) entry->ixnext->ixprev = entry->ixprev;
+
+	entry->ixhead = NULL;
+	entry->ixprev = entry->ixnext = NULL;
+}
+
+void chatbanIndexClear( void )
+{
+	q2ac_destroy( chatbanLike );
+	chatbanLike   = NULL;
+	chatbanOthers = NULL;
+}
+
+// the first chat ban in list order that txt falls foul of, if any
+chatbaninfo_t * chatbanIndexLookup( char * txt )
+{
+	chatbaninfo_t * best = NULL, *entry;
+	char            strbuffer[4096];
+	qboolean        folded = FALSE;
+
+	if( chatbanLike )
+	{
+		Q2S_INC( Q2S_CHATBAN_SCANNED );
+		best = q2ac_search( chatbanLike, txt );
+	}
+
+	for( entry = chatbanOthers; entry; entry = entry->ixnext )
+	{
+		if( best && entry->bannum < best->bannum ) break;
+
+		Q2S_INC( Q2S_CHATBAN_SCANNED );
+
+		switch( entry->type )
+		{
+		case CHATLIKE:
+			if( stringContains( txt, entry->chat ) ) return entry;
+			break;
+
+		case CHATRE:
+			if( !entry->r && ( entry->r = banCompileRE( entry->chat ) ) == NULL ) break;
+
+			if( !folded )
+			{
+				q2a_strcpy( strbuffer, txt );
+				q_strupr( strbuffer );
+				folded = TRUE;
+			}
+
+			if( q2a_regexec( entry->r, strbuffer ) != REG_NOMATCH ) return entry;
+			break;
+
+		default:
+			return entry;
+		}
+	}
+
+	return best;
+}
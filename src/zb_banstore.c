@@ -0,0 +1,821 @@
+/*-------------------------------
+# SPDX-License-Identifier: ISC
+#
+# Copyright © 2022 Daniel Wolf <<nephatrine@gmail.com>>
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+# REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+# AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+# INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+# LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+# OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+# -----------------------------*/
+
+#ifdef USE_PTHREADS
+#	define _GNU_SOURCE
+#endif
+
+#include "g_local.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#if defined( WIN32 )
+#	include <io.h>
+#	include <process.h>
+#	include <sys/locking.h>
+#else
+#	include <sys/file.h>
+#	include <unistd.h>
+#endif
+
+#ifdef USE_PTHREADS
+#	include <pthread.h>
+#endif
+
+// Ban store. SAVE, delban, delchatban and saved TIME bans running out are
+// recorded in "<banfile>.journal" next to the ban file they belong to, by a
+// background thread, so they last across map changes and restarts without
+// the game thread touching the disk. Once the journal holds banjournal_compact
+// records the thread folds it back into the ban file and renames that into
+// place.
+//
+// A ban is named by banStoreId, a hash of its line as the file has it, so the
+// name means the same to every server sharing the file and still holds after
+// the file has been edited by hand. Every record is tagged with the server and
+// change that wrote it:
+//
+//   ;SAVE <tag>                     the next line is a saved ban
+//   BAN: ... / CHATBAN: ...
+//   ;DELETE <id> <time> <tag>       delban or delchatban
+//   ;EXPIRE <id> <time> <tag>       a saved TIME ban ran out
+//
+// A delete drops the bans with that id on the lines before it, so a ban saved
+// again afterwards stays. Compacting comments the deleted lines out and
+// appends the journal as it is. The journal is only a valid ban file with
+// comments, so it is read back the same way.
+//
+// Servers sharing a ban file hold an flock() on "<banfile>.lock" while they
+// append to the journal or compact it, and count its records under the lock,
+// so their changes neither interleave nor get lost. Loading takes no lock and
+// does not wait for the thread: compacting only ever renames a complete file
+// into place, the tags tell which records a file already holds, and changes
+// the thread has not written yet are read from its queue.
+
+int  banjournal_compact = 100; // journal records before it is folded into the ban file, 0 for never
+byte banLoadStore       = BANSTORE_NONE; // store the ban file being read belongs to
+long banLoadLineBase    = 0;             // added to its line numbers
+long banLoadLines       = 0;             // lines in the last file read for a store
+
+#define BANSTORE_COUNT 3
+#define BANSTORE_TAG 48
+
+typedef struct
+{
+	char path[MAX_OSPATH]; // the ban file as it is opened
+	long lines;            // lines loaded, the ban file's then the journal's
+} banstore_t;
+
+static banstore_t    banStores[BANSTORE_COUNT];
+static unsigned long banStoreStarted; // time of the first change
+static unsigned long banStoreSerial;  // changes made since
+
+enum
+{
+	BANSTORE_JOB_APPEND,
+	BANSTORE_JOB_COMPACT
+};
+
+typedef struct banstorejob_s
+{
+	struct banstorejob_s * next;
+	int                    store;
+	int                    kind;
+	char                   path[MAX_OSPATH]; // the store's ban file when it was queued
+	char                   tag[BANSTORE_TAG];
+	char                   text[1];
+} banstorejob_t;
+
+typedef struct
+{
+	unsigned long id;
+	long          line; // the last line it is deleted on
+} banstoredelete_t;
+
+static void banStoreJournalPath( const char * banfile, char * path, size_t size ) { snprintf( path, size, "%s.journal", banfile ); }
+
+// FNV-1a over a ban line without the blanks around it, never 0
+unsigned long banStoreId( const char * line )
+{
+	const char * end;
+	uint32_t     hash = 2166136261u;
+
+	while( *line == ' ' || *line == '\t' ) ++line;
+	for( end = line + strlen( line ); end > line && isspace( (unsigned char)end[-1] ); --end )
+		;
+
+	for( ; line < end; ++line )
+	{
+		hash ^= (unsigned char)*line;
+		hash *= 16777619u;
+	}
+
+	return hash ? hash : 1;
+}
+
+static const char * banStoreNextLine( const char * cp )
+{
+	cp = strchr( cp, '\n' );
+	return cp ? cp + 1 : NULL;
+}
+
+// lines as ReadBanFile numbers them
+static long banStoreCountLines( const char * text, size_t length )
+{
+	long         lines = 0;
+	const char * cp;
+
+	if( !text || !length ) return 0;
+
+	for( cp = text; ( cp = strchr( cp, '\n' ) ) != NULL; ++cp ) ++lines;
+
+	return lines + ( text[length - 1] != '\n' );
+}
+
+// whole file in a malloc'd buffer with a terminating 0, NULL if it can't be read
+static char * banStoreReadAll( const char * path, size_t * length )
+{
+	FILE * fp = fopen( path, "rb" );
+	char * data;
+	long   size;
+
+	*length = 0;
+	if( !fp ) return NULL;
+
+	if( fseek( fp, 0, SEEK_END ) != 0 || ( size = ftell( fp ) ) < 0 || fseek( fp, 0, SEEK_SET ) != 0 || ( data = malloc( (size_t)size + 1 ) ) == NULL )
+	{
+		fclose( fp );
+		return NULL;
+	}
+
+	*length = fread( data, 1, (size_t)size, fp );
+	data[*length] = 0;
+	fclose( fp );
+	return data;
+}
+
+static qboolean banStoreIsRecord( const char * cp ) { return !strncmp( cp, ";SAVE ", 6 ) || !strncmp( cp, ";DELETE ", 8 ) || !strncmp( cp, ";EXPIRE ", 8 ); }
+
+static int banStoreRecords( const char * journal )
+{
+	const char * cp;
+	int          count = 0;
+
+	for( cp = journal; cp && *cp; cp = banStoreNextLine( cp ) )
+		if( banStoreIsRecord( cp ) ) ++count;
+
+	return count;
+}
+
+// the tag of the journal's last record, FALSE if it has none
+static qboolean banStoreLastTag( const char * journal, char * tag )
+{
+	const char *cp, *end, *start;
+	qboolean    found = FALSE;
+
+	for( cp = journal; cp && *cp; cp = banStoreNextLine( cp ) )
+	{
+		if( !banStoreIsRecord( cp ) ) continue;
+
+		for( end = cp; *end && *end != '\n'; ++end )
+			;
+		while( end > cp && isspace( (unsigned char)end[-1] ) ) --end;
+		for( start = end; start > cp && start[-1] != ' '; --start )
+			;
+
+		if( start > cp && end > start && end - start < BANSTORE_TAG )
+		{
+			memcpy( tag, start, (size_t)( end - start ) );
+			tag[end - start] = 0;
+			found            = TRUE;
+		}
+	}
+
+	return found;
+}
+
+// whether a record with the tag has been written to text
+static qboolean banStoreHasTag( const char * text, const char * tag )
+{
+	char needle[BANSTORE_TAG + 2];
+
+	if( !text ) return FALSE;
+
+	snprintf( needle, sizeof( needle ), " %s\n", tag );
+	return strstr( text, needle ) != NULL;
+}
+
+// whether the ban file already holds the journal, left over from a compaction
+// that renamed the file but was stopped before removing it, or one that
+// happened while the journal was being read
+static qboolean banStoreAbsorbed( const char * file, const char * journal )
+{
+	char tag[BANSTORE_TAG];
+
+	return file && banStoreLastTag( journal, tag ) && banStoreHasTag( file, tag );
+}
+
+static int banStoreCompareDeletes( const void * a, const void * b )
+{
+	unsigned long x = ( (const banstoredelete_t *)a )->id, y = ( (const banstoredelete_t *)b )->id;
+
+	return ( x > y ) - ( x < y );
+}
+
+// the ids text deletes, sorted, each with the last line it is deleted on,
+// counting text's lines after base
+static banstoredelete_t * banStoreDeletes( const char * text, long base, int * count )
+{
+	const char *       cp;
+	banstoredelete_t * deletes = NULL;
+	int                size    = 0, i, n;
+	unsigned long      id;
+	long               line = base;
+
+	*count = 0;
+
+	for( cp = text; cp && *cp; cp = banStoreNextLine( cp ) )
+	{
+		++line;
+		if( sscanf( cp, ";DELETE %lx", &id ) != 1 && sscanf( cp, ";EXPIRE %lx", &id ) != 1 ) continue;
+
+		if( *count >= size )
+		{
+			banstoredelete_t * grown = realloc( deletes, ( size ? size * 2 : 64 ) * sizeof( *deletes ) );
+
+			if( !grown ) break;
+
+			deletes = grown;
+			size    = size ? size * 2 : 64;
+		}
+
+		deletes[*count].id   = id;
+		deletes[*count].line = line;
+		++*count;
+	}
+
+	if( !*count ) return deletes;
+
+	qsort( deletes, *count, sizeof( *deletes ), banStoreCompareDeletes );
+
+	for( i = 1, n = 1; i < *count; ++i )
+	{
+		if( deletes[i].id != deletes[n - 1].id )
+			deletes[n++] = deletes[i];
+		else if( deletes[i].line > deletes[n - 1].line )
+			deletes[n - 1].line = deletes[i].line;
+	}
+	*count = n;
+
+	return deletes;
+}
+
+// whether a ban with id on line is deleted by a later line
+static qboolean banStoreDeleted( const banstoredelete_t * deletes, int count, unsigned long id, long line )
+{
+	banstoredelete_t         key;
+	const banstoredelete_t * found;
+
+	if( !count || !id ) return FALSE;
+
+	key.id = id;
+	found  = bsearch( &key, deletes, count, sizeof( *deletes ), banStoreCompareDeletes );
+	return found && found->line > line;
+}
+
+// A tag is the time of the first change, the process and a serial, so a
+// server forked after its first change still writes tags of its own.
+static void banStoreNextTag( char * tag )
+{
+	if( !banStoreStarted ) banStoreStarted = (unsigned long)time( NULL );
+
+#if defined( WIN32 )
+	snprintf( tag, BANSTORE_TAG, "%lx.%lx.%lx", banStoreStarted, (unsigned long)_getpid(), ++banStoreSerial );
+#else
+	snprintf( tag, BANSTORE_TAG, "%lx.%lx.%lx", banStoreStarted, (unsigned long)getpid(), ++banStoreSerial );
+#endif
+}
+
+//
+// Thread Side
+//
+
+static void banStoreSyncFile( FILE * fp )
+{
+	fflush( fp );
+#if defined( WIN32 )
+	_commit( _fileno( fp ) );
+#else
+	fsync( fileno( fp ) );
+#endif
+}
+
+// Takes the lock servers sharing the ban file write it under. Returns the
+// descriptor to give banStoreUnlock, -1 if the lock file can't be opened and
+// the change is made without it.
+static int banStoreLock( const char * banfile )
+{
+	char path[MAX_OSPATH + 8];
+	int  fd;
+
+	snprintf( path, sizeof( path ), "%s.lock", banfile );
+
+#if defined( WIN32 )
+	if( ( fd = _open( path, _O_RDWR | _O_CREAT, _S_IREAD | _S_IWRITE ) ) >= 0 ) _locking( fd, _LK_LOCK, 1 );
+#else
+	if( ( fd = open( path, O_RDWR | O_CREAT, 0644 ) ) >= 0 )
+		while( flock( fd, LOCK_EX ) != 0 && errno == EINTR )
+			;
+#endif
+
+	return fd;
+}
+
+static void banStoreUnlock( int fd )
+{
+	if( fd < 0 ) return;
+
+#if defined( WIN32 )
+	_lseek( fd, 0, SEEK_SET );
+	_locking( fd, _LK_UNLCK, 1 );
+	_close( fd );
+#else
+	flock( fd, LOCK_UN );
+	close( fd );
+#endif
+}
+
+// copies text to fp a line at a time, commenting out the deleted bans
+static void banStoreCopyLines( FILE * fp, const char * text, long * line, const banstoredelete_t * deletes, int count )
+{
+	const char * end;
+	char         ban[256];
+	char *       cp;
+	size_t       length;
+
+	while( *text )
+	{
+		end = strchr( text, '\n' );
+		end = end ? end + 1 : text + strlen( text );
+
+		// only as much of the line as ReadBanFile reads at once
+		length = (size_t)( end - text ) < sizeof( ban ) ? (size_t)( end - text ) : sizeof( ban ) - 1;
+		memcpy( ban, text, length );
+		ban[length] = 0;
+		cp          = ban;
+		SKIPBLANK( cp );
+
+		++*line;
+		if( ( startContains( cp, "BAN:" ) || startContains( cp, "CHATBAN:" ) ) && banStoreDeleted( deletes, count, banStoreId( cp ), *line ) ) fputs( "; ", fp );
+		fwrite( text, 1, (size_t)( end - text ), fp );
+		text = end;
+	}
+}
+
+// Writes the ban file with the journal folded in to "<banfile>.tmp", renames
+// it over the ban file and removes the journal. Called with the lock held.
+static void banStoreFold( const char * banfile, const char * journal )
+{
+	char               journalpath[MAX_OSPATH + 8], tmppath[MAX_OSPATH + 8];
+	char *             file;
+	size_t             filelength;
+	banstoredelete_t * deletes;
+	int                count;
+	long               line = 0;
+	FILE *             fp;
+	qboolean           ok;
+
+	banStoreJournalPath( banfile, journalpath, sizeof( journalpath ) );
+	file = banStoreReadAll( banfile, &filelength );
+
+	if( banStoreAbsorbed( file, journal ) )
+	{
+		remove( journalpath );
+		free( file );
+		return;
+	}
+
+	deletes = banStoreDeletes( journal, banStoreCountLines( file, filelength ), &count );
+
+	snprintf( tmppath, sizeof( tmppath ), "%s.tmp", banfile );
+	ok = ( fp = fopen( tmppath, "wb" ) ) != NULL;
+	if( ok )
+	{
+		if( file ) banStoreCopyLines( fp, file, &line, deletes, count );
+		if( filelength && file[filelength - 1] != '\n' ) fputc( '\n', fp );
+		banStoreCopyLines( fp, journal, &line, deletes, count );
+
+		banStoreSyncFile( fp );
+		ok = !ferror( fp );
+		ok = ( fclose( fp ) == 0 ) && ok;
+	}
+
+#if defined( WIN32 )
+	if( ok ) remove( banfile );
+#endif
+
+	if( ok && rename( tmppath, banfile ) == 0 )
+		remove( journalpath );
+	else
+		remove( tmppath );
+
+	free( deletes );
+	free( file );
+}
+
+// folds the journal in if it holds enough records, whoever wrote them
+static void banStoreCompact( const char * banfile, qboolean always )
+{
+	char   path[MAX_OSPATH + 8];
+	char * journal;
+	size_t length;
+
+	banStoreJournalPath( banfile, path, sizeof( path ) );
+	journal = banStoreReadAll( path, &length );
+	if( !journal ) return;
+
+	if( always || ( banjournal_compact > 0 && banStoreRecords( journal ) >= banjournal_compact ) ) banStoreFold( banfile, journal );
+
+	free( journal );
+}
+
+static void banStoreRun( banstorejob_t * job )
+{
+	char   path[MAX_OSPATH + 8];
+	FILE * fp;
+	int    lock;
+
+	lock = banStoreLock( job->path );
+
+	if( job->kind == BANSTORE_JOB_APPEND )
+	{
+		banStoreJournalPath( job->path, path, sizeof( path ) );
+		if( ( fp = fopen( path, "ab" ) ) != NULL )
+		{
+			fputs( job->text, fp );
+			banStoreSyncFile( fp );
+			fclose( fp );
+		}
+
+		banStoreCompact( job->path, FALSE );
+	}
+	else
+		banStoreCompact( job->path, TRUE );
+
+	banStoreUnlock( lock );
+}
+
+#ifdef USE_PTHREADS
+
+static struct
+{
+	banstorejob_t * head; // stays on the queue until it is written
+	banstorejob_t * tail;
+	int             started;
+	int             stop;
+	pthread_t       thread;
+	pthread_mutex_t guard;
+	pthread_cond_t  wake;
+} banstore;
+
+static void * banStoreThread( void * arg )
+{
+	banstorejob_t * job;
+
+	(void)arg;
+
+	pthread_mutex_lock( &banstore.guard );
+	for( ;; )
+	{
+		if( !banstore.head )
+		{
+			if( banstore.stop ) break;
+
+			pthread_cond_wait( &banstore.wake, &banstore.guard );
+			continue;
+		}
+
+		job = banstore.head;
+		pthread_mutex_unlock( &banstore.guard );
+
+		banStoreRun( job );
+
+		pthread_mutex_lock( &banstore.guard );
+		banstore.head = job->next;
+		if( !banstore.head ) banstore.tail = NULL;
+		free( job );
+	}
+	pthread_mutex_unlock( &banstore.guard );
+
+	return NULL;
+}
+
+#endif
+
+//
+// Game Side
+//
+
+// hands a job to the thread, or does it now if there is no thread
+static void banStorePush( int store, int kind, const char * tag, const char * text )
+{
+	size_t          length = text ? strlen( text ) : 0;
+	banstorejob_t * job    = malloc( sizeof( banstorejob_t ) + length );
+
+	if( !job ) return;
+
+	job->next  = NULL;
+	job->store = store;
+	job->kind  = kind;
+	memcpy( job->path, banStores[store].path, sizeof( job->path ) );
+	snprintf( job->tag, sizeof( job->tag ), "%s", tag ? tag : "" );
+	memcpy( job->text, text ? text : "", length + 1 );
+
+#ifdef USE_PTHREADS
+	if( banstore.started )
+	{
+		pthread_mutex_lock( &banstore.guard );
+		if( banstore.tail )
+			banstore.tail->next = job;
+		else
+			banstore.head = job;
+		banstore.tail = job;
+		pthread_cond_signal( &banstore.wake );
+		pthread_mutex_unlock( &banstore.guard );
+		return;
+	}
+#endif
+
+	banStoreRun( job );
+	free( job );
+}
+
+// copies of the records for a store the thread has not written yet, oldest first
+static banstorejob_t * banStorePending( int store )
+{
+	banstorejob_t *list = NULL, **tail = &list;
+
+#ifdef USE_PTHREADS
+	banstorejob_t *job, *copy;
+	size_t         size;
+
+	if( !banstore.started ) return NULL;
+
+	pthread_mutex_lock( &banstore.guard );
+	for( job = banstore.head; job; job = job->next )
+	{
+		if( job->store != store || job->kind != BANSTORE_JOB_APPEND || strcmp( job->path, banStores[store].path ) ) continue;
+
+		size = sizeof( banstorejob_t ) + strlen( job->text );
+		if( ( copy = malloc( size ) ) == NULL ) break;
+
+		memcpy( copy, job, size );
+		copy->next = NULL;
+		*tail      = copy;
+		tail       = &copy->next;
+	}
+	pthread_mutex_unlock( &banstore.guard );
+#else
+	(void)store;
+	(void)tail;
+#endif
+
+	return list;
+}
+
+// Saves a BAN: or CHATBAN: line to the store and returns the id the new ban
+// has there, or 0 if the store has no ban file.
+unsigned long banStoreAdd( int store, char * line )
+{
+	char tag[BANSTORE_TAG], text[600];
+
+	if( store <= BANSTORE_NONE || store >= BANSTORE_COUNT || !banStores[store].path[0] ) return 0;
+
+	banStoreNextTag( tag );
+	snprintf( text, sizeof( text ), ";SAVE %s\n%s\n", tag, line );
+	banStorePush( store, BANSTORE_JOB_APPEND, tag, text );
+
+	return banStoreId( line );
+}
+
+void banStoreRemove( int store, unsigned long id, qboolean expired )
+{
+	char tag[BANSTORE_TAG], text[128];
+
+	if( !id || store <= BANSTORE_NONE || store >= BANSTORE_COUNT || !banStores[store].path[0] ) return;
+
+	banStoreNextTag( tag );
+	snprintf( text, sizeof( text ), ";%s %08lx %lld %s\n", expired ? "EXPIRE" : "DELETE", id, (long long)time( NULL ), tag );
+	banStorePush( store, BANSTORE_JOB_APPEND, tag, text );
+}
+
+// ltime at which a saved TIME ban ending at expires runs out, soon if it
+// already has
+float banStoreTimeout( time_t expires )
+{
+	double left = difftime( expires, time( NULL ) );
+
+	return ltime + (float)( left > 1.0 ? left : 1.0 );
+}
+
+// drops the bans the records delete from what has been loaded
+static void banStoreApplyDeletes( int store, const banstoredelete_t * deletes, int count )
+{
+	baninfo_t *     entry, *next;
+	chatbaninfo_t * centry, *cnext, *cprev = NULL;
+
+	for( entry = banhead; entry; entry = next )
+	{
+		next = entry->next;
+		if( entry->store == store && banStoreDeleted( deletes, count, entry->storeid, entry->storeline ) ) removeBan( entry );
+	}
+
+	for( centry = chatbanhead; centry; centry = cnext )
+	{
+		cnext = centry->next;
+		if( centry->store == store && banStoreDeleted( deletes, count, centry->storeid, centry->storeline ) )
+			removeChatBan( centry, cprev );
+		else
+			cprev = centry;
+	}
+}
+
+// Reads the journal after the ban file, and then the records still queued
+// for the thread that neither has yet. Returns whether there were any.
+static qboolean banStoreReplay( int store )
+{
+	banstore_t *       s = &banStores[store];
+	char               path[MAX_OSPATH + 8];
+	char *             file, *journal, *text;
+	size_t             filelength, length, size;
+	banstorejob_t *    pending, *job, *next;
+	banstoredelete_t * deletes;
+	int                count;
+	FILE *             fp;
+
+	// taken first, so whatever is gone from the queue by then is on disk
+	pending = banStorePending( store );
+
+	banStoreJournalPath( s->path, path, sizeof( path ) );
+	journal = banStoreReadAll( path, &length );
+	if( !length && !pending )
+	{
+		free( journal );
+		return FALSE;
+	}
+
+	file = banStoreReadAll( s->path, &filelength );
+	if( length && banStoreAbsorbed( file, journal ) )
+	{
+		// the thread removes it under the lock
+		banStorePush( store, BANSTORE_JOB_COMPACT, NULL, NULL );
+		length = 0;
+	}
+
+	size = length + 2;
+	for( job = pending; job; job = job->next ) size += strlen( job->text );
+
+	if( ( text = malloc( size ) ) != NULL )
+	{
+		memcpy( text, journal ? journal : "", length );
+		if( length && text[length - 1] != '\n' ) text[length++] = '\n';
+
+		for( job = pending; job; job = job->next )
+		{
+			if( banStoreHasTag( journal, job->tag ) || banStoreHasTag( file, job->tag ) ) continue;
+
+			memcpy( text + length, job->text, strlen( job->text ) );
+			length += strlen( job->text );
+		}
+		text[length] = 0;
+	}
+
+	for( job = pending; job; job = next )
+	{
+		next = job->next;
+		free( job );
+	}
+	free( file );
+	free( journal );
+
+	if( !text || !length )
+	{
+		free( text );
+		return FALSE;
+	}
+
+	banLoadLineBase = s->lines;
+	banLoadLines    = 0;
+
+	if( ( fp = tmpfile() ) != NULL && fwrite( text, 1, length, fp ) == length && fseek( fp, 0, SEEK_SET ) == 0 )
+		ReadBanStream( fp, path );
+	else
+		gi.dprintf( "WARNING: unable to read %s, bans saved since %s was written are not loaded\n", path, s->path );
+
+	if( fp ) fclose( fp );
+
+	deletes = banStoreDeletes( text, s->lines, &count );
+	banStoreApplyDeletes( store, deletes, count );
+	s->lines += banLoadLines;
+
+	free( deletes );
+	free( text );
+	return TRUE;
+}
+
+// Reads a ban file, from its compiled image when that is current, and then
+// its journal, and makes the file the store SAVE writes to.
+qboolean banStoreLoad( int store, char * bfname )
+{
+	banstore_t * s = &banStores[store];
+	char         file[MAX_OSPATH], name[MAX_OSPATH];
+	FILE *       fp;
+	qboolean     ret;
+
+	// bfname may be the shared buffer ReadBanFile reads lines into
+	q2a_strncpy( file, bfname, sizeof( file ) - 1 );
+	file[sizeof( file ) - 1] = 0;
+
+	// SAVE creates a missing ban file in the save path, like it always has
+	strcpy( name, file );
+	if( ( fp = q2a_fopen( name, sizeof( name ), "rt" ) ) != NULL )
+	{
+		fclose( fp );
+		strcpy( s->path, name );
+	}
+	else if( snprintf( s->path, sizeof( s->path ), "%s/%s", GET_SAVEPATH_STR(), file ) >= (int)sizeof( s->path ) )
+	{
+		// cut short it would name some other file
+		gi.dprintf( "WARNING: ban file path %s/%s is too long, bans can't be saved to it\n", GET_SAVEPATH_STR(), file );
+		s->path[0] = 0;
+	}
+
+	banLoadStore    = (byte)store;
+	banLoadLineBase = 0;
+	banLoadLines    = 0;
+
+	strcpy( name, file );
+	ret      = ReadBanImage( name ) || ReadBanFile( name );
+	s->lines = banLoadLines;
+
+	if( s->path[0] && banStoreReplay( store ) ) ret = TRUE;
+
+	banLoadStore = BANSTORE_NONE;
+	return ret;
+}
+
+void banStoreInitialize()
+{
+#ifdef USE_PTHREADS
+	if( banstore.started ) return;
+
+	pthread_mutex_init( &banstore.guard, NULL );
+	pthread_cond_init( &banstore.wake, NULL );
+
+	if( pthread_create( &banstore.thread, NULL, banStoreThread, NULL ) == 0 )
+		banstore.started = 1;
+	else
+	{
+		gi.dprintf( "WARNING: unable to start ban store thread, bans are saved during the frame\n" );
+		pthread_cond_destroy( &banstore.wake );
+		pthread_mutex_destroy( &banstore.guard );
+	}
+#endif
+}
+
+void banStoreShutdown()
+{
+#ifdef USE_PTHREADS
+	if( banstore.started )
+	{
+		pthread_mutex_lock( &banstore.guard );
+		banstore.stop = 1;
+		pthread_cond_signal( &banstore.wake );
+		pthread_mutex_unlock( &banstore.guard );
+
+		// the thread writes everything still queued before it stops
+		pthread_join( banstore.thread, NULL );
+		pthread_cond_destroy( &banstore.wake );
+		pthread_mutex_destroy( &banstore.guard );
+		memset( &banstore, 0, sizeof( banstore ) );
+	}
+#endif
+}
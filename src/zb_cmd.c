@@ -157,6 +157,12 @@ zbotcmd_t zbotCommands[] =
 			NULL,
 			banRun
 		},
+		{
+			"banjournal_compact",
+			CMDWHERE_CFGFILE | CMDWHERE_CLIENTCONSOLE | CMDWHERE_SERVERCONSOLE,
+			CMDTYPE_NUMBER,
+			&banjournal_compact
+		},
 		{
 			"banonconnect",
 			CMDWHERE_CFGFILE | CMDWHERE_CLIENTCONSOLE | CMDWHERE_SERVERCONSOLE,
@@ -450,6 +456,25 @@ zbotcmd_t zbotCommands[] =
 			CMDTYPE_NUMBER,
 			&entity_classname_offset,
 		},
+		{
+			"entstats_enable",
+			CMDWHERE_CFGFILE | CMDWHERE_CLIENTCONSOLE | CMDWHERE_SERVERCONSOLE,
+			CMDTYPE_LOGICAL,
+			&entstats_enable
+		},
+		{
+			"entstats_interval",
+			CMDWHERE_CFGFILE | CMDWHERE_CLIENTCONSOLE | CMDWHERE_SERVERCONSOLE,
+			CMDTYPE_NUMBER,
+			&entstats_interval
+		},
+		{
+			"entstats",
+			CMDWHERE_CLIENTCONSOLE | CMDWHERE_SERVERCONSOLE,
+			CMDTYPE_NONE,
+			NULL,
+			entstatsRun
+		},
 		{
 			"extendedsay_enable",
 			CMDWHERE_CFGFILE | CMDWHERE_CLIENTCONSOLE | CMDWHERE_SERVERCONSOLE,
@@ -494,6 +519,24 @@ zbotcmd_t zbotCommands[] =
 			CMDTYPE_STRING,
 			hackuserdisplay
 		},		
+		{
+			"hitch_file",
+			CMDWHERE_CFGFILE | CMDWHERE_CLIENTCONSOLE | CMDWHERE_SERVERCONSOLE,
+			CMDTYPE_STRING,
+			hitch_file
+		},
+		{
+			"hitch_frames",
+			CMDWHERE_CFGFILE,	//Only allocates memory at InitGame: can only be read from config
+			CMDTYPE_NUMBER,
+			&hitch_frames
+		},
+		{
+			"hitch_threshold",
+			CMDWHERE_CFGFILE | CMDWHERE_CLIENTCONSOLE | CMDWHERE_SERVERCONSOLE,
+			CMDTYPE_NUMBER,
+			&hitch_threshold
+		},
 		{
 			"impulsestokickon",
 			CMDWHERE_CFGFILE | CMDWHERE_CLIENTCONSOLE | CMDWHERE_SERVERCONSOLE,
@@ -597,6 +640,18 @@ zbotcmd_t zbotCommands[] =
 			CMDTYPE_STRING,
 			lockoutmsg,
 		},
+		{
+			"logbuffer_block",
+			CMDWHERE_CFGFILE | CMDWHERE_CLIENTCONSOLE | CMDWHERE_SERVERCONSOLE,
+			CMDTYPE_LOGICAL,
+			&logbuffer_block
+		},
+		{
+			"logbuffer_size",
+			CMDWHERE_CFGFILE,	//Only allocates memory at InitGame: can only be read from config
+			CMDTYPE_NUMBER,
+			&logbuffer_size
+		},
 		{
 			"logevent",
 			CMDWHERE_CLIENTCONSOLE | CMDWHERE_SERVERCONSOLE,
@@ -611,6 +666,38 @@ zbotcmd_t zbotCommands[] =
 			NULL,
 			logfileRun
 		},
+		{
+			"logflush_bytes",
+			CMDWHERE_CFGFILE | CMDWHERE_CLIENTCONSOLE | CMDWHERE_SERVERCONSOLE,
+			CMDTYPE_NUMBER,
+			&logflush_bytes
+		},
+		{
+			"logflush_time",
+			CMDWHERE_CFGFILE | CMDWHERE_CLIENTCONSOLE | CMDWHERE_SERVERCONSOLE,
+			CMDTYPE_NUMBER,
+			&logflush_time
+		},
+		{
+			"logquery",
+			CMDWHERE_CLIENTCONSOLE | CMDWHERE_SERVERCONSOLE,
+			CMDTYPE_NONE,
+			NULL,
+			logqueryRun
+		},
+		{
+			"logtail_size",
+			CMDWHERE_CFGFILE,	//Only allocates memory at InitGame: can only be read from config
+			CMDTYPE_NUMBER,
+			&logtail_size
+		},
+		{
+			"logtail",
+			CMDWHERE_CLIENTCONSOLE | CMDWHERE_SERVERCONSOLE,
+			CMDTYPE_NONE,
+			NULL,
+			logtailRun
+		},
 		{
 			"lrcon_timeout",
 			CMDWHERE_CFGFILE | CMDWHERE_CLIENTCONSOLE | CMDWHERE_SERVERCONSOLE,
@@ -719,6 +806,19 @@ zbotcmd_t zbotCommands[] =
 			&numofdisplays
 		},
 
+		{
+			"perf_enable",
+			CMDWHERE_CFGFILE | CMDWHERE_CLIENTCONSOLE | CMDWHERE_SERVERCONSOLE,
+			CMDTYPE_LOGICAL,
+			&perf_enable
+		},
+		{
+			"perf",
+			CMDWHERE_CLIENTCONSOLE | CMDWHERE_SERVERCONSOLE,
+			CMDTYPE_NONE,
+			NULL,
+			perfRun
+		},
 		//r1ch 2005-01-26 disable hugely buggy commands BEGIN
 		/*{
 			"play_all_enable",
@@ -807,6 +907,13 @@ zbotcmd_t zbotCommands[] =
 			CMDTYPE_NUMBER,
 			&reconnect_time
 		},
+		{
+			"record",
+			CMDWHERE_CLIENTCONSOLE | CMDWHERE_SERVERCONSOLE,
+			CMDTYPE_NONE,
+			NULL,
+			recordRun
+		},
 		{
 			"reloadbanfile",
 			CMDWHERE_CLIENTCONSOLE | CMDWHERE_SERVERCONSOLE,
@@ -909,6 +1016,12 @@ zbotcmd_t zbotCommands[] =
 			zbotmotd,
 			zbotmotdRun,
 		},
+		{
+			"sharedstore",
+			CMDWHERE_CFGFILE,	//Only opened at InitGame: can only be read from config
+			CMDTYPE_STRING,
+			sharedstore_name
+		},
 		{
 			"skinchangefloodprotect",
 			CMDWHERE_CFGFILE | CMDWHERE_CLIENTCONSOLE | CMDWHERE_SERVERCONSOLE,
@@ -961,6 +1074,25 @@ zbotcmd_t zbotCommands[] =
 			CMDTYPE_LOGICAL,
 			&spawnentities_internal_enable
 		},
+		{
+			"stats_file",
+			CMDWHERE_CFGFILE | CMDWHERE_CLIENTCONSOLE | CMDWHERE_SERVERCONSOLE,
+			CMDTYPE_STRING,
+			stats_file
+		},
+		{
+			"stats_interval",
+			CMDWHERE_CFGFILE | CMDWHERE_CLIENTCONSOLE | CMDWHERE_SERVERCONSOLE,
+			CMDTYPE_NUMBER,
+			&stats_interval
+		},
+		{
+			"stats",
+			CMDWHERE_CLIENTCONSOLE | CMDWHERE_SERVERCONSOLE,
+			CMDTYPE_NONE,
+			NULL,
+			statsRun
+		},
 		{
 			"stuff",
 			CMDWHERE_CLIENTCONSOLE | CMDWHERE_SERVERCONSOLE,
@@ -974,6 +1106,18 @@ zbotcmd_t zbotCommands[] =
 			CMDTYPE_LOGICAL,
 			&swap_attack_use
 		},
+		{
+			"sync_address",
+			CMDWHERE_CFGFILE,	//Only connected at InitGame: can only be read from config
+			CMDTYPE_STRING,
+			sync_address
+		},
+		{
+			"sync_key",
+			CMDWHERE_CFGFILE,	//Only connected at InitGame: can only be read from config
+			CMDTYPE_STRING,
+			sync_key
+		},
 		{
 			"timescaledetect",
 			CMDWHERE_CFGFILE | CMDWHERE_CLIENTCONSOLE | CMDWHERE_SERVERCONSOLE,
@@ -1262,6 +1406,19 @@ zbotcmd_t zbotCommands[] =
 			CMDTYPE_NUMBER,
 			&timers_min_seconds
 		},
+		{
+			"trace_events",
+			CMDWHERE_CFGFILE,	//Allocated once by the first trace: can only be read from config
+			CMDTYPE_NUMBER,
+			&trace_events
+		},
+		{
+			"trace",
+			CMDWHERE_CLIENTCONSOLE | CMDWHERE_SERVERCONSOLE,
+			CMDTYPE_NONE,
+			NULL,
+			traceRun
+		},
 		{ 
 			"userinfochange_count", 
 			CMDWHERE_CFGFILE | CMDWHERE_CLIENTCONSOLE | CMDWHERE_SERVERCONSOLE, 
@@ -2026,7 +2183,7 @@ int getClientsFromArg(int client, edict_t *ent, char *cp, char **text)
 								case 2:
 									q2a_strcpy(strbuffer, proxyinfo[clienti].name);
 									q_strupr(strbuffer);
-									if(regexec(&r, strbuffer, 0, 0, 0) != REG_NOMATCH)
+									if(q2a_regexec(&r, strbuffer) != REG_NOMATCH)
 										{
 											maxi++;
 											proxyinfo[clienti].clientcommand |= CCMD_SELECTED;
@@ -2199,7 +2356,7 @@ edict_t *getClientFromArg(int client, edict_t *ent, int *cleintret, char *cp, ch
 								case 2:
 									q2a_strcpy(strbuffer, proxyinfo[clienti].name);
 									q_strupr(strbuffer);
-									if(regexec(&r, strbuffer, 0, 0, 0) != REG_NOMATCH)
+									if(q2a_regexec(&r, strbuffer) != REG_NOMATCH)
 										{
 											if(foundclienti != -1)
 												{
@@ -3476,7 +3633,10 @@ qboolean doClientCommand(edict_t *ent, int client, qboolean *checkforfloodafter)
 	else if(Q_stricmp (cmd, "whois")==0)
 	{
 		if (whois_active)		{
+			Q2T_BEGIN("whois");
+			Q2S_INC(Q2S_WHOIS_LOOKUPS);
 			whois(client,ent);
+			Q2T_END("whois");
 			return FALSE;
 		}
 	}
@@ -3529,6 +3689,12 @@ void ClientCommand (edict_t *ent)
 	
 	if(!dllloaded) return;
 	
+	if(Q2R_ACTIVE())
+		{
+			q2r_client_command(client);
+		}
+	
+	q2p_frame.commands++;
 	
 	if(q2adminrunmode == 0)
 		{
@@ -3550,7 +3716,7 @@ void ClientCommand (edict_t *ent)
 		(stringContains(stemp,"roconnect")) || //Extra check for zgh-frk patch
 		(stringContains(gi.argv(0),"roconnect"))))
 	{
-			return;
+			goto finished;
 	}
 //*** UPDATE END ***
 	
@@ -3573,7 +3739,9 @@ void ClientCommand (edict_t *ent)
 		}
 	lastClientCmd = -1;
 	
+finished:
 	STOPPERFORMANCE(1, "q2admin->ClientCommand", 0, NULL);
+	RECORDPERFORMANCE(Q2P_CLIENTCOMMAND);
 }
 
 
@@ -3619,6 +3787,11 @@ void  ServerCommand (void)
 	
 	if(!dllloaded) return;
 	
+	if(Q2R_ACTIVE())
+		{
+			q2r_server_command();
+		}
+	
 	if(q2adminrunmode == 0)
 		{
 			dllglobals->ServerCommand();
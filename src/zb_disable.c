@@ -215,7 +215,7 @@ qboolean checkfordisablecmd(char *cp, int disablecmd)
 			return !Q_stricmp(cp, disablecmds[disablecmd].disablecmd);
 			
 		case DISABLE_RE:
-			return (regexec(disablecmds[disablecmd].r, cp, 0, 0, 0) != REG_NOMATCH);
+			return (q2a_regexec(disablecmds[disablecmd].r, cp) != REG_NOMATCH);
 		}
 		
 	return FALSE;
@@ -19,6 +19,7 @@
 #define _GNU_SOURCE
 
 #include "zb_discord.h"
+#include "zb_trace.h"
 
 #include <assert.h>
 #include <concord/discord.h>
@@ -51,6 +52,8 @@ typedef struct
 	struct queue_cmd_s * tail;
 	pthread_mutex_t *    guard;
 	int                  state;
+	int                  length;
+	unsigned int         drops; // messages pushed while the queue was closed
 } queue_head_t;
 
 static queue_head_t * queue_construct()
@@ -58,6 +61,8 @@ static queue_head_t * queue_construct()
 	queue_head_t * queue = (queue_head_t *)malloc( sizeof( queue_head_t ) );
 	queue->head = queue->tail = NULL;
 	queue->state              = Q2D_STATE_UNINITIALIZED;
+	queue->length             = 0;
+	queue->drops              = 0;
 
 	queue->guard = (pthread_mutex_t *)malloc( sizeof( pthread_mutex_t ) );
 	pthread_mutex_init( queue->guard, NULL );
@@ -115,6 +120,12 @@ static void queue_push( queue_head_t * queue, const char * message )
 			}
 
 			queue->tail = element;
+			queue->length++;
+		}
+		else
+		{
+			queue->drops++;
+			free( element );
 		}
 		pthread_mutex_unlock( queue->guard );
 	}
@@ -130,7 +141,11 @@ static queue_cmd_t * queue_pop( queue_head_t * queue )
 
 	if( pthread_mutex_lock( queue->guard ) == 0 )
 	{
-		if( ( element = queue->head ) != NULL ) queue->head = element->next;
+		if( ( element = queue->head ) != NULL )
+		{
+			queue->head = element->next;
+			queue->length--;
+		}
 		pthread_mutex_unlock( queue->guard );
 	}
 
@@ -145,7 +160,11 @@ static queue_cmd_t * queue_try_pop( queue_head_t * queue )
 
 	if( pthread_mutex_trylock( queue->guard ) == 0 )
 	{
-		if( ( element = queue->head ) != NULL ) queue->head = element->next;
+		if( ( element = queue->head ) != NULL )
+		{
+			queue->head = element->next;
+			queue->length--;
+		}
 		pthread_mutex_unlock( queue->guard );
 	}
 
@@ -178,6 +197,18 @@ static void queue_set_state_if( queue_head_t * queue, int new_state, int old_sta
 		queue->state = new_state;
 }
 
+static void queue_get_stats( queue_head_t * queue, int * length, unsigned int * drops )
+{
+	assert( queue && queue->guard );
+
+	if( pthread_mutex_lock( queue->guard ) == 0 )
+	{
+		*length = queue->length;
+		*drops  = queue->drops;
+		pthread_mutex_unlock( queue->guard );
+	}
+}
+
 static int queue_get_state( queue_head_t * queue )
 {
 	assert( queue && queue->guard );
@@ -601,6 +632,8 @@ static void q2d_on_bot_cycle( struct discord * client )
 	queue_cmd_t * command = NULL;
 
 	if( q2d_outgoing_queue->head )
+	{
+		Q2T_BEGIN( "q2d_send" );
 		while( ( command = queue_try_pop( q2d_outgoing_queue ) ) )
 		{
 			q2d_discord_create_message_and_wait( client, q2d_bot.channel_id, command->msg );
@@ -608,6 +641,8 @@ static void q2d_on_bot_cycle( struct discord * client )
 
 			if( q2d_outgoing_queue->head == NULL ) break;
 		}
+		Q2T_END( "q2d_send" );
+	}
 	else if( queue_get_state( q2d_outgoing_queue ) == Q2D_STATE_CLOSING )
 		discord_shutdown( client );
 }
@@ -714,6 +749,8 @@ static void * q2d_main( void * arg )
 {
 	/* unsued */ arg;
 
+	q2t_thread_name( "discord" );
+
 	if( ( q2d_bot.client = q2d_discord_init( q2d_bot.token, q2d_bot.config ) ) )
 	{
 		if( q2d_bot.application_id ) q2d_discord_create_application_commands( q2d_bot.client, q2d_bot.application_id );
@@ -909,4 +946,13 @@ void q2d_shutdown()
 
 	queue_destroy( q2d_incoming_queue );
 	queue_destroy( q2d_outgoing_queue );
+	q2d_incoming_queue = q2d_outgoing_queue = NULL;
+}
+
+void q2d_outgoing_stats( int * length, unsigned int * drops )
+{
+	*length = 0;
+	*drops  = 0;
+
+	if( q2d_outgoing_queue ) queue_get_stats( q2d_outgoing_queue, length, drops );
 }
@@ -24,11 +24,13 @@ void q2d_initialize();
 void q2d_shutdown();
 void q2d_message_to_discord2( int level, const char * s );
 void q2d_process_game_queue();
+void q2d_outgoing_stats( int * length, unsigned int * drops );
 #else
 #	define q2d_initialize()
 #	define q2d_shutdown()
 #	define q2d_message_to_discord2( level, s )
 #	define q2d_process_game_queue()
+#	define q2d_outgoing_stats( length, drops ) ( *( length ) = 0, *( drops ) = 0 )
 #endif
 
 #endif
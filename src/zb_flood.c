@@ -210,7 +210,7 @@ qboolean checkforfloodcmd(char *cp, int floodcmd)
 			return !Q_stricmp(cp, floodcmds[floodcmd].floodcmd);
 			
 		case FLOOD_RE:
-			return (regexec(floodcmds[floodcmd].r, cp, 0, 0, 0) != REG_NOMATCH);
+			return (q2a_regexec(floodcmds[floodcmd].r, cp) != REG_NOMATCH);
 		}
 		
 	return FALSE;
@@ -242,6 +242,9 @@ qboolean checkforfloodcmds(char *cp)
 
 qboolean checkForMute(int client, edict_t *ent, qboolean displayMsg)
 {
+	// a mute given on another server on this host
+	sharedCheckMute(client);
+	
 	if(proxyinfo[client].clientcommand & CCMD_PCSILENCE)
 		{
 			return TRUE;
@@ -298,21 +301,25 @@ qboolean checkForFlood(int client)
 		{
 			if(proxyinfo[client].chatcount >= fi->chatFloodProtectNum)
 				{
+					Q2S_INC(Q2S_FLOOD_TRIGGERS);
 					sprintf(buffer, chatFloodProtectMsg, proxyinfo[client].name);
 					gi.bprintf (PRINT_HIGH, "%s\n", buffer);
 					
 					if(fi->chatFloodProtectSilence == 0)
 						{
 							addCmdQueue(client, QCMD_DISCONNECT, 0, 0, chatFloodProtectMsg);
+							sharedPublishKick(client);
 						}
 					else if(fi->chatFloodProtectSilence < 0)
 						{
 							proxyinfo[client].clientcommand |= CCMD_PCSILENCE;
+							sharedPublishMute(client, -1);
 						}
 					else
 						{
 							proxyinfo[client].chattimeout = ltime + fi->chatFloodProtectSilence;
 							proxyinfo[client].clientcommand |= CCMD_CSILENCE;
+							sharedPublishMute(client, fi->chatFloodProtectSilence);
 						}
 					return TRUE;
 				}
@@ -580,6 +587,7 @@ void muteRun(int startarg, edict_t *ent, int client)
 					proxyinfo[clienti].chattimeout = ltime + seconds;
 					proxyinfo[clienti].clientcommand &= ~CCMD_PCSILENCE;
 					proxyinfo[clienti].clientcommand |= CCMD_CSILENCE;
+					sharedPublishMute(clienti, seconds);
 				}
 			else if(proxyinfo[clienti].clientcommand & (CCMD_CSILENCE | CCMD_PCSILENCE))
 				{
@@ -593,6 +601,7 @@ void muteRun(int startarg, edict_t *ent, int client)
 					gi.cprintf(enti, PRINT_HIGH, "You have been unmuted.\n");
 					
 					proxyinfo[clienti].clientcommand &= ~(CCMD_CSILENCE | CCMD_PCSILENCE);
+					sharedPublishMute(clienti, 0);
 				}
 		}
 	else if(Q_stricmp(text, "PERM") == 0)
@@ -607,6 +616,7 @@ void muteRun(int startarg, edict_t *ent, int client)
 			gi.cprintf(enti, PRINT_HIGH, "You have been muted.\n", seconds);
 			
 			proxyinfo[clienti].clientcommand |= CCMD_PCSILENCE;
+			sharedPublishMute(clienti, -1);
 		}
 	else
 		{
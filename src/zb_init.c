@@ -404,6 +404,12 @@ void InitGame (void)
 #ifdef USE_DISCORD
 	q2d_initialize();
 #endif
+	q2l_initialize();
+	banStoreInitialize();
+	sharedInitialize();
+	syncInitialize();
+	initLogTail();
+	q2p_hitch_initialize();
 	
 	if(q2adminrunmode == 0)
 		{
@@ -521,6 +527,11 @@ void SpawnEntities (char *mapname, char *entities, char *spawnpoint)
 	
 	if(!dllloaded) return;
 	
+	if(Q2R_ACTIVE())
+		{
+			q2r_spawn(mapname, entities, spawnpoint);
+		}
+	
 	if(q2adminrunmode == 0)
 		{
 			dllglobals->SpawnEntities(mapname, backupentities, spawnpoint);
@@ -534,6 +545,11 @@ void SpawnEntities (char *mapname, char *entities, char *spawnpoint)
 		
 	STARTPERFORMANCE(1);
 	
+	// get everything from the last map onto disk before the level loads
+	entstatsFlush();
+	q2l_flush();
+	updateTimestamp();
+	
 	//  q2a_memset(proxyinfoBase, 0x0, (maxclients->value + 1) * sizeof(proxyinfo_t));
 	
 	for(i = -1; i < maxclients->value; i++)
@@ -905,6 +921,11 @@ qboolean ClientConnect (edict_t *ent, char *userinfo)
 	
 	if(!dllloaded) return FALSE;
 	
+	if(Q2R_ACTIVE())
+		{
+			q2r_connect(getEntOffset(ent) - 1, userinfo);
+		}
+	
 	if(q2adminrunmode == 0)
 		{
 			ret = dllglobals->ClientConnect(ent, userinfo);
@@ -956,16 +977,8 @@ qboolean ClientConnect (edict_t *ent, char *userinfo)
 		
 	client = getEntOffset(ent) - 1;
 	
-	if(proxyinfo[client].baninfo)
-		{
-			if(proxyinfo[client].baninfo->numberofconnects)
-				{
-					proxyinfo[client].baninfo->numberofconnects--;
-				}
-				
-			proxyinfo[client].baninfo = NULL;
-		}
-		
+	releaseBanInfo(client);
+	
 //*** UPDATE START ***
 	proxyinfo[client].private_command = 0;
 	proxyinfo[client].pmod = 0;
@@ -1017,6 +1030,8 @@ qboolean ClientConnect (edict_t *ent, char *userinfo)
 	proxyinfo[client].votetimeout = 0;
 	proxyinfo[client].checked_hacked_exe = 0;
 	removeClientCommands(client);
+	proxyinfo[client].maxCmdsPeak = 0;
+	proxyinfo[client].stuffcmdbytes = 0;
 	
 	ret = 1;
 	
@@ -1053,7 +1068,8 @@ qboolean ClientConnect (edict_t *ent, char *userinfo)
 	if ( *s == 0 )
 		{
 			s = NULL; //UPDATE - 1.32e - 1.32e1 change
-			return FALSE;
+			ret = FALSE;
+			goto finished;
 		}
 
 	q2a_strncpy (proxyinfo[client].name, s, sizeof(proxyinfo[client].name)-1);
@@ -1061,13 +1077,15 @@ qboolean ClientConnect (edict_t *ent, char *userinfo)
 	skinname = Info_ValueForKey (userinfo, "skin");
 	if ( *skinname == 0 )
 		{
-			return FALSE;
+			ret = FALSE;
+			goto finished;
 		}
 		
 	if (strlen(skinname) > 38)
 		{
 			gi.cprintf (NULL, PRINT_HIGH, "%s: Skin name exceeds 38 characters (IP = %s)\n", proxyinfo[client].name, proxyinfo[client].ipaddress);
-			return FALSE;
+			ret = FALSE;
+			goto finished;
 		}
 		
 	q2a_strncpy (proxyinfo[client].skin, skinname, sizeof(proxyinfo[client].skin)-1);
@@ -1240,7 +1258,10 @@ qboolean ClientConnect (edict_t *ent, char *userinfo)
 //*** UPDATE START ***
 	if (whois_active)
 	{
+		Q2T_BEGIN("whois_getid");
+		Q2S_INC(Q2S_WHOIS_LOOKUPS);
 		whois_getid(client,ent);
+		Q2T_END("whois_getid");
 		whois_update_seen(client,ent);
 	}
 //*** UPDATE END ***
@@ -1256,7 +1277,9 @@ qboolean ClientConnect (edict_t *ent, char *userinfo)
 				}
 		}
 		
+finished:
 	STOPPERFORMANCE(1, "q2admin->ClientConnect", client, ent);
+	RECORDPERFORMANCE(Q2P_CLIENTCONNECT);
 	return ret;
 }
 
@@ -1362,6 +1385,7 @@ qboolean checkForNameChange(int client, edict_t *ent, char *userinfo)
 									if(proxyinfo[client].namechangecount >= nameChangeFloodProtectNum)
 										{
 											//            q2a_strcpy(ent->client->pers.netname, proxyinfo[client].name);
+											Q2S_INC(Q2S_FLOOD_TRIGGERS);
 											sprintf(buffer, nameChangeFloodProtectMsg, proxyinfo[client].name);
 											gi.bprintf (PRINT_HIGH, "%s\n", buffer);
 											
@@ -1442,6 +1466,7 @@ qboolean checkForSkinChange(int client, edict_t *ent, char *userinfo)
 						{
 							if(proxyinfo[client].skinchangecount >= skinChangeFloodProtectNum)
 								{
+									Q2S_INC(Q2S_FLOOD_TRIGGERS);
 									sprintf(buffer, skinChangeFloodProtectMsg, proxyinfo[client].name);
 									gi.bprintf (PRINT_HIGH, "%s\n", buffer);
 									
@@ -1495,6 +1520,11 @@ void ClientUserinfoChanged (edict_t *ent, char *userinfo)
 	
 	if(!dllloaded) return;
 	
+	if(Q2R_ACTIVE())
+		{
+			q2r_userinfo(getEntOffset(ent) - 1, userinfo);
+		}
+	
 	if(q2adminrunmode == 0)
 		{
 			dllglobals->ClientUserinfoChanged(ent, userinfo);
@@ -1787,6 +1817,7 @@ void ClientUserinfoChanged (edict_t *ent, char *userinfo)
 	q2a_strcpy(proxyinfo[client].userinfo, userinfo);
 	
 	STOPPERFORMANCE(1, "q2admin->ClientUserinfoChanged", client, ent);
+	RECORDPERFORMANCE(Q2P_CLIENTUSERINFOCHANGED);
 }
 
 void ClientDisconnect (edict_t *ent)
@@ -1800,6 +1831,11 @@ void ClientDisconnect (edict_t *ent)
 	
 	if(!dllloaded) return;
 	
+	if(Q2R_ACTIVE())
+		{
+			q2r_disconnect(getEntOffset(ent) - 1);
+		}
+	
 	if(q2adminrunmode == 0)
 		{
 			dllglobals->ClientDisconnect(ent);
@@ -1840,15 +1876,8 @@ void ClientDisconnect (edict_t *ent)
 		
 	logEvent(LT_CLIENTDISCONNECT, client, ent, NULL, 0, 0.0);
 	
-	if(proxyinfo[client].baninfo)
-		{
-			if(proxyinfo[client].baninfo->numberofconnects)
-				{
-					proxyinfo[client].baninfo->numberofconnects--;
-				}
-			proxyinfo[client].baninfo = NULL;
-		}
-		
+	releaseBanInfo(client);
+	
 	if(proxyinfo[client].stuffFile)
 		{
 			fclose(proxyinfo[client].stuffFile);
@@ -1870,6 +1899,8 @@ void ClientDisconnect (edict_t *ent)
 	proxyinfo[client].votetimeout = 0;
 	proxyinfo[client].checked_hacked_exe = 0;
 	removeClientCommands(client);
+	proxyinfo[client].maxCmdsPeak = 0;
+	proxyinfo[client].stuffcmdbytes = 0;
 
 //*** UPDATE START ***
 	proxyinfo[client].userinfo_changed_count = 0;
@@ -1933,6 +1964,11 @@ void ClientBegin (edict_t *ent)
 	
 	if(!dllloaded) return;
 	
+	if(Q2R_ACTIVE())
+		{
+			q2r_begin(getEntOffset(ent) - 1);
+		}
+	
 	if(q2adminrunmode == 0)
 		{
 			dllglobals->ClientBegin(ent);
@@ -28,27 +28,79 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 
 #include "g_local.h"
+#include "zb_logformat.h"
+
+#include <sys/stat.h>
 
 
 typedef struct
 	{
 		qboolean inuse;
 		qboolean mod;
+		qboolean binary;
+		qboolean noindex;
 		char filename[256];
-		
+		unsigned long rotatesize;
+		qboolean rotatedaily;
+		int keep;
+		unsigned long written;
+		char opendate[16];
 	}
 ZB_LOGFILE;
 
 
+#define LOGKEEP_DEFAULT  10
+
+// the sidecar index of log file n is written through writer slot n + 32
+#define LOGINDEX_SLOT(n)  ((n) + 32)
+
+
 ZB_LOGFILE logFiles[32];
 
 
+// log formats are compiled into a list of these when they are loaded so
+// logEvent doesn't have to scan for '#' codes on every event.
+enum zb_logopsenum
+	{
+		LOP_TEXT,
+		LOP_NAME,
+		LOP_PING,
+		LOP_IP,
+		LOP_RATE,
+		LOP_SKIN,
+		LOP_TIME,
+		LOP_ISOTIME,
+		LOP_EPOCHMS,
+		LOP_MESSAGE,
+		LOP_NUMBER,
+		LOP_FLOAT
+	};
+	
+typedef struct
+	{
+		byte op;
+		unsigned short len;
+		char *text;
+	}
+ZB_LOGOP;
+
+#define LOGPROGRAM_MAX  128
+
 typedef struct
 	{
 		char *logtype;
 		qboolean log;
 		unsigned long logfiles;
 		char format[4096];
+		ZB_LOGOP program[LOGPROGRAM_MAX];
+		unsigned int programlen;
+		unsigned int rate;          // events a second, 0 for no limit
+		unsigned int burst;
+		unsigned int sample;        // log 1 in every sample events, 0 or 1 for all
+		float tokens;
+		float refilled;
+		unsigned long sampled;
+		unsigned long suppressed;   // since the last summary line
 	}
 ZB_LOGTYPES;
 
@@ -87,6 +139,44 @@ ZB_LOGTYPES logtypes[] =
     
 #define LOGTYPES_MAX    (sizeof(logtypes) / sizeof(logtypes[0]))
 #define LOGLISTFILE     "q2adminlog.txt"
+
+#define LOGSUPPRESS_INTERVAL  10.0
+
+qboolean logSuppressedAny = FALSE;
+float logSuppressedNext = 0.0;
+
+
+static void resetLogLimit(unsigned int lt)
+{
+	if(logtypes[lt].rate && logtypes[lt].burst < logtypes[lt].rate)
+		{
+			logtypes[lt].burst = logtypes[lt].rate;
+		}
+		
+	logtypes[lt].tokens = (float)logtypes[lt].burst;
+	logtypes[lt].refilled = ltime;
+	logtypes[lt].sampled = 0;
+}
+
+
+// names and IPs written to a BINARY log file are interned per file session so
+// each event only carries their ids.
+#define LOGSTRINGS_MAX    1024
+#define LOGSTRINGS_FULL   (LOGSTRINGS_MAX * 3 / 4)
+#define LOGSTRINGS_LEN    40
+
+typedef struct
+	{
+		unsigned int count;
+		unsigned int hash[LOGSTRINGS_MAX];
+		unsigned int id[LOGSTRINGS_MAX];
+		char text[LOGSTRINGS_MAX][LOGSTRINGS_LEN];
+	}
+ZB_LOGSTRINGS;
+
+ZB_LOGSTRINGS *logStrings[32];
+
+static void startLogSession(int lognum);
     
     
 void expandOutPortNum(char *srcdest, int max)
@@ -190,7 +280,7 @@ qboolean loadLogListFile(char *filename)
 			
 			if(!(cp[0] == ';' || cp[0] == '\n' || isBlank (cp)))
 				{
-					// LOGFILE: LogNum [MOD] "LogFileName"
+					// LOGFILE: LogNum [MOD] [BINARY] [NOINDEX] [ROTATE MB] [DAILY] [KEEP n] "LogFileName"
 					if(startContains(cp, "LOGFILE:"))
 						{
 							cp += 8;
@@ -210,16 +300,70 @@ qboolean loadLogListFile(char *filename)
 										
 									SKIPBLANK(cp);
 									
-									if(startContains(cp, "MOD"))
+									logFiles[lognum].mod = FALSE;
+									logFiles[lognum].binary = FALSE;
+									logFiles[lognum].noindex = FALSE;
+									logFiles[lognum].rotatesize = 0;
+									logFiles[lognum].rotatedaily = FALSE;
+									logFiles[lognum].keep = LOGKEEP_DEFAULT;
+									
+									for(;;)
 										{
-											cp += 3;
+											if(startContains(cp, "MOD"))
+												{
+													cp += 3;
+													logFiles[lognum].mod = TRUE;
+												}
+											else if(startContains(cp, "BINARY"))
+												{
+													cp += 6;
+													logFiles[lognum].binary = TRUE;
+												}
+											else if(startContains(cp, "NOINDEX"))
+												{
+													cp += 7;
+													logFiles[lognum].noindex = TRUE;
+												}
+											else if(startContains(cp, "ROTATE"))
+												{
+													cp += 6;
+													SKIPBLANK(cp);
+													
+													logFiles[lognum].rotatesize = (unsigned long)q2a_atoi(cp) * 1024 * 1024;
+													
+													while(isdigit(*cp))
+														{
+															cp++;
+														}
+												}
+											else if(startContains(cp, "DAILY"))
+												{
+													cp += 5;
+													logFiles[lognum].rotatedaily = TRUE;
+												}
+											else if(startContains(cp, "KEEP"))
+												{
+													cp += 4;
+													SKIPBLANK(cp);
+													
+													logFiles[lognum].keep = q2a_atoi(cp);
+													
+													if(logFiles[lognum].keep < 1)
+														{
+															logFiles[lognum].keep = 1;
+														}
+														
+													while(isdigit(*cp))
+														{
+															cp++;
+														}
+												}
+											else
+												{
+													break;
+												}
+												
 											SKIPBLANK(cp);
-											
-											logFiles[lognum].mod = TRUE;
-										}
-									else
-										{
-											logFiles[lognum].mod = FALSE;
 										}
 										
 									if(*cp == '\"')
@@ -268,6 +412,48 @@ qboolean loadLogListFile(char *filename)
 													SKIPBLANK(cp);
 													
 													logtypes[i].logfiles = 0;
+													logtypes[i].rate = 0;
+													logtypes[i].burst = 0;
+													logtypes[i].sample = 0;
+													
+													// [RATE n [BURST n]] [SAMPLE n]
+													for(;;)
+														{
+															if(startContains(cp, "RATE"))
+																{
+																	cp += 4;
+																	SKIPBLANK(cp);
+																	
+																	logtypes[i].rate = (unsigned int)q2a_atoi(cp);
+																}
+															else if(startContains(cp, "BURST"))
+																{
+																	cp += 5;
+																	SKIPBLANK(cp);
+																	
+																	logtypes[i].burst = (unsigned int)q2a_atoi(cp);
+																}
+															else if(startContains(cp, "SAMPLE"))
+																{
+																	cp += 6;
+																	SKIPBLANK(cp);
+																	
+																	logtypes[i].sample = (unsigned int)q2a_atoi(cp);
+																}
+															else
+																{
+																	break;
+																}
+																
+															while(isdigit(*cp))
+																{
+																	cp++;
+																}
+																
+															SKIPBLANK(cp);
+														}
+														
+													resetLogLimit(i);
 													
 													lognum = q2a_atoi(cp);
 													logtypes[i].log = FALSE;
@@ -320,6 +506,7 @@ qboolean loadLogListFile(char *filename)
 																	
 																	if(!isBlank(logtypes[i].format))
 																		{
+																			compileLogFormat(i);
 																			logtypes[i].log = TRUE;
 																		}
 																	else
@@ -362,13 +549,21 @@ void loadLogList(void)
 	unsigned int i;
 	qboolean ret;
 	
+	for(i = 0; i < Q2L_LOG_SLOTS; i++)
+		{
+			q2l_detach(i);
+		}
+		
 	q2a_memset(logFiles, 0x0, sizeof(logFiles));
 	
 	for(i = 0; i < LOGTYPES_MAX; i++)
 		{
 			logtypes[i].log = FALSE;
+			logtypes[i].suppressed = 0;
 		}
 		
+	logSuppressedAny = FALSE;
+	
 	ret = loadLogListFile(LOGLISTFILE);
 	
 	sprintf(buffer, "%s/%s", moddir, LOGLISTFILE);
@@ -386,320 +581,1495 @@ void loadLogList(void)
 }
 
 
-void convertToLogLine(char *dest, char *format, int client, edict_t *ent, char *message, int number, float number2)
+void compileLogFormat(unsigned int lt)
 {
-	char *cp;
-	time_t ltimetemp;
+	char *format = logtypes[lt].format;
+	char *text = format;
+	ZB_LOGOP *op = logtypes[lt].program;
+	ZB_LOGOP *end = op + LOGPROGRAM_MAX;
+	byte code;
 	
-	while(*format)
+	while(*format && op < end)
 		{
+			code = LOP_TEXT;
+			
 			if(*format == '#')
 				{
-					format++;
-					
-					if(*format == 'n')
-					{
-						if(ent)
-							{
-								cp = proxyinfo[client].name;
-								while(*cp)
-									{
-										*dest++ = *cp++;
-									}
-							}
-					}
-					else if(*format == 'p')
-					{
-						if(ent)
-							{
-								sprintf(dest, "%d", ent->client->ping);
-								while(*dest)
-									{
-										dest++;
-									}
-							}
-					}
-					else if(*format == 'i')
-					{
-						if(ent)
-							{
-								cp = proxyinfo[client].ipaddress;
-								while(*cp)
-									{
-										*dest++ = *cp++;
-									}
-							}
-					}
-					else if(*format == 'r')
-					{
-						if(ent)
-							{
-								sprintf(dest, "%d", proxyinfo[client].rate);
-								while(*dest)
-									{
-										dest++;
-									}
-							}
-					}
-					else if(*format == 's')
-					{
-						if(ent)
-							{
-								cp = proxyinfo[client].skin;
-								while(*cp)
-									{
-										*dest++ = *cp++;
-									}
-							}
-					}
-					else if(*format == 't')
-					{
-						time( &ltimetemp );
-						q2a_strcpy(buffer, ctime( &ltimetemp ));
-
-						cp = buffer;
-						while(*cp && *cp != '\n')
-							{
-								*dest++ = *cp++;
-							}
-					}
-					else if(*format == 'm')
-					{
-						if(message)
-							{
-								cp = message;
-								while(*cp)
-									{
-										if(*cp != '\n')
-											{
-												*dest++ = *cp++;
-											}
-										else
-											{
-												cp++;
-											}
-									}
-							}
-					}
-					else if(*format == 'e')
-					{
-						sprintf(dest, "%d", number);
-						while(*dest)
-							{
-								dest++;
-							}
-					}
-					else if(*format == 'f')
-					{
-						sprintf(dest, "%g", number2);
-						while(*dest)
-							{
-								dest++;
-							}
-					}
-					else
-					{
-						*dest++ = '#';
-						if(*format)
-							{
-								*dest++ = *format;
-							}
-					}
-						
-					if(*format)
+					switch(format[1])
 						{
-							format++;
+						case 'n': code = LOP_NAME; break;
+						case 'p': code = LOP_PING; break;
+						case 'i': code = LOP_IP; break;
+						case 'r': code = LOP_RATE; break;
+						case 's': code = LOP_SKIN; break;
+						case 't': code = LOP_TIME; break;
+						case 'd': code = LOP_ISOTIME; break;
+						case 'u': code = LOP_EPOCHMS; break;
+						case 'm': code = LOP_MESSAGE; break;
+						case 'e': code = LOP_NUMBER; break;
+						case 'f': code = LOP_FLOAT; break;
 						}
 				}
-			else
+				
+			if(code == LOP_TEXT)
+				{
+					// unknown codes are copied as they are
+					format += (*format == '#' && format[1]) ? 2 : 1;
+					continue;
+				}
+				
+			if(format > text)
 				{
-					*dest++ = *format++;
+					op->op = LOP_TEXT;
+					op->text = text;
+					op->len = (unsigned short)(format - text);
+					op++;
+					
+					if(op >= end)
+						{
+							break;
+						}
 				}
+				
+			op->op = code;
+			op->text = NULL;
+			op->len = 0;
+			op++;
+			
+			format += 2;
+			text = format;
 		}
-	*dest = 0;
+		
+	if(format > text && op < end)
+		{
+			op->op = LOP_TEXT;
+			op->text = text;
+			op->len = (unsigned short)q2a_strlen(text);
+			op++;
+		}
+	else if(*format)
+		{
+			gi.dprintf ("WARNING: log format for %s is too long and has been cut short\n", logtypes[lt].logtype);
+		}
+		
+	logtypes[lt].programlen = (unsigned int)(op - logtypes[lt].program);
 }
 
 
-qboolean isLogEvent(enum zb_logtypesenum ltype)
+static char *appendLogText(char *dest, char *end, const char *src, size_t len)
 {
-	return logtypes[(int)ltype].log;
+	if(len > (size_t)(end - dest))
+		{
+			len = end - dest;
+		}
+		
+	q2a_memcpy(dest, src, len);
+	return dest + len;
 }
 
 
-void logEvent(enum zb_logtypesenum ltype, int client, edict_t *ent, char *message, int number, float number2)
+static char *appendLogString(char *dest, char *end, const char *src)
+{
+	return appendLogText(dest, end, src, q2a_strlen(src));
+}
+
+
+static char *appendLogNumber(char *dest, char *end, int value)
+{
+	char digits[12];
+	char *cp = digits + sizeof(digits);
+	unsigned int u = (value < 0) ? 0u - (unsigned int)value : (unsigned int)value;
+	
+	do
+		{
+			*--cp = '0' + (u % 10);
+			u /= 10;
+		}
+	while(u);
+	
+	if(value < 0)
+		{
+			*--cp = '-';
+		}
+		
+	return appendLogText(dest, end, cp, digits + sizeof(digits) - cp);
+}
+
+
+size_t convertToLogLine(char *dest, size_t size, unsigned int lt, int client, edict_t *ent, char *message, int number, float number2)
 {
-	if(logtypes[(int)ltype].log)
+	char *start = dest;
+	char *end = dest + size - 1;
+	char *cp;
+	ZB_LOGOP *op = logtypes[lt].program;
+	ZB_LOGOP *last = op + logtypes[lt].programlen;
+	size_t len;
+	char numbuf[32];
+	
+	for(; op < last; op++)
 		{
-			char logline[4096];
-			char logname[356];
-			unsigned long logfile;
-			unsigned int i;
-			FILE *logfilePtr;
-			
-			// prepare log line.
-			convertToLogLine(logline, logtypes[(int)ltype].format, client, ent, message, number, number2);
-			
-			for(i = 0, logfile = 0x1; i < 32; i++, logfile <<= 1)
+			switch(op->op)
 				{
-					if((logtypes[(int)ltype].logfiles & logfile) && logFiles[i].inuse)
+				case LOP_TEXT:
+					dest = appendLogText(dest, end, op->text, op->len);
+					break;
+					
+				case LOP_NAME:
+					if(ent)
 						{
-							if(logFiles[i].mod)
-								{
-									sprintf(logname, "%s/%s", moddir, logFiles[i].filename);
-								}
-							else
-								{
-									q2a_strcpy(logname, logFiles[i].filename);
-								}
-								
-							logfilePtr = q2a_fopen(logname, sizeof(logname), "at");
-							
-							if(logfilePtr)
+							dest = appendLogString(dest, end, proxyinfo[client].name);
+						}
+					break;
+					
+				case LOP_PING:
+					if(ent)
+						{
+							dest = appendLogNumber(dest, end, ent->client->ping);
+						}
+					break;
+					
+				case LOP_IP:
+					if(ent)
+						{
+							dest = appendLogString(dest, end, proxyinfo[client].ipaddress);
+						}
+					break;
+					
+				case LOP_RATE:
+					if(ent)
+						{
+							dest = appendLogNumber(dest, end, proxyinfo[client].rate);
+						}
+					break;
+					
+				case LOP_SKIN:
+					if(ent)
+						{
+							dest = appendLogString(dest, end, proxyinfo[client].skin);
+						}
+					break;
+					
+				case LOP_TIME:
+					cp = getTimestamp(TS_CTIME, &len);
+					dest = appendLogText(dest, end, cp, len);
+					break;
+					
+				case LOP_ISOTIME:
+					cp = getTimestamp(TS_ISO8601, &len);
+					dest = appendLogText(dest, end, cp, len);
+					break;
+					
+				case LOP_EPOCHMS:
+					cp = getTimestamp(TS_EPOCHMS, &len);
+					dest = appendLogText(dest, end, cp, len);
+					break;
+					
+				case LOP_MESSAGE:
+					if(message)
+						{
+							// copied in runs, leaving out any newlines
+							for(cp = message; *cp; )
 								{
-									fprintf(logfilePtr, "%s\n", logline);
-									fclose(logfilePtr);
+									size_t run = strcspn(cp, "\n");
+									
+									dest = appendLogText(dest, end, cp, run);
+									cp += run;
+									
+									if(*cp)
+										{
+											cp++;
+										}
 								}
 						}
+					break;
+					
+				case LOP_NUMBER:
+					dest = appendLogNumber(dest, end, number);
+					break;
+					
+				case LOP_FLOAT:
+					sprintf(numbuf, "%g", number2);
+					dest = appendLogString(dest, end, numbuf);
+					break;
+				}
+		}
+		
+	*dest = 0;
+	return dest - start;
+}
+
+
+static size_t writeLogFile(int lognum, const char *data, size_t len)
+{
+	size_t written = q2l_write(lognum, data, len);
+	
+	logFiles[lognum].written += written;
+	Q2S_ADD(Q2S_LOG_BYTES, written);
+	q2p_frame.logwrites++;
+	return written;
+}
+
+
+static void getLogIndexName(int lognum, char *indexname)
+{
+	sprintf(indexname, "%s.idx", q2l_path(lognum));
+}
+
+
+static void closeLogFile(int lognum)
+{
+	q2l_detach(lognum);
+	q2l_detach(LOGINDEX_SLOT(lognum));
+}
+
+
+// adds a record with no type, name or IP for every line between from and the
+// end of the log, so lines the index missed still count and the line numbers
+// it gives stay those of the log. They take the time of the record before.
+static void fillLogIndex(int lognum, FILE *indexPtr, unsigned long from, uint64_t time)
+{
+	unsigned char record[Q2LI_RECORD_SIZE];
+	char buffer[16384];
+	unsigned long offset, start = from;
+	size_t got, i;
+	FILE *logfilePtr;
+	
+	logfilePtr = fopen(q2l_path(lognum), "rb");
+	
+	if(!logfilePtr || fseek(logfilePtr, (long)from, SEEK_SET) != 0)
+		{
+			if(logfilePtr)
+				{
+					fclose(logfilePtr);
+				}
+			return;
+		}
+		
+	memset(record, 0, sizeof(record));
+	q2lb_put64(record + 8, time);
+	record[26] = Q2LI_TYPE_UNKNOWN;
+	q2lb_put32(record + 28, (uint32_t)-1);
+	offset = from;
+	
+	while(offset < logFiles[lognum].written && (got = fread(buffer, 1, sizeof(buffer), logfilePtr)) > 0)
+		{
+			for(i = 0; i < got && offset < logFiles[lognum].written; i++, offset++)
+				{
+					if(buffer[i] != '\n')
+						{
+							continue;
+						}
+						
+					q2lb_put64(record, start);
+					q2lb_put16(record + 24, (uint16_t)(offset + 1 - start > 0xFFFF ? 0xFFFF : offset + 1 - start));
+					fwrite(record, Q2LI_RECORD_SIZE, 1, indexPtr);
+					start = offset + 1;
+				}
+		}
+		
+	fclose(logfilePtr);
+}
+
+
+// opens the sidecar index for a text log that has just been opened. Lines
+// written while the index was closed (or its records were dropped) are added
+// back to it; an index that runs past the log or doesn't end on a line (the
+// log was edited or replaced outside q2admin) is built again from the start.
+static void openLogIndex(int lognum)
+{
+	char indexname[MAX_OSPATH + 8];
+	unsigned char record[Q2LI_RECORD_SIZE];
+	unsigned long end = 0;
+	uint64_t time = 0;
+	qboolean valid = TRUE;
+	FILE *indexPtr, *logfilePtr;
+	long size;
+	int last;
+	
+	if(logFiles[lognum].binary || logFiles[lognum].noindex)
+		{
+			return;
+		}
+		
+	getLogIndexName(lognum, indexname);
+	indexPtr = fopen(indexname, "rb");
+	
+	if(indexPtr)
+		{
+			fseek(indexPtr, 0, SEEK_END);
+			size = ftell(indexPtr);
+			
+			if(size % Q2LI_RECORD_SIZE)
+				{
+					valid = FALSE;
+				}
+			else if(size > 0)
+				{
+					fseek(indexPtr, size - Q2LI_RECORD_SIZE, SEEK_SET);
+					valid = fread(record, Q2LI_RECORD_SIZE, 1, indexPtr) == 1;
+					end = (unsigned long)(q2lb_get64(record) + q2lb_get16(record + 24));
+					time = q2lb_get64(record + 8);
+				}
+				
+			fclose(indexPtr);
+		}
+		
+	if(valid && end > logFiles[lognum].written)
+		{
+			valid = FALSE;
+		}
+	else if(valid && end > 0 && end < logFiles[lognum].written)
+		{
+			logfilePtr = fopen(q2l_path(lognum), "rb");
+			last = (logfilePtr && fseek(logfilePtr, (long)end - 1, SEEK_SET) == 0) ? fgetc(logfilePtr) : EOF;
+			valid = last == '\n';
+			
+			if(logfilePtr)
+				{
+					fclose(logfilePtr);
+				}
+		}
+		
+	if(!valid)
+		{
+			end = 0;
+			time = 0;
+		}
+		
+	indexPtr = fopen(indexname, valid ? "ab" : "wb");
+	
+	if(indexPtr)
+		{
+			if(end < logFiles[lognum].written)
+				{
+					fillLogIndex(lognum, indexPtr, end, time);
+				}
+				
+			q2l_attach(LOGINDEX_SLOT(lognum), indexPtr, indexname, TRUE);
+		}
+}
+
+
+static void writeLogIndex(int lognum, unsigned long offset, size_t len, enum zb_logtypesenum ltype, int client, edict_t *ent)
+{
+	unsigned char record[Q2LI_RECORD_SIZE];
+	uint32_t namehash = 0, iphash = 0;
+	
+	if(!q2l_is_open(LOGINDEX_SLOT(lognum)))
+		{
+			return;
+		}
+		
+	if(ent)
+		{
+			namehash = q2li_hash(proxyinfo[client].name, q2a_strlen(proxyinfo[client].name));
+			iphash = q2li_hash(proxyinfo[client].ipaddress, strcspn(proxyinfo[client].ipaddress, ":"));
+		}
+		
+	q2lb_put64(record, offset);
+	q2lb_put64(record + 8, (uint64_t)getTimestampMs());
+	q2lb_put32(record + 16, namehash);
+	q2lb_put32(record + 20, iphash);
+	q2lb_put16(record + 24, (uint16_t)len);
+	record[26] = (unsigned char)ltype;
+	record[27] = 0;
+	q2lb_put32(record + 28, (uint32_t)(ent ? client : -1));
+	
+	if(!q2l_write(LOGINDEX_SLOT(lognum), (char *)record, Q2LI_RECORD_SIZE))
+		{
+			// a line without its index record would shift every later one
+			closeLogFile(lognum);
+		}
+}
+
+
+static qboolean logFileNeedsRotate(int lognum)
+{
+	if(logFiles[lognum].rotatesize && logFiles[lognum].written >= logFiles[lognum].rotatesize)
+		{
+			return TRUE;
+		}
+		
+	return logFiles[lognum].rotatedaily && q2a_strcmp(logFiles[lognum].opendate, getTimestamp(TS_DATE, NULL)) != 0;
+}
+
+
+// starts a new segment: the writer renames the log to <name>.1, shifting older
+// segments up one and dropping whatever falls past KEEP, and opens it again.
+// The old segment is compressed in the background.
+static void rotateLogFile(int lognum)
+{
+	if(q2l_compress_busy(lognum))
+		{
+			// still compressing the last segment, try again on a later event
+			return;
+		}
+		
+	q2l_rotate(lognum, LOGINDEX_SLOT(lognum), logFiles[lognum].keep, !logFiles[lognum].binary && logFiles[lognum].noindex);
+	logFiles[lognum].written = 0;
+	q2a_strcpy(logFiles[lognum].opendate, getTimestamp(TS_DATE, NULL));
+	
+	if(logFiles[lognum].binary)
+		{
+			startLogSession(lognum);
+		}
+}
+
+
+static unsigned int internLogString(int lognum, const char *text)
+{
+	ZB_LOGSTRINGS *strings = logStrings[lognum];
+	unsigned char record[Q2LB_STRING_SIZE + LOGSTRINGS_LEN];
+	unsigned int hash = 2166136261u;
+	unsigned int slot;
+	size_t len;
+	
+	if(!*text)
+		{
+			return 0;
+		}
+		
+	len = q2a_strlen(text);
+	if(len >= LOGSTRINGS_LEN)
+		{
+			len = LOGSTRINGS_LEN - 1;
+		}
+		
+	for(slot = 0; slot < len; slot++)
+		{
+			hash = (hash ^ (unsigned char)text[slot]) * 16777619u;
+		}
+		
+	hash |= 1;
+	
+	for(slot = hash % LOGSTRINGS_MAX; strings->hash[slot]; slot = (slot + 1) % LOGSTRINGS_MAX)
+		{
+			if(strings->hash[slot] == hash && strncmp(strings->text[slot], text, len) == 0 && strings->text[slot][len] == 0)
+				{
+					return strings->id[slot];
+				}
+		}
+		
+	if(strings->count >= LOGSTRINGS_FULL)
+		{
+			// the table is getting full, start a new session so ids can be reused
+			startLogSession(lognum);
+			return internLogString(lognum, text);
+		}
+		
+	strings->hash[slot] = hash;
+	strings->id[slot] = ++strings->count;
+	q2a_memcpy(strings->text[slot], text, len);
+	strings->text[slot][len] = 0;
+	
+	q2lb_put_header(record, Q2LB_STRING_SIZE + len, Q2LB_KIND_STRING, 0, (uint32_t)lframenum, getTimestampMs());
+	q2lb_put32(record + Q2LB_HEADER_SIZE, strings->id[slot]);
+	q2lb_put16(record + Q2LB_HEADER_SIZE + 4, (uint16_t)len);
+	q2a_memcpy(record + Q2LB_STRING_SIZE, text, len);
+	
+	if(!writeLogFile(lognum, (char *)record, Q2LB_STRING_SIZE + len))
+		{
+			// dropped, so forget it again and send it with a later event
+			strings->hash[slot] = 0;
+			strings->count--;
+			return 0;
+		}
+		
+	
+	return strings->id[slot];
+}
+
+
+static void startLogSession(int lognum)
+{
+	unsigned char record[Q2LB_HEADER_SIZE + 64];
+	long long now = getTimestampMs();
+	unsigned int i;
+	size_t len;
+	
+	if(!logStrings[lognum])
+		{
+			logStrings[lognum] = gi.TagMalloc(sizeof(ZB_LOGSTRINGS), TAG_GAME);
+		}
+		
+	q2a_memset(logStrings[lognum], 0x0, sizeof(ZB_LOGSTRINGS));
+	
+	q2lb_put_header(record, Q2LB_SESSION_SIZE, Q2LB_KIND_SESSION, 0, (uint32_t)lframenum, now);
+	q2a_memcpy(record + Q2LB_HEADER_SIZE, Q2LB_MAGIC, 4);
+	q2lb_put16(record + Q2LB_HEADER_SIZE + 4, Q2LB_VERSION);
+	q2lb_put16(record + Q2LB_HEADER_SIZE + 6, (uint16_t)port->value);
+	writeLogFile(lognum, (char *)record, Q2LB_SESSION_SIZE);
+	
+	for(i = 0; i < LOGTYPES_MAX; i++)
+		{
+			len = q2a_strlen(logtypes[i].logtype);
+			q2lb_put_header(record, Q2LB_HEADER_SIZE + len, Q2LB_KIND_TYPENAME, i, (uint32_t)lframenum, now);
+			q2a_memcpy(record + Q2LB_HEADER_SIZE, logtypes[i].logtype, len);
+			writeLogFile(lognum, (char *)record, Q2LB_HEADER_SIZE + len);
+		}
+}
+
+
+static void logBinaryEvent(int lognum, enum zb_logtypesenum ltype, int client, edict_t *ent, char *message, int number, float number2)
+{
+	unsigned char record[Q2LB_RECORD_MAX];
+	unsigned int nameid = 0, ipid = 0;
+	size_t len = 0;
+	
+	if(ent)
+		{
+			// the name and ip ids have to be from the same session, so start the
+			// new one now if interning both could fill the table in between
+			if(logStrings[lognum]->count >= LOGSTRINGS_FULL - 1)
+				{
+					startLogSession(lognum);
+				}
+				
+			nameid = internLogString(lognum, proxyinfo[client].name);
+			ipid = internLogString(lognum, proxyinfo[client].ipaddress);
+		}
+		
+	if(message)
+		{
+			len = q2a_strlen(message);
+			
+			if(len > sizeof(record) - Q2LB_EVENT_SIZE)
+				{
+					len = sizeof(record) - Q2LB_EVENT_SIZE;
+				}
+				
+			q2a_memcpy(record + Q2LB_EVENT_SIZE, message, len);
+		}
+		
+	q2lb_put_header(record, Q2LB_EVENT_SIZE + len, Q2LB_KIND_EVENT, (int)ltype, (uint32_t)lframenum, getTimestampMs());
+	q2lb_put16(record + Q2LB_HEADER_SIZE, (uint16_t)(ent ? client : -1));
+	q2lb_put16(record + Q2LB_HEADER_SIZE + 2, (uint16_t)len);
+	q2lb_put32(record + Q2LB_HEADER_SIZE + 4, nameid);
+	q2lb_put32(record + Q2LB_HEADER_SIZE + 8, ipid);
+	q2lb_put32(record + Q2LB_HEADER_SIZE + 12, (uint32_t)number);
+	q2lb_put_float(record + Q2LB_HEADER_SIZE + 16, number2);
+	writeLogFile(lognum, (char *)record, Q2LB_EVENT_SIZE + len);
+}
+
+
+void getLogFileName(int lognum, char *logname)
+{
+	if(logFiles[lognum].mod)
+		{
+			sprintf(logname, "%s/%s", moddir, logFiles[lognum].filename);
+		}
+	else
+		{
+			q2a_strcpy(logname, logFiles[lognum].filename);
+		}
+}
+
+
+qboolean isLogEvent(enum zb_logtypesenum ltype)
+{
+	return logtypes[(int)ltype].log;
+}
+
+
+// every event also goes into this ring, logged to a file or not, so recent
+// ones can be looked at with !logtail without touching the disk.
+#define LOGTAIL_MESSAGE  128
+
+typedef struct
+	{
+		long long time;
+		int tick;
+		short client;
+		byte type;
+		char name[16];
+		char ip[40];
+		int number;
+		float number2;
+		char message[LOGTAIL_MESSAGE];
+	}
+ZB_LOGTAIL;
+
+int logtail_size = 1024;
+
+ZB_LOGTAIL *logTail = NULL;
+unsigned long logTailSize = 0;
+unsigned long logTailNext = 0;    // sequence number of the next event
+
+
+void initLogTail(void)
+{
+	if(logTail || logtail_size <= 0)
+		{
+			return;
+		}
+		
+	logTail = malloc(logtail_size * sizeof(ZB_LOGTAIL));
+	
+	if(!logTail)
+		{
+			gi.dprintf ("WARNING: unable to allocate %d entry log tail\n", logtail_size);
+			return;
+		}
+		
+	logTailSize = logtail_size;
+	logTailNext = 0;
+}
+
+
+void freeLogTail(void)
+{
+	free(logTail);
+	logTail = NULL;
+	logTailSize = 0;
+}
+
+
+static void copyLogTailText(char *dest, const char *src, size_t size)
+{
+	size_t len = q2a_strlen(src);
+	
+	if(len >= size)
+		{
+			len = size - 1;
+		}
+		
+	q2a_memcpy(dest, src, len);
+	dest[len] = 0;
+}
+
+
+static void pushLogTail(enum zb_logtypesenum ltype, int client, edict_t *ent, char *message, int number, float number2)
+{
+	ZB_LOGTAIL *entry = &logTail[logTailNext % logTailSize];
+	
+	entry->time = getTimestampMs();
+	entry->tick = lframenum;
+	entry->type = (byte)ltype;
+	entry->number = number;
+	entry->number2 = number2;
+	
+	if(ent)
+		{
+			entry->client = (short)client;
+			copyLogTailText(entry->name, proxyinfo[client].name, sizeof(entry->name));
+			copyLogTailText(entry->ip, proxyinfo[client].ipaddress, sizeof(entry->ip));
+		}
+	else
+		{
+			entry->client = -1;
+			entry->name[0] = 0;
+			entry->ip[0] = 0;
+		}
+		
+	copyLogTailText(entry->message, message ? message : "", sizeof(entry->message));
+	logTailNext++;
+}
+
+
+// rotates the log file if it is due and opens it if it isn't open yet.
+static qboolean prepareLogFile(unsigned int lognum)
+{
+	char logname[356];
+	FILE *logfilePtr;
+	struct stat st;
+	
+	if(q2l_is_open(lognum) && logFileNeedsRotate(lognum))
+		{
+			rotateLogFile(lognum);
+		}
+		
+	if(q2l_is_open(lognum))
+		{
+			return TRUE;
+		}
+		
+	getLogFileName(lognum, logname);
+	
+	if(q2l_failed(lognum))
+		{
+			gi.dprintf ("WARNING: couldn't rotate log file %s\n", logname);
+			closeLogFile(lognum);
+		}
+		
+	// indexed logs are opened binary so the offsets match the file on Windows too
+	logfilePtr = q2a_fopen(logname, sizeof(logname), (logFiles[lognum].binary || !logFiles[lognum].noindex) ? "ab" : "at");
+	
+	if(!logfilePtr)
+		{
+			return FALSE;
+		}
+		
+	fseek(logfilePtr, 0, SEEK_END);
+	logFiles[lognum].written = (unsigned long)ftell(logfilePtr);
+	
+	// a DAILY log carried over from an earlier day is rotated before it is written
+	if(logFiles[lognum].written && stat(logname, &st) == 0)
+		{
+			strftime(logFiles[lognum].opendate, sizeof(logFiles[lognum].opendate), "%Y-%m-%d", localtime(&st.st_mtime));
+		}
+	else
+		{
+			q2a_strcpy(logFiles[lognum].opendate, getTimestamp(TS_DATE, NULL));
+		}
+	
+	q2l_attach(lognum, logfilePtr, logname, logFiles[lognum].binary);
+	
+	if(logFiles[lognum].binary)
+		{
+			startLogSession(lognum);
+		}
+	else
+		{
+			openLogIndex(lognum);
+		}
+		
+	if(logFileNeedsRotate(lognum))
+		{
+			rotateLogFile(lognum);
+		}
+		
+	return TRUE;
+}
+
+
+// 1 in n sampling and then a token bucket refilled with the frame time, so a
+// flood of one type costs a couple of compares per event instead of a write.
+static qboolean allowLogEvent(unsigned int lt)
+{
+	ZB_LOGTYPES *type = &logtypes[lt];
+	
+	if(type->sample > 1 && (type->sampled++ % type->sample) != 0)
+		{
+			goto suppressed;
+		}
+		
+	if(type->rate)
+		{
+			if(ltime > type->refilled)
+				{
+					type->tokens += (ltime - type->refilled) * type->rate;
+					
+					if(type->tokens > type->burst)
+						{
+							type->tokens = (float)type->burst;
+						}
+				}
+				
+			type->refilled = ltime;
+			
+			if(type->tokens < 1.0)
+				{
+					goto suppressed;
+				}
+				
+			type->tokens -= 1.0;
+		}
+		
+	return TRUE;
+	
+suppressed:
+	type->suppressed++;
+	
+	if(!logSuppressedAny)
+		{
+			logSuppressedAny = TRUE;
+			logSuppressedNext = ltime + LOGSUPPRESS_INTERVAL;
+		}
+		
+	return FALSE;
+}
+
+
+static void logSuppressedLine(unsigned int lt)
+{
+	char logline[256];
+	unsigned long logfile, offset;
+	unsigned int i;
+	size_t len, message, written;
+	
+	// binary records carry their own time so they only get the message part
+	message = sprintf(logline, "%s ", getTimestamp(TS_ISO8601, NULL));
+	len = message + sprintf(logline + message, "%lu %s events suppressed", logtypes[lt].suppressed, logtypes[lt].logtype);
+	
+	for(i = 0, logfile = 0x1; i < 32; i++, logfile <<= 1)
+		{
+			if(!(logtypes[lt].logfiles & logfile) || !logFiles[i].inuse || !prepareLogFile(i))
+				{
+					continue;
+				}
+				
+			if(logFiles[i].binary)
+				{
+					logBinaryEvent(i, lt, 0, NULL, logline + message, (int)logtypes[lt].suppressed, 0.0);
+					continue;
+				}
+				
+			logline[len] = '\n';
+			offset = logFiles[i].written;
+			written = writeLogFile(i, logline, len + 1);
+			logline[len] = 0;
+			
+			if(written > len)
+				{
+					writeLogIndex(i, offset + (written - len - 1), len + 1, lt, 0, NULL);
+				}
+		}
+		
+	logtypes[lt].suppressed = 0;
+}
+
+
+// called every frame, writes the "N events suppressed" lines once the
+// interval since the first suppressed event is up (or straight away if all).
+void logSuppressedSummary(qboolean all)
+{
+	unsigned int i;
+	
+	if(!logSuppressedAny || (!all && ltime < logSuppressedNext))
+		{
+			return;
+		}
+		
+	logSuppressedAny = FALSE;
+	
+	for(i = 0; i < LOGTYPES_MAX; i++)
+		{
+			if(logtypes[i].suppressed && logtypes[i].log)
+				{
+					logSuppressedLine(i);
+				}
+		}
+}
+
+
+void logEvent(enum zb_logtypesenum ltype, int client, edict_t *ent, char *message, int number, float number2)
+{
+	Q2T_BEGIN("logEvent");
+	
+	if(logTail)
+		{
+			pushLogTail(ltype, client, ent, message, number, number2);
+		}
+		
+	if(logtypes[(int)ltype].log && allowLogEvent(ltype))
+		{
+			char logline[4096];
+			unsigned long logfile, offset;
+			unsigned int i;
+			size_t len = 0, written;
+			
+			for(i = 0, logfile = 0x1; i < 32; i++, logfile <<= 1)
+				{
+					if((logtypes[(int)ltype].logfiles & logfile) && logFiles[i].inuse)
+						{
+							if(!prepareLogFile(i))
+								{
+									continue;
+								}
+								
+							if(logFiles[i].binary)
+								{
+									logBinaryEvent(i, ltype, client, ent, message, number, number2);
+									continue;
+								}
+								
+							// prepare log line the first time a text file needs it.
+							if(!len)
+								{
+									len = convertToLogLine(logline, sizeof(logline) - 1, (int)ltype, client, ent, message, number, number2);
+									logline[len++] = '\n';
+								}
+								
+							offset = logFiles[i].written;
+							written = writeLogFile(i, logline, len);
+							
+							if(written >= len)
+								{
+									writeLogIndex(i, offset + (written - len), len, ltype, client, ent);
+								}
+						}
+				}
+		}
+		
+	Q2T_END("logEvent");
+}
+
+
+
+void displaylogfileRun(int startarg, edict_t *ent, int client)
+{
+	int logToDisplay = 0;
+	
+	if (gi.argc() > startarg)
+		{
+			logToDisplay = q2a_atoi(gi.argv(startarg));
+		}
+		
+	if(logToDisplay >= 1 && logToDisplay <= 32)
+		{
+			proxyinfo[client].logfilenum = logToDisplay - 1;
+			//   proxyinfo[client].logfilereadpos = 0;
+			
+			if(logFiles[proxyinfo[client].logfilenum].binary)
+				{
+					gi.cprintf (ent, PRINT_HIGH, "Log file %d is binary, use q2admin-logdump to read it.\n", logToDisplay);
+				}
+			else if(logFiles[proxyinfo[client].logfilenum].inuse)
+				{
+					q2l_flush();
+					gi.cprintf (ent, PRINT_HIGH, "Start Logfile %d (%s)\n", logToDisplay, logFiles[proxyinfo[client].logfilenum].filename);
+					addCmdQueue(client, QCMD_DISPLOGFILE, 0, 0, 0);
+				}
+			else
+				{
+					gi.cprintf (ent, PRINT_HIGH, "Log file %d not in use.\n", logToDisplay);
+				}
+		}
+	else
+		{
+			gi.cprintf (ent, PRINT_HIGH, "[sv] !displaylogfile logfilenum(1-32)\n");
+		}
+}
+
+
+void displayLogFileCont(edict_t *ent, int client, long logfilereadpos)
+{
+	int logNum = proxyinfo[client].logfilenum;
+	char logname[356];
+	char logline[4096];
+	FILE *logfilePtr;
+	
+	getLogFileName(logNum, logname);
+	logfilePtr = q2a_fopen(logname, sizeof(logname), "rt");
+	
+	if(logfilePtr)
+		{
+			fseek(logfilePtr, logfilereadpos, SEEK_SET);
+			
+			if(fgets(logline, 4096, logfilePtr) != NULL)
+				{
+					gi.cprintf (ent, PRINT_HIGH, "%s", logline);
+					logfilereadpos = ftell(logfilePtr);
+					addCmdQueue(client, QCMD_DISPLOGFILE, 0, logfilereadpos, 0);
+				}
+			else
+				{
+					gi.cprintf (ent, PRINT_HIGH, "End Logfile %d (%s)\n", logNum + 1, logFiles[logNum].filename);
+				}
+				
+			fprintf(logfilePtr, "%s\n", logline);
+			fclose(logfilePtr);
+		}
+	else
+		{
+			gi.cprintf (ent, PRINT_HIGH, "End Logfile %d (%s)\n", logNum + 1, logFiles[logNum].filename);
+		}
+}
+
+
+
+
+void clearlogfileRun(int startarg, edict_t *ent, int client)
+{
+	int logToDisplay = 0;
+	
+	if (gi.argc() > startarg)
+		{
+			logToDisplay = q2a_atoi(gi.argv(startarg));
+		}
+		
+	if(logToDisplay >= 1 && logToDisplay <= 32)
+		{
+			logToDisplay--;
+			
+			if(logFiles[logToDisplay].inuse)
+				{
+					char logname[356];
+					FILE *logfilePtr;
+					
+					closeLogFile(logToDisplay);
+					getLogFileName(logToDisplay, logname);
+					logfilePtr = q2a_fopen(logname, sizeof(logname), "w+t");
+					if(!logfilePtr)
+						{
+							gi.cprintf (ent, PRINT_HIGH, "logfilename \"%s\" couldn't be opened!\n", logFiles[logToDisplay].filename);
+						}
+					else
+						{
+							fclose(logfilePtr);
+							
+							if(q2a_strlen(logname) + 4 < sizeof(logname))
+								{
+									q2a_strcat(logname, ".idx");
+									remove(logname);
+								}
+								
+							gi.cprintf (ent, PRINT_HIGH, "Log file %d (%s) cleared\n", logToDisplay + 1, logFiles[logToDisplay].filename);
+						}
+				}
+			else
+				{
+					gi.cprintf (ent, PRINT_HIGH, "Log file %d not in use.\n", logToDisplay + 1);
+				}
+		}
+	else
+		{
+			gi.cprintf (ent, PRINT_HIGH, "[sv] !clearlogfile logfilenum(1-32)\n");
+		}
+}
+
+
+#define LOGTAILCMD    "[sv] !logtail [logtype] [player] [lines]\n"
+#define LOGTAIL_LINES    20
+
+
+static qboolean matchLogTail(logtail_t *tail, ZB_LOGTAIL *entry)
+{
+	if(tail->type >= 0 && entry->type != tail->type)
+		{
+			return FALSE;
+		}
+		
+	if(tail->player[0])
+		{
+			q2a_strcpy(buffer, entry->name);
+			q_strupr(buffer);
+			
+			if(!q2a_strstr(buffer, tail->player) && !startContains(entry->ip, tail->player))
+				{
+					return FALSE;
 				}
 		}
+		
+	return TRUE;
 }
 
 
-
-void displaylogfileRun(int startarg, edict_t *ent, int client)
+void logtailRun(int startarg, edict_t *ent, int client)
 {
-	int logToDisplay = 0;
+	logtail_t *tail = &proxyinfo[client].logtail;
+	unsigned long seq, oldest;
+	unsigned int i;
+	int argi, lines = LOGTAIL_LINES;
+	char *arg;
 	
-	if (gi.argc() > startarg)
+	if(!logTail)
 		{
-			logToDisplay = q2a_atoi(gi.argv(startarg));
+			gi.cprintf (ent, PRINT_HIGH, "The log tail is turned off (logtail_size).\n");
+			return;
 		}
 		
-	if(logToDisplay >= 1 && logToDisplay <= 32)
+	tail->type = -1;
+	tail->player[0] = 0;
+	
+	// any order: a number is the line count, a log type name is the type and
+	// anything else part of a player name or the start of an IP
+	for(argi = startarg; argi < gi.argc(); argi++)
 		{
-			proxyinfo[client].logfilenum = logToDisplay - 1;
-			//   proxyinfo[client].logfilereadpos = 0;
+			arg = gi.argv(argi);
 			
-			if(logFiles[proxyinfo[client].logfilenum].inuse)
+			if(*arg && arg[strspn(arg, "0123456789")] == 0)
 				{
-					gi.cprintf (ent, PRINT_HIGH, "Start Logfile %d (%s)\n", logToDisplay, logFiles[proxyinfo[client].logfilenum].filename);
-					addCmdQueue(client, QCMD_DISPLOGFILE, 0, 0, 0);
+					lines = q2a_atoi(arg);
+					continue;
+				}
+				
+			for(i = 0; i < LOGTYPES_MAX; i++)
+				{
+					if(Q_stricmp(logtypes[i].logtype, arg) == 0)
+						{
+							break;
+						}
+				}
+				
+			if(i < LOGTYPES_MAX)
+				{
+					tail->type = i;
 				}
 			else
 				{
-					gi.cprintf (ent, PRINT_HIGH, "Log file %d not in use.\n", logToDisplay);
+					q2a_strncpy(tail->player, arg, sizeof(tail->player) - 1);
+					tail->player[sizeof(tail->player) - 1] = 0;
+					q_strupr(tail->player);
+				}
+		}
+		
+	if(lines < 1)
+		{
+			gi.cprintf (ent, PRINT_HIGH, LOGTAILCMD);
+			return;
+		}
+		
+	// walk back from the newest event to find where the last n matches start
+	oldest = (logTailNext > logTailSize) ? logTailNext - logTailSize : 0;
+	tail->end = logTailNext;
+	tail->cursor = logTailNext;
+	tail->remaining = 0;
+	
+	for(seq = logTailNext; seq > oldest && tail->remaining < lines; seq--)
+		{
+			if(matchLogTail(tail, &logTail[(seq - 1) % logTailSize]))
+				{
+					tail->cursor = seq - 1;
+					tail->remaining++;
 				}
 		}
+		
+	gi.cprintf (ent, PRINT_HIGH, "Start Log Tail (%d of the last %lu events)\n", tail->remaining, logTailNext - oldest);
+	
+	if(tail->remaining)
+		{
+			addCmdQueue(client, QCMD_LOGTAIL, 0, 0, 0);
+		}
 	else
 		{
-			gi.cprintf (ent, PRINT_HIGH, "[sv] !displaylogfile logfilenum(1-32)\n");
+			gi.cprintf (ent, PRINT_HIGH, "End Log Tail\n");
 		}
 }
 
 
-void displayLogFileCont(edict_t *ent, int client, long logfilereadpos)
+void logTailCont(edict_t *ent, int client)
 {
-	int logNum = proxyinfo[client].logfilenum;
-	char logname[356];
-	char logline[4096];
-	FILE *logfilePtr;
+	logtail_t *tail = &proxyinfo[client].logtail;
+	unsigned long oldest = (logTailNext > logTailSize) ? logTailNext - logTailSize : 0;
+	ZB_LOGTAIL *entry;
+	struct tm *ts;
+	time_t secs;
+	char stamp[16];
 	
-	if(logFiles[logNum].mod)
+	if(!logTail)
 		{
-			sprintf(logname, "%s/%s", moddir, logFiles[logNum].filename);
+			return;
 		}
-	else
+		
+	// anything overwritten since the command was run is skipped
+	if(tail->cursor < oldest)
 		{
-			q2a_strcpy(logname, logFiles[logNum].filename);
+			tail->cursor = oldest;
 		}
 		
-	logfilePtr = q2a_fopen(logname, sizeof(logname), "rt");
-	
-	if(logfilePtr)
+	for(; tail->cursor < tail->end; tail->cursor++)
 		{
-			fseek(logfilePtr, logfilereadpos, SEEK_SET);
+			entry = &logTail[tail->cursor % logTailSize];
 			
-			if(fgets(logline, 4096, logfilePtr) != NULL)
+			if(!matchLogTail(tail, entry))
 				{
-					gi.cprintf (ent, PRINT_HIGH, "%s", logline);
-					logfilereadpos = ftell(logfilePtr);
-					addCmdQueue(client, QCMD_DISPLOGFILE, 0, logfilereadpos, 0);
+					continue;
+				}
+				
+			secs = (time_t)(entry->time / 1000);
+			ts = localtime(&secs);
+			
+			if(!ts || !strftime(stamp, sizeof(stamp), "%H:%M:%S", ts))
+				{
+					stamp[0] = 0;
+				}
+				
+			if(entry->client >= 0)
+				{
+					gi.cprintf (ent, PRINT_HIGH, "%s %s [%d] %s (%s) %d: %s\n", stamp, logtypes[entry->type].logtype, entry->client, entry->name, entry->ip, entry->number, entry->message);
 				}
 			else
 				{
-					gi.cprintf (ent, PRINT_HIGH, "End Logfile %d (%s)\n", logNum + 1, logFiles[logNum].filename);
+					gi.cprintf (ent, PRINT_HIGH, "%s %s %d: %s\n", stamp, logtypes[entry->type].logtype, entry->number, entry->message);
 				}
 				
-			fprintf(logfilePtr, "%s\n", logline);
-			fclose(logfilePtr);
+			tail->cursor++;
+			tail->remaining--;
+			break;
+		}
+		
+	if(tail->remaining > 0 && tail->cursor < tail->end)
+		{
+			addCmdQueue(client, QCMD_LOGTAIL, 0, 0, 0);
 		}
 	else
 		{
-			gi.cprintf (ent, PRINT_HIGH, "End Logfile %d (%s)\n", logNum + 1, logFiles[logNum].filename);
+			gi.cprintf (ent, PRINT_HIGH, "End Log Tail\n");
 		}
 }
 
 
+#define LOGQUERYCMD    "[sv] !logquery logfilenum(1-32) [from <line>] [type <logtype>] [name <name>] [ip <ip>] [hours <n>] [lines <n>]\n"
+#define LOGQUERY_LINES    10
+#define LOGQUERY_MAXLINES Q2L_QUERY_LINES
 
 
-void clearlogfileRun(int startarg, edict_t *ent, int client)
+// finds where the log file really is (q2a_fopen searches a few places) and
+// builds the name of its index.
+static qboolean getLogIndexPaths(int lognum, char *logname, size_t size, char *indexname)
 {
-	int logToDisplay = 0;
+	FILE *logfilePtr;
 	
-	if (gi.argc() > startarg)
+	if(q2l_is_open(lognum))
 		{
-			logToDisplay = q2a_atoi(gi.argv(startarg));
+			q2a_strncpy(logname, q2l_path(lognum), size - 1);
+			logname[size - 1] = 0;
+		}
+	else
+		{
+			getLogFileName(lognum, logname);
+			logfilePtr = q2a_fopen(logname, size, "rb");
+			
+			if(!logfilePtr)
+				{
+					return FALSE;
+				}
+				
+			fclose(logfilePtr);
 		}
 		
-	if(logToDisplay >= 1 && logToDisplay <= 32)
+	sprintf(indexname, "%s.idx", logname);
+	return TRUE;
+}
+
+
+static qboolean readLogIndex(FILE *indexPtr, unsigned long record, unsigned char *data)
+{
+	return fseek(indexPtr, (long)(record * Q2LI_RECORD_SIZE), SEEK_SET) == 0 && fread(data, Q2LI_RECORD_SIZE, 1, indexPtr) == 1;
+}
+
+
+void logqueryRun(int startarg, edict_t *ent, int client)
+{
+	logquery_t *query = &proxyinfo[client].logquery;
+	q2l_filter_t filter;
+	char logname[MAX_OSPATH];
+	char indexname[MAX_OSPATH + 8];
+	unsigned char record[Q2LI_RECORD_SIZE];
+	unsigned long count, low, high, mid, from = 0;
+	qboolean filtered = FALSE;
+	FILE *indexPtr;
+	char *cmd;
+	int lognum, argi;
+	unsigned int i;
+	
+	lognum = (gi.argc() > startarg) ? q2a_atoi(gi.argv(startarg)) : 0;
+	
+	if(lognum < 1 || lognum > 32)
 		{
-			logToDisplay--;
+			gi.cprintf (ent, PRINT_HIGH, LOGQUERYCMD);
+			return;
+		}
+		
+	lognum--;
+	
+	if(!logFiles[lognum].inuse)
+		{
+			gi.cprintf (ent, PRINT_HIGH, "Log file %d not in use.\n", lognum + 1);
+			return;
+		}
+		
+	if(logFiles[lognum].binary || logFiles[lognum].noindex)
+		{
+			gi.cprintf (ent, PRINT_HIGH, "Log file %d has no index.\n", lognum + 1);
+			return;
+		}
+		
+	query->lognum = lognum;
+	filter.lines = LOGQUERY_LINES;
+	filter.type = -1;
+	filter.namehash = 0;
+	filter.iphash = 0;
+	filter.since = 0;
+	
+	for(argi = startarg + 1; argi + 1 < gi.argc(); argi += 2)
+		{
+			cmd = gi.argv(argi);
 			
-			if(logFiles[logToDisplay].inuse)
+			if(Q_stricmp(cmd, "FROM") == 0)
 				{
-					char logname[356];
-					FILE *logfilePtr;
-					
-					if(logFiles[logToDisplay].mod)
+					from = (unsigned long)q2a_atoi(gi.argv(argi + 1));
+				}
+			else if(Q_stricmp(cmd, "TYPE") == 0)
+				{
+					for(i = 0; i < LOGTYPES_MAX; i++)
 						{
-							sprintf(logname, "%s/%s", moddir, logFiles[logToDisplay].filename);
+							if(Q_stricmp(logtypes[i].logtype, gi.argv(argi + 1)) == 0)
+								{
+									break;
+								}
 						}
-					else
+						
+					if(i >= LOGTYPES_MAX)
 						{
-							q2a_strcpy(logname, logFiles[logToDisplay].filename);
+							gi.cprintf (ent, PRINT_HIGH, LOGQUERYCMD);
+							return;
 						}
 						
-					logfilePtr = q2a_fopen(logname, sizeof(logname), "w+t");
-					if(!logfilePtr)
+					filter.type = i;
+					filtered = TRUE;
+				}
+			else if(Q_stricmp(cmd, "NAME") == 0)
+				{
+					cmd = gi.argv(argi + 1);
+					filter.namehash = q2li_hash(cmd, q2a_strlen(cmd));
+					filtered = TRUE;
+				}
+			else if(Q_stricmp(cmd, "IP") == 0)
+				{
+					cmd = gi.argv(argi + 1);
+					filter.iphash = q2li_hash(cmd, strcspn(cmd, ":"));
+					filtered = TRUE;
+				}
+			else if(Q_stricmp(cmd, "HOURS") == 0)
+				{
+					filter.since = getTimestampMs() - (long long)(q2a_atof(gi.argv(argi + 1)) * 3600000.0);
+					filtered = TRUE;
+				}
+			else if(Q_stricmp(cmd, "LINES") == 0)
+				{
+					filter.lines = q2a_atoi(gi.argv(argi + 1));
+					
+					if(filter.lines < 1)
 						{
-							gi.cprintf (ent, PRINT_HIGH, "logfilename \"%s\" couldn't be opened!\n", logFiles[logToDisplay].filename);
+							filter.lines = 1;
 						}
-					else
+					else if(filter.lines > LOGQUERY_MAXLINES)
 						{
-							fclose(logfilePtr);
-							gi.cprintf (ent, PRINT_HIGH, "Log file %d (%s) cleared\n", logToDisplay + 1, logFiles[logToDisplay].filename);
+							filter.lines = LOGQUERY_MAXLINES;
 						}
 				}
 			else
 				{
-					gi.cprintf (ent, PRINT_HIGH, "Log file %d not in use.\n", logToDisplay + 1);
+					gi.cprintf (ent, PRINT_HIGH, LOGQUERYCMD);
+					return;
 				}
 		}
+		
+	if(argi < gi.argc())
+		{
+			gi.cprintf (ent, PRINT_HIGH, LOGQUERYCMD);
+			return;
+		}
+		
+	q2l_flush();
+	
+	if(!getLogIndexPaths(lognum, logname, sizeof(logname), indexname) || (indexPtr = fopen(indexname, "rb")) == NULL)
+		{
+			gi.cprintf (ent, PRINT_HIGH, "Log file %d (%s) has no index yet.\n", lognum + 1, logFiles[lognum].filename);
+			return;
+		}
+		
+	fseek(indexPtr, 0, SEEK_END);
+	count = (unsigned long)ftell(indexPtr) / Q2LI_RECORD_SIZE;
+	
+	// a plain page with no starting line shows the end of the log
+	if(from)
+		{
+			low = from - 1;
+		}
+	else if(!filtered && count > (unsigned long)filter.lines)
+		{
+			low = count - filter.lines;
+		}
 	else
 		{
-			gi.cprintf (ent, PRINT_HIGH, "[sv] !clearlogfile logfilenum(1-32)\n");
+			low = 0;
+		}
+		
+	// lines are written in time order, so the first one in range can be found
+	// with a binary search of the index
+	if(filter.since)
+		{
+			high = count;
+			
+			while(low < high)
+				{
+					mid = low + (high - low) / 2;
+					
+					if(!readLogIndex(indexPtr, mid, record))
+						{
+							break;
+						}
+						
+					if((long long)q2lb_get64(record + 8) < filter.since)
+						{
+							low = mid + 1;
+						}
+					else
+						{
+							high = mid;
+						}
+				}
+		}
+		
+	fclose(indexPtr);
+	
+	if(!q2l_query_start(client, logname, indexname, low, count, &filter))
+		{
+			gi.cprintf (ent, PRINT_HIGH, "Log file %d (%s) could not be searched.\n", lognum + 1, logFiles[lognum].filename);
+			return;
+		}
+		
+	gi.cprintf (ent, PRINT_HIGH, "Start Log Query %d (%s), %lu indexed lines\n", lognum + 1, logFiles[lognum].filename, count);
+	addCmdQueue(client, QCMD_LOGQUERY, 0, 0, 0);
+}
+
+
+void logQueryCont(edict_t *ent, int client)
+{
+	logquery_t *query = &proxyinfo[client].logquery;
+	unsigned long line, cursor, end;
+	const char *text;
+	
+	switch(q2l_query_next(client, &line, &text))
+		{
+		case Q2L_QUERY_BUSY:
+			addCmdQueue(client, QCMD_LOGQUERY, 0, 0, 0);
+			return;
+			
+		case Q2L_QUERY_LINE:
+			gi.cprintf (ent, PRINT_HIGH, "%6lu: %s\n", line, text);
+			addCmdQueue(client, QCMD_LOGQUERY, 0, 0, 0);
+			return;
+		}
+		
+	cursor = q2l_query_cursor(client, &end);
+	q2l_query_stop(client);
+	
+	if(cursor < end)
+		{
+			gi.cprintf (ent, PRINT_HIGH, "End Log Query %d (continue with: from %lu)\n", query->lognum + 1, cursor + 1);
+		}
+	else
+		{
+			gi.cprintf (ent, PRINT_HIGH, "End Log Query %d\n", query->lognum + 1);
 		}
 }
 
 
-#define LOGFILECMD    "[sv] !logfile [view <logfilenum> / edit [filenum(1-32)] [mod] [filename] / del [filenum(1-32)]]\n"
+#define LOGFILECMD    "[sv] !logfile [view <logfilenum> / edit [filenum(1-32)] [mod] [binary] [noindex] [rotate MB] [daily] [keep n] [filename] / del [filenum(1-32)]]\n"
+
+
+static char *logFileRotation(int lognum)
+{
+	static char text[64];
+	
+	text[0] = 0;
+	
+	if(logFiles[lognum].rotatesize)
+		{
+			sprintf(text, " (rotate %luMB%s, keep %d)", logFiles[lognum].rotatesize / (1024 * 1024), logFiles[lognum].rotatedaily ? " daily" : "", logFiles[lognum].keep);
+		}
+	else if(logFiles[lognum].rotatedaily)
+		{
+			sprintf(text, " (rotate daily, keep %d)", logFiles[lognum].keep);
+		}
+		
+	return text;
+}
+
 
 void logfileRun(int startarg, edict_t *ent, int client)
 {
 	char *cmd;
 	int logfilenum;
 	char filename[256];
-	int mod;
+	qboolean mod, binary, noindex, daily;
+	unsigned long rotatesize;
+	int keep;
+	int argi;
 	
 	if (gi.argc() <= startarg)
 		{
@@ -711,7 +2081,7 @@ void logfileRun(int startarg, edict_t *ent, int client)
 	
 	if(Q_stricmp(cmd, "VIEW") == 0)
 		{
-			gi.cprintf (ent, PRINT_HIGH, "Start Logfile List\n\nFileNum  Mod  Filename\n");
+			gi.cprintf (ent, PRINT_HIGH, "Start Logfile List\n\nFileNum  Mod  Bin  Filename\n");
 			
 			if (gi.argc() > startarg + 1)
 				{
@@ -720,7 +2090,7 @@ void logfileRun(int startarg, edict_t *ent, int client)
 					if(logfilenum > 0 && logfilenum <= 32 && logFiles[logfilenum - 1].inuse)
 						{
 							logfilenum--;
-							gi.cprintf (ent, PRINT_HIGH, "  %3d    %s  %s\n", logfilenum + 1, logFiles[logfilenum].mod ? "Yes" : " No", logFiles[logfilenum].filename);
+							gi.cprintf (ent, PRINT_HIGH, "  %3d    %s  %s  %s%s\n", logfilenum + 1, logFiles[logfilenum].mod ? "Yes" : " No", logFiles[logfilenum].binary ? "Yes" : " No", logFiles[logfilenum].filename, logFileRotation(logfilenum));
 						}
 						
 					gi.cprintf (ent, PRINT_HIGH, "\nEnd Logfile List\n");
@@ -757,14 +2127,63 @@ void logfileRun(int startarg, edict_t *ent, int client)
 				
 			logfilenum--;
 			
-			cmd = gi.argv(startarg + 2);
-			mod = startContains(cmd, "mod");
+			mod = FALSE;
+			binary = FALSE;
+			noindex = FALSE;
+			daily = FALSE;
+			rotatesize = 0;
+			keep = LOGKEEP_DEFAULT;
 			
-			processstring(filename, mod ? gi.argv(startarg + 3) : cmd, sizeof(filename) - 1, 0);
+			for(argi = startarg + 2; ; argi++)
+				{
+					cmd = gi.argv(argi);
+					
+					if(Q_stricmp(cmd, "MOD") == 0)
+						{
+							mod = TRUE;
+						}
+					else if(Q_stricmp(cmd, "BINARY") == 0)
+						{
+							binary = TRUE;
+						}
+					else if(Q_stricmp(cmd, "NOINDEX") == 0)
+						{
+							noindex = TRUE;
+						}
+					else if(Q_stricmp(cmd, "DAILY") == 0)
+						{
+							daily = TRUE;
+						}
+					else if(Q_stricmp(cmd, "ROTATE") == 0)
+						{
+							rotatesize = (unsigned long)q2a_atoi(gi.argv(++argi)) * 1024 * 1024;
+						}
+					else if(Q_stricmp(cmd, "KEEP") == 0)
+						{
+							keep = q2a_atoi(gi.argv(++argi));
+							
+							if(keep < 1)
+								{
+									keep = 1;
+								}
+						}
+					else
+						{
+							break;
+						}
+				}
+				
+			processstring(filename, cmd, sizeof(filename) - 1, 0);
 			
 			if(!isBlank(filename))
 				{
+					closeLogFile(logfilenum);
 					logFiles[logfilenum].mod = mod;
+					logFiles[logfilenum].binary = binary;
+					logFiles[logfilenum].noindex = noindex;
+					logFiles[logfilenum].rotatesize = rotatesize;
+					logFiles[logfilenum].rotatedaily = daily;
+					logFiles[logfilenum].keep = keep;
 					q2a_strcpy(logFiles[logfilenum].filename, filename);
 					logFiles[logfilenum].inuse = TRUE;
 					gi.cprintf (ent, PRINT_HIGH, "Log file Added!\n");
@@ -795,6 +2214,7 @@ void logfileRun(int startarg, edict_t *ent, int client)
 				}
 			else
 				{
+					closeLogFile(logfilenum);
 					logFiles[logfilenum].inuse = FALSE;
 					gi.cprintf (ent, PRINT_HIGH, "Log file turned off!\n");
 				}
@@ -809,7 +2229,7 @@ void logfileRun(int startarg, edict_t *ent, int client)
 
 void displayLogFileListCont(edict_t *ent, int client, long logfilenum)
 {
-	gi.cprintf (ent, PRINT_HIGH, "  %3d    %s  %s\n", logfilenum + 1, logFiles[logfilenum].mod ? "Yes" : " No", logFiles[logfilenum].filename);
+	gi.cprintf (ent, PRINT_HIGH, "  %3d    %s  %s  %s%s\n", logfilenum + 1, logFiles[logfilenum].mod ? "Yes" : " No", logFiles[logfilenum].binary ? "Yes" : " No", logFiles[logfilenum].filename, logFileRotation(logfilenum));
 	
 	for(logfilenum++; logfilenum < 32; logfilenum++)
 		{
@@ -831,7 +2251,7 @@ void displayLogFileListCont(edict_t *ent, int client, long logfilenum)
 
 
 
-#define LOGEVENTCMD    "[sv] !logevent [view <logtype> / edit [logtype] <log [yes/no]> <logfiles [logfile[+logfile...]]> <format \"format\">]\n"
+#define LOGEVENTCMD    "[sv] !logevent [view <logtype> / edit [logtype] <log [yes/no]> <logfiles [logfile[+logfile...]]> <rate n> <burst n> <sample n> <format \"format\">]\n"
 
 void logeventRun(int startarg, edict_t *ent, int client)
 {
@@ -842,6 +2262,7 @@ void logeventRun(int startarg, edict_t *ent, int client)
 	qboolean log;
 	unsigned long logfiles;
 	unsigned long lognum;
+	unsigned int rate, burst, sample;
 	char format[4096];
 	
 	if (gi.argc() <= startarg)
@@ -898,6 +2319,9 @@ void logeventRun(int startarg, edict_t *ent, int client)
 						
 					log = logtypes[i].log;
 					logfiles = logtypes[i].logfiles;
+					rate = logtypes[i].rate;
+					burst = logtypes[i].burst;
+					sample = logtypes[i].sample;
 					q2a_strcpy(format, logtypes[i].format);
 					
 					for(argi = startarg + 2; gi.argc() > argi; argi++)
@@ -989,6 +2413,28 @@ void logeventRun(int startarg, edict_t *ent, int client)
 											return;
 										}
 								}
+							else if(Q_stricmp(cmd, "RATE") == 0 || Q_stricmp(cmd, "BURST") == 0 || Q_stricmp(cmd, "SAMPLE") == 0)
+								{
+									argi++;
+									if(gi.argc() <= argi)
+										{
+											gi.cprintf (ent, PRINT_HIGH, LOGEVENTCMD);
+											return;
+										}
+										
+									if(Q_stricmp(cmd, "RATE") == 0)
+										{
+											rate = (unsigned int)q2a_atoi(gi.argv(argi));
+										}
+									else if(Q_stricmp(cmd, "BURST") == 0)
+										{
+											burst = (unsigned int)q2a_atoi(gi.argv(argi));
+										}
+									else
+										{
+											sample = (unsigned int)q2a_atoi(gi.argv(argi));
+										}
+								}
 							else if(Q_stricmp(cmd, "FORMAT") == 0)
 								{
 									argi++;
@@ -1017,7 +2463,12 @@ void logeventRun(int startarg, edict_t *ent, int client)
 						
 					logtypes[i].log = log;
 					logtypes[i].logfiles = logfiles;
+					logtypes[i].rate = rate;
+					logtypes[i].burst = burst;
+					logtypes[i].sample = sample;
+					resetLogLimit(i);
 					q2a_strcpy(logtypes[i].format, format);
+					compileLogFormat(i);
 					
 					displayLogEventListCont(ent, client, i, TRUE);
 				}
@@ -1061,6 +2512,16 @@ void displayLogEventListCont(edict_t *ent, int client, long logevent, qboolean o
 				}
 		}
 		
+	if(logtypes[logevent].rate)
+		{
+			sprintf(buffer + q2a_strlen(buffer), "rate %u/%u ", logtypes[logevent].rate, logtypes[logevent].burst);
+		}
+		
+	if(logtypes[logevent].sample > 1)
+		{
+			sprintf(buffer + q2a_strlen(buffer), "1 in %u ", logtypes[logevent].sample);
+		}
+		
 	gi.cprintf (ent, PRINT_HIGH, "%-20s %s %s \"%s\"\n", logtypes[logevent].logtype, logtypes[logevent].log ? "Yes" : " No", buffer, logtypes[logevent].format);
 	
 	if(onetimeonly)
@@ -0,0 +1,156 @@
+/*-------------------------------
+# SPDX-License-Identifier: ISC
+#
+# Copyright © 2022 Daniel Wolf <<nephatrine@gmail.com>>
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+# REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+# AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+# INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+# LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+# OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+# -----------------------------*/
+
+#ifndef ZB_LOGFORMAT_H
+#define ZB_LOGFORMAT_H 1
+
+#include <ctype.h>
+#include <stdint.h>
+#include <string.h>
+
+// Layout of BINARY log files, shared by the module and q2admin-logdump.
+//
+// A file is a sequence of records. Every record starts with the same 16 byte
+// header and all fields are little-endian:
+//
+//   u16 size    whole record including this header
+//   u8  kind    Q2LB_KIND_*
+//   u8  type    zb_logtypesenum value (events only)
+//   u32 tick    server frame number
+//   i64 time    wall clock, milliseconds since the epoch
+//
+// Each time the module opens the file it writes a SESSION record followed by
+// one TYPENAME record per log type. String ids are only valid until the next
+// SESSION record. A name or IP is sent as a STRING record the first time it
+// is used in a session, and events refer to it by id (0 means none).
+
+#define Q2LB_MAGIC "Q2AL"
+#define Q2LB_VERSION 1
+
+#define Q2LB_HEADER_SIZE 16
+#define Q2LB_SESSION_SIZE ( Q2LB_HEADER_SIZE + 8 )
+#define Q2LB_EVENT_SIZE ( Q2LB_HEADER_SIZE + 20 )
+#define Q2LB_STRING_SIZE ( Q2LB_HEADER_SIZE + 6 )
+#define Q2LB_RECORD_MAX 0xFFFF
+
+enum q2lb_kind_e
+{
+	Q2LB_KIND_SESSION  = 0, // char magic[4], u16 version, u16 port
+	Q2LB_KIND_TYPENAME = 1, // u8 name bytes (type is in the header)
+	Q2LB_KIND_STRING   = 2, // u32 id, u16 length, u8 bytes
+	Q2LB_KIND_EVENT    = 3  // i16 client, u16 message length, u32 name id, u32 ip id, i32 number, f32 number2, u8 message bytes
+};
+
+static inline void q2lb_put16( unsigned char * p, uint16_t v )
+{
+	p[0] = (unsigned char)v;
+	p[1] = (unsigned char)( v >> 8 );
+}
+
+static inline void q2lb_put32( unsigned char * p, uint32_t v )
+{
+	q2lb_put16( p, (uint16_t)v );
+	q2lb_put16( p + 2, (uint16_t)( v >> 16 ) );
+}
+
+static inline void q2lb_put64( unsigned char * p, uint64_t v )
+{
+	q2lb_put32( p, (uint32_t)v );
+	q2lb_put32( p + 4, (uint32_t)( v >> 32 ) );
+}
+
+static inline uint16_t q2lb_get16( const unsigned char * p ) { return (uint16_t)( p[0] | ( p[1] << 8 ) ); }
+static inline uint32_t q2lb_get32( const unsigned char * p ) { return (uint32_t)q2lb_get16( p ) | ( (uint32_t)q2lb_get16( p + 2 ) << 16 ); }
+static inline uint64_t q2lb_get64( const unsigned char * p ) { return (uint64_t)q2lb_get32( p ) | ( (uint64_t)q2lb_get32( p + 4 ) << 32 ); }
+
+static inline void q2lb_put_header( unsigned char * p, size_t size, int kind, int type, uint32_t tick, int64_t time )
+{
+	q2lb_put16( p, (uint16_t)size );
+	p[2] = (unsigned char)kind;
+	p[3] = (unsigned char)type;
+	q2lb_put32( p + 4, tick );
+	q2lb_put64( p + 8, (uint64_t)time );
+}
+
+static inline void q2lb_put_float( unsigned char * p, float v )
+{
+	uint32_t bits;
+
+	memcpy( &bits, &v, sizeof( bits ) );
+	q2lb_put32( p, bits );
+}
+
+static inline float q2lb_get_float( const unsigned char * p )
+{
+	uint32_t bits = q2lb_get32( p );
+	float    v;
+
+	memcpy( &v, &bits, sizeof( v ) );
+	return v;
+}
+
+// Text log files get a sidecar "<name>.idx" holding one fixed size record per
+// line, so line L is record L-1 and paging or searching only reads the index
+// and then seeks straight to the matching lines.
+//
+//   u64 offset    where the line starts in the log
+//   i64 time      wall clock, milliseconds since the epoch
+//   u32 name      q2li_hash of the player name (0 means none)
+//   u32 ip        q2li_hash of the player IP without its port (0 means none)
+//   u16 length    line length including the newline
+//   u8  type      zb_logtypesenum value (Q2LI_TYPE_UNKNOWN for lines added back)
+//   u8  reserved
+//   i32 client    client slot (-1 means none)
+
+#define Q2LI_RECORD_SIZE 32
+#define Q2LI_TYPE_UNKNOWN 0xFF
+
+// Next to the index "<name>.ids" sums up every Q2LI_BLOCK records, entry B
+// covering records B * Q2LI_BLOCK on, so a filtered search only reads the
+// blocks that can hold a match and seeks past the rest:
+//
+//   u64 offset    offset of the block's first line, as in its index record
+//   i64 time      time of the block's first line, as in its index record
+//   u64 types     bit per type in the block, types 63 and up share bit 63
+//   u8  names[32] two bits per name hash in the block, see q2li_bloom_bit
+//   u8  ips[32]   the same for the IP hashes
+//
+// Only whole blocks are summed up. Searches add the blocks filled since the
+// last one, and start the file again when its first or last entry no longer
+// matches the index (it was rebuilt, or the log was cleared or rotated).
+
+#define Q2LI_BLOCK 1024
+#define Q2LI_SUMMARY_SIZE 88
+
+static inline int q2li_type_bit( int type ) { return type < 63 ? type : 63; }
+
+// bit n (0 or 1) of the 256 a hash sets in a summary's names or ips
+static inline int q2li_bloom_bit( uint32_t hash, int n ) { return n ? ( hash >> 16 ) & 0xFF : hash & 0xFF; }
+
+// Case-insensitive FNV-1a, never 0.
+static inline uint32_t q2li_hash( const char * text, size_t length )
+{
+	uint32_t hash = 2166136261u;
+	size_t   i;
+
+	for( i = 0; i < length; ++i ) hash = ( hash ^ (unsigned char)tolower( (unsigned char)text[i] ) ) * 16777619u;
+
+	return hash ? hash : 1;
+}
+
+#endif
@@ -0,0 +1,1154 @@
+/*-------------------------------
+# SPDX-License-Identifier: ISC
+#
+# Copyright © 2022 Daniel Wolf <<nephatrine@gmail.com>>
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+# REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+# AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+# INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+# LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+# OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+# -----------------------------*/
+
+#ifdef USE_PTHREADS
+#	define _GNU_SOURCE
+#endif
+
+#include "g_local.h"
+#include "zb_logformat.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef USE_PTHREADS
+#	include <pthread.h>
+#	include <sched.h>
+#	include <time.h>
+#	ifdef USE_ZLIB
+#		include <zlib.h>
+#		define Q2L_COMPRESS 1
+#	endif
+#endif
+
+//
+// Configuration
+//
+
+int      logbuffer_size  = 256;   // KiB, read once at InitGame
+int      logflush_bytes  = 16384; // wake the writer once this much is queued
+int      logflush_time   = 1000;  // ... or this many milliseconds have passed
+qboolean logbuffer_block = FALSE; // wait for space instead of dropping lines
+
+//
+// Open Files
+//
+
+typedef struct
+{
+	FILE *       fp; // the writer's, swapped by a rotation
+	char         path[MAX_OSPATH];
+	unsigned int dropped;
+	int          binary;
+	int          open;   // attached, as far as the game thread knows
+	int          failed; // a rotation could not reopen it
+} q2l_file_t;
+
+static q2l_file_t q2l_files[Q2L_MAX_FILES];
+
+// failed is set by the writer thread and read by the game thread
+#ifdef USE_PTHREADS
+#	define Q2L_LOAD( v ) __atomic_load_n( &( v ), __ATOMIC_ACQUIRE )
+#	define Q2L_STORE( v, n ) __atomic_store_n( &( v ), ( n ), __ATOMIC_RELEASE )
+#else
+#	define Q2L_LOAD( v ) ( v )
+#	define Q2L_STORE( v, n ) ( ( v ) = ( n ) )
+#endif
+static float      q2l_last_flush = 0.0f;
+
+static void q2l_write_direct( int slot, const char * data, size_t length )
+{
+	if( q2l_files[slot].fp ) fwrite( data, 1, length, q2l_files[slot].fp );
+}
+
+static void q2l_flush_direct()
+{
+	int i;
+
+	for( i = 0; i < Q2L_MAX_FILES; ++i )
+		if( q2l_files[i].fp ) fflush( q2l_files[i].fp );
+}
+
+// Renames the file in slot to <path>.1, shifting older segments up one and
+// dropping whatever falls past keep, and opens the path again for the lines
+// that follow. index is the slot of its sidecar index, which starts again
+// empty since it can't follow the segment into its archive.
+static void q2l_rotate_direct( int slot, int index, int keep, int text )
+{
+	q2l_file_t * file = &q2l_files[slot];
+	char         from[MAX_OSPATH + 16];
+	char         to[MAX_OSPATH + 16];
+	int          seg;
+
+	if( !file->fp ) return;
+
+#	ifdef Q2L_COMPRESS
+	// the last segment is still read from its .1 name
+	while( q2l_compress_busy( slot ) )
+	{
+		struct timespec pause = { 0, 1000000L };
+		nanosleep( &pause, NULL );
+	}
+#	endif
+
+	fclose( file->fp );
+	file->fp = NULL;
+
+	if( index >= 0 && q2l_files[index].fp )
+	{
+		fclose( q2l_files[index].fp );
+		q2l_files[index].fp = fopen( q2l_files[index].path, "wb" );
+		if( !q2l_files[index].fp ) Q2L_STORE( q2l_files[index].failed, 1 );
+	}
+
+	snprintf( to, sizeof( to ), "%s.%d", file->path, keep );
+	remove( to );
+	snprintf( to, sizeof( to ), "%s.%d.gz", file->path, keep );
+	remove( to );
+
+	for( seg = keep - 1; seg >= 1; seg-- )
+	{
+		snprintf( from, sizeof( from ), "%s.%d", file->path, seg );
+		snprintf( to, sizeof( to ), "%s.%d", file->path, seg + 1 );
+		rename( from, to );
+
+		snprintf( from, sizeof( from ), "%s.%d.gz", file->path, seg );
+		snprintf( to, sizeof( to ), "%s.%d.gz", file->path, seg + 1 );
+		rename( from, to );
+	}
+
+	// left closed, so the game thread opens it again and warns
+	snprintf( to, sizeof( to ), "%s.1", file->path );
+	if( rename( file->path, to ) != 0 )
+	{
+		Q2L_STORE( file->failed, 1 );
+		return;
+	}
+
+	q2l_compress( slot, to );
+
+	file->fp = fopen( file->path, text ? "at" : "ab" );
+	if( !file->fp ) Q2L_STORE( file->failed, 1 );
+}
+
+#ifdef USE_PTHREADS
+
+//
+// Ring Buffer
+//
+// Single producer (game thread), single consumer (writer thread). The head and
+// tail are free-running byte counters; only the producer stores head and only
+// the consumer stores tail, so the hot path needs no lock.
+//
+
+#	define Q2L_ALIGN( n ) ( ( (size_t)( n ) + 7 ) & ~(size_t)7 )
+#	define Q2L_WRAP 0xFFFF
+#	define Q2L_ROTATE 0x8000 // added to the slot of a q2l_rotate_t record
+
+typedef struct
+{
+	int16_t index;
+	int16_t keep;
+	int32_t text;
+} q2l_rotate_t;
+
+typedef struct
+{
+	uint16_t slot;
+	uint16_t reserved;
+	uint32_t length;
+} q2l_record_t;
+
+static struct
+{
+	char *          ring;
+	size_t          capacity;
+	size_t          mask;
+	size_t          head;
+	size_t          tail;
+	int             signaled;
+	int             running;
+	unsigned int    flush_req;
+	unsigned int    flush_done;
+	pthread_t       thread;
+	pthread_mutex_t guard;
+	pthread_mutex_t files_guard;
+	pthread_cond_t  wake;
+	pthread_cond_t  done;
+} q2l;
+
+static void q2l_wake_writer()
+{
+	if( __atomic_exchange_n( &q2l.signaled, 1, __ATOMIC_ACQ_REL ) ) return;
+
+	pthread_mutex_lock( &q2l.guard );
+	pthread_cond_signal( &q2l.wake );
+	pthread_mutex_unlock( &q2l.guard );
+}
+
+static void q2l_drain()
+{
+	size_t head = __atomic_load_n( &q2l.head, __ATOMIC_ACQUIRE );
+	size_t tail = q2l.tail;
+
+	pthread_mutex_lock( &q2l.files_guard );
+	while( tail != head )
+	{
+		q2l_record_t * record = (q2l_record_t *)( q2l.ring + ( tail & q2l.mask ) );
+
+		if( record->slot == Q2L_WRAP ) { tail += q2l.capacity - ( tail & q2l.mask ); }
+		else if( record->slot & Q2L_ROTATE )
+		{
+			q2l_rotate_t * rotate = (q2l_rotate_t *)( record + 1 );
+
+			q2l_rotate_direct( record->slot & ~Q2L_ROTATE, rotate->index, rotate->keep, rotate->text );
+			tail += sizeof( q2l_record_t ) + Q2L_ALIGN( record->length );
+		}
+		else
+		{
+			q2l_write_direct( record->slot, (const char *)( record + 1 ), record->length );
+			tail += sizeof( q2l_record_t ) + Q2L_ALIGN( record->length );
+		}
+
+		__atomic_store_n( &q2l.tail, tail, __ATOMIC_RELEASE );
+	}
+	pthread_mutex_unlock( &q2l.files_guard );
+}
+
+static void * q2l_thread_run( void * arg )
+{
+	struct timespec deadline;
+	unsigned int    request;
+	int             running = 1;
+
+	(void)arg;
+
+	while( running )
+	{
+		// signaled is cleared under the guard, so a wake or flush request
+		// that comes in after this point is seen by the next pass
+		pthread_mutex_lock( &q2l.guard );
+		if( !__atomic_load_n( &q2l.signaled, __ATOMIC_ACQUIRE ) && q2l.flush_req == q2l.flush_done && q2l.running )
+		{
+			clock_gettime( CLOCK_REALTIME, &deadline );
+			deadline.tv_sec += logflush_time / 1000;
+			deadline.tv_nsec += ( logflush_time % 1000 ) * 1000000L;
+			if( deadline.tv_nsec >= 1000000000L )
+			{
+				deadline.tv_sec += 1;
+				deadline.tv_nsec -= 1000000000L;
+			}
+			pthread_cond_timedwait( &q2l.wake, &q2l.guard, &deadline );
+		}
+		__atomic_store_n( &q2l.signaled, 0, __ATOMIC_RELEASE );
+		request = q2l.flush_req;
+		running = q2l.running;
+		pthread_mutex_unlock( &q2l.guard );
+
+		q2l_drain();
+
+		pthread_mutex_lock( &q2l.files_guard );
+		q2l_flush_direct();
+		pthread_mutex_unlock( &q2l.files_guard );
+
+		pthread_mutex_lock( &q2l.guard );
+		q2l.flush_done = request;
+		pthread_cond_broadcast( &q2l.done );
+		pthread_mutex_unlock( &q2l.guard );
+	}
+
+	return NULL;
+}
+
+// Reserve room for one record and return where its payload goes, or NULL if
+// the line has to be dropped.
+static char * q2l_reserve( int slot, size_t length )
+{
+	size_t need = sizeof( q2l_record_t ) + Q2L_ALIGN( length );
+	size_t head = q2l.head;
+	size_t room = q2l.capacity - ( head & q2l.mask );
+	size_t total = ( room < need ) ? room + need : need;
+
+	while( q2l.capacity - ( head - __atomic_load_n( &q2l.tail, __ATOMIC_ACQUIRE ) ) < total )
+	{
+		if( !logbuffer_block ) return NULL;
+
+		q2l_wake_writer();
+		sched_yield();
+	}
+
+	if( room < need )
+	{
+		( (q2l_record_t *)( q2l.ring + ( head & q2l.mask ) ) )->slot = Q2L_WRAP;
+		head += room;
+		__atomic_store_n( &q2l.head, head, __ATOMIC_RELEASE );
+	}
+
+	q2l_record_t * record = (q2l_record_t *)( q2l.ring + ( head & q2l.mask ) );
+	record->slot          = (uint16_t)slot;
+	record->reserved      = 0;
+	record->length        = (uint32_t)length;
+
+	return (char *)( record + 1 );
+}
+
+static void q2l_commit( size_t length )
+{
+	size_t head = q2l.head + sizeof( q2l_record_t ) + Q2L_ALIGN( length );
+
+	__atomic_store_n( &q2l.head, head, __ATOMIC_RELEASE );
+	if( head - __atomic_load_n( &q2l.tail, __ATOMIC_ACQUIRE ) >= (size_t)logflush_bytes ) q2l_wake_writer();
+}
+
+static int q2l_push( int slot, const char * data, size_t length )
+{
+	char * payload = q2l_reserve( slot, length );
+
+	if( payload == NULL ) return 0;
+
+	memcpy( payload, data, length );
+	q2l_commit( length );
+	return 1;
+}
+
+#endif
+
+#ifdef Q2L_COMPRESS
+
+//
+// Segment Compression
+//
+// A second thread so gzipping a large segment never holds up the writer. Jobs
+// are one per slot; the game thread only queues them and polls pending.
+//
+
+static struct
+{
+	char            path[Q2L_MAX_FILES][MAX_OSPATH];
+	int             pending[Q2L_MAX_FILES];
+	int             started;
+	int             stop;
+	pthread_t       thread;
+	pthread_mutex_t guard;
+	pthread_cond_t  wake;
+} q2z;
+
+static int q2z_gzip( const char * source )
+{
+	static char buffer[65536];
+	char        target[MAX_OSPATH + 4];
+	FILE *      in;
+	gzFile      out;
+	size_t      length;
+	int         failed = 0;
+
+	snprintf( target, sizeof( target ), "%s.gz", source );
+
+	in = fopen( source, "rb" );
+	if( in == NULL ) return 0;
+
+	out = gzopen( target, "wb" );
+	if( out == NULL )
+	{
+		fclose( in );
+		return 0;
+	}
+
+	while( ( length = fread( buffer, 1, sizeof( buffer ), in ) ) > 0 )
+	{
+		if( __atomic_load_n( &q2z.stop, __ATOMIC_ACQUIRE ) || gzwrite( out, buffer, (unsigned)length ) != (int)length )
+		{
+			failed = 1;
+			break;
+		}
+	}
+
+	fclose( in );
+	if( gzclose( out ) != Z_OK ) failed = 1;
+
+	// an unfinished archive is removed and the plain segment kept instead
+	if( failed )
+	{
+		remove( target );
+		return 0;
+	}
+
+	remove( source );
+	return 1;
+}
+
+static void * q2z_thread_run( void * arg )
+{
+	char source[MAX_OSPATH];
+	int  i;
+
+	(void)arg;
+
+	pthread_mutex_lock( &q2z.guard );
+	while( !q2z.stop )
+	{
+		for( i = 0; i < Q2L_MAX_FILES; ++i )
+			if( __atomic_load_n( &q2z.pending[i], __ATOMIC_ACQUIRE ) ) break;
+
+		if( i >= Q2L_MAX_FILES )
+		{
+			pthread_cond_wait( &q2z.wake, &q2z.guard );
+			continue;
+		}
+
+		q2a_strcpy( source, q2z.path[i] );
+		pthread_mutex_unlock( &q2z.guard );
+
+		q2z_gzip( source );
+
+		pthread_mutex_lock( &q2z.guard );
+		__atomic_store_n( &q2z.pending[i], 0, __ATOMIC_RELEASE );
+	}
+	pthread_mutex_unlock( &q2z.guard );
+
+	return NULL;
+}
+
+static void q2z_shutdown()
+{
+	if( !q2z.started ) return;
+
+	pthread_mutex_lock( &q2z.guard );
+	__atomic_store_n( &q2z.stop, 1, __ATOMIC_RELEASE );
+	pthread_cond_signal( &q2z.wake );
+	pthread_mutex_unlock( &q2z.guard );
+
+	pthread_join( q2z.thread, NULL );
+	pthread_cond_destroy( &q2z.wake );
+	pthread_mutex_destroy( &q2z.guard );
+	memset( &q2z, 0, sizeof( q2z ) );
+}
+
+#endif
+
+//
+// Index Queries
+//
+// !logquery walks a log's sidecar index on its own thread so a search through
+// a large log never holds up a frame; the game thread starts it and prints the
+// lines found one per frame. Without pthreads a slice of the index is searched
+// each frame instead. A search by type, name or IP first brings the index's
+// block summaries up to date (on the thread only) and then skips every block
+// they rule out.
+//
+
+#define Q2L_QUERY_SLICE 8192 // index records searched per frame without the thread
+
+typedef struct
+{
+	char          logname[MAX_OSPATH];
+	char          indexname[MAX_OSPATH + 8];
+	char          summaryname[MAX_OSPATH + 8];
+	q2l_filter_t  filter;
+	unsigned char *summary;  // Q2LI_SUMMARY_SIZE per whole block, NULL until loaded
+	unsigned long blocks;
+	int           summed;    // loaded, or not worth it for this filter
+	unsigned long cursor;    // next index record to look at
+	unsigned long end;
+	int           found;     // published to the game thread after line/text
+	int           shown;
+	int           done;
+	int           scanning;  // the thread has it, so stopping leaves the free to the thread
+	int           cancelled;
+	unsigned long line[Q2L_QUERY_LINES];
+	char          text[Q2L_QUERY_LINES][Q2L_QUERY_TEXT];
+} q2l_query_t;
+
+static q2l_query_t * q2l_queries[Q2L_MAX_QUERIES];
+
+static void q2l_query_free( q2l_query_t * query )
+{
+	free( query->summary );
+	free( query );
+}
+
+static void q2l_summary_add( unsigned char * summary, const unsigned char * record )
+{
+	uint64_t types = q2lb_get64( summary + 16 ) | ( 1ull << q2li_type_bit( record[26] ) );
+	uint32_t hash;
+	int      n;
+
+	q2lb_put64( summary + 16, types );
+
+	if( ( hash = q2lb_get32( record + 16 ) ) != 0 )
+		for( n = 0; n < 2; ++n ) summary[24 + q2li_bloom_bit( hash, n ) / 8] |= (unsigned char)( 1 << ( q2li_bloom_bit( hash, n ) % 8 ) );
+
+	if( ( hash = q2lb_get32( record + 20 ) ) != 0 )
+		for( n = 0; n < 2; ++n ) summary[56 + q2li_bloom_bit( hash, n ) / 8] |= (unsigned char)( 1 << ( q2li_bloom_bit( hash, n ) % 8 ) );
+}
+
+static int q2l_summary_has( const unsigned char * bloom, uint32_t hash )
+{
+	int n;
+
+	for( n = 0; n < 2; ++n )
+		if( !( bloom[q2li_bloom_bit( hash, n ) / 8] & ( 1 << ( q2li_bloom_bit( hash, n ) % 8 ) ) ) ) return 0;
+
+	return 1;
+}
+
+// 0 if nothing in the block can match the filter
+static int q2l_summary_match( const unsigned char * summary, const q2l_filter_t * filter )
+{
+	if( filter->type >= 0 && !( q2lb_get64( summary + 16 ) & ( 1ull << q2li_type_bit( filter->type ) ) ) ) return 0;
+	if( filter->namehash && !q2l_summary_has( summary + 24, filter->namehash ) ) return 0;
+	if( filter->iphash && !q2l_summary_has( summary + 56, filter->iphash ) ) return 0;
+	return 1;
+}
+
+// 0 unless the summary's offset and time are those of the index record
+static int q2l_summary_fits( FILE * indexPtr, const unsigned char * summary, unsigned long block )
+{
+	unsigned char record[Q2LI_RECORD_SIZE];
+
+	if( fseek( indexPtr, (long)( block * Q2LI_BLOCK * Q2LI_RECORD_SIZE ), SEEK_SET ) != 0 || fread( record, Q2LI_RECORD_SIZE, 1, indexPtr ) != 1 ) return 0;
+
+	return !memcmp( record, summary, 16 );
+}
+
+// loads the summaries of the index's whole blocks, adding those it lacks when
+// build is set. Left without any when they can't be read or written.
+static void q2l_summary_load( q2l_query_t * query, FILE * indexPtr, int build )
+{
+	unsigned char  records[128 * Q2LI_RECORD_SIZE];
+	unsigned char *summary;
+	unsigned long  blocks = query->end / Q2LI_BLOCK, have = 0, i, want;
+	size_t         got, n;
+	FILE *         summaryPtr;
+	long           size;
+
+	query->summed = 1;
+
+	if( query->filter.type < 0 && !query->filter.namehash && !query->filter.iphash ) return;
+	if( !blocks || ( query->summary = (unsigned char *)calloc( blocks, Q2LI_SUMMARY_SIZE ) ) == NULL ) return;
+
+	if( ( summaryPtr = fopen( query->summaryname, "rb" ) ) != NULL )
+	{
+		fseek( summaryPtr, 0, SEEK_END );
+		size = ftell( summaryPtr );
+		have = size > 0 ? (unsigned long)size / Q2LI_SUMMARY_SIZE : 0;
+		if( have > blocks ) have = 0;
+
+		fseek( summaryPtr, 0, SEEK_SET );
+		if( have && fread( query->summary, Q2LI_SUMMARY_SIZE, have, summaryPtr ) != have ) have = 0;
+		fclose( summaryPtr );
+
+		if( have && ( !q2l_summary_fits( indexPtr, query->summary, 0 ) || !q2l_summary_fits( indexPtr, query->summary + ( have - 1 ) * Q2LI_SUMMARY_SIZE, have - 1 ) ) ) have = 0;
+	}
+
+	query->blocks = have;
+	if( !build || have == blocks ) return;
+
+	summaryPtr = fopen( query->summaryname, have ? "ab" : "wb" );
+	if( summaryPtr == NULL || fseek( indexPtr, (long)( have * Q2LI_BLOCK * Q2LI_RECORD_SIZE ), SEEK_SET ) != 0 )
+	{
+		if( summaryPtr ) fclose( summaryPtr );
+		return;
+	}
+
+	for( ; have < blocks && !Q2L_LOAD( query->cancelled ); ++have )
+	{
+		summary = query->summary + have * Q2LI_SUMMARY_SIZE;
+		memset( summary, 0, Q2LI_SUMMARY_SIZE );
+
+		for( i = 0; i < Q2LI_BLOCK; i += got )
+		{
+			want = Q2LI_BLOCK - i;
+			if( want > sizeof( records ) / Q2LI_RECORD_SIZE ) want = sizeof( records ) / Q2LI_RECORD_SIZE;
+
+			got = fread( records, Q2LI_RECORD_SIZE, want, indexPtr );
+			if( !got ) break;
+
+			if( !i ) memcpy( summary, records, 16 );
+			for( n = 0; n < got; ++n ) q2l_summary_add( summary, records + n * Q2LI_RECORD_SIZE );
+		}
+
+		if( i < Q2LI_BLOCK || fwrite( summary, Q2LI_SUMMARY_SIZE, 1, summaryPtr ) != 1 ) break;
+	}
+
+	fclose( summaryPtr );
+	query->blocks = have;
+}
+
+// searches from the cursor until the wanted lines are found or the end is
+// reached; a limit also stops it after that many records or the first match
+static void q2l_query_scan( q2l_query_t * query, unsigned long limit )
+{
+	unsigned char  records[128 * Q2LI_RECORD_SIZE];
+	unsigned char *record;
+	unsigned long  scanned = 0, want, block;
+	size_t         got, n, len;
+	FILE *         indexPtr, *logPtr;
+	int            found = query->found;
+	int            matched = 0;
+
+	indexPtr = fopen( query->indexname, "rb" );
+	logPtr   = fopen( query->logname, "rb" );
+
+	// without the thread the summaries are only read, building them could take a while
+	if( indexPtr && !query->summed ) q2l_summary_load( query, indexPtr, !limit );
+
+	if( indexPtr == NULL || logPtr == NULL || fseek( indexPtr, (long)( query->cursor * Q2LI_RECORD_SIZE ), SEEK_SET ) != 0 ) query->end = query->cursor;
+
+	while( query->cursor < query->end && found < query->filter.lines && ( !limit || ( scanned < limit && !matched ) ) )
+	{
+		if( Q2L_LOAD( query->cancelled ) ) break;
+
+		block = query->cursor / Q2LI_BLOCK;
+		if( block < query->blocks && !q2l_summary_match( query->summary + block * Q2LI_SUMMARY_SIZE, &query->filter ) )
+		{
+			query->cursor = ( block + 1 ) * Q2LI_BLOCK;
+			if( query->cursor > query->end ) query->cursor = query->end;
+			scanned++;
+			if( fseek( indexPtr, (long)( query->cursor * Q2LI_RECORD_SIZE ), SEEK_SET ) != 0 ) query->end = query->cursor;
+			continue;
+		}
+
+		// batches stop at block ends, so the next block's summary is looked at
+		want = query->end - query->cursor;
+		if( want > sizeof( records ) / Q2LI_RECORD_SIZE ) want = sizeof( records ) / Q2LI_RECORD_SIZE;
+		if( want > Q2LI_BLOCK - query->cursor % Q2LI_BLOCK ) want = Q2LI_BLOCK - query->cursor % Q2LI_BLOCK;
+
+		got = fread( records, Q2LI_RECORD_SIZE, want, indexPtr );
+		if( !got )
+		{
+			query->end = query->cursor;
+			break;
+		}
+
+		for( n = 0, record = records; n < got; ++n, record += Q2LI_RECORD_SIZE )
+		{
+			query->cursor++;
+			scanned++;
+
+			if( ( query->filter.type >= 0 && record[26] != query->filter.type ) ||
+			    ( query->filter.namehash && q2lb_get32( record + 16 ) != query->filter.namehash ) ||
+			    ( query->filter.iphash && q2lb_get32( record + 20 ) != query->filter.iphash ) ||
+			    ( query->filter.since && (long long)q2lb_get64( record + 8 ) < query->filter.since ) )
+			{
+				continue;
+			}
+
+			len = q2lb_get16( record + 24 );
+			if( len >= Q2L_QUERY_TEXT ) len = Q2L_QUERY_TEXT - 1;
+			if( fseek( logPtr, (long)q2lb_get64( record ), SEEK_SET ) != 0 ) len = 0;
+			else len = fread( query->text[found], 1, len, logPtr );
+
+			query->text[found][len] = 0;
+			query->text[found][strcspn( query->text[found], "\r\n" )] = 0;
+			query->line[found] = query->cursor;
+			Q2L_STORE( query->found, ++found );
+			matched = 1;
+			break;
+		}
+
+		// the batch was read past the match
+		if( n < got && fseek( indexPtr, (long)( query->cursor * Q2LI_RECORD_SIZE ), SEEK_SET ) != 0 ) query->end = query->cursor;
+	}
+
+	if( indexPtr ) fclose( indexPtr );
+	if( logPtr ) fclose( logPtr );
+
+	if( query->cursor >= query->end || found >= query->filter.lines ) Q2L_STORE( query->done, 1 );
+}
+
+#ifdef USE_PTHREADS
+
+static struct
+{
+	int             started;
+	int             stop;
+	pthread_t       thread;
+	pthread_mutex_t guard;
+	pthread_cond_t  wake;
+} q2q;
+
+static void * q2q_thread_run( void * arg )
+{
+	q2l_query_t * query;
+	int           i;
+
+	(void)arg;
+
+	pthread_mutex_lock( &q2q.guard );
+	while( !q2q.stop )
+	{
+		for( i = 0; i < Q2L_MAX_QUERIES; ++i )
+		{
+			if( q2l_queries[i] && !q2l_queries[i]->done && !q2l_queries[i]->cancelled ) break;
+		}
+
+		if( i >= Q2L_MAX_QUERIES )
+		{
+			pthread_cond_wait( &q2q.wake, &q2q.guard );
+			continue;
+		}
+
+		query           = q2l_queries[i];
+		query->scanning = 1;
+		pthread_mutex_unlock( &q2q.guard );
+
+		q2l_query_scan( query, 0 );
+
+		pthread_mutex_lock( &q2q.guard );
+		query->scanning = 0;
+		if( query->cancelled ) q2l_query_free( query );
+		else Q2L_STORE( query->done, 1 );
+	}
+	pthread_mutex_unlock( &q2q.guard );
+
+	return NULL;
+}
+
+static void q2q_start()
+{
+	if( q2q.started ) return;
+
+	pthread_mutex_init( &q2q.guard, NULL );
+	pthread_cond_init( &q2q.wake, NULL );
+
+	if( pthread_create( &q2q.thread, NULL, q2q_thread_run, NULL ) != 0 )
+	{
+		gi.dprintf( "WARNING: unable to start log query thread, searching between frames\n" );
+		pthread_cond_destroy( &q2q.wake );
+		pthread_mutex_destroy( &q2q.guard );
+		return;
+	}
+
+	q2q.started = 1;
+}
+
+static void q2q_shutdown()
+{
+	if( !q2q.started ) return;
+
+	pthread_mutex_lock( &q2q.guard );
+	q2q.stop = 1;
+	pthread_cond_signal( &q2q.wake );
+	pthread_mutex_unlock( &q2q.guard );
+
+	pthread_join( q2q.thread, NULL );
+	pthread_cond_destroy( &q2q.wake );
+	pthread_mutex_destroy( &q2q.guard );
+	memset( &q2q, 0, sizeof( q2q ) );
+}
+
+#endif
+
+int q2l_query_start( int id, const char * logname, const char * indexname, unsigned long from, unsigned long end, const q2l_filter_t * filter )
+{
+	q2l_query_t * query;
+
+	if( id < 0 || id >= Q2L_MAX_QUERIES ) return 0;
+
+	q2l_query_stop( id );
+
+	query = (q2l_query_t *)calloc( 1, sizeof( q2l_query_t ) );
+	if( query == NULL ) return 0;
+
+	q2a_strncpy( query->logname, logname, sizeof( query->logname ) - 1 );
+	q2a_strncpy( query->indexname, indexname, sizeof( query->indexname ) - 1 );
+	snprintf( query->summaryname, sizeof( query->summaryname ), "%s.ids", logname );
+	query->filter = *filter;
+	query->cursor = from;
+	query->end    = end;
+
+	if( query->filter.lines < 1 ) query->filter.lines = 1;
+	if( query->filter.lines > Q2L_QUERY_LINES ) query->filter.lines = Q2L_QUERY_LINES;
+
+#ifdef USE_PTHREADS
+	q2q_start();
+	if( q2q.started )
+	{
+		pthread_mutex_lock( &q2q.guard );
+		q2l_queries[id] = query;
+		pthread_cond_signal( &q2q.wake );
+		pthread_mutex_unlock( &q2q.guard );
+		return 1;
+	}
+#endif
+
+	q2l_queries[id] = query;
+	return 1;
+}
+
+int q2l_query_next( int id, unsigned long * line, const char ** text )
+{
+	q2l_query_t * query;
+
+	if( id < 0 || id >= Q2L_MAX_QUERIES || ( query = q2l_queries[id] ) == NULL ) return Q2L_QUERY_DONE;
+
+	if( query->shown >= Q2L_LOAD( query->found ) )
+	{
+		if( Q2L_LOAD( query->done ) ) return Q2L_QUERY_DONE;
+
+#ifdef USE_PTHREADS
+		if( q2q.started ) return Q2L_QUERY_BUSY;
+#endif
+
+		q2l_query_scan( query, Q2L_QUERY_SLICE );
+		if( query->shown >= query->found ) return query->done ? Q2L_QUERY_DONE : Q2L_QUERY_BUSY;
+	}
+
+	*line = query->line[query->shown];
+	*text = query->text[query->shown];
+	query->shown++;
+	return Q2L_QUERY_LINE;
+}
+
+unsigned long q2l_query_cursor( int id, unsigned long * end )
+{
+	q2l_query_t * query;
+
+	if( id < 0 || id >= Q2L_MAX_QUERIES || ( query = q2l_queries[id] ) == NULL || !Q2L_LOAD( query->done ) )
+	{
+		*end = 0;
+		return 0;
+	}
+
+	*end = query->end;
+	return query->cursor;
+}
+
+void q2l_query_stop( int id )
+{
+	q2l_query_t * query;
+
+	if( id < 0 || id >= Q2L_MAX_QUERIES || ( query = q2l_queries[id] ) == NULL ) return;
+
+#ifdef USE_PTHREADS
+	if( q2q.started )
+	{
+		pthread_mutex_lock( &q2q.guard );
+		q2l_queries[id] = NULL;
+		if( query->scanning ) Q2L_STORE( query->cancelled, 1 );
+		else q2l_query_free( query );
+		pthread_mutex_unlock( &q2q.guard );
+		return;
+	}
+#endif
+
+	q2l_queries[id] = NULL;
+	q2l_query_free( query );
+}
+
+//
+// Public Interface
+//
+
+void q2l_initialize()
+{
+#ifdef USE_PTHREADS
+	size_t capacity = 64 * 1024;
+
+	if( q2l.running ) return;
+
+	while( capacity < (size_t)logbuffer_size * 1024 && capacity < ( (size_t)1 << 30 ) ) capacity <<= 1;
+
+	q2l.ring = (char *)malloc( capacity );
+	if( q2l.ring == NULL )
+	{
+		gi.dprintf( "WARNING: unable to allocate %u KiB log buffer, logging synchronously\n", (unsigned int)( capacity / 1024 ) );
+		return;
+	}
+
+	q2l.capacity = capacity;
+	q2l.mask     = capacity - 1;
+	q2l.head = q2l.tail = 0;
+	q2l.signaled        = 0;
+	q2l.flush_req = q2l.flush_done = 0;
+	q2l.running                    = 1;
+
+	pthread_mutex_init( &q2l.guard, NULL );
+	pthread_mutex_init( &q2l.files_guard, NULL );
+	pthread_cond_init( &q2l.wake, NULL );
+	pthread_cond_init( &q2l.done, NULL );
+
+	if( pthread_create( &q2l.thread, NULL, q2l_thread_run, NULL ) != 0 )
+	{
+		gi.dprintf( "WARNING: unable to start log writer thread, logging synchronously\n" );
+		q2l.running = 0;
+		pthread_cond_destroy( &q2l.done );
+		pthread_cond_destroy( &q2l.wake );
+		pthread_mutex_destroy( &q2l.files_guard );
+		pthread_mutex_destroy( &q2l.guard );
+		free( q2l.ring );
+		q2l.ring = NULL;
+	}
+#endif
+}
+
+void q2l_shutdown()
+{
+	int i;
+
+#ifdef USE_PTHREADS
+	if( q2l.running )
+	{
+		pthread_mutex_lock( &q2l.guard );
+		q2l.running = 0;
+		pthread_cond_signal( &q2l.wake );
+		pthread_mutex_unlock( &q2l.guard );
+
+		pthread_join( q2l.thread, NULL );
+
+		pthread_cond_destroy( &q2l.done );
+		pthread_cond_destroy( &q2l.wake );
+		pthread_mutex_destroy( &q2l.files_guard );
+		pthread_mutex_destroy( &q2l.guard );
+		free( q2l.ring );
+		q2l.ring = NULL;
+	}
+#endif
+
+#ifdef Q2L_COMPRESS
+	q2z_shutdown();
+#endif
+
+#ifdef USE_PTHREADS
+	q2q_shutdown();
+#endif
+
+	for( i = 0; i < Q2L_MAX_QUERIES; ++i ) q2l_query_stop( i );
+
+	q2l_detach_all();
+}
+
+void q2l_run_frame()
+{
+#ifdef USE_PTHREADS
+	if( q2l.running ) return;
+#endif
+
+	if( ltime - q2l_last_flush >= logflush_time / 1000.0f )
+	{
+		q2l_flush_direct();
+		q2l_last_flush = ltime;
+	}
+}
+
+void q2l_flush()
+{
+#ifdef USE_PTHREADS
+	if( q2l.running )
+	{
+		unsigned int request;
+
+		pthread_mutex_lock( &q2l.guard );
+		request = ++q2l.flush_req;
+		__atomic_store_n( &q2l.signaled, 1, __ATOMIC_RELEASE );
+		pthread_cond_signal( &q2l.wake );
+		while( q2l.running && (int)( q2l.flush_done - request ) < 0 ) pthread_cond_wait( &q2l.done, &q2l.guard );
+		pthread_mutex_unlock( &q2l.guard );
+		return;
+	}
+#endif
+
+	q2l_flush_direct();
+}
+
+int q2l_is_open( int slot ) { return slot >= 0 && slot < Q2L_MAX_FILES && q2l_files[slot].open && !Q2L_LOAD( q2l_files[slot].failed ); }
+
+void q2l_attach( int slot, FILE * fp, const char * path, int binary )
+{
+	if( slot < 0 || slot >= Q2L_MAX_FILES || fp == NULL ) return;
+
+	q2l_detach( slot );
+
+#ifdef USE_PTHREADS
+	if( q2l.running ) pthread_mutex_lock( &q2l.files_guard );
+#endif
+
+	// left behind by a rotation that could not reopen it
+	if( q2l_files[slot].fp ) fclose( q2l_files[slot].fp );
+
+	q2l_files[slot].fp      = fp;
+	q2l_files[slot].dropped = 0;
+	q2l_files[slot].binary  = binary;
+	q2l_files[slot].open    = 1;
+	Q2L_STORE( q2l_files[slot].failed, 0 );
+	q2a_strncpy( q2l_files[slot].path, path, sizeof( q2l_files[slot].path ) - 1 );
+	q2l_files[slot].path[sizeof( q2l_files[slot].path ) - 1] = 0;
+
+#ifdef USE_PTHREADS
+	if( q2l.running ) pthread_mutex_unlock( &q2l.files_guard );
+#endif
+}
+
+void q2l_detach( int slot )
+{
+	if( slot < 0 || slot >= Q2L_MAX_FILES || !q2l_files[slot].open ) return;
+
+	q2l_flush();
+
+#ifdef USE_PTHREADS
+	if( q2l.running ) pthread_mutex_lock( &q2l.files_guard );
+#endif
+
+	if( q2l_files[slot].fp ) fclose( q2l_files[slot].fp );
+	q2l_files[slot].fp      = NULL;
+	q2l_files[slot].open    = 0;
+	q2l_files[slot].path[0] = 0;
+
+#ifdef USE_PTHREADS
+	if( q2l.running ) pthread_mutex_unlock( &q2l.files_guard );
+#endif
+}
+
+void q2l_detach_all()
+{
+	int i;
+
+	for( i = 0; i < Q2L_MAX_FILES; ++i ) q2l_detach( i );
+}
+
+// Returns how many bytes will end up in the file: 0 if the data was dropped,
+// or more than length if a dropped-lines note went out first.
+size_t q2l_write( int slot, const char * data, size_t length )
+{
+	size_t note = 0;
+
+	if( !q2l_is_open( slot ) ) return 0;
+
+#ifdef USE_PTHREADS
+	if( q2l.running )
+	{
+		// anything larger than a quarter of the ring bypasses it
+		if( sizeof( q2l_record_t ) + Q2L_ALIGN( length ) > q2l.capacity / 4 )
+		{
+			q2l_flush();
+			pthread_mutex_lock( &q2l.files_guard );
+			q2l_write_direct( slot, data, length );
+			pthread_mutex_unlock( &q2l.files_guard );
+			return length;
+		}
+
+		// binary logs can't take a text note, so their drops are only counted
+		if( q2l_files[slot].dropped && !q2l_files[slot].binary )
+		{
+			char text[64];
+			int  len = snprintf( text, sizeof( text ), "[q2admin] %u log lines dropped\n", q2l_files[slot].dropped );
+
+			if( !q2l_push( slot, text, (size_t)len ) )
+			{
+				q2l_files[slot].dropped++;
+				return 0;
+			}
+			q2l_files[slot].dropped = 0;
+			note                    = (size_t)len;
+		}
+
+		if( !q2l_push( slot, data, length ) )
+		{
+			q2l_files[slot].dropped++;
+			return note;
+		}
+		return note + length;
+	}
+#endif
+
+	q2l_write_direct( slot, data, length );
+	return length;
+}
+
+const char * q2l_path( int slot ) { return q2l_is_open( slot ) ? q2l_files[slot].path : ""; }
+
+void q2l_rotate( int slot, int index, int keep, int text )
+{
+#ifdef USE_PTHREADS
+	q2l_rotate_t rotate;
+#endif
+
+	if( !q2l_is_open( slot ) ) return;
+
+#ifdef USE_PTHREADS
+	if( q2l.running )
+	{
+		rotate.index = (int16_t)( q2l_is_open( index ) ? index : -1 );
+		rotate.keep  = (int16_t)keep;
+		rotate.text  = text;
+
+		// it has to go in, or lines meant for the next segment end up in this one
+		while( !q2l_push( slot | Q2L_ROTATE, (const char *)&rotate, sizeof( rotate ) ) )
+		{
+			q2l_wake_writer();
+			sched_yield();
+		}
+
+		q2l_wake_writer();
+		return;
+	}
+#endif
+
+	q2l_rotate_direct( slot, q2l_is_open( index ) ? index : -1, keep, text );
+}
+
+int q2l_failed( int slot )
+{
+	if( slot < 0 || slot >= Q2L_MAX_FILES || !q2l_files[slot].open ) return 0;
+
+	return Q2L_LOAD( q2l_files[slot].failed );
+}
+
+int q2l_compress_busy( int slot )
+{
+#ifdef Q2L_COMPRESS
+	if( slot >= 0 && slot < Q2L_MAX_FILES ) return __atomic_load_n( &q2z.pending[slot], __ATOMIC_ACQUIRE );
+#else
+	(void)slot;
+#endif
+	return 0;
+}
+
+void q2l_compress( int slot, const char * path )
+{
+#ifdef Q2L_COMPRESS
+	if( slot < 0 || slot >= Q2L_MAX_FILES || q2l_compress_busy( slot ) ) return;
+
+	if( !q2z.started )
+	{
+		pthread_mutex_init( &q2z.guard, NULL );
+		pthread_cond_init( &q2z.wake, NULL );
+
+		if( pthread_create( &q2z.thread, NULL, q2z_thread_run, NULL ) != 0 )
+		{
+			gi.dprintf( "WARNING: unable to start log compression thread, rotated logs are kept as they are\n" );
+			pthread_cond_destroy( &q2z.wake );
+			pthread_mutex_destroy( &q2z.guard );
+			return;
+		}
+
+		q2z.started = 1;
+	}
+
+	pthread_mutex_lock( &q2z.guard );
+	q2a_strncpy( q2z.path[slot], path, sizeof( q2z.path[slot] ) - 1 );
+	q2z.path[slot][sizeof( q2z.path[slot] ) - 1] = 0;
+	__atomic_store_n( &q2z.pending[slot], 1, __ATOMIC_RELEASE );
+	pthread_cond_signal( &q2z.wake );
+	pthread_mutex_unlock( &q2z.guard );
+#else
+	(void)slot, (void)path;
+#endif
+}
@@ -0,0 +1,91 @@
+/*-------------------------------
+# SPDX-License-Identifier: ISC
+#
+# Copyright © 2022 Daniel Wolf <<nephatrine@gmail.com>>
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+# REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+# AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+# INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+# LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+# OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+# -----------------------------*/
+
+#ifndef ZB_LOGWRITER_H
+#define ZB_LOGWRITER_H 1
+
+#include <stddef.h>
+#include <stdio.h>
+
+// one slot per LOGFILE plus one for each of their sidecar indexes, then the
+// hook recorder
+#define Q2L_LOG_SLOTS 64
+#define Q2L_SLOT_RECORD 64
+#define Q2L_MAX_FILES 65
+
+// Buffered log output. Every LOGFILE slot keeps its handle open and lines are
+// queued in a ring that a background thread drains when it passes
+// logflush_bytes or every logflush_time milliseconds. Without pthreads the
+// lines go straight to the (still persistent) stdio handle instead.
+
+void q2l_initialize();
+void q2l_shutdown();
+void q2l_run_frame();
+void q2l_flush();
+
+int  q2l_is_open( int slot );
+void q2l_attach( int slot, FILE * fp, const char * path, int binary );
+void q2l_detach( int slot );
+void q2l_detach_all();
+size_t q2l_write( int slot, const char * data, size_t length );
+
+const char * q2l_path( int slot );
+
+// Rotation happens on the writer thread in line with the writes, so lines
+// queued before it end up in the old segment and the rest in the new one.
+// index is the slot of the log's sidecar index (-1 for none) and text picks
+// the mode the log is opened again with. q2l_failed is set when the file could
+// not be renamed or opened again, and the slot then counts as closed.
+void q2l_rotate( int slot, int index, int keep, int text );
+int  q2l_failed( int slot );
+
+// Rotated segments are gzipped by another background thread when both zlib
+// and pthreads are available, and are left as they are otherwise. Only one
+// segment per slot is compressed at a time.
+int  q2l_compress_busy( int slot );
+void q2l_compress( int slot, const char * path );
+
+// Index searches for !logquery, one per client. The search runs on its own
+// thread and q2l_query_next hands back one matching line at a time, returning
+// BUSY while it is still looking; without pthreads each call searches another
+// slice of the index instead. Line numbers are index records counted from 1.
+#define Q2L_MAX_QUERIES 256
+#define Q2L_QUERY_LINES 100
+#define Q2L_QUERY_TEXT 1024
+
+#define Q2L_QUERY_DONE 0
+#define Q2L_QUERY_BUSY 1
+#define Q2L_QUERY_LINE 2
+
+typedef struct
+{
+	int          lines;    // matches wanted
+	int          type;     // -1 for any
+	unsigned int namehash; // 0 for any
+	unsigned int iphash;   // 0 for any
+	long long    since;    // epoch ms, 0 for any
+} q2l_filter_t;
+
+int  q2l_query_start( int id, const char * logname, const char * indexname, unsigned long from, unsigned long end, const q2l_filter_t * filter );
+int  q2l_query_next( int id, unsigned long * line, const char ** text );
+void q2l_query_stop( int id );
+
+// where a finished search stopped, to continue it from; 0 while it still runs
+unsigned long q2l_query_cursor( int id, unsigned long * end );
+
+#endif
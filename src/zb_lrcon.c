@@ -252,7 +252,7 @@ qboolean checklrcon(char *cp, int lrcon)
 			//r1ch: overflow fix
 			q2a_strncpy(strbuffer, cp, sizeof(strbuffer)-1);
 			q_strupr(strbuffer);
-			return (regexec(lrconcmds[lrcon].r, strbuffer, 0, 0, 0) != REG_NOMATCH);
+			return (q2a_regexec(lrconcmds[lrcon].r, strbuffer) != REG_NOMATCH);
 		}
 		
 	return FALSE;
@@ -36,6 +36,11 @@ void addCmdQueue(int  client, byte command, float timeout, unsigned long data, c
 	proxyinfo[client].cmdQueue[proxyinfo[client].maxCmds].data = data;
 	proxyinfo[client].cmdQueue[proxyinfo[client].maxCmds].str = str;
 	proxyinfo[client].maxCmds++;
+	
+	if(proxyinfo[client].maxCmds > proxyinfo[client].maxCmdsPeak)
+		{
+			proxyinfo[client].maxCmdsPeak = proxyinfo[client].maxCmds;
+		}
 
 	if (command == QCMD_DISCONNECT)
 	{
@@ -45,6 +50,7 @@ void addCmdQueue(int  client, byte command, float timeout, unsigned long data, c
 //*** UPDATE START ***
 	if ( proxyinfo[client].maxCmds >= ALLOWED_MAXCMDS_SAFETY)
 	{
+		Q2S_INC(Q2S_FLOOD_TRIGGERS);
 		proxyinfo[client].clientcommand |= CCMD_KICKED;
 		gi.bprintf (PRINT_HIGH, "%s tried to flood the server.\n", proxyinfo[client].name);
 		sprintf(tmptext, "kick %d\n", client);
@@ -0,0 +1,450 @@
+/*-------------------------------
+# SPDX-License-Identifier: ISC
+#
+# Copyright © 2022 Daniel Wolf <<nephatrine@gmail.com>>
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+# REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+# AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+# INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+# LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+# OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+# -----------------------------*/
+
+#include "g_local.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef USE_PTHREADS
+#	include <pthread.h>
+#endif
+
+#if defined( WIN32 )
+#	include <windows.h>
+#else
+#	include <time.h>
+#endif
+
+//
+// Configuration
+//
+
+qboolean perf_enable      = TRUE;               // time the hooks for !perf
+int      hitch_frames     = 50;                 // frames kept, read once at InitGame
+int      hitch_threshold  = 100;                // milliseconds, 0 to never dump
+char     hitch_file[256]  = "q2adminhitch.log"; // dumps are appended here
+
+//
+// Clock
+//
+
+#if defined( WIN32 )
+uint64_t q2p_now()
+{
+	static LARGE_INTEGER frequency;
+	LARGE_INTEGER        counter;
+
+	if( !frequency.QuadPart ) QueryPerformanceFrequency( &frequency );
+	QueryPerformanceCounter( &counter );
+
+	return (uint64_t)( counter.QuadPart / frequency.QuadPart ) * 1000000000u + (uint64_t)( counter.QuadPart % frequency.QuadPart ) * 1000000000u / (uint64_t)frequency.QuadPart;
+}
+#else
+uint64_t q2p_now()
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+#endif
+
+//
+// Histograms
+//
+
+// Every power of two is split into 1 << Q2P_SUB_BITS buckets, so a bucket is
+// never more than 25% wide and a whole histogram is a couple of KiB.
+#define Q2P_SUB_BITS 2
+#define Q2P_SUB_COUNT ( 1u << Q2P_SUB_BITS )
+#define Q2P_BUCKETS ( 64u << Q2P_SUB_BITS )
+
+typedef struct
+{
+	uint64_t count;
+	uint64_t max;
+	uint64_t buckets[Q2P_BUCKETS];
+} q2p_hist_t;
+
+static q2p_hist_t q2p_hists[Q2P_HOOK_MAX][Q2P_SIDE_MAX];
+
+static const char * q2p_hook_names[Q2P_HOOK_MAX] = { "ClientThink", "ClientCommand", "G_RunFrame", "ClientConnect", "ClientUserinfoChanged" };
+static const char * q2p_side_names[Q2P_SIDE_MAX] = { "q2admin", "mod" };
+
+static unsigned int q2p_bucket( uint64_t ns )
+{
+	unsigned int log;
+
+	if( ns < Q2P_SUB_COUNT ) return (unsigned int)ns;
+
+#if defined( __GNUC__ )
+	log = 63u - (unsigned int)__builtin_clzll( ns );
+#else
+	for( log = 0; ns >> ( log + 1 ); ++log ) {}
+#endif
+
+	return ( log << Q2P_SUB_BITS ) + (unsigned int)( ( ns >> ( log - Q2P_SUB_BITS ) ) & ( Q2P_SUB_COUNT - 1 ) );
+}
+
+// smallest value that lands in the bucket
+static uint64_t q2p_bucket_floor( unsigned int bucket )
+{
+	unsigned int log = bucket >> Q2P_SUB_BITS;
+
+	if( bucket < Q2P_SUB_COUNT ) return bucket;
+	return (uint64_t)( Q2P_SUB_COUNT | ( bucket & ( Q2P_SUB_COUNT - 1 ) ) ) << ( log - Q2P_SUB_BITS );
+}
+
+void q2p_record( int hook, int side, uint64_t ns )
+{
+	q2p_hist_t * hist = &q2p_hists[hook][side];
+
+	hist->buckets[q2p_bucket( ns )]++;
+	hist->count++;
+	if( ns > hist->max ) hist->max = ns;
+}
+
+void q2p_reset() { memset( q2p_hists, 0, sizeof( q2p_hists ) ); }
+
+uint64_t q2p_count( int hook, int side ) { return q2p_hists[hook][side].count; }
+uint64_t q2p_max( int hook, int side ) { return q2p_hists[hook][side].max; }
+
+uint64_t q2p_percentile( int hook, int side, double percent )
+{
+	q2p_hist_t * hist   = &q2p_hists[hook][side];
+	uint64_t     target = (uint64_t)( hist->count * percent / 100.0 + 0.5 );
+	uint64_t     seen   = 0, upper;
+	unsigned int i;
+
+	if( !hist->count ) return 0;
+	if( target < 1 ) target = 1;
+
+	for( i = 0; i < Q2P_BUCKETS - 1; ++i )
+	{
+		seen += hist->buckets[i];
+		if( seen >= target ) break;
+	}
+
+	// report the top of the bucket, but never more than was actually seen
+	upper = ( i < Q2P_SUB_COUNT ) ? i : q2p_bucket_floor( i + 1 ) - 1;
+	return ( i >= Q2P_BUCKETS - 1 || upper > hist->max ) ? hist->max : upper;
+}
+
+//
+// Flight Recorder
+//
+
+typedef struct
+{
+	uint32_t frame;
+	uint32_t total; // microseconds
+	uint32_t phases[Q2P_PHASE_MAX];
+	uint16_t thinks;
+	uint16_t commands;
+	uint16_t logwrites;
+} q2p_record_t;
+
+typedef struct
+{
+	q2p_record_t * ring;
+	unsigned int   size;
+	unsigned int   next;  // frames recorded so far, the ring index is next % size
+	unsigned int   after; // frames still to record before dumping, 0 for none
+	uint32_t       hitchframe;
+	uint32_t       hitchtotal;
+	char           hitchtime[64];
+
+	// handed to the writer
+	q2p_record_t * dump;
+	unsigned int   dumpcount;
+	uint32_t       dumpframe;
+	uint32_t       dumptotal;
+	int            dumpthreshold;
+	char           dumptime[64];
+	char           dumpname[256];
+	FILE *         fp;
+	int            busy;
+	unsigned int   dumps;
+	unsigned int   skipped; // hitches while the last dump was still being written
+
+#ifdef USE_PTHREADS
+	pthread_t       thread;
+	pthread_mutex_t guard;
+	pthread_cond_t  wake;
+	int             started;
+	int             stop;
+#endif
+} q2p_hitch_t;
+
+q2p_frame_t        q2p_frame;
+static q2p_hitch_t q2h;
+
+static const char * q2p_phase_names[Q2P_PHASE_MAX] = { "house", "queue", "timers", "voting", "discord", "mod" };
+
+static uint32_t q2p_usec( uint64_t ns ) { return ns / 1000 > UINT32_MAX ? UINT32_MAX : (uint32_t)( ns / 1000 ); }
+static uint16_t q2p_clamp16( unsigned int n ) { return n > UINT16_MAX ? UINT16_MAX : (uint16_t)n; }
+
+static void q2p_hitch_write()
+{
+	unsigned int i, j;
+
+	if( !q2h.fp ) return;
+
+	fprintf( q2h.fp, "Frame hitch at %s: frame %u took %.2f ms (hitch_threshold %d)\n", q2h.dumptime, q2h.dumpframe, q2h.dumptotal / 1000.0, q2h.dumpthreshold );
+	fprintf( q2h.fp, "     frame    total" );
+	for( j = 0; j < Q2P_PHASE_MAX; ++j ) fprintf( q2h.fp, " %8s", q2p_phase_names[j] );
+	fprintf( q2h.fp, "  thinks  cmds  logs\n" );
+
+	for( i = 0; i < q2h.dumpcount; ++i )
+	{
+		q2p_record_t * r = &q2h.dump[i];
+
+		fprintf( q2h.fp, "%c %8u %8.2f", r->total >= (uint32_t)q2h.dumpthreshold * 1000 ? '*' : ' ', r->frame, r->total / 1000.0 );
+		for( j = 0; j < Q2P_PHASE_MAX; ++j ) fprintf( q2h.fp, " %8.2f", r->phases[j] / 1000.0 );
+		fprintf( q2h.fp, "  %6u %5u %5u\n", r->thinks, r->commands, r->logwrites );
+	}
+
+	fprintf( q2h.fp, "\n" );
+	fflush( q2h.fp );
+}
+
+#ifdef USE_PTHREADS
+static void * q2p_hitch_run( void * arg )
+{
+	(void)arg;
+
+	pthread_mutex_lock( &q2h.guard );
+	while( !q2h.stop )
+	{
+		if( !__atomic_load_n( &q2h.busy, __ATOMIC_ACQUIRE ) )
+		{
+			pthread_cond_wait( &q2h.wake, &q2h.guard );
+			continue;
+		}
+
+		pthread_mutex_unlock( &q2h.guard );
+		q2p_hitch_write();
+		pthread_mutex_lock( &q2h.guard );
+
+		__atomic_store_n( &q2h.busy, 0, __ATOMIC_RELEASE );
+	}
+	pthread_mutex_unlock( &q2h.guard );
+
+	return NULL;
+}
+#endif
+
+void q2p_hitch_initialize()
+{
+	if( q2h.ring || hitch_frames <= 0 ) return;
+
+	q2h.ring = calloc( (size_t)hitch_frames, sizeof( q2p_record_t ) );
+	q2h.dump = calloc( (size_t)hitch_frames, sizeof( q2p_record_t ) );
+
+	if( !q2h.ring || !q2h.dump )
+	{
+		gi.dprintf( "WARNING: unable to allocate %d frame hitch recorder\n", hitch_frames );
+		free( q2h.ring );
+		free( q2h.dump );
+		q2h.ring = q2h.dump = NULL;
+		return;
+	}
+
+	q2h.size = (unsigned int)hitch_frames;
+	memset( &q2p_frame, 0, sizeof( q2p_frame ) );
+
+#ifdef USE_PTHREADS
+	pthread_mutex_init( &q2h.guard, NULL );
+	pthread_cond_init( &q2h.wake, NULL );
+
+	if( pthread_create( &q2h.thread, NULL, q2p_hitch_run, NULL ) == 0 )
+		q2h.started = 1;
+	else
+	{
+		gi.dprintf( "WARNING: unable to start frame hitch thread, dumps are written during the frame\n" );
+		pthread_cond_destroy( &q2h.wake );
+		pthread_mutex_destroy( &q2h.guard );
+	}
+#endif
+}
+
+void q2p_hitch_shutdown()
+{
+	if( !q2h.ring ) return;
+
+#ifdef USE_PTHREADS
+	if( q2h.started )
+	{
+		// a dump in progress is finished first
+		pthread_mutex_lock( &q2h.guard );
+		q2h.stop = 1;
+		pthread_cond_signal( &q2h.wake );
+		pthread_mutex_unlock( &q2h.guard );
+
+		pthread_join( q2h.thread, NULL );
+		pthread_cond_destroy( &q2h.wake );
+		pthread_mutex_destroy( &q2h.guard );
+	}
+#endif
+
+	if( q2h.fp ) fclose( q2h.fp );
+	free( q2h.ring );
+	free( q2h.dump );
+	memset( &q2h, 0, sizeof( q2h ) );
+}
+
+uint64_t q2p_hitch_begin() { return q2h.ring ? q2p_now() : 0; }
+
+void q2p_hitch_phase( int phase, uint64_t * mark )
+{
+	uint64_t now;
+
+	if( !*mark ) return;
+
+	now = q2p_now();
+	q2p_frame.phases[phase] += now - *mark;
+	*mark = now;
+}
+
+// copies the ring oldest first and hands it to the writer
+static void q2p_hitch_dump()
+{
+	unsigned int count = q2h.next < q2h.size ? q2h.next : q2h.size;
+	unsigned int first = q2h.next - count, i;
+	char         name[256];
+
+	if( __atomic_load_n( &q2h.busy, __ATOMIC_ACQUIRE ) )
+	{
+		q2h.skipped++;
+		return;
+	}
+
+	// the file is opened here as the path lookup reads cvars
+	if( !q2h.fp || strcmp( q2h.dumpname, hitch_file ) != 0 )
+	{
+		if( q2h.fp ) fclose( q2h.fp );
+
+		q2a_strncpy( q2h.dumpname, hitch_file, sizeof( q2h.dumpname ) - 1 );
+		q2h.dumpname[sizeof( q2h.dumpname ) - 1] = 0;
+		q2a_strcpy( name, q2h.dumpname );
+		q2h.fp = q2a_fopen( name, sizeof( name ), "at" );
+
+		if( !q2h.fp ) return;
+	}
+
+	for( i = 0; i < count; ++i ) q2h.dump[i] = q2h.ring[( first + i ) % q2h.size];
+
+	q2h.dumpcount     = count;
+	q2h.dumpframe     = q2h.hitchframe;
+	q2h.dumptotal     = q2h.hitchtotal;
+	q2h.dumpthreshold = hitch_threshold;
+	q2a_strcpy( q2h.dumptime, q2h.hitchtime );
+	q2h.dumps++;
+
+#ifdef USE_PTHREADS
+	if( q2h.started )
+	{
+		pthread_mutex_lock( &q2h.guard );
+		__atomic_store_n( &q2h.busy, 1, __ATOMIC_RELEASE );
+		pthread_cond_signal( &q2h.wake );
+		pthread_mutex_unlock( &q2h.guard );
+		return;
+	}
+#endif
+
+	q2p_hitch_write();
+}
+
+void q2p_hitch_end( uint64_t start )
+{
+	q2p_record_t * r;
+	uint64_t       total;
+	int            i;
+
+	if( !start || !q2h.ring ) return;
+
+	total = q2p_now() - start;
+	r     = &q2h.ring[q2h.next % q2h.size];
+
+	// the queue loop also runs timer_action
+	if( q2p_frame.phases[Q2P_PHASE_QUEUE] >= q2p_frame.phases[Q2P_PHASE_TIMERS] ) q2p_frame.phases[Q2P_PHASE_QUEUE] -= q2p_frame.phases[Q2P_PHASE_TIMERS];
+
+	r->frame = (uint32_t)lframenum;
+	r->total = q2p_usec( total );
+	for( i = 0; i < Q2P_PHASE_MAX; ++i ) r->phases[i] = q2p_usec( q2p_frame.phases[i] );
+	r->thinks    = q2p_clamp16( q2p_frame.thinks );
+	r->commands  = q2p_clamp16( q2p_frame.commands );
+	r->logwrites = q2p_clamp16( q2p_frame.logwrites );
+
+	memset( &q2p_frame, 0, sizeof( q2p_frame ) );
+	q2h.next++;
+
+	if( q2h.after )
+	{
+		if( --q2h.after == 0 ) q2p_hitch_dump();
+	}
+	else if( hitch_threshold > 0 && total >= (uint64_t)hitch_threshold * 1000000u )
+	{
+		// wait for a fifth of the ring to see how the server recovers
+		q2h.hitchframe = r->frame;
+		q2h.hitchtotal = r->total;
+		q2a_strncpy( q2h.hitchtime, getTimestamp( TS_ISO8601, NULL ), sizeof( q2h.hitchtime ) - 1 );
+		q2h.hitchtime[sizeof( q2h.hitchtime ) - 1] = 0;
+		q2h.after = q2h.size / 5 + 1;
+	}
+}
+
+//
+// Admin Command
+//
+
+#define PERFCMD "[sv] !perf [reset]\n"
+
+void perfRun( int startarg, edict_t * ent, int client )
+{
+	int hook, side;
+
+	if( gi.argc() > startarg && Q_stricmp( gi.argv( startarg ), "RESET" ) != 0 )
+	{
+		gi.cprintf( ent, PRINT_HIGH, PERFCMD );
+		return;
+	}
+
+	if( !perf_enable ) gi.cprintf( ent, PRINT_HIGH, "Hook timing is turned off (perf_enable).\n" );
+
+	gi.cprintf( ent, PRINT_HIGH, "Hook (microseconds)           Side        Count      p50      p90      p99      max\n" );
+
+	for( hook = 0; hook < Q2P_HOOK_MAX; ++hook )
+	{
+		for( side = 0; side < Q2P_SIDE_MAX; ++side )
+		{
+			gi.cprintf( ent, PRINT_HIGH, "%-29s %-7s %10llu %8.1f %8.1f %8.1f %8.1f\n", q2p_hook_names[hook], q2p_side_names[side], (unsigned long long)q2p_count( hook, side ), q2p_percentile( hook, side, 50.0 ) / 1000.0,
+			            q2p_percentile( hook, side, 90.0 ) / 1000.0, q2p_percentile( hook, side, 99.0 ) / 1000.0, q2p_max( hook, side ) / 1000.0 );
+		}
+	}
+
+	if( q2h.ring ) gi.cprintf( ent, PRINT_HIGH, "Frame hitches over %d ms: %u written to %s, %u skipped\n", hitch_threshold, q2h.dumps, q2h.dumpname[0] ? q2h.dumpname : hitch_file, q2h.skipped );
+
+	if( gi.argc() > startarg )
+	{
+		q2p_reset();
+		gi.cprintf( ent, PRINT_HIGH, "Hook timings reset.\n" );
+	}
+}
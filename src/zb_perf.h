@@ -0,0 +1,94 @@
+/*-------------------------------
+# SPDX-License-Identifier: ISC
+#
+# Copyright © 2022 Daniel Wolf <<nephatrine@gmail.com>>
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+# REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+# AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+# INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+# LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+# OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+# -----------------------------*/
+
+#ifndef ZB_PERF_H
+#define ZB_PERF_H 1
+
+#include <stdint.h>
+
+// Hook timing. Each hook keeps two log-bucketed latency histograms: the mod
+// call on its own and q2admin's part (the whole hook minus the mod call), so
+// it is easy to tell which side is using the frame budget.
+
+enum q2p_hook_e
+{
+	Q2P_CLIENTTHINK,
+	Q2P_CLIENTCOMMAND,
+	Q2P_RUNFRAME,
+	Q2P_CLIENTCONNECT,
+	Q2P_CLIENTUSERINFOCHANGED,
+	Q2P_HOOK_MAX
+};
+
+enum q2p_side_e
+{
+	Q2P_Q2ADMIN,
+	Q2P_MOD,
+	Q2P_SIDE_MAX
+};
+
+// monotonic clock in nanoseconds
+uint64_t q2p_now();
+
+void q2p_record( int hook, int side, uint64_t ns );
+void q2p_reset();
+
+// smallest time that at least percent of the samples were at or under, to
+// within a quarter of its power of two
+uint64_t q2p_percentile( int hook, int side, double percent );
+uint64_t q2p_count( int hook, int side );
+uint64_t q2p_max( int hook, int side );
+
+// Frame hitch flight recorder. G_RunFrame splits its time into phases and the
+// last hitch_frames frames are kept in a ring. A frame over hitch_threshold
+// milliseconds gets the frames around it appended to hitch_file by a
+// background thread once a few more frames have gone by.
+
+enum q2p_phase_e
+{
+	Q2P_PHASE_HOUSEKEEPING, // lrcon, log and reconnect list upkeep
+	Q2P_PHASE_QUEUE,        // client command queues
+	Q2P_PHASE_TIMERS,       // timer_action
+	Q2P_PHASE_VOTING,       // checkOnVoting
+	Q2P_PHASE_DISCORD,      // q2d_process_game_queue
+	Q2P_PHASE_MOD,          // dllglobals->RunFrame
+	Q2P_PHASE_MAX
+};
+
+// the frame being recorded, the counts are bumped inline by the hooks
+typedef struct
+{
+	uint64_t     phases[Q2P_PHASE_MAX];
+	unsigned int thinks;
+	unsigned int commands;
+	unsigned int logwrites;
+} q2p_frame_t;
+
+extern q2p_frame_t q2p_frame;
+
+void q2p_hitch_initialize();
+void q2p_hitch_shutdown();
+
+// q2p_hitch_begin returns 0 when the recorder is off, which makes the others
+// do nothing. q2p_hitch_phase adds the time since *mark to a phase and moves
+// the mark on.
+uint64_t q2p_hitch_begin();
+void     q2p_hitch_phase( int phase, uint64_t * mark );
+void     q2p_hitch_end( uint64_t start );
+
+#endif
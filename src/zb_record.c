@@ -0,0 +1,271 @@
+/*-------------------------------
+# SPDX-License-Identifier: ISC
+#
+# Copyright © 2022 Daniel Wolf <<nephatrine@gmail.com>>
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+# REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+# AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+# INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+# LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+# OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+# -----------------------------*/
+
+#include "g_local.h"
+#include "zb_recordformat.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+//
+// Recording State
+//
+
+#define Q2R_DEFAULT_FILE "q2adminrecord.q2r"
+#define Q2R_PAYLOAD_MAX 4096 // everything but SPAWN fits, argv and userinfo are far smaller
+
+int q2r_active = 0;
+
+static struct
+{
+	uint64_t           start; // q2p_now() when recording started
+	unsigned long      records;
+	unsigned long      dropped;
+	unsigned long long bytes;
+	char               path[MAX_OSPATH];
+} q2r;
+
+// Writes one record. When the log writer's ring is full it is flushed once
+// and the record tried again, since a gap in a recording is worse than a slow
+// frame, and only then counted as dropped.
+static void q2r_write( int kind, int client, const unsigned char * payload, size_t length )
+{
+	unsigned char  stack[Q2R_HEADER_SIZE + Q2R_PAYLOAD_MAX];
+	unsigned char *record = stack;
+	size_t         size   = Q2R_HEADER_SIZE + length;
+	size_t         written;
+
+	if( size > sizeof( stack ) && ( record = malloc( size ) ) == NULL )
+	{
+		q2r.dropped++;
+		return;
+	}
+
+	q2r_put_header( record, kind, client, (uint32_t)lframenum, length );
+	if( length ) q2a_memcpy( record + Q2R_HEADER_SIZE, payload, length );
+
+	written = q2l_write( Q2L_SLOT_RECORD, (const char *)record, size );
+	if( !written )
+	{
+		q2l_flush();
+		written = q2l_write( Q2L_SLOT_RECORD, (const char *)record, size );
+	}
+
+	if( written )
+	{
+		q2r.records++;
+		q2r.bytes += written;
+	}
+	else
+		q2r.dropped++;
+
+	if( record != stack ) free( record );
+}
+
+// appends a NUL terminated string, cut short to fit
+static size_t q2r_put_string( unsigned char * p, size_t at, size_t size, const char * s )
+{
+	size_t len = s ? q2a_strlen( s ) : 0;
+
+	if( at >= size ) return at;
+	if( len > size - at - 1 ) len = size - at - 1;
+
+	if( len ) q2a_memcpy( p + at, s, len );
+	p[at + len] = 0;
+	return at + len + 1;
+}
+
+static void q2r_write_string( int kind, int client, char * s )
+{
+	unsigned char payload[Q2R_PAYLOAD_MAX];
+
+	q2r_write( kind, client, payload, q2r_put_string( payload, 0, sizeof( payload ), s ) );
+}
+
+// argv as the engine tokenised it plus the raw args, so a replay does not
+// depend on the driver splitting lines the same way
+static void q2r_write_command( int kind, int client )
+{
+	unsigned char payload[Q2R_PAYLOAD_MAX];
+	size_t        at   = 2;
+	int           argc = gi.argc();
+	int           i;
+
+	if( argc > 0xFFFF ) argc = 0xFFFF;
+
+	for( i = 0; i < argc; ++i ) at = q2r_put_string( payload, at, sizeof( payload ) - 1, gi.argv( i ) );
+	at = q2r_put_string( payload, at, sizeof( payload ), gi.args() );
+
+	q2lb_put16( payload, (uint16_t)argc );
+	q2r_write( kind, client, payload, at );
+}
+
+//
+// Hook Entry Points
+//
+
+void q2r_frame( void )
+{
+	unsigned char payload[8];
+
+	q2lb_put64( payload, q2p_now() - q2r.start );
+	q2r_write( Q2R_KIND_FRAME, -1, payload, sizeof( payload ) );
+}
+
+void q2r_spawn( char * mapname, char * entities, char * spawnpoint )
+{
+	unsigned char *payload;
+	size_t         size = q2a_strlen( mapname ) + ( entities ? q2a_strlen( entities ) : 0 ) + q2a_strlen( spawnpoint ) + 3;
+	size_t         at;
+
+	if( ( payload = malloc( size ) ) == NULL )
+	{
+		q2r.dropped++;
+		return;
+	}
+
+	at = q2r_put_string( payload, 0, size, mapname );
+	at = q2r_put_string( payload, at, size, entities );
+	at = q2r_put_string( payload, at, size, spawnpoint );
+	q2r_write( Q2R_KIND_SPAWN, -1, payload, at );
+	free( payload );
+}
+
+void q2r_connect( int client, char * userinfo ) { q2r_write_string( Q2R_KIND_CONNECT, client, userinfo ); }
+void q2r_userinfo( int client, char * userinfo ) { q2r_write_string( Q2R_KIND_USERINFO, client, userinfo ); }
+void q2r_begin( int client ) { q2r_write( Q2R_KIND_BEGIN, client, NULL, 0 ); }
+void q2r_disconnect( int client ) { q2r_write( Q2R_KIND_DISCONNECT, client, NULL, 0 ); }
+void q2r_client_command( int client ) { q2r_write_command( Q2R_KIND_COMMAND, client ); }
+void q2r_server_command( void ) { q2r_write_command( Q2R_KIND_SERVERCMD, -1 ); }
+
+void q2r_think( int client, usercmd_t * ucmd )
+{
+	unsigned char payload[Q2R_USERCMD_SIZE];
+
+	payload[0] = ucmd->msec;
+	payload[1] = ucmd->buttons;
+	q2lb_put16( payload + 2, (uint16_t)ucmd->angles[0] );
+	q2lb_put16( payload + 4, (uint16_t)ucmd->angles[1] );
+	q2lb_put16( payload + 6, (uint16_t)ucmd->angles[2] );
+	q2lb_put16( payload + 8, (uint16_t)ucmd->forwardmove );
+	q2lb_put16( payload + 10, (uint16_t)ucmd->sidemove );
+	q2lb_put16( payload + 12, (uint16_t)ucmd->upmove );
+	payload[14] = ucmd->impulse;
+	payload[15] = ucmd->lightlevel;
+	q2r_write( Q2R_KIND_THINK, client, payload, sizeof( payload ) );
+}
+
+//
+// Start / Stop
+//
+
+static qboolean q2r_start( const char * filename )
+{
+	unsigned char header[Q2R_FILE_HEADER_SIZE];
+	FILE *        fp;
+	int           client;
+
+	q2a_strncpy( q2r.path, filename, sizeof( q2r.path ) - 1 );
+	q2r.path[sizeof( q2r.path ) - 1] = 0;
+
+	if( ( fp = q2a_fopen( q2r.path, sizeof( q2r.path ), "wb" ) ) == NULL ) return FALSE;
+
+	q2l_attach( Q2L_SLOT_RECORD, fp, q2r.path, TRUE );
+
+	q2r.start   = q2p_now();
+	q2r.records = 0;
+	q2r.dropped = 0;
+	q2r.bytes   = 0;
+
+	q2a_memcpy( header, Q2R_MAGIC, 4 );
+	q2lb_put16( header + 4, Q2R_VERSION );
+	q2lb_put16( header + 6, (uint16_t)maxclients->value );
+	q2lb_put64( header + 8, (uint64_t)getTimestampMs() );
+	q2l_write( Q2L_SLOT_RECORD, (const char *)header, sizeof( header ) );
+	q2r.bytes += sizeof( header );
+
+	// the state a replay needs to start from the same place
+	q2r_spawn( gmapname, "", "" );
+
+	for( client = 0; client < maxclients->value; ++client )
+	{
+		if( !proxyinfo[client].inuse ) continue;
+
+		q2r_connect( client, proxyinfo[client].userinfo );
+		q2r_begin( client );
+	}
+
+	q2r_active = 1;
+	return TRUE;
+}
+
+static void q2r_stop( void )
+{
+	if( !q2r_active ) return;
+
+	q2r_active = 0;
+	q2l_detach( Q2L_SLOT_RECORD );
+}
+
+void q2r_shutdown( void ) { q2r_stop(); }
+
+//
+// Admin Command
+//
+
+#define RECORDCMD "[sv] !record start [file] / stop\n"
+
+void recordRun( int startarg, edict_t * ent, int client )
+{
+	const char * file = gi.argc() > startarg + 1 ? gi.argv( startarg + 1 ) : Q2R_DEFAULT_FILE;
+
+	(void)client;
+
+	if( gi.argc() <= startarg )
+	{
+		if( q2r_active )
+			gi.cprintf( ent, PRINT_HIGH, "Recording to %s: %lu records, %llu bytes, %lu dropped.\n", q2r.path, q2r.records, q2r.bytes, q2r.dropped );
+		else
+			gi.cprintf( ent, PRINT_HIGH, RECORDCMD );
+		return;
+	}
+
+	if( Q_stricmp( gi.argv( startarg ), "START" ) == 0 )
+	{
+		if( q2r_active )
+			gi.cprintf( ent, PRINT_HIGH, "Already recording to %s.\n", q2r.path );
+		else if( !q2r_start( file ) )
+			gi.cprintf( ent, PRINT_HIGH, "Unable to open %s.\n", file );
+		else
+			gi.cprintf( ent, PRINT_HIGH, "Recording to %s.\n", q2r.path );
+	}
+	else if( Q_stricmp( gi.argv( startarg ), "STOP" ) == 0 )
+	{
+		if( !q2r_active )
+		{
+			gi.cprintf( ent, PRINT_HIGH, "No recording is running.\n" );
+			return;
+		}
+
+		q2r_stop();
+		gi.cprintf( ent, PRINT_HIGH, "Recording stopped, %lu records and %llu bytes in %s (%lu dropped).\n", q2r.records, q2r.bytes, q2r.path, q2r.dropped );
+	}
+	else
+		gi.cprintf( ent, PRINT_HIGH, RECORDCMD );
+}
@@ -0,0 +1,46 @@
+/*-------------------------------
+# SPDX-License-Identifier: ISC
+#
+# Copyright © 2022 Daniel Wolf <<nephatrine@gmail.com>>
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+# REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+# AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+# INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+# LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+# OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+# -----------------------------*/
+
+#ifndef ZB_RECORD_H
+#define ZB_RECORD_H 1
+
+// Hook recorder. While a recording is running the inbound game hooks append
+// what the server handed them to a binary file (see zb_recordformat.h) through
+// the log writer, so q2admin-host can play the traffic back into the module
+// later. Everything happens on the game thread.
+
+struct usercmd_s;
+
+extern int q2r_active;
+
+#define Q2R_ACTIVE() q2r_active
+
+// only call these while Q2R_ACTIVE()
+void q2r_frame( void );
+void q2r_spawn( char * mapname, char * entities, char * spawnpoint );
+void q2r_connect( int client, char * userinfo );
+void q2r_userinfo( int client, char * userinfo );
+void q2r_begin( int client );
+void q2r_disconnect( int client );
+void q2r_client_command( int client );
+void q2r_server_command( void );
+void q2r_think( int client, struct usercmd_s * ucmd );
+
+void q2r_shutdown( void );
+
+#endif
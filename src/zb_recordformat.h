@@ -0,0 +1,76 @@
+/*-------------------------------
+# SPDX-License-Identifier: ISC
+#
+# Copyright © 2022 Daniel Wolf <<nephatrine@gmail.com>>
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+# REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+# AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+# INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+# LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+# OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+# -----------------------------*/
+
+#ifndef ZB_RECORDFORMAT_H
+#define ZB_RECORDFORMAT_H 1
+
+#include "zb_logformat.h"
+
+// Layout of hook recordings, shared by the module and the q2admin-host replay
+// driver. All fields are little-endian.
+//
+// A file starts with a 16 byte header:
+//
+//   char magic[4]   "Q2AR"
+//   u16  version    Q2R_VERSION
+//   u16  maxclients
+//   i64  time       wall clock when recording started, milliseconds since the epoch
+//
+// followed by records that each start with the same 12 byte header:
+//
+//   u8  kind        Q2R_KIND_*
+//   u8  reserved
+//   i16 client      client slot (-1 means none)
+//   u32 frame       q2admin frame number
+//   u32 length      payload bytes after this header
+//
+// Strings in payloads are NUL terminated. A recording started mid-map opens
+// with a SPAWN record for the current map (with no entity string) and a
+// CONNECT and BEGIN for every client already on the server.
+
+#define Q2R_MAGIC "Q2AR"
+#define Q2R_VERSION 1
+
+#define Q2R_FILE_HEADER_SIZE 16
+#define Q2R_HEADER_SIZE 12
+#define Q2R_USERCMD_SIZE 16
+
+enum q2r_kind_e
+{
+	Q2R_KIND_FRAME      = 0, // u64 nanoseconds since recording started, before G_RunFrame
+	Q2R_KIND_SPAWN      = 1, // mapname, entities, spawnpoint
+	Q2R_KIND_CONNECT    = 2, // userinfo
+	Q2R_KIND_USERINFO   = 3, // userinfo
+	Q2R_KIND_BEGIN      = 4, // (none)
+	Q2R_KIND_DISCONNECT = 5, // (none)
+	Q2R_KIND_COMMAND    = 6, // u16 argc, argc argv strings, args string
+	Q2R_KIND_THINK      = 7, // usercmd: u8 msec, u8 buttons, i16 angles[3], i16 forward, side, up, u8 impulse, u8 lightlevel
+	Q2R_KIND_SERVERCMD  = 8, // same as COMMAND
+	Q2R_KIND_MAX
+};
+
+static inline void q2r_put_header( unsigned char * p, int kind, int client, uint32_t frame, size_t length )
+{
+	p[0] = (unsigned char)kind;
+	p[1] = 0;
+	q2lb_put16( p + 2, (uint16_t)(int16_t)client );
+	q2lb_put32( p + 4, frame );
+	q2lb_put32( p + 8, (uint32_t)length );
+}
+
+#endif
@@ -0,0 +1,645 @@
+/*-------------------------------
+# SPDX-License-Identifier: ISC
+#
+# Copyright © 2022 Daniel Wolf <<nephatrine@gmail.com>>
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+# REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+# AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+# INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+# LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+# OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+# -----------------------------*/
+
+#include "g_local.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef USE_SHARED
+#	include <errno.h>
+#	include <fcntl.h>
+#	include <pthread.h>
+#	include <sched.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+// Sanctions shared between servers. Every q2admin started with the same
+// sharedstore name maps one POSIX shared memory segment holding a ring of the
+// last SHARED_SLOTS console bans, mutes and flood kicks. Publishing takes a
+// robust process-shared mutex between the publishers; reading takes none. Each slot is a
+// seqlock (its sequence is odd while it is written), and the header's serial
+// is bumped after the slot is complete, so a server reads one word a frame
+// and only walks the slots when something new has arrived. Servers on other
+// hosts are reached through a sync daemon instead (see zb_sync.c), and both
+// hand what they receive to sharedReceive.
+//
+// What a server receives it applies like its own console would have:
+//
+//   - bans are added as temporary bans. A TIME ban keeps its wall clock end
+//     and is added again after this server's level changes, others last until
+//     the level changes
+//   - mutes are kept per address, so a player hopping to another server is
+//     still muted when they next talk, and unmuting clears them everywhere
+//   - flood kicks disconnect the same address if it is on this server too
+//
+// The ban lists and their index are not shared. The index (zb_banindex.c)
+// points at each server's own level memory entries, which carry that
+// server's MAX holds and expiry heap slots, and LIKE and RE bans hold
+// compiled regexes, none of which can live in a segment mapped at a different
+// address in every process. Servers on one host can also load different ban
+// files. Every server still loads its own copy of its ban file (or compiled
+// image, see zb_banimage.c) each level.
+
+char sharedstore_name[256] = ""; // shm_open name, empty to share nothing
+
+#define SHARED_MAGIC "Q2AS"
+#define SHARED_VERSION 4
+#define SHARED_SLOTS 1024
+#define SHARED_MUTES 64
+#define SHARED_BANS 256        // other servers' TIME bans kept to add back after a level change
+#define SHARED_SEEN 1024       // sanctions remembered so one arriving twice is applied once
+#define SHARED_KICK_SECONDS 10 // a flood kick is only acted on this long after it was given
+#define SHARED_READ_TRIES 8
+
+#ifdef USE_SHARED
+
+typedef struct
+{
+	uint32_t   seq; // odd while the slot is being written
+	uint32_t   reserved;
+	uint64_t   serial; // publish number it holds
+	sanction_t record;
+} sharedslot_t;
+
+typedef struct
+{
+	char            magic[4];
+	uint32_t        version;
+	uint32_t        slots;
+	uint32_t        slotsize;
+	uint32_t        ready; // set once the creator has filled this in
+	uint32_t        reserved;
+	uint64_t        serial; // last publish number
+	pthread_mutex_t lock;   // held while publishing
+	sharedslot_t    slot[SHARED_SLOTS];
+} sharedstore_t;
+
+#endif
+
+// mutes received from the other servers, by address
+typedef struct
+{
+	byte   ip[4];
+	time_t expires; // 0 for PERM
+} sharedmute_t;
+
+static uint32_t     sharedOrigin = 0; // this server in the sanctions it gives
+static uint32_t     sharedGiven  = 0;
+static uint64_t     sharedSeen[SHARED_SEEN];
+static int          sharedSeenNext = 0;
+static sharedmute_t sharedMutes[SHARED_MUTES];
+static int          sharedMuteCount = 0;
+static sanction_t * sharedBans      = NULL;
+static int          sharedBanCount  = 0;
+
+static void sharedPublish( const sanction_t * record );
+
+// random, so servers on different hosts started together still differ
+uint32_t sharedOriginId()
+{
+	uint32_t id = 0;
+	FILE *   fp;
+
+	if( sharedOrigin ) return sharedOrigin;
+
+	fp = fopen( "/dev/urandom", "rb" );
+	if( fp )
+	{
+		if( fread( &id, sizeof( id ), 1, fp ) != 1 ) id = 0;
+		fclose( fp );
+	}
+
+	if( !id ) id = ( (uint32_t)time( NULL ) * 2654435761u ) ^ (uint32_t)clock() ^ (uint32_t)(uintptr_t)&id;
+
+	sharedOrigin = id ? id : 1;
+	return sharedOrigin;
+}
+
+// TRUE if this sanction was already received, remembering it otherwise
+static qboolean sharedSeenBefore( const sanction_t * record )
+{
+	uint64_t key = ( (uint64_t)record->origin << 32 ) | record->serial;
+	int      i;
+
+	for( i = 0; i < SHARED_SEEN; ++i )
+		if( sharedSeen[i] == key ) return TRUE;
+
+	sharedSeen[sharedSeenNext] = key;
+	sharedSeenNext             = ( sharedSeenNext + 1 ) % SHARED_SEEN;
+	return FALSE;
+}
+
+//
+// Mutes
+//
+
+static void sharedMuteSet( const byte * ip, int seconds, time_t expires )
+{
+	int i, j;
+
+	for( i = 0; i < sharedMuteCount; ++i )
+		if( !memcmp( sharedMutes[i].ip, ip, 4 ) ) break;
+
+	if( !seconds )
+	{
+		if( i < sharedMuteCount ) sharedMutes[i] = sharedMutes[--sharedMuteCount];
+		return;
+	}
+
+	// full, so the one that ends soonest makes room
+	if( i == SHARED_MUTES )
+	{
+		for( i = 0, j = 1; j < SHARED_MUTES; ++j )
+			if( sharedMutes[j].expires && ( !sharedMutes[i].expires || sharedMutes[j].expires < sharedMutes[i].expires ) ) i = j;
+	}
+	else if( i == sharedMuteCount )
+		sharedMuteCount++;
+
+	memcpy( sharedMutes[i].ip, ip, 4 );
+	sharedMutes[i].expires = seconds < 0 ? 0 : expires;
+}
+
+// mutes client if another server muted its address
+void sharedCheckMute( int client )
+{
+	time_t now;
+	int    i;
+
+	if( !sharedMuteCount || ( proxyinfo[client].clientcommand & CCMD_PCSILENCE ) ) return;
+
+	for( i = 0; i < sharedMuteCount; ++i )
+		if( !memcmp( sharedMutes[i].ip, proxyinfo[client].ipaddressBinary, 4 ) ) break;
+
+	if( i == sharedMuteCount ) return;
+
+	if( !sharedMutes[i].expires )
+	{
+		proxyinfo[client].clientcommand |= CCMD_PCSILENCE;
+		return;
+	}
+
+	now = time( NULL );
+	if( sharedMutes[i].expires <= now )
+	{
+		sharedMutes[i] = sharedMutes[--sharedMuteCount];
+		return;
+	}
+
+	if( !( proxyinfo[client].clientcommand & CCMD_CSILENCE ) || proxyinfo[client].chattimeout < ltime + (float)( sharedMutes[i].expires - now ) )
+	{
+		proxyinfo[client].chattimeout = ltime + (float)( sharedMutes[i].expires - now );
+		proxyinfo[client].clientcommand |= CCMD_CSILENCE;
+	}
+}
+
+//
+// Receiving
+//
+
+// keeps a TIME ban from another server for sharedReload
+static void sharedKeepBan( const sanction_t * record )
+{
+	time_t now = time( NULL );
+	int    i, j;
+
+	if( !sharedBans && ( sharedBans = malloc( SHARED_BANS * sizeof( sanction_t ) ) ) == NULL ) return;
+
+	for( i = j = 0; i < sharedBanCount; ++i )
+		if( sharedBans[i].expires > now ) sharedBans[j++] = sharedBans[i];
+	sharedBanCount = j;
+
+	// full, so the one that ends soonest makes room
+	if( sharedBanCount == SHARED_BANS )
+	{
+		for( i = 0, j = 1; j < SHARED_BANS; ++j )
+			if( sharedBans[j].expires < sharedBans[i].expires ) i = j;
+
+		if( sharedBans[i].expires > record->expires ) return;
+	}
+	else
+		i = sharedBanCount++;
+
+	sharedBans[i] = *record;
+}
+
+static void sharedAddBan( const sanction_t * record )
+{
+	baninfo_t * entry = gi.TagMalloc( sizeof( baninfo_t ), TAG_LEVEL );
+
+	q2a_memset( entry, 0, sizeof( *entry ) );
+	entry->exclude             = record->exclude;
+	entry->type                = record->type;
+	entry->loadType            = LT_TEMP;
+	entry->subnetmask          = record->subnetmask;
+	entry->maxnumberofconnects = record->maxconnects;
+	memcpy( entry->ip, record->ip, 4 );
+	snprintf( entry->nick, sizeof( entry->nick ), "%s", record->nick );
+
+	if( record->msg[0] )
+	{
+		entry->msg = gi.TagMalloc( q2a_strlen( record->msg ) + 1, TAG_LEVEL );
+		q2a_strcpy( entry->msg, record->msg );
+	}
+
+	entry->floodinfo.chatFloodProtect        = record->flood[0];
+	entry->floodinfo.chatFloodProtectNum     = record->flood[1];
+	entry->floodinfo.chatFloodProtectSec     = record->flood[2];
+	entry->floodinfo.chatFloodProtectSilence = record->flood[3];
+
+	// a NAME RE ban's expression is compiled when it is first matched
+	if( record->expires ) entry->timeout = banStoreTimeout( (time_t)record->expires );
+
+	addBan( entry );
+}
+
+static void sharedApply( const sanction_t * record, qboolean live )
+{
+	time_t now = time( NULL );
+	int    client;
+
+	switch( record->kind )
+	{
+	case SANCTION_BAN:
+		if( record->expires ? record->expires <= now : !live ) return;
+
+		sharedAddBan( record );
+		checkAllClientsBanned();
+		break;
+
+	case SANCTION_MUTE:
+		if( record->seconds > 0 && record->expires <= now ) return;
+
+		sharedMuteSet( record->ip, record->seconds, (time_t)record->expires );
+
+		for( client = 0; client < maxclients->value; ++client )
+		{
+			if( !proxyinfo[client].inuse || memcmp( proxyinfo[client].ipaddressBinary, record->ip, 4 ) ) continue;
+
+			if( !record->seconds )
+				proxyinfo[client].clientcommand &= ~( CCMD_CSILENCE | CCMD_PCSILENCE );
+			else
+			{
+				proxyinfo[client].clientcommand &= ~CCMD_PCSILENCE;
+				sharedCheckMute( client );
+			}
+		}
+		break;
+
+	case SANCTION_KICK:
+		if( record->time + SHARED_KICK_SECONDS < now ) return;
+
+		for( client = 0; client < maxclients->value; ++client )
+			if( proxyinfo[client].inuse && !memcmp( proxyinfo[client].ipaddressBinary, record->ip, 4 ) ) addCmdQueue( client, QCMD_DISCONNECT, 0, 0, chatFloodProtectMsg );
+		break;
+	}
+}
+
+// Bans another server can't give this one: + entries (exclude is FALSE), which
+// would let players past this server's own bans, and bans on every name over
+// more than a /8, or on any address range wider than that.
+static qboolean sharedTooBroad( const sanction_t * record )
+{
+	if( record->kind != SANCTION_BAN ) return FALSE;
+
+	return !record->exclude || record->subnetmask > 32 || ( record->subnetmask && record->subnetmask < 8 ) || ( record->type == NICKALL && record->subnetmask < 8 );
+}
+
+// applies a sanction from another server. live is FALSE while catching up on
+// ones given before this server started, which skips bans that only last
+// until the level changes.
+void sharedReceive( const sanction_t * record, qboolean live )
+{
+	if( record->origin == sharedOriginId() || sharedSeenBefore( record ) ) return;
+
+	if( sharedTooBroad( record ) )
+	{
+		gi.dprintf( "WARNING: ignored a + or too broad ban (%u.%u.%u.%u/%u) from server %08x\n", record->ip[0], record->ip[1], record->ip[2], record->ip[3], record->subnetmask, record->origin );
+		return;
+	}
+
+	sharedApply( record, live );
+
+	if( record->kind == SANCTION_BAN && record->expires > time( NULL ) && !record->saved ) sharedKeepBan( record );
+}
+
+// adds the other servers' TIME bans back after this server's lists are reloaded
+void sharedReload()
+{
+	int i;
+
+	for( i = 0; i < sharedBanCount; ++i ) sharedApply( &sharedBans[i], FALSE );
+}
+
+//
+// Publishing
+//
+
+static void sharedGive( sanction_t * record )
+{
+	record->origin = sharedOriginId();
+	record->serial = ++sharedGiven;
+	record->time   = (int64_t)time( NULL );
+
+	sharedPublish( record );
+	syncPublish( record );
+}
+
+// + entries are kept to this server. Their passwords would otherwise sit in the
+// segment and go out to every daemon, and the others would refuse them anyway.
+void sharedPublishBan( baninfo_t * entry, qboolean saved )
+{
+	sanction_t record;
+
+	if( !entry->exclude ) return;
+
+	q2a_memset( &record, 0, sizeof( record ) );
+	record.kind        = SANCTION_BAN;
+	record.exclude     = (uint8_t)entry->exclude;
+	record.type        = entry->type;
+	record.subnetmask  = entry->subnetmask;
+	record.saved       = (uint8_t)saved;
+	record.maxconnects = (int32_t)entry->maxnumberofconnects;
+	record.flood[0]    = entry->floodinfo.chatFloodProtect;
+	record.flood[1]    = entry->floodinfo.chatFloodProtectNum;
+	record.flood[2]    = entry->floodinfo.chatFloodProtectSec;
+	record.flood[3]    = entry->floodinfo.chatFloodProtectSilence;
+	memcpy( record.ip, entry->ip, 4 );
+	snprintf( record.nick, sizeof( record.nick ), "%s", entry->nick );
+	if( entry->msg ) snprintf( record.msg, sizeof( record.msg ), "%s", entry->msg );
+
+	if( entry->expires )
+		record.expires = (int64_t)entry->expires;
+	else if( entry->timeout )
+		record.expires = (int64_t)time( NULL ) + (int64_t)( entry->timeout - ltime );
+
+	sharedGive( &record );
+}
+
+// seconds is the mute length, -1 for PERM or 0 to unmute
+void sharedPublishMute( int client, int seconds )
+{
+	sanction_t record;
+
+	// an unmute here also ends one that came from another server
+	if( !seconds ) sharedMuteSet( proxyinfo[client].ipaddressBinary, 0, 0 );
+
+	q2a_memset( &record, 0, sizeof( record ) );
+	record.kind    = SANCTION_MUTE;
+	record.seconds = seconds;
+	record.expires = seconds > 0 ? (int64_t)time( NULL ) + seconds : 0;
+	memcpy( record.ip, proxyinfo[client].ipaddressBinary, 4 );
+	sharedGive( &record );
+}
+
+void sharedPublishKick( int client )
+{
+	sanction_t record;
+
+	q2a_memset( &record, 0, sizeof( record ) );
+	record.kind = SANCTION_KICK;
+	memcpy( record.ip, proxyinfo[client].ipaddressBinary, 4 );
+	sharedGive( &record );
+}
+
+#ifdef USE_SHARED
+
+static sharedstore_t * sharedStore  = NULL;
+static uint64_t        sharedSerial = 0;     // last publish number read
+static qboolean        sharedLive   = FALSE; // past the first frame, which catches up on the ring
+
+//
+// Slots
+//
+
+// copies a slot out, FALSE if it kept changing under us
+static qboolean sharedRead( uint64_t serial, sharedslot_t * copy )
+{
+	sharedslot_t * slot = &sharedStore->slot[serial % SHARED_SLOTS];
+	uint32_t       seq;
+	int            tries;
+
+	for( tries = 0; tries < SHARED_READ_TRIES; ++tries )
+	{
+		seq = __atomic_load_n( &slot->seq, __ATOMIC_ACQUIRE );
+		if( seq & 1 ) continue;
+
+		memcpy( copy, slot, sizeof( *copy ) );
+		__atomic_thread_fence( __ATOMIC_ACQUIRE );
+
+		if( __atomic_load_n( &slot->seq, __ATOMIC_RELAXED ) == seq ) return copy->serial == serial;
+	}
+
+	return FALSE;
+}
+
+// Publishers take turns through the header's mutex. It is robust, so if one
+// dies holding it the next gets it anyway, and its seqlock bump steps past a
+// slot that was left half written. Gives up rather than stall the frame.
+static qboolean sharedLock()
+{
+	int tries, ret;
+
+	for( tries = 0; tries < 1000; ++tries )
+	{
+		ret = pthread_mutex_trylock( &sharedStore->lock );
+		if( ret == 0 ) return TRUE;
+
+		if( ret == EOWNERDEAD ) return pthread_mutex_consistent( &sharedStore->lock ) == 0;
+
+		if( ret != EBUSY ) return FALSE;
+
+		sched_yield();
+	}
+
+	return FALSE;
+}
+
+static void sharedPublish( const sanction_t * record )
+{
+	sharedslot_t * slot;
+	uint64_t       serial;
+	uint32_t       seq;
+
+	if( !sharedStore ) return;
+
+	if( !sharedLock() )
+	{
+		gi.dprintf( "WARNING: unable to lock shared store %s, a sanction was not shared with this host's servers\n", sharedstore_name );
+		return;
+	}
+
+	serial = sharedStore->serial + 1;
+	slot   = &sharedStore->slot[serial % SHARED_SLOTS];
+
+	// odd, and past whatever a publisher that died half way through left
+	seq = ( __atomic_load_n( &slot->seq, __ATOMIC_RELAXED ) | 1 ) + 2;
+	__atomic_store_n( &slot->seq, seq, __ATOMIC_RELAXED );
+	__atomic_thread_fence( __ATOMIC_RELEASE );
+
+	slot->serial = serial;
+	slot->record = *record;
+
+	__atomic_store_n( &slot->seq, seq + 1, __ATOMIC_RELEASE );
+	__atomic_store_n( &sharedStore->serial, serial, __ATOMIC_RELEASE );
+	pthread_mutex_unlock( &sharedStore->lock );
+}
+
+void sharedFrame()
+{
+	sharedslot_t slot;
+	uint64_t     serial, last;
+	qboolean     live = sharedLive;
+
+	if( !sharedStore ) return;
+
+	sharedLive = TRUE;
+	last       = __atomic_load_n( &sharedStore->serial, __ATOMIC_ACQUIRE );
+	if( last == sharedSerial ) return;
+
+	// only the last SHARED_SLOTS are still there
+	serial = last - sharedSerial > SHARED_SLOTS ? last - SHARED_SLOTS + 1 : sharedSerial + 1;
+
+	for( ; serial <= last; ++serial )
+		if( sharedRead( serial, &slot ) ) sharedReceive( &slot.record, live );
+
+	sharedSerial = last;
+}
+
+//
+// Segment
+//
+
+void sharedInitialize()
+{
+	sharedstore_t * store;
+	struct stat     st;
+	int             fd, tries;
+	qboolean        created = FALSE;
+
+	if( sharedStore || !sharedstore_name[0] ) return;
+
+	// whoever creates it sizes and fills in the header, the rest wait for that
+	fd = shm_open( sharedstore_name, O_RDWR | O_CREAT | O_EXCL, 0660 );
+	if( fd >= 0 )
+		created = ftruncate( fd, sizeof( sharedstore_t ) ) == 0;
+	else if( errno == EEXIST )
+		fd = shm_open( sharedstore_name, O_RDWR, 0660 );
+
+	// a server starting at the same moment may not have sized it yet
+	for( tries = 0; fd >= 0 && !created && tries < 100 && fstat( fd, &st ) == 0 && st.st_size < (off_t)sizeof( sharedstore_t ); ++tries ) usleep( 1000 );
+
+	if( fd < 0 || ( !created && ( fstat( fd, &st ) != 0 || st.st_size < (off_t)sizeof( sharedstore_t ) ) ) )
+	{
+		gi.dprintf( "WARNING: unable to open shared store %s\n", sharedstore_name );
+		if( fd >= 0 ) close( fd );
+		return;
+	}
+
+	store = mmap( NULL, sizeof( sharedstore_t ), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+	close( fd );
+
+	if( store == MAP_FAILED )
+	{
+		gi.dprintf( "WARNING: unable to map shared store %s\n", sharedstore_name );
+		return;
+	}
+
+	if( created )
+	{
+		pthread_mutexattr_t attr;
+
+		pthread_mutexattr_init( &attr );
+		pthread_mutexattr_setpshared( &attr, PTHREAD_PROCESS_SHARED );
+		pthread_mutexattr_setrobust( &attr, PTHREAD_MUTEX_ROBUST );
+		created = pthread_mutex_init( &store->lock, &attr ) == 0;
+		pthread_mutexattr_destroy( &attr );
+
+		// left without a magic, so servers opening it after us give up on it too
+		if( !created )
+		{
+			gi.dprintf( "WARNING: unable to set up shared store %s\n", sharedstore_name );
+			munmap( store, sizeof( sharedstore_t ) );
+			return;
+		}
+
+		memcpy( store->magic, SHARED_MAGIC, 4 );
+		store->version  = SHARED_VERSION;
+		store->slots    = SHARED_SLOTS;
+		store->slotsize = sizeof( sharedslot_t );
+		__atomic_store_n( &store->ready, 1, __ATOMIC_RELEASE );
+	}
+
+	for( tries = 0; tries < 100 && !__atomic_load_n( &store->ready, __ATOMIC_ACQUIRE ); ++tries ) usleep( 1000 );
+
+	if( memcmp( store->magic, SHARED_MAGIC, 4 ) || store->version != SHARED_VERSION || store->slots != SHARED_SLOTS || store->slotsize != sizeof( sharedslot_t ) )
+	{
+		gi.dprintf( "WARNING: shared store %s is from another q2admin version\n", sharedstore_name );
+		munmap( store, sizeof( sharedstore_t ) );
+		return;
+	}
+
+	sharedStore  = store;
+	sharedSerial = 0;
+	sharedLive   = FALSE;
+	gi.dprintf( "Sharing bans and mutes through %s\n", sharedstore_name );
+}
+
+// the segment is left in place for the other servers
+static void sharedUnmap()
+{
+	if( !sharedStore ) return;
+
+	munmap( sharedStore, sizeof( sharedstore_t ) );
+	sharedStore  = NULL;
+	sharedSerial = 0;
+	sharedLive   = FALSE;
+}
+
+#else
+
+static void sharedPublish( const sanction_t * record ) {}
+static void sharedUnmap() {}
+
+void sharedInitialize()
+{
+	if( sharedstore_name[0] ) gi.dprintf( "WARNING: sharedstore is not supported by this build\n" );
+}
+
+void sharedFrame() {}
+
+#endif
+
+// a server started again is a new origin, and takes back what others still send
+void sharedShutdown()
+{
+	sharedUnmap();
+
+	free( sharedBans );
+	sharedBans      = NULL;
+	sharedBanCount  = 0;
+	sharedMuteCount = 0;
+	sharedOrigin    = 0;
+	sharedGiven     = 0;
+	sharedSeenNext  = 0;
+	q2a_memset( sharedSeen, 0, sizeof( sharedSeen ) );
+}
@@ -0,0 +1,55 @@
+/*-------------------------------
+# SPDX-License-Identifier: ISC
+#
+# Copyright © 2022 Daniel Wolf <<nephatrine@gmail.com>>
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+# REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+# AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+# INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+# LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+# OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+# -----------------------------*/
+
+#ifndef ZB_SHARED_H
+#define ZB_SHARED_H 1
+
+#include <stdint.h>
+
+// A ban, mute or flood kick given on one server for the others to apply. It is
+// carried between servers on one host by the shared store (zb_shared.c) and
+// between hosts by a sync daemon (zb_sync.c). Every server numbers what it
+// gives, so one arriving both ways, or twice, is only applied once.
+
+enum sanction_kind_e
+{
+	SANCTION_BAN = 1,
+	SANCTION_MUTE,
+	SANCTION_KICK
+};
+
+typedef struct
+{
+	uint32_t origin;  // server that gave it, random per server start
+	uint32_t serial;  // that server's count of sanctions given
+	uint32_t kind;    // SANCTION_*
+	int32_t  seconds; // mute length, -1 for PERM, 0 to unmute
+	int64_t  time;    // wall clock when given
+	int64_t  expires; // wall clock end, 0 for none
+	uint8_t  ip[4];
+	uint8_t  subnetmask;
+	uint8_t  type; // NICK* of a ban
+	uint8_t  exclude;
+	uint8_t  saved; // also in the origin's ban file
+	int32_t  maxconnects;
+	int32_t  flood[4]; // chatFloodProtect, Num, Sec, Silence
+	char     nick[80];
+	char     msg[256];
+} sanction_t;
+
+#endif
@@ -251,7 +251,7 @@ qboolean checkforspawncmd(char *cp, int spawncmd)
 			return !Q_stricmp(cp, spawncmds[spawncmd].spawncmd);
 			
 		case SPAWN_RE:
-			return (regexec(spawncmds[spawncmd].r, cp, 0, 0, 0) != REG_NOMATCH);
+			return (q2a_regexec(spawncmds[spawncmd].r, cp) != REG_NOMATCH);
 		}
 		
 	return FALSE;
@@ -447,6 +447,252 @@ void spawnDelRun(int startarg, edict_t *ent, int client)
 	gi.cprintf (ent, PRINT_HIGH, "Disbled-entities command deleted\n");
 }
 
+// Entity accounting.  With entstats_enable on, links and unlinks are counted
+// per classname instead of logging ENTITYCREATE / ENTITYDELETE for each one,
+// and a summary per class is logged every entstats_interval seconds.
+//
+// Mods relink entities every frame, so only a link of an entity that isn't
+// linked yet is a create and only an unlink of a linked one is a delete.
+//
+// Classes are found by the classname pointer first (mods nearly always use
+// string constants), falling back to the name when a pointer is new.
+
+#define ENTSTATS_CLASSES   512
+#define ENTSTATS_NAMES     1024   // power of 2, more than ENTSTATS_CLASSES
+#define ENTSTATS_POINTERS  4096   // power of 2
+#define ENTSTATS_LINES     20
+#define ENTSTATS_EDICTS    8192   // edicts past this aren't counted
+
+typedef struct
+	{
+		char name[64];
+		int live;
+		int peak;                  // most live this interval
+		unsigned long created;     // this interval
+		unsigned long deleted;
+		unsigned long total;       // created since the map started
+	}
+entstat_t;
+
+typedef struct
+	{
+		const char *classname;
+		unsigned short stat;       // entStats index + 1, 0 for empty
+	}
+entstatptr_t;
+
+qboolean entstats_enable = FALSE;
+int entstats_interval = 60;
+
+entstat_t entStats[ENTSTATS_CLASSES + 1];   // the last one is for everything that doesn't fit
+unsigned int entStatsCount = 0;
+unsigned short entStatsByName[ENTSTATS_NAMES];
+entstatptr_t entStatsByPointer[ENTSTATS_POINTERS];
+unsigned int entStatsPointers = 0;
+float entStatsNext = 0.0;
+
+// what each edict was counted against when it was linked (entStats index + 1,
+// 0 for not linked). The engine only gives solid entities an area link, so
+// ent->area can't tell whether one has been counted yet.
+unsigned short entStatsLinked[ENTSTATS_EDICTS];
+
+
+static entstat_t *getEntStatByName(const char *classname)
+{
+	unsigned int hash = 2166136261u;
+	unsigned int slot;
+	const char *cp;
+	
+	for(cp = classname; *cp; cp++)
+		{
+			hash = (hash ^ (byte)*cp) * 16777619u;
+		}
+		
+	for(slot = hash & (ENTSTATS_NAMES - 1); entStatsByName[slot]; slot = (slot + 1) & (ENTSTATS_NAMES - 1))
+		{
+			if(q2a_strcmp(entStats[entStatsByName[slot] - 1].name, classname) == 0)
+				{
+					return &entStats[entStatsByName[slot] - 1];
+				}
+		}
+		
+	if(entStatsCount >= ENTSTATS_CLASSES)
+		{
+			return &entStats[ENTSTATS_CLASSES];
+		}
+		
+	q2a_strncpy(entStats[entStatsCount].name, classname, sizeof(entStats[entStatsCount].name) - 1);
+	entStatsByName[slot] = (unsigned short)++entStatsCount;
+	
+	return &entStats[entStatsCount - 1];
+}
+
+
+static entstat_t *getEntStat(edict_t *ent)
+{
+	const char *classname = *((char **)((uintptr_t)ent + entity_classname_offset));
+	unsigned int slot = (unsigned int)(((uintptr_t)classname >> 3) * 2654435761u) & (ENTSTATS_POINTERS - 1);
+	entstat_t *stat;
+	
+	for(; entStatsByPointer[slot].stat; slot = (slot + 1) & (ENTSTATS_POINTERS - 1))
+		{
+			if(entStatsByPointer[slot].classname == classname)
+				{
+					return &entStats[entStatsByPointer[slot].stat - 1];
+				}
+		}
+		
+	stat = getEntStatByName(classname ? classname : "noclass");
+	
+	// keep the pointer table under 3/4 full, after that new pointers go by name
+	if(stat != &entStats[ENTSTATS_CLASSES] && entStatsPointers < ENTSTATS_POINTERS / 4 * 3)
+		{
+			entStatsByPointer[slot].classname = classname;
+			entStatsByPointer[slot].stat = (unsigned short)(stat - entStats + 1);
+			entStatsPointers++;
+		}
+		
+	return stat;
+}
+
+
+static void logEntStats(void)
+{
+	unsigned int i;
+	entstat_t *stat;
+	
+	for(i = 0; i <= ENTSTATS_CLASSES; i++)
+		{
+			stat = &entStats[i];
+			
+			if(stat->created || stat->deleted)
+				{
+					sprintf(buffer, "%s: %lu created, %lu deleted, %d live, %d peak", stat->name, stat->created, stat->deleted, stat->live, stat->peak);
+					logEvent(LT_ENTITYCREATE, 0, NULL, buffer, (int)stat->created, (float)stat->peak);
+				}
+				
+			stat->created = 0;
+			stat->deleted = 0;
+			stat->peak = stat->live;
+		}
+}
+
+
+// called every frame, logs the summary once the interval is up.
+void entstatsFrame(void)
+{
+	if(!entstats_enable || ltime < entStatsNext)
+		{
+			return;
+		}
+		
+	if(entStatsNext > 0.0)
+		{
+			logEntStats();
+		}
+		
+	entStatsNext = ltime + (entstats_interval > 0 ? entstats_interval : 60);
+}
+
+
+// map change or shutdown: the engine drops every entity without unlinking
+// them and the classname strings may be freed, so start again from nothing.
+void entstatsFlush(void)
+{
+	if(entstats_enable)
+		{
+			logEntStats();
+		}
+		
+	q2a_memset(entStats, 0x0, sizeof(entStats));
+	q2a_strcpy(entStats[ENTSTATS_CLASSES].name, "other");
+	q2a_memset(entStatsByName, 0x0, sizeof(entStatsByName));
+	q2a_memset(entStatsByPointer, 0x0, sizeof(entStatsByPointer));
+	q2a_memset(entStatsLinked, 0x0, sizeof(entStatsLinked));
+	entStatsCount = 0;
+	entStatsPointers = 0;
+	entStatsNext = 0.0;
+}
+
+
+#define ENTSTATSCMD    "[sv] !entstats [classname] [lines] / reset\n"
+
+void entstatsRun(int startarg, edict_t *ent, int client)
+{
+	unsigned short order[ENTSTATS_CLASSES + 1];
+	unsigned int count = 0, i, j;
+	unsigned short swap;
+	int argi, lines = ENTSTATS_LINES;
+	char *match = NULL, *arg;
+	entstat_t *stat;
+	
+	if(!entstats_enable)
+		{
+			gi.cprintf (ent, PRINT_HIGH, "Entity stats are turned off (entstats_enable).\n");
+			return;
+		}
+		
+	for(argi = startarg; argi < gi.argc(); argi++)
+		{
+			arg = gi.argv(argi);
+			
+			if(Q_stricmp(arg, "RESET") == 0)
+				{
+					for(i = 0; i <= ENTSTATS_CLASSES; i++)
+						{
+							entStats[i].created = 0;
+							entStats[i].deleted = 0;
+							entStats[i].peak = entStats[i].live;
+						}
+						
+					gi.cprintf (ent, PRINT_HIGH, "Entity stats reset.\n");
+					return;
+				}
+			else if(isdigit(*arg))
+				{
+					lines = q2a_atoi(arg);
+				}
+			else
+				{
+					match = arg;
+				}
+		}
+		
+	for(i = 0; i <= ENTSTATS_CLASSES; i++)
+		{
+			stat = &entStats[i];
+			
+			if((stat->live || stat->total) && (!match || q2a_strstr(stat->name, match)))
+				{
+					order[count++] = (unsigned short)i;
+				}
+		}
+		
+	// most live first, a leak or spam projectile ends up at the top
+	for(i = 1; i < count; i++)
+		{
+			swap = order[i];
+			
+			for(j = i; j > 0 && entStats[order[j - 1]].live < entStats[swap].live; j--)
+				{
+					order[j] = order[j - 1];
+				}
+				
+			order[j] = swap;
+		}
+		
+	gi.cprintf (ent, PRINT_HIGH, "Class                          Live  Peak  Created  Deleted    Total\n");
+	
+	for(i = 0; i < count && (int)i < lines; i++)
+		{
+			stat = &entStats[order[i]];
+			gi.cprintf (ent, PRINT_HIGH, "%-30.30s %5d %5d %8lu %8lu %8lu\n", stat->name, stat->live, stat->peak, stat->created, stat->deleted, stat->total);
+		}
+		
+	gi.cprintf (ent, PRINT_HIGH, "%u of %u classes, %d seconds into the interval\n", i, count, (int)(ltime - (entStatsNext - (entstats_interval > 0 ? entstats_interval : 60))));
+}
+
+
 void linkentity_internal(edict_t *ent)
 {
 	if(spawnentities_internal_enable && spawnentities_enable)
@@ -461,14 +707,51 @@ void linkentity_internal(edict_t *ent)
 				}
 		}
 		
-	logEvent(LT_ENTITYCREATE, 0, NULL, *((char **)((uintptr_t)ent + entity_classname_offset)), 0, 0.0);
-	
+	if(entstats_enable)
+		{
+			int entnum = (int)getEntOffset(ent);
+			
+			if(entnum >= 0 && entnum < ENTSTATS_EDICTS && !entStatsLinked[entnum])
+				{
+					entstat_t *stat = getEntStat(ent);
+					
+					entStatsLinked[entnum] = (unsigned short)(stat - entStats + 1);
+					stat->created++;
+					stat->total++;
+					
+					if(++stat->live > stat->peak)
+						{
+							stat->peak = stat->live;
+						}
+				}
+		}
+	else
+		{
+			logEvent(LT_ENTITYCREATE, 0, NULL, *((char **)((uintptr_t)ent + entity_classname_offset)), 0, 0.0);
+		}
+		
 	gi.linkentity(ent);
 }
 
 void unlinkentity_internal(edict_t *ent)
 {
-	logEvent(LT_ENTITYDELETE, 0, NULL, *((char **)((uintptr_t)ent + entity_classname_offset)), 0, 0.0);
-	
+	if(entstats_enable)
+		{
+			int entnum = (int)getEntOffset(ent);
+			
+			if(entnum >= 0 && entnum < ENTSTATS_EDICTS && entStatsLinked[entnum])
+				{
+					entstat_t *stat = &entStats[entStatsLinked[entnum] - 1];
+					
+					entStatsLinked[entnum] = 0;
+					stat->deleted++;
+					stat->live--;
+				}
+		}
+	else
+		{
+			logEvent(LT_ENTITYDELETE, 0, NULL, *((char **)((uintptr_t)ent + entity_classname_offset)), 0, 0.0);
+		}
+		
 	gi.unlinkentity(ent);
 }
@@ -0,0 +1,315 @@
+/*-------------------------------
+# SPDX-License-Identifier: ISC
+#
+# Copyright © 2022 Daniel Wolf <<nephatrine@gmail.com>>
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+# REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+# AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+# INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+# LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+# OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+# -----------------------------*/
+
+#include "g_local.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef USE_PTHREADS
+#	include <pthread.h>
+#endif
+
+//
+// Configuration
+//
+
+int  stats_interval = 0; // seconds between snapshots, 0 turns them off
+char stats_file[256] = "q2adminstats.txt";
+
+//
+// Counters
+//
+
+q2s_counter_t q2s_counters[Q2S_COUNTERS];
+
+static const char * q2s_names[Q2S_COUNTERS] = {
+      "ban_checks", "ban_entries_scanned", "bans_expired", "ban_cache_hits", "chatban_checks", "chatban_entries_scanned", "regex_evals", "flood_triggers", "stuffcmd_bytes", "log_bytes", "whois_lookups",
+};
+
+typedef struct
+{
+	int                client;
+	char               name[16];
+	int                depth;
+	int                peak;
+	unsigned long long stuffbytes;
+} q2s_client_t;
+
+typedef struct
+{
+	unsigned long long counters[Q2S_COUNTERS];
+	int                depth; // all clients
+	int                peak;  // highest of any client
+	int                reconnects;
+	int                discordqueue;
+	unsigned int       discorddrops;
+	char               time[64];
+	unsigned long      frame;
+	int                clients;
+	q2s_client_t       client[MAX_CLIENTS];
+} q2s_snapshot_t;
+
+static void q2s_gather( q2s_snapshot_t * s )
+{
+	int i;
+
+	for( i = 0; i < Q2S_COUNTERS; ++i ) s->counters[i] = q2s_counters[i].value;
+
+	s->depth      = 0;
+	s->peak       = 0;
+	s->reconnects = maxReconnectList;
+	s->clients    = 0;
+	s->frame      = lframenum;
+	q2d_outgoing_stats( &s->discordqueue, &s->discorddrops );
+
+	for( i = 0; i < maxclients->value && i < MAX_CLIENTS; ++i )
+	{
+		q2s_client_t * c;
+
+		if( !proxyinfo[i].inuse ) continue;
+
+		c             = &s->client[s->clients++];
+		c->client     = i;
+		c->depth      = proxyinfo[i].maxCmds;
+		c->peak       = proxyinfo[i].maxCmdsPeak;
+		c->stuffbytes = proxyinfo[i].stuffcmdbytes;
+		q2a_strcpy( c->name, proxyinfo[i].name );
+
+		s->depth += c->depth;
+		if( c->peak > s->peak ) s->peak = c->peak;
+	}
+}
+
+//
+// Snapshot File
+//
+
+static struct
+{
+	q2s_snapshot_t snapshot;
+	FILE *         fp;
+	char           path[MAX_OSPATH]; // where the .tmp file is renamed to
+	char           temp[MAX_OSPATH];
+	int            busy;
+	float          next;
+
+#ifdef USE_PTHREADS
+	pthread_t       thread;
+	pthread_mutex_t guard;
+	pthread_cond_t  wake;
+	int             started;
+	int             stop;
+#endif
+} q2s;
+
+static void q2s_write_client( FILE * fp, const char * metric, const q2s_client_t * c, unsigned long long value )
+{
+	const char * cp;
+
+	fprintf( fp, "q2admin_client_%s{client=\"%d\",name=\"", metric, c->client );
+	for( cp = c->name; *cp; ++cp )
+	{
+		if( *cp == '"' || *cp == '\\' ) fputc( '\\', fp );
+		fputc( *cp, fp );
+	}
+	fprintf( fp, "\"} %llu\n", value );
+}
+
+// one "name value" line per counter, with the per client ones labelled, so
+// the file can be scraped as Prometheus text
+static void q2s_write()
+{
+	q2s_snapshot_t * s = &q2s.snapshot;
+	int              i;
+
+	fprintf( q2s.fp, "# q2admin stats at %s, frame %lu\n", s->time, s->frame );
+	for( i = 0; i < Q2S_COUNTERS; ++i ) fprintf( q2s.fp, "q2admin_%s %llu\n", q2s_names[i], s->counters[i] );
+
+	fprintf( q2s.fp, "q2admin_queue_depth %d\n", s->depth );
+	fprintf( q2s.fp, "q2admin_queue_peak %d\n", s->peak );
+	fprintf( q2s.fp, "q2admin_reconnect_list %d\n", s->reconnects );
+	fprintf( q2s.fp, "q2admin_discord_queue %d\n", s->discordqueue );
+	fprintf( q2s.fp, "q2admin_discord_drops %u\n", s->discorddrops );
+
+	for( i = 0; i < s->clients; ++i )
+	{
+		q2s_write_client( q2s.fp, "queue_depth", &s->client[i], (unsigned long long)s->client[i].depth );
+		q2s_write_client( q2s.fp, "queue_peak", &s->client[i], (unsigned long long)s->client[i].peak );
+		q2s_write_client( q2s.fp, "stuffcmd_bytes", &s->client[i], s->client[i].stuffbytes );
+	}
+
+	fclose( q2s.fp );
+	q2s.fp = NULL;
+
+	// the scraper only ever sees a whole file
+#ifdef WIN32
+	remove( q2s.path );
+#endif
+	rename( q2s.temp, q2s.path );
+}
+
+#ifdef USE_PTHREADS
+static void * q2s_run( void * arg )
+{
+	(void)arg;
+
+	pthread_mutex_lock( &q2s.guard );
+	while( !q2s.stop )
+	{
+		if( !__atomic_load_n( &q2s.busy, __ATOMIC_ACQUIRE ) )
+		{
+			pthread_cond_wait( &q2s.wake, &q2s.guard );
+			continue;
+		}
+
+		pthread_mutex_unlock( &q2s.guard );
+		q2s_write();
+		pthread_mutex_lock( &q2s.guard );
+
+		__atomic_store_n( &q2s.busy, 0, __ATOMIC_RELEASE );
+	}
+	pthread_mutex_unlock( &q2s.guard );
+
+	return NULL;
+}
+
+static void q2s_start()
+{
+	pthread_mutex_init( &q2s.guard, NULL );
+	pthread_cond_init( &q2s.wake, NULL );
+
+	if( pthread_create( &q2s.thread, NULL, q2s_run, NULL ) == 0 )
+		q2s.started = 1;
+	else
+	{
+		gi.dprintf( "WARNING: unable to start stats thread, snapshots are written during the frame\n" );
+		pthread_cond_destroy( &q2s.wake );
+		pthread_mutex_destroy( &q2s.guard );
+		q2s.started = -1;
+	}
+}
+#endif
+
+static void q2s_snapshot()
+{
+	size_t len;
+
+	// a writer that is still busy means the disk is slower than stats_interval
+	if( __atomic_load_n( &q2s.busy, __ATOMIC_ACQUIRE ) ) return;
+
+	// the file is opened here as the path lookup reads cvars
+	snprintf( q2s.temp, sizeof( q2s.temp ), "%s.tmp", stats_file );
+	q2s.fp = q2a_fopen( q2s.temp, sizeof( q2s.temp ), "wt" );
+	if( !q2s.fp ) return;
+
+	len = strlen( q2s.temp ) - 4;
+	memcpy( q2s.path, q2s.temp, len );
+	q2s.path[len] = 0;
+
+	q2s_gather( &q2s.snapshot );
+	q2a_strcpy( q2s.snapshot.time, getTimestamp( TS_ISO8601, NULL ) );
+
+#ifdef USE_PTHREADS
+	if( !q2s.started ) q2s_start();
+
+	if( q2s.started > 0 )
+	{
+		pthread_mutex_lock( &q2s.guard );
+		__atomic_store_n( &q2s.busy, 1, __ATOMIC_RELEASE );
+		pthread_cond_signal( &q2s.wake );
+		pthread_mutex_unlock( &q2s.guard );
+		return;
+	}
+#endif
+
+	q2s_write();
+}
+
+void q2s_frame()
+{
+	if( stats_interval <= 0 || !stats_file[0] ) return;
+
+	// ltime starts again with the level
+	if( q2s.next > ltime + stats_interval ) q2s.next = ltime;
+	if( ltime < q2s.next ) return;
+
+	q2s.next = ltime + stats_interval;
+	q2s_snapshot();
+}
+
+void q2s_shutdown()
+{
+#ifdef USE_PTHREADS
+	if( q2s.started > 0 )
+	{
+		// a snapshot in progress is finished first
+		pthread_mutex_lock( &q2s.guard );
+		q2s.stop = 1;
+		pthread_cond_signal( &q2s.wake );
+		pthread_mutex_unlock( &q2s.guard );
+
+		pthread_join( q2s.thread, NULL );
+		pthread_cond_destroy( &q2s.wake );
+		pthread_mutex_destroy( &q2s.guard );
+	}
+#endif
+
+	if( q2s.fp ) fclose( q2s.fp );
+	memset( &q2s, 0, sizeof( q2s ) );
+}
+
+//
+// Admin Command
+//
+
+void statsRun( int startarg, edict_t * ent, int client )
+{
+	static q2s_snapshot_t s;
+	int                   i;
+
+	(void)client;
+
+	q2s_gather( &s );
+
+	for( i = 0; i < Q2S_COUNTERS; ++i ) gi.cprintf( ent, PRINT_HIGH, "%-24s %llu\n", q2s_names[i], s.counters[i] );
+
+	gi.cprintf( ent, PRINT_HIGH, "%-24s %d (peak %d)\n", "queue_depth", s.depth, s.peak );
+	gi.cprintf( ent, PRINT_HIGH, "%-24s %d\n", "reconnect_list", s.reconnects );
+	gi.cprintf( ent, PRINT_HIGH, "%-24s %d (%u dropped)\n", "discord_queue", s.discordqueue, s.discorddrops );
+
+	if( s.clients )
+	{
+		gi.cprintf( ent, PRINT_HIGH, "\n  # name             queue  peak  stuffcmd bytes\n" );
+		for( i = 0; i < s.clients; ++i ) gi.cprintf( ent, PRINT_HIGH, "%3d %-16s %5d %5d  %llu\n", s.client[i].client, s.client[i].name, s.client[i].depth, s.client[i].peak, s.client[i].stuffbytes );
+	}
+
+	if( gi.argc() > startarg && Q_stricmp( gi.argv( startarg ), "RESET" ) == 0 )
+	{
+		memset( q2s_counters, 0, sizeof( q2s_counters ) );
+
+		for( i = 0; i < maxclients->value; ++i )
+		{
+			proxyinfo[i].maxCmdsPeak   = proxyinfo[i].maxCmds;
+			proxyinfo[i].stuffcmdbytes = 0;
+		}
+
+		gi.cprintf( ent, PRINT_HIGH, "Counters reset.\n" );
+	}
+}
@@ -0,0 +1,64 @@
+/*-------------------------------
+# SPDX-License-Identifier: ISC
+#
+# Copyright © 2022 Daniel Wolf <<nephatrine@gmail.com>>
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+# REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+# AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+# INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+# LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+# OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+# -----------------------------*/
+
+#ifndef ZB_STATS_H
+#define ZB_STATS_H 1
+
+// Subsystem counters for !stats and the stats_file snapshot. They are plain
+// integers bumped inline by the game thread, each on its own cache line so a
+// hot one never drags a neighbour along with it. Gauges (queue lengths, list
+// sizes) are not kept here but read when the counters are shown.
+
+#define Q2S_CACHELINE 64
+
+#if defined( _MSC_VER )
+#	define Q2S_ALIGNED __declspec( align( Q2S_CACHELINE ) )
+#else
+#	define Q2S_ALIGNED __attribute__( ( aligned( Q2S_CACHELINE ) ) )
+#endif
+
+enum q2s_counter_e
+{
+	Q2S_BAN_CHECKS,
+	Q2S_BAN_SCANNED,
+	Q2S_BAN_EXPIRED,
+	Q2S_BAN_CACHE_HITS,
+	Q2S_CHATBAN_CHECKS,
+	Q2S_CHATBAN_SCANNED,
+	Q2S_REGEX_EVALS,
+	Q2S_FLOOD_TRIGGERS,
+	Q2S_STUFFCMD_BYTES,
+	Q2S_LOG_BYTES,
+	Q2S_WHOIS_LOOKUPS,
+	Q2S_COUNTERS
+};
+
+typedef struct Q2S_ALIGNED
+{
+	unsigned long long value;
+} q2s_counter_t;
+
+extern q2s_counter_t q2s_counters[Q2S_COUNTERS];
+
+#define Q2S_INC( counter ) ( q2s_counters[counter].value++ )
+#define Q2S_ADD( counter, n ) ( q2s_counters[counter].value += ( n ) )
+
+void q2s_frame();
+void q2s_shutdown();
+
+#endif
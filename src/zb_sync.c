@@ -0,0 +1,665 @@
+/*-------------------------------
+# SPDX-License-Identifier: ISC
+#
+# Copyright © 2022 Daniel Wolf <<nephatrine@gmail.com>>
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+# REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+# AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+# INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+# LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+# OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+# -----------------------------*/
+
+#ifdef USE_PTHREADS
+#	define _GNU_SOURCE
+#endif
+
+#include "g_local.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef USE_PTHREADS
+#	include <errno.h>
+#	include <fcntl.h>
+#	include <netdb.h>
+#	include <netinet/in.h>
+#	include <netinet/tcp.h>
+#	include <poll.h>
+#	include <pthread.h>
+#	include <sys/socket.h>
+#	include <sys/un.h>
+#	include <time.h>
+#	include <unistd.h>
+
+#	include "zb_syncformat.h"
+#endif
+
+// Sanctions shared with servers on other hosts. With sync_address set the
+// module keeps a connection to a sync daemon (utils/q2a_syncd.c is the
+// reference one) and sends it every ban, mute and flood kick given here; the
+// daemon passes them on to the other servers and daemons it is linked with.
+// With sync_key set every frame is signed with it (see zb_syncformat.h), and
+// nothing is sent to or taken from a daemon that does not have the same key.
+//
+// Only the background thread touches the socket. It connects, reconnects
+// after SYNC_RETRY_SECONDS when the daemon goes away, and moves frames between
+// the socket and two queues. The game thread adds to one queue as sanctions
+// are given and empties the other once a frame, applying what arrived through
+// sharedReceive, so a slow or missing daemon never holds up a frame.
+
+char sync_address[256] = ""; // "unix:/path" or "host:port", empty to sync nothing
+char sync_key[256]     = ""; // shared with the daemon, empty to sign nothing
+
+#ifdef USE_PTHREADS
+
+#	define SYNC_QUEUE_MAX 1024 // sanctions held each way, the oldest are dropped past this
+#	define SYNC_RETRY_SECONDS 5
+#	define SYNC_SEND_SECONDS 5 // a daemon not taking a frame for this long is dropped
+
+enum
+{
+	SYNC_CONNECTING = 0,
+	SYNC_CONNECTED,
+	SYNC_REJECTED, // answered, but not as a sync daemon
+	SYNC_BADKEY,   // a sync daemon, but without our key
+	SYNC_NORANDOM  // no nonce could be made, so not connecting
+};
+
+typedef struct syncitem_s
+{
+	struct syncitem_s * next;
+	sanction_t          record;
+} syncitem_t;
+
+typedef struct
+{
+	syncitem_t * head;
+	syncitem_t * tail;
+	int          count;
+} syncqueue_t;
+
+static struct
+{
+	pthread_t       thread;
+	pthread_mutex_t guard; // both queues
+	syncqueue_t     outbound;
+	syncqueue_t     inbound;
+	int             waiting; // inbound.count, read without the guard
+	int             wake[2]; // pipe that interrupts the thread's poll
+	uint32_t        origin; // sharedOriginId, for the thread's HELLO
+	int             running;
+	int             stop;
+	int             state;    // SYNC_*, set by the thread
+	int             reported; // last state logged by the game thread
+	unsigned long   dropped;
+	char            address[sizeof( sync_address )];
+	char            key[sizeof( sync_key )];
+	q2y_session_t   session; // nonces on the connection, thread only like the two below
+	int             hello;   // the daemon's HELLO has arrived
+	int             trusted; // and its AUTH checked out
+} syncLink;
+
+//
+// Queues
+//
+
+static void syncPush( syncqueue_t * queue, syncitem_t * item )
+{
+	syncitem_t * oldest;
+
+	item->next = NULL;
+	if( queue->tail )
+		queue->tail->next = item;
+	else
+		queue->head = item;
+	queue->tail = item;
+
+	if( ++queue->count > SYNC_QUEUE_MAX )
+	{
+		oldest      = queue->head;
+		queue->head = oldest->next;
+		queue->count--;
+		syncLink.dropped++;
+		free( oldest );
+	}
+}
+
+static syncitem_t * syncTake( syncqueue_t * queue )
+{
+	syncitem_t * items = queue->head;
+
+	queue->head  = NULL;
+	queue->tail  = NULL;
+	queue->count = 0;
+	return items;
+}
+
+static void syncFree( syncitem_t * items )
+{
+	syncitem_t * next;
+
+	for( ; items; items = next )
+	{
+		next = items->next;
+		free( items );
+	}
+}
+
+static void syncWake()
+{
+	ssize_t ignored = write( syncLink.wake[1], "", 1 );
+	(void)ignored;
+}
+
+//
+// Socket
+//
+
+// connects without blocking past SYNC_SEND_SECONDS or a shutdown
+static qboolean syncConnectTo( int fd, const struct sockaddr * addr, socklen_t length )
+{
+	struct pollfd polls;
+	socklen_t     size = sizeof( int );
+	int           flags, error = 0, waited;
+
+	flags = fcntl( fd, F_GETFL );
+	fcntl( fd, F_SETFL, flags | O_NONBLOCK );
+
+	if( connect( fd, addr, length ) != 0 )
+	{
+		if( errno != EINPROGRESS ) return FALSE;
+
+		polls.fd     = fd;
+		polls.events = POLLOUT;
+		for( waited = 0; waited < SYNC_SEND_SECONDS * 1000 && !__atomic_load_n( &syncLink.stop, __ATOMIC_ACQUIRE ); waited += 250 )
+			if( poll( &polls, 1, 250 ) > 0 ) break;
+
+		if( !( polls.revents & POLLOUT ) || getsockopt( fd, SOL_SOCKET, SO_ERROR, &error, &size ) != 0 || error ) return FALSE;
+	}
+
+	fcntl( fd, F_SETFL, flags );
+	return TRUE;
+}
+
+static int syncConnectUnix( const char * path )
+{
+	struct sockaddr_un addr;
+	int                fd;
+
+	if( strlen( path ) >= sizeof( addr.sun_path ) ) return -1;
+
+	memset( &addr, 0, sizeof( addr ) );
+	addr.sun_family = AF_UNIX;
+	strcpy( addr.sun_path, path );
+
+	fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+	if( fd >= 0 && !syncConnectTo( fd, (struct sockaddr *)&addr, sizeof( addr ) ) )
+	{
+		close( fd );
+		fd = -1;
+	}
+
+	return fd;
+}
+
+static int syncConnectInet( const char * address )
+{
+	struct addrinfo hints, *found, *ai;
+	char            host[sizeof( sync_address )];
+	char *          port;
+	int             fd = -1, on = 1;
+
+	strcpy( host, address );
+	port = strrchr( host, ':' );
+	if( !port ) return -1;
+	*port++ = 0;
+
+	// [v6 address]:port
+	if( host[0] == '[' && port - host >= 3 && port[-2] == ']' )
+	{
+		port[-2] = 0;
+		memmove( host, host + 1, strlen( host ) );
+	}
+
+	memset( &hints, 0, sizeof( hints ) );
+	hints.ai_family   = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if( getaddrinfo( host, port, &hints, &found ) != 0 ) return -1;
+
+	for( ai = found; ai && fd < 0; ai = ai->ai_next )
+	{
+		fd = socket( ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol );
+		if( fd >= 0 && !syncConnectTo( fd, ai->ai_addr, ai->ai_addrlen ) )
+		{
+			close( fd );
+			fd = -1;
+		}
+	}
+
+	freeaddrinfo( found );
+	if( fd >= 0 ) setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof( on ) );
+	return fd;
+}
+
+static qboolean syncWriteAll( int fd, const unsigned char * data, size_t length )
+{
+	ssize_t sent;
+
+	while( length )
+	{
+		sent = send( fd, data, length, MSG_NOSIGNAL );
+		if( sent < 0 && errno == EINTR ) continue;
+		if( sent <= 0 ) return FALSE;
+
+		data += sent;
+		length -= (size_t)sent;
+	}
+
+	return TRUE;
+}
+
+// FALSE unless the system's random source filled data
+static qboolean syncRandom( unsigned char * data, size_t length )
+{
+	FILE * fp = fopen( "/dev/urandom", "rb" );
+	size_t got = 0;
+
+	if( fp )
+	{
+		got = fread( data, 1, length, fp );
+		fclose( fp );
+	}
+
+	return got == length;
+}
+
+static int syncConnect()
+{
+	unsigned char  hello[Q2Y_HELLO_SIZE];
+	struct timeval timeout = { SYNC_SEND_SECONDS, 0 };
+	int            fd;
+
+	// a guessable nonce would let an old handshake be replayed
+	if( !syncRandom( syncLink.session.nonce, sizeof( syncLink.session.nonce ) ) )
+	{
+		__atomic_store_n( &syncLink.state, SYNC_NORANDOM, __ATOMIC_RELEASE );
+		return -1;
+	}
+
+	syncLink.session.dialled = 1;
+	syncLink.hello           = 0;
+	syncLink.trusted         = 0;
+
+	if( !strncmp( syncLink.address, "unix:", 5 ) )
+		fd = syncConnectUnix( syncLink.address + 5 );
+	else
+		fd = syncConnectInet( syncLink.address );
+
+	if( fd < 0 ) return -1;
+
+	setsockopt( fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof( timeout ) );
+
+	q2y_put_hello( hello, syncLink.origin, syncLink.session.nonce );
+	if( !syncWriteAll( fd, hello, sizeof( hello ) ) )
+	{
+		close( fd );
+		return -1;
+	}
+
+	return fd;
+}
+
+// sends everything queued once the daemon is trusted, putting back what it did not take
+static qboolean syncSend( int fd )
+{
+	unsigned char frame[Q2Y_FRAME_MAX];
+	syncitem_t *  items, *next;
+	size_t        size;
+
+	if( !syncLink.trusted ) return TRUE;
+
+	pthread_mutex_lock( &syncLink.guard );
+	items = syncTake( &syncLink.outbound );
+	pthread_mutex_unlock( &syncLink.guard );
+
+	for( ; items; items = next )
+	{
+		size = q2y_put_sanction( frame, &items->record );
+		q2y_seal( frame, size, syncLink.key, &syncLink.session );
+		if( !syncWriteAll( fd, frame, size ) ) break;
+
+		next = items->next;
+		free( items );
+	}
+
+	if( !items ) return TRUE;
+
+	pthread_mutex_lock( &syncLink.guard );
+	for( next = items; next->next; next = next->next ) {}
+	next->next = syncLink.outbound.head;
+	if( !syncLink.outbound.head ) syncLink.outbound.tail = next;
+	syncLink.outbound.head = items;
+	for( ; items; items = items->next ) syncLink.outbound.count++;
+	while( syncLink.outbound.count > SYNC_QUEUE_MAX )
+	{
+		items                  = syncLink.outbound.head;
+		syncLink.outbound.head = items->next;
+		syncLink.outbound.count--;
+		syncLink.dropped++;
+		free( items );
+	}
+	pthread_mutex_unlock( &syncLink.guard );
+	return FALSE;
+}
+
+// reads what the daemon sent, answering its HELLO and queueing whole
+// sanctions for the game thread. FALSE once the connection is closed or sends
+// something that is not a frame, or not one signed with our key.
+static qboolean syncReceive( int fd, unsigned char * input, size_t room, size_t * have )
+{
+	syncitem_t *  batch = NULL, **last = &batch;
+	syncitem_t *  item;
+	unsigned char auth[Q2Y_AUTH_SIZE];
+	ssize_t       got;
+	size_t        used = 0, size;
+	uint32_t      origin;
+	qboolean      ok = TRUE;
+
+	got = recv( fd, input + *have, room - *have, 0 );
+	if( got < 0 && ( errno == EINTR || errno == EAGAIN ) ) return TRUE;
+	if( got <= 0 ) return FALSE;
+	*have += (size_t)got;
+
+	while( ok && *have - used >= Q2Y_HEADER_SIZE )
+	{
+		size = q2lb_get16( input + used );
+		if( size < Q2Y_HEADER_SIZE || size > Q2Y_FRAME_MAX )
+		{
+			ok = FALSE;
+			break;
+		}
+		if( *have - used < size ) break;
+
+		switch( input[used + 2] )
+		{
+		case Q2Y_HELLO:
+			switch( q2y_get_hello( input + used, size, &origin, &syncLink.session ) )
+			{
+			case 0:
+				__atomic_store_n( &syncLink.state, SYNC_REJECTED, __ATOMIC_RELEASE );
+				ok = FALSE;
+				break;
+
+			case -1: // our own nonce, sent back to get our AUTH for it
+				__atomic_store_n( &syncLink.state, SYNC_BADKEY, __ATOMIC_RELEASE );
+				ok = FALSE;
+				break;
+
+			default:
+				syncLink.hello = 1;
+				ok             = syncWriteAll( fd, auth, q2y_put_auth( auth, syncLink.key, &syncLink.session ) );
+				break;
+			}
+			break;
+
+		case Q2Y_AUTH:
+			if( !syncLink.hello || !q2y_check( input + used, size, syncLink.key, &syncLink.session ) )
+			{
+				__atomic_store_n( &syncLink.state, SYNC_BADKEY, __ATOMIC_RELEASE );
+				ok = FALSE;
+				break;
+			}
+
+			syncLink.trusted = 1;
+			__atomic_store_n( &syncLink.state, SYNC_CONNECTED, __ATOMIC_RELEASE );
+			break;
+
+		case Q2Y_SANCTION:
+			if( !syncLink.trusted || !q2y_check( input + used, size, syncLink.key, &syncLink.session ) )
+			{
+				__atomic_store_n( &syncLink.state, SYNC_BADKEY, __ATOMIC_RELEASE );
+				ok = FALSE;
+				break;
+			}
+
+			if( ( item = malloc( sizeof( syncitem_t ) ) ) == NULL ) break;
+
+			if( q2y_get_sanction( input + used, size, &item->record ) )
+			{
+				item->next = NULL;
+				*last      = item;
+				last       = &item->next;
+			}
+			else
+				free( item );
+			break;
+		}
+
+		used += size;
+	}
+
+	memmove( input, input + used, *have - used );
+	*have -= used;
+
+	if( batch )
+	{
+		pthread_mutex_lock( &syncLink.guard );
+		for( item = batch; item; item = batch )
+		{
+			batch = item->next;
+			syncPush( &syncLink.inbound, item );
+		}
+		__atomic_store_n( &syncLink.waiting, syncLink.inbound.count, __ATOMIC_RELEASE );
+		pthread_mutex_unlock( &syncLink.guard );
+	}
+
+	return ok;
+}
+
+static void syncDrainWake()
+{
+	char drain[64];
+
+	while( read( syncLink.wake[0], drain, sizeof( drain ) ) > 0 ) {}
+}
+
+// waits SYNC_RETRY_SECONDS before the next connect, waking early only to stop.
+// Sanctions given meanwhile wake the pipe too, but just wait in the queue.
+static void syncPause()
+{
+	struct pollfd   poller;
+	struct timespec now, until;
+	long            left;
+
+	clock_gettime( CLOCK_MONOTONIC, &until );
+	until.tv_sec += SYNC_RETRY_SECONDS;
+
+	poller.fd     = syncLink.wake[0];
+	poller.events = POLLIN;
+
+	while( !__atomic_load_n( &syncLink.stop, __ATOMIC_ACQUIRE ) )
+	{
+		clock_gettime( CLOCK_MONOTONIC, &now );
+		left = ( until.tv_sec - now.tv_sec ) * 1000 + ( until.tv_nsec - now.tv_nsec ) / 1000000;
+		if( left <= 0 ) break;
+
+		poll( &poller, 1, (int)left );
+		syncDrainWake();
+	}
+}
+
+static void * syncThread( void * arg )
+{
+	unsigned char input[Q2Y_FRAME_MAX * 4];
+	struct pollfd polls[2];
+	size_t        have = 0;
+	int           fd   = -1;
+
+	while( !__atomic_load_n( &syncLink.stop, __ATOMIC_ACQUIRE ) )
+	{
+		if( fd < 0 && ( fd = syncConnect() ) < 0 )
+		{
+			syncPause();
+			continue;
+		}
+
+		polls[0].fd     = fd;
+		polls[0].events = POLLIN;
+		polls[1].fd     = syncLink.wake[0];
+		polls[1].events = POLLIN;
+		if( poll( polls, 2, -1 ) < 0 && errno != EINTR ) polls[0].revents = POLLERR;
+
+		if( polls[1].revents & POLLIN ) syncDrainWake();
+
+		// received first, so what queued up before the daemon's AUTH goes out with it
+		if( ( ( polls[0].revents & ( POLLIN | POLLHUP | POLLERR ) ) && !syncReceive( fd, input, sizeof( input ), &have ) ) || !syncSend( fd ) )
+		{
+			close( fd );
+			fd   = -1;
+			have = 0;
+			if( __atomic_load_n( &syncLink.state, __ATOMIC_ACQUIRE ) == SYNC_CONNECTED ) __atomic_store_n( &syncLink.state, SYNC_CONNECTING, __ATOMIC_RELEASE );
+
+			// a daemon that drops us straight away (wrong key, full, not a
+			// daemon at all) would otherwise be reconnected to in a busy loop
+			syncPause();
+		}
+	}
+
+	// whatever was given just before the server stopped still goes out
+	if( fd >= 0 )
+	{
+		syncSend( fd );
+		close( fd );
+	}
+
+	return NULL;
+}
+
+//
+// Game Thread
+//
+
+void syncPublish( const sanction_t * record )
+{
+	syncitem_t * item;
+
+	if( !syncLink.running || ( item = malloc( sizeof( syncitem_t ) ) ) == NULL ) return;
+
+	item->record = *record;
+
+	pthread_mutex_lock( &syncLink.guard );
+	syncPush( &syncLink.outbound, item );
+	pthread_mutex_unlock( &syncLink.guard );
+
+	syncWake();
+}
+
+void syncFrame()
+{
+	syncitem_t * items, *next;
+	int          state;
+
+	if( !syncLink.running ) return;
+
+	state = __atomic_load_n( &syncLink.state, __ATOMIC_ACQUIRE );
+	if( state != syncLink.reported )
+	{
+		if( state == SYNC_CONNECTED )
+			gi.dprintf( "Syncing bans and mutes through %s\n", syncLink.address );
+		else if( state == SYNC_REJECTED )
+			gi.dprintf( "WARNING: %s is not a q2admin sync daemon\n", syncLink.address );
+		else if( state == SYNC_BADKEY )
+			gi.dprintf( "WARNING: sync daemon %s does not have this server's sync_key\n", syncLink.address );
+		else if( state == SYNC_NORANDOM )
+			gi.dprintf( "WARNING: unable to read /dev/urandom, not connecting to sync daemon %s\n", syncLink.address );
+		else
+			gi.dprintf( "WARNING: lost sync daemon %s, reconnecting\n", syncLink.address );
+		syncLink.reported = state;
+	}
+
+	if( !__atomic_load_n( &syncLink.waiting, __ATOMIC_ACQUIRE ) ) return;
+
+	pthread_mutex_lock( &syncLink.guard );
+	items = syncTake( &syncLink.inbound );
+	__atomic_store_n( &syncLink.waiting, 0, __ATOMIC_RELEASE );
+	pthread_mutex_unlock( &syncLink.guard );
+
+	for( ; items; items = next )
+	{
+		next = items->next;
+		sharedReceive( &items->record, TRUE );
+		free( items );
+	}
+}
+
+void syncInitialize()
+{
+	if( syncLink.running || !sync_address[0] ) return;
+
+	memset( &syncLink, 0, sizeof( syncLink ) );
+	snprintf( syncLink.address, sizeof( syncLink.address ), "%s", sync_address );
+	snprintf( syncLink.key, sizeof( syncLink.key ), "%s", sync_key );
+	syncLink.origin = sharedOriginId();
+
+	if( pipe( syncLink.wake ) != 0 )
+	{
+		gi.dprintf( "WARNING: unable to start sync with %s\n", syncLink.address );
+		return;
+	}
+
+	fcntl( syncLink.wake[0], F_SETFL, O_NONBLOCK );
+	fcntl( syncLink.wake[1], F_SETFL, O_NONBLOCK );
+	fcntl( syncLink.wake[0], F_SETFD, FD_CLOEXEC );
+	fcntl( syncLink.wake[1], F_SETFD, FD_CLOEXEC );
+	pthread_mutex_init( &syncLink.guard, NULL );
+
+	if( pthread_create( &syncLink.thread, NULL, syncThread, NULL ) != 0 )
+	{
+		gi.dprintf( "WARNING: unable to start sync with %s\n", syncLink.address );
+		pthread_mutex_destroy( &syncLink.guard );
+		close( syncLink.wake[0] );
+		close( syncLink.wake[1] );
+		return;
+	}
+
+	syncLink.running = 1;
+}
+
+void syncShutdown()
+{
+	if( !syncLink.running ) return;
+
+	__atomic_store_n( &syncLink.stop, 1, __ATOMIC_RELEASE );
+	syncWake();
+	pthread_join( syncLink.thread, NULL );
+
+	if( syncLink.dropped ) gi.dprintf( "WARNING: sync with %s dropped %lu sanctions\n", syncLink.address, syncLink.dropped );
+
+	syncFree( syncTake( &syncLink.outbound ) );
+	syncFree( syncTake( &syncLink.inbound ) );
+	pthread_mutex_destroy( &syncLink.guard );
+	close( syncLink.wake[0] );
+	close( syncLink.wake[1] );
+	syncLink.running = 0;
+}
+
+#else
+
+void syncInitialize()
+{
+	if( sync_address[0] ) gi.dprintf( "WARNING: sync_address is not supported by this build\n" );
+}
+
+void syncShutdown() {}
+void syncFrame() {}
+void syncPublish( const sanction_t * record ) {}
+
+#endif
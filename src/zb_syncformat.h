@@ -0,0 +1,346 @@
+/*-------------------------------
+# SPDX-License-Identifier: ISC
+#
+# Copyright © 2022 Daniel Wolf <<nephatrine@gmail.com>>
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+# REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+# AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+# INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+# LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+# OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+# -----------------------------*/
+
+#ifndef ZB_SYNCFORMAT_H
+#define ZB_SYNCFORMAT_H 1
+
+#include <stdint.h>
+#include <string.h>
+
+#include "zb_logformat.h"
+#include "zb_shared.h"
+
+// Frames on the link between q2admin and a sync daemon, shared by the module
+// and q2admin-syncd. A frame starts with a 4 byte header and all fields are
+// little-endian:
+//
+//   u16 size      whole frame including this header
+//   u8  type      Q2Y_*
+//   u8  reserved
+//
+// Each end sends HELLO once connected, with a random nonce. Every other frame
+// ends in a Q2Y_MAC_SIZE byte MAC, HMAC-SHA256 under the shared sync key of
+// which end sent it (the one that connected or the one that accepted), the
+// sender's nonce, the receiver's nonce and the frame up to the MAC. So a frame
+// is only good on the connection it was sent on and in the direction it was
+// sent, and can't be reflected back to the end that made it. Having the other
+// end's HELLO, each end sends AUTH, and neither trusts the other until its
+// AUTH checks out. A HELLO carrying the receiver's own nonce is refused. After that a server sends a SANCTION for every ban, mute or
+// flood kick it gives, and a daemon passes each one it has not seen before to
+// all its other trusted connections, so servers and daemons can be linked in
+// any shape. Without a key the MACs are zeros and are not checked. Frames of
+// an unknown type are skipped.
+
+#define Q2Y_MAGIC "Q2AY"
+#define Q2Y_VERSION 4
+
+#define Q2Y_HEADER_SIZE 4
+#define Q2Y_NONCE_SIZE 16
+#define Q2Y_MAC_SIZE 16
+#define Q2Y_HELLO_SIZE ( Q2Y_HEADER_SIZE + 12 + Q2Y_NONCE_SIZE )
+#define Q2Y_AUTH_SIZE ( Q2Y_HEADER_SIZE + Q2Y_MAC_SIZE )
+#define Q2Y_SANCTION_SIZE ( Q2Y_HEADER_SIZE + 64 )
+#define Q2Y_FRAME_MAX ( Q2Y_SANCTION_SIZE + 79 + 255 + Q2Y_MAC_SIZE )
+
+enum q2y_type_e
+{
+	Q2Y_HELLO    = 0, // char magic[4], u16 version, u16 reserved, u32 origin (0 from a daemon), u8 nonce[16]
+	Q2Y_SANCTION = 1, // see q2y_put_sanction
+	Q2Y_AUTH     = 2  // just the MAC
+};
+
+//
+// MACs
+//
+
+// one connection's end, as seen from this side
+typedef struct
+{
+	int           dialled;                   // this end connected, the other accepted
+	unsigned char nonce[Q2Y_NONCE_SIZE];     // this end's, sent in its HELLO
+	unsigned char peernonce[Q2Y_NONCE_SIZE]; // the other end's, from its HELLO
+} q2y_session_t;
+
+typedef struct
+{
+	uint32_t      state[8];
+	uint64_t      length;
+	unsigned char block[64];
+	size_t        used;
+} q2y_sha256_t;
+
+static inline uint32_t q2y_ror( uint32_t x, int n ) { return ( x >> n ) | ( x << ( 32 - n ) ); }
+
+static inline void q2y_sha256_block( q2y_sha256_t * h, const unsigned char * p )
+{
+	static const uint32_t k[64] = {
+		0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74,
+		0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da, 0x983e5152, 0xa831c66d,
+		0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e,
+		0x92722c85, 0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+		0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
+	uint32_t w[64], a, b, c, d, e, f, g, x, t1, t2;
+	int      i;
+
+	for( i = 0; i < 16; ++i ) w[i] = ( (uint32_t)p[i * 4] << 24 ) | ( (uint32_t)p[i * 4 + 1] << 16 ) | ( (uint32_t)p[i * 4 + 2] << 8 ) | p[i * 4 + 3];
+	for( ; i < 64; ++i )
+		w[i] = w[i - 16] + ( q2y_ror( w[i - 15], 7 ) ^ q2y_ror( w[i - 15], 18 ) ^ ( w[i - 15] >> 3 ) ) + w[i - 7] +
+		       ( q2y_ror( w[i - 2], 17 ) ^ q2y_ror( w[i - 2], 19 ) ^ ( w[i - 2] >> 10 ) );
+
+	a = h->state[0], b = h->state[1], c = h->state[2], d = h->state[3];
+	e = h->state[4], f = h->state[5], g = h->state[6], x = h->state[7];
+
+	for( i = 0; i < 64; ++i )
+	{
+		t1 = x + ( q2y_ror( e, 6 ) ^ q2y_ror( e, 11 ) ^ q2y_ror( e, 25 ) ) + ( ( e & f ) ^ ( ~e & g ) ) + k[i] + w[i];
+		t2 = ( q2y_ror( a, 2 ) ^ q2y_ror( a, 13 ) ^ q2y_ror( a, 22 ) ) + ( ( a & b ) ^ ( a & c ) ^ ( b & c ) );
+		x  = g, g = f, f = e, e = d + t1;
+		d  = c, c = b, b = a, a = t1 + t2;
+	}
+
+	h->state[0] += a, h->state[1] += b, h->state[2] += c, h->state[3] += d;
+	h->state[4] += e, h->state[5] += f, h->state[6] += g, h->state[7] += x;
+}
+
+static inline void q2y_sha256_init( q2y_sha256_t * h )
+{
+	static const uint32_t iv[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+
+	memcpy( h->state, iv, sizeof( iv ) );
+	h->length = 0;
+	h->used   = 0;
+}
+
+static inline void q2y_sha256_add( q2y_sha256_t * h, const unsigned char * p, size_t length )
+{
+	h->length += length;
+
+	while( length-- )
+	{
+		h->block[h->used++] = *p++;
+		if( h->used == 64 )
+		{
+			q2y_sha256_block( h, h->block );
+			h->used = 0;
+		}
+	}
+}
+
+static inline void q2y_sha256_end( q2y_sha256_t * h, unsigned char * digest )
+{
+	uint64_t bits = h->length * 8;
+	int      i;
+
+	h->block[h->used++] = 0x80;
+	if( h->used > 56 )
+	{
+		memset( h->block + h->used, 0, 64 - h->used );
+		q2y_sha256_block( h, h->block );
+		h->used = 0;
+	}
+	memset( h->block + h->used, 0, 56 - h->used );
+	for( i = 0; i < 8; ++i ) h->block[56 + i] = (unsigned char)( bits >> ( 56 - i * 8 ) );
+	q2y_sha256_block( h, h->block );
+
+	for( i = 0; i < 32; ++i ) digest[i] = (unsigned char)( h->state[i / 4] >> ( 24 - ( i % 4 ) * 8 ) );
+}
+
+// HMAC-SHA256 of the sender's role, both nonces sender's first and the frame
+// up to its MAC, cut to Q2Y_MAC_SIZE
+static inline void q2y_mac( unsigned char * mac, const char * key, int dialled, const unsigned char * from, const unsigned char * to, const unsigned char * p, size_t size )
+{
+	unsigned char pad[64], digest[32], role = dialled ? 'D' : 'A';
+	q2y_sha256_t  h;
+	size_t        length = strlen( key );
+	int           i;
+
+	memset( pad, 0, sizeof( pad ) );
+	if( length > sizeof( pad ) )
+	{
+		q2y_sha256_init( &h );
+		q2y_sha256_add( &h, (const unsigned char *)key, length );
+		q2y_sha256_end( &h, pad );
+	}
+	else
+		memcpy( pad, key, length );
+
+	for( i = 0; i < 64; ++i ) pad[i] ^= 0x36;
+	q2y_sha256_init( &h );
+	q2y_sha256_add( &h, pad, sizeof( pad ) );
+	q2y_sha256_add( &h, &role, 1 );
+	q2y_sha256_add( &h, from, Q2Y_NONCE_SIZE );
+	q2y_sha256_add( &h, to, Q2Y_NONCE_SIZE );
+	q2y_sha256_add( &h, p, size - Q2Y_MAC_SIZE );
+	q2y_sha256_end( &h, digest );
+
+	for( i = 0; i < 64; ++i ) pad[i] ^= 0x36 ^ 0x5c;
+	q2y_sha256_init( &h );
+	q2y_sha256_add( &h, pad, sizeof( pad ) );
+	q2y_sha256_add( &h, digest, sizeof( digest ) );
+	q2y_sha256_end( &h, digest );
+
+	memcpy( mac, digest, Q2Y_MAC_SIZE );
+}
+
+// fills in the MAC at the end of a frame this end sends
+static inline void q2y_seal( unsigned char * p, size_t size, const char * key, const q2y_session_t * session )
+{
+	if( key[0] )
+		q2y_mac( p + size - Q2Y_MAC_SIZE, key, session->dialled, session->nonce, session->peernonce, p, size );
+	else
+		memset( p + size - Q2Y_MAC_SIZE, 0, Q2Y_MAC_SIZE );
+}
+
+// 0 unless the frame's MAC is right for one the other end sent
+static inline int q2y_check( const unsigned char * p, size_t size, const char * key, const q2y_session_t * session )
+{
+	unsigned char mac[Q2Y_MAC_SIZE], diff = 0;
+	int           i;
+
+	if( size < Q2Y_HEADER_SIZE + Q2Y_MAC_SIZE ) return 0;
+	if( !key[0] ) return 1;
+
+	q2y_mac( mac, key, !session->dialled, session->peernonce, session->nonce, p, size );
+	for( i = 0; i < Q2Y_MAC_SIZE; ++i ) diff |= mac[i] ^ p[size - Q2Y_MAC_SIZE + i];
+
+	return diff == 0;
+}
+
+//
+// Frames
+//
+
+static inline void q2y_put_header( unsigned char * p, size_t size, int type )
+{
+	q2lb_put16( p, (uint16_t)size );
+	p[2] = (unsigned char)type;
+	p[3] = 0;
+}
+
+static inline size_t q2y_put_hello( unsigned char * p, uint32_t origin, const unsigned char * nonce )
+{
+	q2y_put_header( p, Q2Y_HELLO_SIZE, Q2Y_HELLO );
+	memcpy( p + 4, Q2Y_MAGIC, 4 );
+	q2lb_put16( p + 8, Q2Y_VERSION );
+	q2lb_put16( p + 10, 0 );
+	q2lb_put32( p + 12, origin );
+	memcpy( p + 16, nonce, Q2Y_NONCE_SIZE );
+	return Q2Y_HELLO_SIZE;
+}
+
+// 0 unless p holds a HELLO this version understands, -1 if it carries this
+// end's own nonce back. Otherwise keeps the other end's nonce in session.
+static inline int q2y_get_hello( const unsigned char * p, size_t size, uint32_t * origin, q2y_session_t * session )
+{
+	if( size < Q2Y_HELLO_SIZE || memcmp( p + 4, Q2Y_MAGIC, 4 ) || q2lb_get16( p + 8 ) != Q2Y_VERSION ) return 0;
+	if( !memcmp( p + 16, session->nonce, Q2Y_NONCE_SIZE ) ) return -1;
+
+	*origin = q2lb_get32( p + 12 );
+	memcpy( session->peernonce, p + 16, Q2Y_NONCE_SIZE );
+	return 1;
+}
+
+static inline size_t q2y_put_auth( unsigned char * p, const char * key, const q2y_session_t * session )
+{
+	q2y_put_header( p, Q2Y_AUTH_SIZE, Q2Y_AUTH );
+	q2y_seal( p, Q2Y_AUTH_SIZE, key, session );
+	return Q2Y_AUTH_SIZE;
+}
+
+static inline size_t q2y_strlen( const char * text, size_t room )
+{
+	size_t length = 0;
+
+	while( length < room - 1 && text[length] ) length++;
+
+	return length;
+}
+
+// SANCTION, p needs Q2Y_FRAME_MAX bytes:
+//
+//   u32 origin, u32 serial, u8 kind, u8 type, u8 exclude, u8 subnetmask,
+//   u8 ip[4], u8 saved, u8 nick length, u16 reserved, u16 msg length,
+//   u16 reserved, i32 seconds, i32 maxconnects, i32 flood[4], i64 time,
+//   i64 expires, then the nick and msg bytes and the MAC
+//
+// The MAC is left for q2y_seal.
+static inline size_t q2y_put_sanction( unsigned char * p, const sanction_t * s )
+{
+	size_t nick     = q2y_strlen( s->nick, sizeof( s->nick ) );
+	size_t msg  = q2y_strlen( s->msg, sizeof( s->msg ) );
+	size_t size = Q2Y_SANCTION_SIZE + nick + msg + Q2Y_MAC_SIZE;
+	int    i;
+
+	q2y_put_header( p, size, Q2Y_SANCTION );
+	q2lb_put32( p + 4, s->origin );
+	q2lb_put32( p + 8, s->serial );
+	p[12] = (unsigned char)s->kind;
+	p[13] = s->type;
+	p[14] = s->exclude;
+	p[15] = s->subnetmask;
+	memcpy( p + 16, s->ip, 4 );
+	p[20] = s->saved;
+	p[21] = (unsigned char)nick;
+	q2lb_put16( p + 22, 0 );
+	q2lb_put16( p + 24, (uint16_t)msg );
+	q2lb_put16( p + 26, 0 );
+	q2lb_put32( p + 28, (uint32_t)s->seconds );
+	q2lb_put32( p + 32, (uint32_t)s->maxconnects );
+	for( i = 0; i < 4; ++i ) q2lb_put32( p + 36 + i * 4, (uint32_t)s->flood[i] );
+	q2lb_put64( p + 52, (uint64_t)s->time );
+	q2lb_put64( p + 60, (uint64_t)s->expires );
+
+	memcpy( p + Q2Y_SANCTION_SIZE, s->nick, nick );
+	memcpy( p + Q2Y_SANCTION_SIZE + nick, s->msg, msg );
+	memset( p + size - Q2Y_MAC_SIZE, 0, Q2Y_MAC_SIZE );
+	return size;
+}
+
+// 0 if p is not a well formed SANCTION
+static inline int q2y_get_sanction( const unsigned char * p, size_t size, sanction_t * s )
+{
+	size_t nick, msg;
+	int    i;
+
+	if( size < Q2Y_SANCTION_SIZE ) return 0;
+
+	nick = p[21];
+	msg  = q2lb_get16( p + 24 );
+	if( nick >= sizeof( s->nick ) || msg >= sizeof( s->msg ) || size != Q2Y_SANCTION_SIZE + nick + msg + Q2Y_MAC_SIZE ) return 0;
+
+	memset( s, 0, sizeof( *s ) );
+	s->origin     = q2lb_get32( p + 4 );
+	s->serial     = q2lb_get32( p + 8 );
+	s->kind       = p[12];
+	s->type       = p[13];
+	s->exclude    = p[14];
+	s->subnetmask = p[15];
+	memcpy( s->ip, p + 16, 4 );
+	s->saved       = p[20];
+	s->seconds     = (int32_t)q2lb_get32( p + 28 );
+	s->maxconnects = (int32_t)q2lb_get32( p + 32 );
+	for( i = 0; i < 4; ++i ) s->flood[i] = (int32_t)q2lb_get32( p + 36 + i * 4 );
+	s->time    = (int64_t)q2lb_get64( p + 52 );
+	s->expires = (int64_t)q2lb_get64( p + 60 );
+
+	memcpy( s->nick, p + Q2Y_SANCTION_SIZE, nick );
+	memcpy( s->msg, p + Q2Y_SANCTION_SIZE + nick, msg );
+	return 1;
+}
+
+#endif
@@ -0,0 +1,515 @@
+/*-------------------------------
+# SPDX-License-Identifier: ISC
+#
+# Copyright © 2022 Daniel Wolf <<nephatrine@gmail.com>>
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+# REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+# AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+# INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+# LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+# OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+# -----------------------------*/
+
+#include "g_local.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef USE_PTHREADS
+#	include <pthread.h>
+#endif
+
+#if defined( _MSC_VER )
+#	define Q2T_THREAD_LOCAL __declspec( thread )
+#else
+#	define Q2T_THREAD_LOCAL __thread
+#endif
+
+#ifdef USE_PTHREADS
+#	define Q2T_LOAD( v ) __atomic_load_n( &( v ), __ATOMIC_ACQUIRE )
+#	define Q2T_STORE( v, n ) __atomic_store_n( &( v ), ( n ), __ATOMIC_RELEASE )
+#	define Q2T_INCREMENT( v ) __atomic_fetch_add( &( v ), 1, __ATOMIC_RELAXED )
+#else
+#	define Q2T_LOAD( v ) ( v )
+#	define Q2T_STORE( v, n ) ( ( v ) = ( n ) )
+#	define Q2T_INCREMENT( v ) ( ( v )++ )
+#endif
+
+//
+// Configuration
+//
+
+int trace_events = 262144; // buffer entries, allocated by the first !trace start
+
+//
+// Capture State
+//
+
+#define Q2T_THREADS 8
+#define Q2T_DEPTH 64 // open spans per thread closed off by the writer
+#define Q2T_DEFAULT_FILE "q2admintrace.json"
+
+typedef struct
+{
+	uint64_t     time;
+	const char * name;
+	uint32_t     tid;
+	char         phase;
+	char         ready;
+} q2t_event_t;
+
+static struct
+{
+	q2t_event_t * events;
+	uint32_t      capacity;
+	uint32_t      next;
+	uint32_t      count; // events handed to the writer
+	uint32_t      dropped;
+	uint64_t      start;
+	uint64_t      stop;
+	uint32_t      threads;
+	const char *  names[Q2T_THREADS];
+	FILE *        fp;
+	int           busy;
+
+#ifdef USE_PTHREADS
+	pthread_t thread;
+	int       joinable;
+#endif
+} q2t;
+
+int q2t_active = 0;
+
+static Q2T_THREAD_LOCAL uint32_t q2t_tid;
+
+static game_export_t q2t_hooks; // what globals held before the capture started
+
+static uint32_t q2t_thread_id()
+{
+	if( !q2t_tid ) q2t_tid = Q2T_INCREMENT( q2t.threads ) + 1;
+	return q2t_tid;
+}
+
+void q2t_thread_name( const char * name )
+{
+	uint32_t tid = q2t_thread_id();
+
+	if( tid <= Q2T_THREADS ) Q2T_STORE( q2t.names[tid - 1], name );
+}
+
+void q2t_event( const char * name, char phase )
+{
+	uint32_t      i = Q2T_INCREMENT( q2t.next );
+	q2t_event_t * e;
+
+	if( i >= q2t.capacity ) return;
+
+	e        = &q2t.events[i];
+	e->time  = q2p_now();
+	e->name  = name;
+	e->tid   = q2t_thread_id();
+	e->phase = phase;
+	Q2T_STORE( e->ready, 1 );
+}
+
+//
+// Hook Wrappers
+//
+
+static void q2t_Init()
+{
+	q2t_event( "InitGame", 'B' );
+	q2t_hooks.Init();
+	Q2T_END( "InitGame" );
+}
+
+static void q2t_Shutdown()
+{
+	// ShutdownGame ends the capture itself
+	q2t_event( "ShutdownGame", 'B' );
+	q2t_hooks.Shutdown();
+}
+
+static void q2t_SpawnEntities( char * mapname, char * entstring, char * spawnpoint )
+{
+	Q2T_BEGIN( "SpawnEntities" );
+	q2t_hooks.SpawnEntities( mapname, entstring, spawnpoint );
+	Q2T_END( "SpawnEntities" );
+}
+
+static void q2t_WriteGame( char * filename, qboolean autosave )
+{
+	Q2T_BEGIN( "WriteGame" );
+	q2t_hooks.WriteGame( filename, autosave );
+	Q2T_END( "WriteGame" );
+}
+
+static void q2t_ReadGame( char * filename )
+{
+	Q2T_BEGIN( "ReadGame" );
+	q2t_hooks.ReadGame( filename );
+	Q2T_END( "ReadGame" );
+}
+
+static void q2t_WriteLevel( char * filename )
+{
+	Q2T_BEGIN( "WriteLevel" );
+	q2t_hooks.WriteLevel( filename );
+	Q2T_END( "WriteLevel" );
+}
+
+static void q2t_ReadLevel( char * filename )
+{
+	Q2T_BEGIN( "ReadLevel" );
+	q2t_hooks.ReadLevel( filename );
+	Q2T_END( "ReadLevel" );
+}
+
+static qboolean q2t_ClientConnect( edict_t * ent, char * userinfo )
+{
+	qboolean ret;
+
+	Q2T_BEGIN( "ClientConnect" );
+	ret = q2t_hooks.ClientConnect( ent, userinfo );
+	Q2T_END( "ClientConnect" );
+	return ret;
+}
+
+static void q2t_ClientBegin( edict_t * ent )
+{
+	Q2T_BEGIN( "ClientBegin" );
+	q2t_hooks.ClientBegin( ent );
+	Q2T_END( "ClientBegin" );
+}
+
+static void q2t_ClientUserinfoChanged( edict_t * ent, char * userinfo )
+{
+	Q2T_BEGIN( "ClientUserinfoChanged" );
+	q2t_hooks.ClientUserinfoChanged( ent, userinfo );
+	Q2T_END( "ClientUserinfoChanged" );
+}
+
+static void q2t_ClientDisconnect( edict_t * ent )
+{
+	Q2T_BEGIN( "ClientDisconnect" );
+	q2t_hooks.ClientDisconnect( ent );
+	Q2T_END( "ClientDisconnect" );
+}
+
+static void q2t_ClientCommand( edict_t * ent )
+{
+	Q2T_BEGIN( "ClientCommand" );
+	q2t_hooks.ClientCommand( ent );
+	Q2T_END( "ClientCommand" );
+}
+
+static void q2t_ClientThink( edict_t * ent, usercmd_t * cmd )
+{
+	Q2T_BEGIN( "ClientThink" );
+	q2t_hooks.ClientThink( ent, cmd );
+	Q2T_END( "ClientThink" );
+}
+
+static void q2t_RunFrame()
+{
+	Q2T_BEGIN( "G_RunFrame" );
+	q2t_hooks.RunFrame();
+	Q2T_END( "G_RunFrame" );
+}
+
+static void q2t_ServerCommand()
+{
+	Q2T_BEGIN( "ServerCommand" );
+	q2t_hooks.ServerCommand();
+	Q2T_END( "ServerCommand" );
+}
+
+// The engine calls through the globals it was given on every use, so the
+// wrappers only cost anything while a capture is running.
+static void q2t_swap_hooks( int on )
+{
+	if( on )
+	{
+		q2t_hooks                     = globals;
+		globals.Init                  = q2t_Init;
+		globals.Shutdown              = q2t_Shutdown;
+		globals.SpawnEntities         = q2t_SpawnEntities;
+		globals.WriteGame             = q2t_WriteGame;
+		globals.ReadGame              = q2t_ReadGame;
+		globals.WriteLevel            = q2t_WriteLevel;
+		globals.ReadLevel             = q2t_ReadLevel;
+		globals.ClientConnect         = q2t_ClientConnect;
+		globals.ClientBegin           = q2t_ClientBegin;
+		globals.ClientUserinfoChanged = q2t_ClientUserinfoChanged;
+		globals.ClientDisconnect      = q2t_ClientDisconnect;
+		globals.ClientCommand         = q2t_ClientCommand;
+		globals.ClientThink           = q2t_ClientThink;
+		globals.RunFrame              = q2t_RunFrame;
+		globals.ServerCommand         = q2t_ServerCommand;
+	}
+	else
+	{
+		globals.Init                  = q2t_hooks.Init;
+		globals.Shutdown              = q2t_hooks.Shutdown;
+		globals.SpawnEntities         = q2t_hooks.SpawnEntities;
+		globals.WriteGame             = q2t_hooks.WriteGame;
+		globals.ReadGame              = q2t_hooks.ReadGame;
+		globals.WriteLevel            = q2t_hooks.WriteLevel;
+		globals.ReadLevel             = q2t_hooks.ReadLevel;
+		globals.ClientConnect         = q2t_hooks.ClientConnect;
+		globals.ClientBegin           = q2t_hooks.ClientBegin;
+		globals.ClientUserinfoChanged = q2t_hooks.ClientUserinfoChanged;
+		globals.ClientDisconnect      = q2t_hooks.ClientDisconnect;
+		globals.ClientCommand         = q2t_hooks.ClientCommand;
+		globals.ClientThink           = q2t_hooks.ClientThink;
+		globals.RunFrame              = q2t_hooks.RunFrame;
+		globals.ServerCommand         = q2t_hooks.ServerCommand;
+	}
+}
+
+//
+// JSON Writer
+//
+
+static void q2t_write_string( FILE * fp, const char * text )
+{
+	fputc( '"', fp );
+	for( ; *text; ++text )
+	{
+		if( *text == '"' || *text == '\\' )
+			fprintf( fp, "\\%c", *text );
+		else if( (unsigned char)*text < 0x20 )
+			fprintf( fp, "\\u%04x", (unsigned char)*text );
+		else
+			fputc( *text, fp );
+	}
+	fputc( '"', fp );
+}
+
+static void q2t_write_event( const char * name, char phase, uint64_t time, uint32_t tid, int * first )
+{
+	fprintf( q2t.fp, "%s{\"name\":", *first ? "" : ",\n" );
+	q2t_write_string( q2t.fp, name );
+	fprintf( q2t.fp, ",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%u}", phase, ( time - q2t.start ) / 1000.0, tid );
+	*first = 0;
+}
+
+// Spans are matched up per thread as they are written. An end whose begin
+// came before the capture started is left out, and spans still open when it
+// stopped (the hook that ran !trace stop, for one) are closed at the stop time.
+static void q2t_write()
+{
+	static const char * open[Q2T_THREADS][Q2T_DEPTH];
+	uint32_t            depth[Q2T_THREADS] = { 0 };
+	uint32_t            i, t;
+	int                 first = 1;
+
+	fprintf( q2t.fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" );
+
+	for( i = 0; i < Q2T_THREADS; ++i )
+	{
+		const char * name = Q2T_LOAD( q2t.names[i] );
+
+		if( !name ) continue;
+
+		fprintf( q2t.fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", first ? "" : ",\n", i + 1 );
+		q2t_write_string( q2t.fp, name );
+		fprintf( q2t.fp, "}}" );
+		first = 0;
+	}
+
+	for( i = 0; i < q2t.count; ++i )
+	{
+		q2t_event_t * e = &q2t.events[i];
+
+		// an event another thread was still filling in when the capture stopped
+		if( !Q2T_LOAD( e->ready ) ) continue;
+
+		if( e->tid <= Q2T_THREADS )
+		{
+			t = e->tid - 1;
+
+			if( e->phase == 'B' )
+			{
+				if( depth[t] < Q2T_DEPTH ) open[t][depth[t]] = e->name;
+				depth[t]++;
+			}
+			else if( e->phase == 'E' )
+			{
+				if( !depth[t] ) continue;
+				depth[t]--;
+			}
+		}
+
+		q2t_write_event( e->name, e->phase, e->time, e->tid, &first );
+	}
+
+	for( t = 0; t < Q2T_THREADS; ++t )
+	{
+		while( depth[t] )
+		{
+			depth[t]--;
+			q2t_write_event( depth[t] < Q2T_DEPTH ? open[t][depth[t]] : "", 'E', q2t.stop, t + 1, &first );
+		}
+	}
+
+	fprintf( q2t.fp, "\n]}\n" );
+	fclose( q2t.fp );
+	q2t.fp = NULL;
+}
+
+#ifdef USE_PTHREADS
+static void * q2t_write_run( void * arg )
+{
+	(void)arg;
+
+	q2t_write();
+	Q2T_STORE( q2t.busy, 0 );
+	return NULL;
+}
+#endif
+
+static void q2t_join()
+{
+#ifdef USE_PTHREADS
+	if( q2t.joinable )
+	{
+		pthread_join( q2t.thread, NULL );
+		q2t.joinable = 0;
+	}
+#endif
+}
+
+//
+// Capture Control
+//
+
+static qboolean q2t_start()
+{
+	if( Q2T_LOAD( q2t_active ) || Q2T_LOAD( q2t.busy ) ) return FALSE;
+
+	q2t_join();
+
+	if( !q2t.events )
+	{
+		if( trace_events <= 0 ) return FALSE;
+
+		q2t.events = malloc( (size_t)trace_events * sizeof( q2t_event_t ) );
+		if( !q2t.events ) return FALSE;
+
+		q2t.capacity = (uint32_t)trace_events;
+	}
+
+	memset( q2t.events, 0, (size_t)q2t.capacity * sizeof( q2t_event_t ) );
+	q2t.start = q2p_now();
+	Q2T_STORE( q2t.next, 0 );
+
+	q2t_thread_name( "game" );
+	q2t_swap_hooks( 1 );
+	Q2T_STORE( q2t_active, 1 );
+	return TRUE;
+}
+
+// returns how many events were kept (-1 if the file could not be opened), the
+// file itself is written in the background
+static int q2t_stop( const char * filename )
+{
+	char     path[MAX_OSPATH];
+	uint32_t next;
+
+	if( !Q2T_LOAD( q2t_active ) ) return 0;
+
+	Q2T_STORE( q2t_active, 0 );
+	q2t_swap_hooks( 0 );
+
+	next        = Q2T_LOAD( q2t.next );
+	q2t.stop    = q2p_now();
+	q2t.count   = next < q2t.capacity ? next : q2t.capacity;
+	q2t.dropped = next - q2t.count;
+
+	q2a_strncpy( path, filename, sizeof( path ) - 1 );
+	path[sizeof( path ) - 1] = 0;
+	q2t.fp                   = q2a_fopen( path, sizeof( path ), "wt" );
+
+	if( !q2t.fp ) return -1;
+
+	Q2T_STORE( q2t.busy, 1 );
+
+#ifdef USE_PTHREADS
+	if( pthread_create( &q2t.thread, NULL, q2t_write_run, NULL ) == 0 )
+	{
+		q2t.joinable = 1;
+		return (int)q2t.count;
+	}
+#endif
+
+	q2t_write();
+	Q2T_STORE( q2t.busy, 0 );
+	return (int)q2t.count;
+}
+
+void q2t_shutdown()
+{
+	q2t_stop( Q2T_DEFAULT_FILE );
+	q2t_join();
+
+	free( q2t.events );
+	q2t.events   = NULL;
+	q2t.capacity = 0;
+}
+
+//
+// Admin Command
+//
+
+#define TRACECMD "[sv] !trace start / stop [file]\n"
+
+void traceRun( int startarg, edict_t * ent, int client )
+{
+	const char * file = gi.argc() > startarg + 1 ? gi.argv( startarg + 1 ) : Q2T_DEFAULT_FILE;
+	int          count;
+
+	(void)client;
+
+	if( gi.argc() <= startarg )
+	{
+		gi.cprintf( ent, PRINT_HIGH, TRACECMD );
+		return;
+	}
+
+	if( Q_stricmp( gi.argv( startarg ), "START" ) == 0 )
+	{
+		if( Q2T_ACTIVE() )
+			gi.cprintf( ent, PRINT_HIGH, "A trace is already running.\n" );
+		else if( Q2T_LOAD( q2t.busy ) )
+			gi.cprintf( ent, PRINT_HIGH, "The last trace is still being written.\n" );
+		else if( !q2t_start() )
+			gi.cprintf( ent, PRINT_HIGH, "Unable to allocate %d trace events (trace_events).\n", trace_events );
+		else
+			gi.cprintf( ent, PRINT_HIGH, "Trace started, room for %u events.\n", q2t.capacity );
+	}
+	else if( Q_stricmp( gi.argv( startarg ), "STOP" ) == 0 )
+	{
+		if( !Q2T_ACTIVE() )
+		{
+			gi.cprintf( ent, PRINT_HIGH, "No trace is running.\n" );
+			return;
+		}
+
+		count = q2t_stop( file );
+
+		if( count < 0 )
+			gi.cprintf( ent, PRINT_HIGH, "Trace stopped, unable to open %s.\n", file );
+		else
+			gi.cprintf( ent, PRINT_HIGH, "Trace stopped, writing %d events to %s (%u dropped).\n", count, file, q2t.dropped );
+	}
+	else
+		gi.cprintf( ent, PRINT_HIGH, TRACECMD );
+}
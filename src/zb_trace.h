@@ -0,0 +1,55 @@
+/*-------------------------------
+# SPDX-License-Identifier: ISC
+#
+# Copyright © 2022 Daniel Wolf <<nephatrine@gmail.com>>
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+# REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+# AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+# INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+# LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+# OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+# -----------------------------*/
+
+#ifndef ZB_TRACE_H
+#define ZB_TRACE_H 1
+
+#include <stdint.h>
+
+// On-demand span capture for chrome://tracing and Perfetto. While a capture
+// is running every Q2T_BEGIN / Q2T_END pair takes a slot in a buffer that is
+// allocated once (trace_events entries), and the game hooks in globals are
+// swapped for wrappers that add their own spans. On stop the buffer is turned
+// into trace-event JSON by a background thread.
+//
+// This header stands alone so the Discord thread can use it as well.
+
+extern int q2t_active;
+
+void q2t_event( const char * name, char phase );
+void q2t_thread_name( const char * name );
+
+#ifdef USE_PTHREADS
+#	define Q2T_ACTIVE() __atomic_load_n( &q2t_active, __ATOMIC_ACQUIRE )
+#else
+#	define Q2T_ACTIVE() q2t_active
+#endif
+
+// name must be a string that stays around, the pointer is what is kept
+#define Q2T_BEGIN( name )                         \
+	do                                            \
+	{                                             \
+		if( Q2T_ACTIVE() ) q2t_event( name, 'B' ); \
+	} while( 0 )
+#define Q2T_END( name )                           \
+	do                                            \
+	{                                             \
+		if( Q2T_ACTIVE() ) q2t_event( name, 'E' ); \
+	} while( 0 )
+
+#endif
@@ -28,12 +28,42 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "g_local.h"
 
+#if defined(WIN32)
+#include <sys/timeb.h>
+#else
+#include <sys/time.h>
+#endif
+
 // required for proxy testing
 void stuffcmd(edict_t *e, char *s)
 {
+	int client = getEntOffset(e) - 1;
+	size_t len = strlen(s);
+	
+	Q2T_BEGIN("stuffcmd");
+	Q2S_ADD(Q2S_STUFFCMD_BYTES, len);
+	
+	if(client >= 0 && client < maxclients->value)
+		{
+			proxyinfo[client].stuffcmdbytes += len;
+		}
+		
 	gi.WriteByte (11);
 	gi.WriteString (s);
 	gi.unicast (e, true);
+	Q2T_END("stuffcmd");
+}
+
+// regexec for the admin lists, which never want the match offsets
+int q2a_regexec(regex_t *r, char *s)
+{
+	int ret;
+	
+	Q2T_BEGIN("regexec");
+	Q2S_INC(Q2S_REGEX_EVALS);
+	ret = regexec(r, s, 0, 0, 0);
+	Q2T_END("regexec");
+	return ret;
 }
 
 /** Case independent string compare (strcasecmp)
@@ -291,27 +321,12 @@ char* processstring(char* output, char* input, int max, char end)
 			}
 			else if ((*input == 't') || (*input == 'T'))
 			{
-				struct tm* timestamptm;
-				time_t timestampsec;
-				char* timestampcp = NULL;
 				size_t timestamplen;
-				char timestr[32];
-
-				time(&timestampsec);/* Get time in seconds */
-				timestamptm = localtime(&timestampsec);/* Convert time to struct */
-				/* tm form */
-
-				timestampcp = asctime(timestamptm);/* get string version of date / time */
-				if (timestampcp) /* Cover case of asctime failure */
-					timestamplen = strlen(timestampcp) - 1;/* length minus the '\n' */
-				else
-					timestamplen = 0;
+				char* timestampcp = getTimestamp(TS_CTIME, &timestamplen);
 
-				if (timestampcp && timestamplen && max >= timestamplen)
+				if (timestamplen && max >= timestamplen)
 				{
-					strncpy(timestr, timestampcp, sizeof timestr);
-					timestr[timestamplen] = '\0';
-					strcpy(output, timestr);
+					q2a_memcpy(output, timestampcp, timestamplen);
 					output += timestamplen;
 					max -= ((int)timestamplen - 1);
 				}
@@ -404,3 +419,82 @@ void q_strupr(char* c)
 		c++;
 	}
 }
+
+
+// wall clock cache, formatted at most once a second (epoch ms once a frame)
+static time_t timestampsec = 0;
+static long long timestampms = 0;
+static char timestampstr[TS_MAX][40];
+static size_t timestamplen[TS_MAX];
+
+void updateTimestamp(void)
+{
+	time_t now;
+	long long nowms;
+	struct tm *nowtm;
+	
+#if defined(WIN32)
+	struct __timeb64 tb;
+	
+	_ftime64(&tb);
+	now = (time_t)tb.time;
+	nowms = (long long)tb.time * 1000 + tb.millitm;
+#else
+	struct timeval tv;
+	
+	gettimeofday(&tv, NULL);
+	now = tv.tv_sec;
+	nowms = (long long)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+#endif
+
+	timestampms = nowms;
+	timestamplen[TS_EPOCHMS] = sprintf(timestampstr[TS_EPOCHMS], "%lld", nowms);
+	
+	if(now == timestampsec)
+		{
+			return;
+		}
+		
+	timestampsec = now;
+	nowtm = localtime(&now);
+	
+	if(nowtm)
+		{
+			// same layout as ctime() without the newline
+			timestamplen[TS_CTIME] = strftime(timestampstr[TS_CTIME], sizeof(timestampstr[TS_CTIME]), "%a %b %e %H:%M:%S %Y", nowtm);
+			timestamplen[TS_ISO8601] = strftime(timestampstr[TS_ISO8601], sizeof(timestampstr[TS_ISO8601]), "%Y-%m-%dT%H:%M:%S%z", nowtm);
+			timestamplen[TS_DATE] = strftime(timestampstr[TS_DATE], sizeof(timestampstr[TS_DATE]), "%Y-%m-%d", nowtm);
+		}
+	else
+		{
+			timestamplen[TS_CTIME] = timestamplen[TS_ISO8601] = timestamplen[TS_DATE] = 0;
+			timestampstr[TS_CTIME][0] = timestampstr[TS_ISO8601][0] = timestampstr[TS_DATE][0] = 0;
+		}
+}
+
+
+char *getTimestamp(enum zb_timestampenum style, size_t *len)
+{
+	if(!timestampsec)
+		{
+			updateTimestamp();
+		}
+		
+	if(len)
+		{
+			*len = timestamplen[style];
+		}
+		
+	return timestampstr[style];
+}
+
+
+long long getTimestampMs(void)
+{
+	if(!timestampsec)
+		{
+			updateTimestamp();
+		}
+		
+	return timestampms;
+}
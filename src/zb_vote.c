@@ -229,7 +229,7 @@ qboolean checkforvotecmd(char *cp, int votecmd)
 			return !Q_stricmp(cp, votecmds[votecmd].votecmd);
 			
 		case VOTE_RE:
-			return (regexec(votecmds[votecmd].r, cp, 0, 0, 0) != REG_NOMATCH);
+			return (q2a_regexec(votecmds[votecmd].r, cp) != REG_NOMATCH);
 		}
 		
 	return FALSE;
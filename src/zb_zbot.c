@@ -281,6 +281,13 @@ void ClientThink (edict_t *ent, usercmd_t *ucmd)
 	
 	if(!dllloaded) return;
 	
+	if(Q2R_ACTIVE())
+		{
+			q2r_think(getEntOffset(ent) - 1, ucmd);
+		}
+	
+	q2p_frame.thinks++;
+	
 	if(q2adminrunmode == 0)
 		{
 			dllglobals->ClientThink(ent, ucmd);
@@ -357,7 +364,7 @@ void ClientThink (edict_t *ent, usercmd_t *ucmd)
 	
 	if(ucmd->impulse)
 		{
-			if(client >= maxclients->value) return;
+			if(client >= maxclients->value) goto finished;
 			
 			if(displayimpulses)
 				{
@@ -438,7 +445,9 @@ void ClientThink (edict_t *ent, usercmd_t *ucmd)
 			copyDllInfo();
 		}
 		
+finished:
 	STOPPERFORMANCE_2(1, "q2admin->ClientThink", 0, NULL);
+	RECORDPERFORMANCE(Q2P_CLIENTTHINK);
 }
 
 //*** UPDATE START ***
@@ -476,12 +485,18 @@ void G_RunFrame(void)
 	char checkConnectProxy[RANDOM_STRING_LENGTH+1];
 	char ReconnectString[RANDOM_STRING_LENGTH+1];
 	char rndConnectString[RANDOM_STRING_LENGTH+1];	//UPDATE
+	uint64_t hitchstart, hitchmark;
 	
 	INITPERFORMANCE_2(1);
 	INITPERFORMANCE_2(2);
 	
 	if(!dllloaded) return;
 	
+	if(Q2R_ACTIVE())
+		{
+			q2r_frame();
+		}
+	
 	if(q2adminrunmode == 0)
 		{
 #ifdef USE_DISCORD
@@ -493,9 +508,11 @@ void G_RunFrame(void)
 		}
 		
 	STARTPERFORMANCE(1);
+	hitchstart = hitchmark = q2p_hitch_begin();
 	
 	lframenum++;
 	ltime = lframenum * FRAMETIME;
+	updateTimestamp();
 	
 	if(serverinfoenable && (lframenum > 10))
 		{
@@ -508,6 +525,14 @@ void G_RunFrame(void)
 	// check if a lrcon password has timed out
 	check_lrcon_password();
 	
+	q2l_run_frame();
+	logSuppressedSummary(FALSE);
+	entstatsFrame();
+	q2s_frame();
+	banIndexExpire();
+	sharedFrame();
+	syncFrame();
+	
 	if(maxReconnectList)
 		{
 			unsigned int i;
@@ -544,14 +569,20 @@ void G_RunFrame(void)
 				}
 		}
 		
+	q2p_hitch_phase(Q2P_PHASE_HOUSEKEEPING, &hitchmark);
+	
 	if(framesperprocess && ((lframenum % framesperprocess) != 0))
 		{
 #ifdef USE_DISCORD
 			q2d_process_game_queue();
+			q2p_hitch_phase(Q2P_PHASE_DISCORD, &hitchmark);
 #endif
+			STARTPERFORMANCE(2);
 			dllglobals->RunFrame();
+			STOPPERFORMANCE_2(2, "mod->G_RunFrame", 0, NULL);
+			q2p_hitch_phase(Q2P_PHASE_MOD, &hitchmark);
 			copyDllInfo();
-			return;
+			goto finished;
 		}
 		
 	maxdoclients = client;
@@ -575,7 +606,12 @@ void G_RunFrame(void)
 			}
 
 			if (timers_active)
+			{
+				uint64_t timermark = hitchmark ? q2p_now() : 0;
+				
 				timer_action(client,ent);
+				q2p_hitch_phase(Q2P_PHASE_TIMERS, &timermark);
+			}
 //*** UPDATE END ***
 
 			if(getCommandFromQueue(client, &command, &data, &str))
@@ -995,6 +1031,14 @@ void G_RunFrame(void)
 				{
 					displayLogEventListCont(ent, client, data, FALSE);
 				}
+				else if(command == QCMD_LOGQUERY)
+				{
+					logQueryCont(ent, client);
+				}
+				else if(command == QCMD_LOGTAIL)
+				{
+					logTailCont(ent, client);
+				}
 				else if(command == QCMD_GETIPALT)
 				{
 					// open logfile and read IP address from log
@@ -1423,19 +1467,26 @@ void G_RunFrame(void)
 		client = -1;
 	}
 
+	q2p_hitch_phase(Q2P_PHASE_QUEUE, &hitchmark);
 	checkOnVoting();
+	q2p_hitch_phase(Q2P_PHASE_VOTING, &hitchmark);
     
 #ifdef USE_DISCORD
 	q2d_process_game_queue();
+	q2p_hitch_phase(Q2P_PHASE_DISCORD, &hitchmark);
 #endif
 
 	STARTPERFORMANCE(2);
 	dllglobals->RunFrame();
 	STOPPERFORMANCE_2(2, "mod->G_RunFrame", 0, NULL);
+	q2p_hitch_phase(Q2P_PHASE_MOD, &hitchmark);
 
 	copyDllInfo();
 
+finished:
 	STOPPERFORMANCE_2(1, "q2admin->G_RunFrame", 0, NULL);
+	RECORDPERFORMANCE(Q2P_RUNFRAME);
+	q2p_hitch_end(hitchstart);
 }
 
 int get_admin_level(char *givenpass,char *givenname)
@@ -2084,12 +2135,9 @@ void whois_getid(int client,edict_t *ent)
 void whois_update_seen(int client,edict_t *ent)
 {
 	//to be called on client connect and disconnect
-	time_t ltimetemp;
-	time( &ltimetemp );
 	if (proxyinfo[client].userid>=0)
 	{
-		q2a_strcpy(whois_details[proxyinfo[client].userid].seen, ctime( &ltimetemp ));
-		whois_details[proxyinfo[client].userid].seen[strlen(whois_details[proxyinfo[client].userid].seen)-1] = 0;
+		q2a_strcpy(whois_details[proxyinfo[client].userid].seen, getTimestamp(TS_CTIME, NULL));
 	}
 }
 
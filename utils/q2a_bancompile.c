@@ -0,0 +1,167 @@
+/*-------------------------------
+# SPDX-License-Identifier: ISC
+#
+# Copyright © 2022 Daniel Wolf <<nephatrine@gmail.com>>
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+# REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+# AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+# INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+# LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+# OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+# -----------------------------*/
+
+// q2admin-bancompile: reads a ban file the way the module does and writes the
+// result out as "<banfile>.bin", which the module then loads at startup for
+// as long as the ban file and its INCLUDEs are unchanged.
+
+#include "g_local.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//
+// Engine Stubs
+//
+
+#define COMPILE_CVARS 16
+
+static cvar_t compile_cvars[COMPILE_CVARS];
+static int    compile_num_cvars = 0;
+
+static cvar_t * compile_cvar( char * name, char * value, int flags )
+{
+	int i;
+
+	for( i = 0; i < compile_num_cvars; ++i )
+		if( strcmp( compile_cvars[i].name, name ) == 0 ) return &compile_cvars[i];
+
+	if( compile_num_cvars >= COMPILE_CVARS ) abort();
+
+	cvar_t * cvar = &compile_cvars[compile_num_cvars++];
+	cvar->name    = strdup( name );
+	cvar->string  = strdup( value );
+	cvar->flags   = flags;
+	cvar->value   = (float)atof( value );
+	return cvar;
+}
+
+static void compile_print( char * fmt, ... )
+{
+	va_list args;
+
+	va_start( args, fmt );
+	vfprintf( stderr, fmt, args );
+	va_end( args );
+}
+
+static void compile_error( char * fmt, ... )
+{
+	va_list args;
+
+	va_start( args, fmt );
+	vfprintf( stderr, fmt, args );
+	va_end( args );
+	exit( 1 );
+}
+
+static void * compile_malloc( int size, int tag )
+{
+	(void)tag;
+	return calloc( 1, (size_t)size );
+}
+
+static void compile_free( void * block ) { free( block ); }
+
+//
+// Main
+//
+
+static void compile_usage()
+{
+	fputs( "usage: q2admin-bancompile [-o image] banfile\n"
+	       "  -o image   write the image here instead of banfile.bin\n"
+	       "Run it from the directory the server reads the ban file from, so INCLUDEs\n"
+	       "resolve the same way. The server uses the image while the ban file and its\n"
+	       "INCLUDEs keep the size and modification time they had when it was compiled.\n",
+	       stderr );
+}
+
+int main( int argc, char ** argv )
+{
+	const char *    output = NULL;
+	const char *    name   = NULL;
+	char            banfile[MAX_OSPATH];
+	char            image[MAX_OSPATH + 4]; // room for ".bin"
+	long            bans = 0, chatbans = 0;
+	baninfo_t *     entry;
+	chatbaninfo_t * centry;
+	int             i;
+
+	for( i = 1; i < argc; ++i )
+	{
+		if( strcmp( argv[i], "-o" ) == 0 && i + 1 < argc )
+			output = argv[++i];
+		else if( argv[i][0] == '-' || name )
+		{
+			compile_usage();
+			return 2;
+		}
+		else
+			name = argv[i];
+	}
+
+	if( !name || strlen( name ) + 4 >= sizeof( banfile ) || ( output && strlen( output ) >= sizeof( image ) ) )
+	{
+		compile_usage();
+		return 2;
+	}
+
+	memset( &gi, 0, sizeof( gi ) );
+	gi.dprintf   = compile_print;
+	gi.error     = compile_error;
+	gi.TagMalloc = compile_malloc;
+	gi.TagFree   = compile_free;
+	gi.cvar      = compile_cvar;
+
+	maxclients = gi.cvar( "maxclients", "1", 0 );
+	basepath   = gi.cvar( "basepath", ".", 0 );
+	savepath   = gi.cvar( "savepath", ".", 0 );
+
+	// ReadBanFile takes a writable name
+	snprintf( banfile, sizeof( banfile ), "%s", name );
+	if( output )
+		snprintf( image, sizeof( image ), "%s", output );
+	else
+		snprintf( image, sizeof( image ), "%s.bin", banfile );
+
+	// name the bans so they can still be deleted through the ban file's journal
+	banLoadStore    = BANSTORE_BASE;
+	banLoadLineBase = 0;
+
+	banImageRecordSources();
+	if( !ReadBanFile( banfile ) )
+	{
+		fprintf( stderr, "%s: could not be read\n", banfile );
+		return 1;
+	}
+
+	if( !banImageWrite( image ) )
+	{
+		fprintf( stderr, "%s: could not be written\n", image );
+		return 1;
+	}
+
+	for( entry = banhead; entry; entry = entry->next ) bans++;
+	for( centry = chatbanhead; centry; centry = centry->next ) chatbans++;
+
+	printf( "%s: %ld bans, %ld chat bans\n", image, bans, chatbans );
+	return 0;
+}
@@ -0,0 +1,482 @@
+/*-------------------------------
+# SPDX-License-Identifier: ISC
+#
+# Copyright © 2022 Daniel Wolf <<nephatrine@gmail.com>>
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+# REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+# AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+# INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+# LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+# OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+# -----------------------------*/
+
+// q2admin-logdump: decodes BINARY log files written by q2admin into text or
+// JSON lines, optionally keeping only some event types, players or times.
+
+#include "zb_logformat.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef _WIN32
+#	include <strings.h>
+#endif
+
+#ifdef USE_ZLIB
+#	include <zlib.h>
+#endif
+
+#define DUMP_BUFFER ( 1024 * 1024 )
+#define DUMP_TYPES 256
+#define DUMP_MAX_FILTERS 32
+
+typedef struct
+{
+	char text[64];
+	int  match;
+} dump_string_t;
+
+static struct
+{
+	int          json;
+	const char * types[DUMP_MAX_FILTERS];
+	int          num_types;
+	const char * players[DUMP_MAX_FILTERS];
+	int          num_players;
+	int64_t      since;
+	int64_t      until;
+} opts = { 0, { NULL }, 0, { NULL }, 0, INT64_MIN, INT64_MAX };
+
+// per session state, reset by every SESSION record
+static char            type_names[DUMP_TYPES][64];
+static int             type_match[DUMP_TYPES];
+static dump_string_t * strings     = NULL;
+static size_t          num_strings = 0;
+static size_t          max_strings = 0;
+static unsigned        port        = 0;
+
+static char out_buffer[DUMP_BUFFER];
+
+//
+// Filters
+//
+
+static int dump_contains( const char * haystack, const char * needle )
+{
+	size_t n = strlen( needle );
+
+	for( ; *haystack; ++haystack )
+	{
+		size_t i;
+		for( i = 0; i < n && tolower( (unsigned char)haystack[i] ) == tolower( (unsigned char)needle[i] ); ++i )
+			;
+		if( i == n ) return 1;
+	}
+
+	return n == 0;
+}
+
+static int dump_type_wanted( const char * name )
+{
+	int i;
+
+	if( !opts.num_types ) return 1;
+
+	for( i = 0; i < opts.num_types; ++i )
+	{
+#ifdef _WIN32
+		if( _stricmp( name, opts.types[i] ) == 0 ) return 1;
+#else
+		if( strcasecmp( name, opts.types[i] ) == 0 ) return 1;
+#endif
+	}
+
+	return 0;
+}
+
+static int dump_player_wanted( const char * text )
+{
+	int i;
+
+	for( i = 0; i < opts.num_players; ++i )
+		if( dump_contains( text, opts.players[i] ) ) return 1;
+
+	return 0;
+}
+
+// Accepts epoch milliseconds or a local YYYY-MM-DD[THH:MM[:SS]] date.
+static int dump_parse_time( const char * text, int64_t * out )
+{
+	struct tm tm;
+	char *    end;
+	int       n;
+
+	if( strlen( text ) > 10 || !strchr( text, '-' ) )
+	{
+		long long ms = strtoll( text, &end, 10 );
+		if( *end == 0 && end != text )
+		{
+			*out = ms;
+			return 1;
+		}
+	}
+
+	memset( &tm, 0, sizeof( tm ) );
+	n = sscanf( text, "%d-%d-%d%*1[T ]%d:%d:%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec );
+	if( n < 3 ) return 0;
+
+	tm.tm_year -= 1900;
+	tm.tm_mon -= 1;
+	tm.tm_isdst = -1;
+	*out        = (int64_t)mktime( &tm ) * 1000;
+	return 1;
+}
+
+//
+// Output
+//
+
+static void dump_time( int64_t ms, char * out, size_t size )
+{
+	time_t      secs = (time_t)( ms / 1000 );
+	struct tm * tm   = localtime( &secs );
+
+	if( !tm || !strftime( out, size, "%Y-%m-%dT%H:%M:%S", tm ) )
+	{
+		snprintf( out, size, "%lld", (long long)ms );
+		return;
+	}
+
+	snprintf( out + strlen( out ), size - strlen( out ), ".%03d", (int)( ms % 1000 ) );
+}
+
+static void dump_json_string( const char * key, const char * text, size_t length )
+{
+	size_t i;
+
+	printf( ",\"%s\":\"", key );
+
+	for( i = 0; i < length; ++i )
+	{
+		unsigned char c = (unsigned char)text[i];
+
+		if( c == '"' || c == '\\' )
+			printf( "\\%c", c );
+		else if( c < 0x20 || c >= 0x7F )
+			printf( "\\u%04x", c );
+		else
+			putchar( c );
+	}
+
+	putchar( '"' );
+}
+
+static const char * dump_string( uint32_t id )
+{
+	if( !id || id > num_strings ) return "";
+	return strings[id - 1].text;
+}
+
+static void dump_event( const unsigned char * rec, size_t size )
+{
+	int          type    = rec[3];
+	uint32_t     tick    = q2lb_get32( rec + 4 );
+	int64_t      time    = (int64_t)q2lb_get64( rec + 8 );
+	int          client  = (int16_t)q2lb_get16( rec + Q2LB_HEADER_SIZE );
+	size_t       msglen  = q2lb_get16( rec + Q2LB_HEADER_SIZE + 2 );
+	uint32_t     nameid  = q2lb_get32( rec + Q2LB_HEADER_SIZE + 4 );
+	uint32_t     ipid    = q2lb_get32( rec + Q2LB_HEADER_SIZE + 8 );
+	int32_t      number  = (int32_t)q2lb_get32( rec + Q2LB_HEADER_SIZE + 12 );
+	float        number2 = q2lb_get_float( rec + Q2LB_HEADER_SIZE + 16 );
+	const char * message = (const char *)rec + Q2LB_EVENT_SIZE;
+	char         stamp[64];
+
+	if( msglen > size - Q2LB_EVENT_SIZE ) msglen = size - Q2LB_EVENT_SIZE;
+
+	if( opts.json )
+	{
+		printf( "{\"time\":%lld,\"tick\":%lu,\"port\":%u", (long long)time, (unsigned long)tick, port );
+		dump_json_string( "type", type_names[type], strlen( type_names[type] ) );
+		printf( ",\"client\":%d", client );
+		if( client >= 0 )
+		{
+			dump_json_string( "name", dump_string( nameid ), strlen( dump_string( nameid ) ) );
+			dump_json_string( "ip", dump_string( ipid ), strlen( dump_string( ipid ) ) );
+		}
+		printf( ",\"number\":%ld,\"number2\":%g", (long)number, number2 );
+		dump_json_string( "message", message, msglen );
+		fputs( "}\n", stdout );
+		return;
+	}
+
+	dump_time( time, stamp, sizeof( stamp ) );
+	printf( "%s %-18s", stamp, type_names[type] );
+	if( client >= 0 ) printf( " [%d] %s (%s)", client, dump_string( nameid ), dump_string( ipid ) );
+	printf( " %ld %g %.*s\n", (long)number, number2, (int)msglen, message );
+}
+
+//
+// Records
+//
+
+static void dump_reset_session( unsigned new_port )
+{
+	int i;
+
+	for( i = 0; i < DUMP_TYPES; ++i )
+	{
+		snprintf( type_names[i], sizeof( type_names[i] ), "TYPE%d", i );
+		type_match[i] = dump_type_wanted( type_names[i] );
+	}
+
+	num_strings = 0;
+	port        = new_port;
+}
+
+static void dump_add_string( uint32_t id, const char * text, size_t length )
+{
+	dump_string_t * s;
+
+	if( id == 0 ) return;
+
+	if( id > max_strings )
+	{
+		size_t           count = max_strings ? max_strings : 1024;
+		dump_string_t * grown;
+
+		while( count < id ) count *= 2;
+		grown = (dump_string_t *)realloc( strings, count * sizeof( dump_string_t ) );
+		if( !grown )
+		{
+			fputs( "q2admin-logdump: out of memory\n", stderr );
+			exit( 1 );
+		}
+
+		memset( grown + max_strings, 0, ( count - max_strings ) * sizeof( dump_string_t ) );
+		strings     = grown;
+		max_strings = count;
+	}
+
+	if( length >= sizeof( s->text ) ) length = sizeof( s->text ) - 1;
+
+	s = &strings[id - 1];
+	memcpy( s->text, text, length );
+	s->text[length] = 0;
+	s->match        = dump_player_wanted( s->text );
+
+	if( id > num_strings ) num_strings = id;
+}
+
+static int dump_record( const unsigned char * rec, size_t size )
+{
+	int     kind = rec[2];
+	int     type = rec[3];
+	int64_t time;
+
+	switch( kind )
+	{
+	case Q2LB_KIND_SESSION:
+		if( size < Q2LB_SESSION_SIZE || memcmp( rec + Q2LB_HEADER_SIZE, Q2LB_MAGIC, 4 ) != 0 ) return 0;
+		if( q2lb_get16( rec + Q2LB_HEADER_SIZE + 4 ) > Q2LB_VERSION )
+		{
+			fputs( "q2admin-logdump: log was written by a newer q2admin\n", stderr );
+			return 0;
+		}
+		dump_reset_session( q2lb_get16( rec + Q2LB_HEADER_SIZE + 6 ) );
+		break;
+
+	case Q2LB_KIND_TYPENAME:
+	{
+		size_t length = size - Q2LB_HEADER_SIZE;
+		if( length >= sizeof( type_names[type] ) ) length = sizeof( type_names[type] ) - 1;
+		memcpy( type_names[type], rec + Q2LB_HEADER_SIZE, length );
+		type_names[type][length] = 0;
+		type_match[type]         = dump_type_wanted( type_names[type] );
+		break;
+	}
+
+	case Q2LB_KIND_STRING:
+		if( size < Q2LB_STRING_SIZE ) return 0;
+		dump_add_string( q2lb_get32( rec + Q2LB_HEADER_SIZE ), (const char *)rec + Q2LB_STRING_SIZE, size - Q2LB_STRING_SIZE );
+		break;
+
+	case Q2LB_KIND_EVENT:
+		if( size < Q2LB_EVENT_SIZE ) return 0;
+		if( !type_match[type] ) break;
+
+		time = (int64_t)q2lb_get64( rec + 8 );
+		if( time < opts.since || time >= opts.until ) break;
+
+		if( opts.num_players )
+		{
+			uint32_t nameid = q2lb_get32( rec + Q2LB_HEADER_SIZE + 4 );
+			uint32_t ipid   = q2lb_get32( rec + Q2LB_HEADER_SIZE + 8 );
+
+			if( !( nameid && nameid <= num_strings && strings[nameid - 1].match ) && !( ipid && ipid <= num_strings && strings[ipid - 1].match ) ) break;
+		}
+
+		dump_event( rec, size );
+		break;
+
+	default:
+		// unknown record kinds from newer versions are skipped
+		break;
+	}
+
+	return 1;
+}
+
+// Rotated segments are gzipped, so with zlib every input goes through gzread,
+// which passes uncompressed files through as they are.
+#ifdef USE_ZLIB
+typedef gzFile dump_input_t;
+
+static dump_input_t dump_open( const char * path ) { return strcmp( path, "-" ) == 0 ? gzdopen( fileno( stdin ), "rb" ) : gzopen( path, "rb" ); }
+static size_t       dump_read( dump_input_t in, void * data, size_t length )
+{
+	int got = gzread( in, data, (unsigned)length );
+	return got > 0 ? (size_t)got : 0;
+}
+static void dump_close( dump_input_t in ) { gzclose( in ); }
+#else
+typedef FILE * dump_input_t;
+
+static dump_input_t dump_open( const char * path ) { return strcmp( path, "-" ) == 0 ? stdin : fopen( path, "rb" ); }
+static size_t       dump_read( dump_input_t in, void * data, size_t length ) { return fread( data, 1, length, in ); }
+static void         dump_close( dump_input_t in )
+{
+	if( in != stdin ) fclose( in );
+}
+#endif
+
+static int dump_file( const char * path )
+{
+	static unsigned char buffer[DUMP_BUFFER];
+	size_t               have = 0, used = 0;
+	long long            offset = 0;
+	dump_input_t         fp     = dump_open( path );
+
+	if( !fp )
+	{
+		fprintf( stderr, "q2admin-logdump: cannot open %s\n", path );
+		return 0;
+	}
+
+	dump_reset_session( 0 );
+
+	for( ;; )
+	{
+		size_t got;
+
+		memmove( buffer, buffer + used, have - used );
+		have -= used;
+		offset += used;
+		used = 0;
+
+		got = dump_read( fp, buffer + have, sizeof( buffer ) - have );
+		if( !got ) break;
+		have += got;
+
+		while( have - used >= Q2LB_HEADER_SIZE )
+		{
+			size_t size = q2lb_get16( buffer + used );
+
+			if( size < Q2LB_HEADER_SIZE )
+			{
+				fprintf( stderr, "q2admin-logdump: %s: corrupt record at offset %lld\n", path, offset + (long long)used );
+				goto failed;
+			}
+
+			if( have - used < size ) break;
+
+			if( !dump_record( buffer + used, size ) )
+			{
+				fprintf( stderr, "q2admin-logdump: %s: bad record at offset %lld\n", path, offset + (long long)used );
+				goto failed;
+			}
+
+			used += size;
+		}
+	}
+
+	if( have ) fprintf( stderr, "q2admin-logdump: %s: ignoring %lu trailing bytes\n", path, (unsigned long)have );
+	dump_close( fp );
+	return 1;
+
+failed:
+	dump_close( fp );
+	return 0;
+}
+
+//
+// Main
+//
+
+static void dump_usage()
+{
+	fputs( "usage: q2admin-logdump [options] file...\n"
+	       "  --json          write one JSON object per line\n"
+	       "  --type NAME     only events of this log type (repeatable)\n"
+	       "  --player TEXT   only events whose player name or IP contains TEXT (repeatable)\n"
+	       "  --since TIME    only events at or after TIME\n"
+	       "  --until TIME    only events before TIME\n"
+	       "TIME is epoch milliseconds or a local YYYY-MM-DD[THH:MM[:SS]] date.\n"
+	       "A file name of - reads standard input.\n"
+#ifdef USE_ZLIB
+	       "Gzipped (rotated) files are read directly.\n"
+#endif
+	       ,
+	       stderr );
+}
+
+int main( int argc, char ** argv )
+{
+	int i, files = 0, ok = 1;
+
+	for( i = 1; i < argc; ++i )
+	{
+		const char * arg = argv[i];
+
+		if( strcmp( arg, "--json" ) == 0 )
+			opts.json = 1;
+		else if( strcmp( arg, "--type" ) == 0 && i + 1 < argc && opts.num_types < DUMP_MAX_FILTERS )
+			opts.types[opts.num_types++] = argv[++i];
+		else if( strcmp( arg, "--player" ) == 0 && i + 1 < argc && opts.num_players < DUMP_MAX_FILTERS )
+			opts.players[opts.num_players++] = argv[++i];
+		else if( strcmp( arg, "--since" ) == 0 && i + 1 < argc && dump_parse_time( argv[i + 1], &opts.since ) )
+			++i;
+		else if( strcmp( arg, "--until" ) == 0 && i + 1 < argc && dump_parse_time( argv[i + 1], &opts.until ) )
+			++i;
+		else if( arg[0] == '-' && arg[1] )
+		{
+			dump_usage();
+			return 2;
+		}
+		else
+			argv[++files] = argv[i];
+	}
+
+	if( !files )
+	{
+		dump_usage();
+		return 2;
+	}
+
+	setvbuf( stdout, out_buffer, _IOFBF, sizeof( out_buffer ) );
+
+	for( i = 1; i <= files; ++i )
+		if( !dump_file( argv[i] ) ) ok = 0;
+
+	fflush( stdout );
+	free( strings );
+	return ok ? 0 : 1;
+}
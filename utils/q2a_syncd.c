@@ -0,0 +1,695 @@
+/*-------------------------------
+# SPDX-License-Identifier: ISC
+#
+# Copyright © 2022 Daniel Wolf <<nephatrine@gmail.com>>
+#
+# Permission to use, copy, modify, and/or distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+# REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+# AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+# INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+# LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+# OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+# PERFORMANCE OF THIS SOFTWARE.
+# -----------------------------*/
+
+// q2admin-syncd: reference sync daemon. Servers whose sync_address points at
+// it send it the bans, mutes and flood kicks they give, and it passes each one
+// on to every other server connected. Daemons on other hosts are linked with
+// -p, and pass on what they get the same way, so any number of hosts can share
+// sanctions. Every sanction is passed on once however the links loop.
+//
+// Sanctions that run until a wall clock time (TIME bans, timed mutes) are kept
+// until then and sent to each server or daemon as it connects, so a server
+// started late still gets the bans given elsewhere.
+//
+// With -k every connection has to prove it has the same key before anything
+// is taken from it or sent to it, and every frame after that is signed with
+// it (see zb_syncformat.h).
+
+#include "zb_syncformat.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SYNCD_MAX_LISTEN 8
+#define SYNCD_MAX_PEERS 16
+#define SYNCD_MAX_CONNS 256
+#define SYNCD_SEEN 4096
+#define SYNCD_HISTORY 1024
+#define SYNCD_OUTPUT_MAX ( 1024 * 1024 ) // a connection this far behind is dropped
+#define SYNCD_RETRY_SECONDS 5
+
+typedef struct
+{
+	int             fd;
+	int             peer;       // index into opts.peers, -1 for one that connected here
+	int             connecting; // peer connect still in progress
+	int             closed;
+	int             hello;   // its HELLO has arrived
+	int             trusted; // and its AUTH checked out
+	q2y_session_t   session;
+	char            name[280];
+	unsigned char   input[Q2Y_FRAME_MAX * 4];
+	size_t          have;
+	unsigned char * output;
+	size_t          outlen;
+	size_t          outcap;
+} syncd_conn_t;
+
+static struct
+{
+	int          verbose;
+	const char * key;
+	const char * listen[SYNCD_MAX_LISTEN];
+	int          num_listen;
+	const char * peers[SYNCD_MAX_PEERS];
+	int          num_peers;
+} opts;
+
+static int            listen_fd[SYNCD_MAX_LISTEN];
+static time_t         peer_retry[SYNCD_MAX_PEERS];
+static int            peer_up[SYNCD_MAX_PEERS];
+static syncd_conn_t * conns[SYNCD_MAX_CONNS];
+static int            num_conns = 0;
+static uint64_t       seen[SYNCD_SEEN];
+static int            seen_next = 0;
+static sanction_t     history[SYNCD_HISTORY];
+static int            num_history = 0;
+
+static volatile sig_atomic_t stopping = 0;
+
+static void syncd_log( const char * fmt, ... )
+{
+	char      stamp[32], line[512];
+	time_t    now = time( NULL );
+	struct tm tm;
+	va_list   args;
+
+	if( !opts.verbose ) return;
+
+	localtime_r( &now, &tm );
+	strftime( stamp, sizeof( stamp ), "%Y-%m-%d %H:%M:%S", &tm );
+
+	va_start( args, fmt );
+	vsnprintf( line, sizeof( line ), fmt, args );
+	va_end( args );
+	fprintf( stderr, "%s %s\n", stamp, line );
+}
+
+//
+// Sockets
+//
+
+// a bound and listening socket, or a connect in progress, for "unix:/path" or "[host]:port"
+static int syncd_socket( const char * address, int listening )
+{
+	struct addrinfo    hints, *found, *ai;
+	struct sockaddr_un sun;
+	char               host[256];
+	char *             port;
+	int                fd = -1, on = 1;
+
+	if( !strncmp( address, "unix:", 5 ) )
+	{
+		if( strlen( address + 5 ) >= sizeof( sun.sun_path ) ) return -1;
+
+		memset( &sun, 0, sizeof( sun ) );
+		sun.sun_family = AF_UNIX;
+		strcpy( sun.sun_path, address + 5 );
+
+		if( ( fd = socket( AF_UNIX, SOCK_STREAM, 0 ) ) < 0 ) return -1;
+		fcntl( fd, F_SETFL, O_NONBLOCK );
+
+		if( listening )
+		{
+			unlink( sun.sun_path );
+			if( bind( fd, (struct sockaddr *)&sun, sizeof( sun ) ) == 0 && listen( fd, 16 ) == 0 ) return fd;
+		}
+		else if( connect( fd, (struct sockaddr *)&sun, sizeof( sun ) ) == 0 || errno == EINPROGRESS )
+			return fd;
+
+		close( fd );
+		return -1;
+	}
+
+	if( strlen( address ) >= sizeof( host ) ) return -1;
+	strcpy( host, address );
+	if( ( port = strrchr( host, ':' ) ) == NULL ) return -1;
+	*port++ = 0;
+
+	if( host[0] == '[' && port - host >= 3 && port[-2] == ']' )
+	{
+		port[-2] = 0;
+		memmove( host, host + 1, strlen( host ) );
+	}
+
+	memset( &hints, 0, sizeof( hints ) );
+	hints.ai_family   = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags    = listening ? AI_PASSIVE : 0;
+	if( getaddrinfo( host[0] && strcmp( host, "*" ) ? host : NULL, port, &hints, &found ) != 0 ) return -1;
+
+	for( ai = found; ai; ai = ai->ai_next )
+	{
+		if( ( fd = socket( ai->ai_family, ai->ai_socktype, ai->ai_protocol ) ) < 0 ) continue;
+		fcntl( fd, F_SETFL, O_NONBLOCK );
+
+		if( listening )
+		{
+			setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof( on ) );
+			if( bind( fd, ai->ai_addr, ai->ai_addrlen ) == 0 && listen( fd, 16 ) == 0 ) break;
+		}
+		else
+		{
+			setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof( on ) );
+			if( connect( fd, ai->ai_addr, ai->ai_addrlen ) == 0 || errno == EINPROGRESS ) break;
+		}
+
+		close( fd );
+		fd = -1;
+	}
+
+	freeaddrinfo( found );
+	return fd;
+}
+
+//
+// Connections
+//
+
+static void syncd_queue( syncd_conn_t * conn, const unsigned char * data, size_t length )
+{
+	unsigned char * grown;
+	size_t          room;
+
+	if( conn->closed ) return;
+
+	if( conn->outlen + length > SYNCD_OUTPUT_MAX )
+	{
+		fprintf( stderr, "%s: too far behind, dropped\n", conn->name );
+		conn->closed = 1;
+		return;
+	}
+
+	if( conn->outlen + length > conn->outcap )
+	{
+		room = conn->outcap ? conn->outcap * 2 : 4096;
+		while( room < conn->outlen + length ) room *= 2;
+
+		if( ( grown = realloc( conn->output, room ) ) == NULL )
+		{
+			conn->closed = 1;
+			return;
+		}
+
+		conn->output = grown;
+		conn->outcap = room;
+	}
+
+	memcpy( conn->output + conn->outlen, data, length );
+	conn->outlen += length;
+}
+
+static void syncd_flush( syncd_conn_t * conn )
+{
+	ssize_t sent;
+
+	while( conn->outlen && !conn->closed )
+	{
+		sent = send( conn->fd, conn->output, conn->outlen, MSG_NOSIGNAL );
+		if( sent < 0 && errno == EINTR ) continue;
+		if( sent < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) ) return;
+		if( sent <= 0 )
+		{
+			conn->closed = 1;
+			return;
+		}
+
+		memmove( conn->output, conn->output + sent, conn->outlen - (size_t)sent );
+		conn->outlen -= (size_t)sent;
+	}
+}
+
+// 0 unless the system's random source filled data
+static int syncd_random( unsigned char * data, size_t length )
+{
+	FILE * fp = fopen( "/dev/urandom", "rb" );
+	size_t got = 0;
+
+	if( fp )
+	{
+		got = fread( data, 1, length, fp );
+		fclose( fp );
+	}
+
+	return got == length;
+}
+
+static void syncd_greet( syncd_conn_t * conn )
+{
+	unsigned char frame[Q2Y_HELLO_SIZE];
+
+	// a guessable nonce would let an old handshake be replayed
+	if( !syncd_random( conn->session.nonce, sizeof( conn->session.nonce ) ) )
+	{
+		fprintf( stderr, "%s: unable to read /dev/urandom, dropped\n", conn->name );
+		conn->closed = 1;
+		return;
+	}
+
+	conn->session.dialled = conn->peer >= 0;
+	syncd_queue( conn, frame, q2y_put_hello( frame, 0, conn->session.nonce ) );
+}
+
+// a sanction signed for conn
+static void syncd_send( syncd_conn_t * conn, const sanction_t * s )
+{
+	unsigned char frame[Q2Y_FRAME_MAX];
+	size_t        size = q2y_put_sanction( frame, s );
+
+	q2y_seal( frame, size, opts.key, &conn->session );
+	syncd_queue( conn, frame, size );
+}
+
+// what is still in force, once conn has shown it has the key
+static void syncd_trust( syncd_conn_t * conn )
+{
+	time_t now = time( NULL );
+	int    i;
+
+	conn->trusted = 1;
+
+	for( i = 0; i < num_history; ++i )
+		if( history[i].expires > now ) syncd_send( conn, &history[i] );
+}
+
+static syncd_conn_t * syncd_add( int fd, int peer, const char * name )
+{
+	syncd_conn_t * conn;
+
+	if( num_conns == SYNCD_MAX_CONNS || ( conn = calloc( 1, sizeof( syncd_conn_t ) ) ) == NULL )
+	{
+		fprintf( stderr, "%s: too many connections\n", name );
+		close( fd );
+		return NULL;
+	}
+
+	conn->fd   = fd;
+	conn->peer = peer;
+	snprintf( conn->name, sizeof( conn->name ), "%s", name );
+	conns[num_conns++] = conn;
+	return conn;
+}
+
+static void syncd_sweep()
+{
+	int i, j;
+
+	for( i = j = 0; i < num_conns; ++i )
+	{
+		if( !conns[i]->closed )
+		{
+			conns[j++] = conns[i];
+			continue;
+		}
+
+		syncd_log( "%s: disconnected", conns[i]->name );
+		if( conns[i]->peer >= 0 )
+		{
+			peer_up[conns[i]->peer]    = 0;
+			peer_retry[conns[i]->peer] = time( NULL ) + SYNCD_RETRY_SECONDS;
+		}
+
+		close( conns[i]->fd );
+		free( conns[i]->output );
+		free( conns[i] );
+	}
+
+	num_conns = j;
+}
+
+//
+// Sanctions
+//
+
+static int syncd_seen( const sanction_t * s )
+{
+	uint64_t key = ( (uint64_t)s->origin << 32 ) | s->serial;
+	int      i;
+
+	for( i = 0; i < SYNCD_SEEN; ++i )
+		if( seen[i] == key ) return 1;
+
+	seen[seen_next] = key;
+	seen_next       = ( seen_next + 1 ) % SYNCD_SEEN;
+	return 0;
+}
+
+static void syncd_remember( const sanction_t * s )
+{
+	time_t now = time( NULL );
+	int    i, j;
+
+	for( i = j = 0; i < num_history; ++i )
+	{
+		// an unmute ends the mutes kept for that address
+		if( history[i].expires <= now || ( s->kind == SANCTION_MUTE && !s->seconds && history[i].kind == SANCTION_MUTE && !memcmp( history[i].ip, s->ip, 4 ) ) ) continue;
+		history[j++] = history[i];
+	}
+	num_history = j;
+
+	if( s->kind == SANCTION_KICK || s->expires <= now ) return;
+
+	// full, so the one that ends soonest makes room
+	if( num_history == SYNCD_HISTORY )
+	{
+		for( i = 0, j = 1; j < SYNCD_HISTORY; ++j )
+			if( history[j].expires < history[i].expires ) i = j;
+
+		if( history[i].expires > s->expires ) return;
+	}
+	else
+		i = num_history++;
+
+	history[i] = *s;
+}
+
+static const char * syncd_kind( uint32_t kind )
+{
+	switch( kind )
+	{
+	case SANCTION_BAN:
+		return "ban";
+	case SANCTION_MUTE:
+		return "mute";
+	case SANCTION_KICK:
+		return "kick";
+	}
+
+	return "unknown";
+}
+
+static void syncd_relay( syncd_conn_t * from, const unsigned char * frame, size_t size )
+{
+	sanction_t s;
+	int        i;
+
+	if( !from->trusted || !q2y_check( frame, size, opts.key, &from->session ) )
+	{
+		fprintf( stderr, "%s: sanction not signed with our key, dropped\n", from->name );
+		from->closed = 1;
+		return;
+	}
+
+	if( !q2y_get_sanction( frame, size, &s ) )
+	{
+		fprintf( stderr, "%s: malformed sanction skipped\n", from->name );
+		return;
+	}
+
+	if( syncd_seen( &s ) ) return;
+
+	syncd_log( "%s: %s %u.%u.%u.%u%s%s from %08x #%u", from->name, syncd_kind( s.kind ), s.ip[0], s.ip[1], s.ip[2], s.ip[3], s.nick[0] ? " " : "", s.nick, s.origin, s.serial );
+	syncd_remember( &s );
+
+	for( i = 0; i < num_conns; ++i )
+		if( conns[i] != from && conns[i]->trusted ) syncd_send( conns[i], &s );
+}
+
+static void syncd_read( syncd_conn_t * conn )
+{
+	unsigned char auth[Q2Y_AUTH_SIZE];
+	size_t        used = 0, size;
+	ssize_t       got;
+	uint32_t      origin;
+
+	got = recv( conn->fd, conn->input + conn->have, sizeof( conn->input ) - conn->have, 0 );
+	if( got < 0 && ( errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK ) ) return;
+	if( got <= 0 )
+	{
+		conn->closed = 1;
+		return;
+	}
+	conn->have += (size_t)got;
+
+	while( conn->have - used >= Q2Y_HEADER_SIZE && !conn->closed )
+	{
+		size = q2lb_get16( conn->input + used );
+		if( size < Q2Y_HEADER_SIZE || size > Q2Y_FRAME_MAX )
+		{
+			fprintf( stderr, "%s: not a q2admin sync link\n", conn->name );
+			conn->closed = 1;
+			return;
+		}
+		if( conn->have - used < size ) break;
+
+		switch( conn->input[used + 2] )
+		{
+		case Q2Y_HELLO:
+			switch( q2y_get_hello( conn->input + used, size, &origin, &conn->session ) )
+			{
+			case 0:
+				fprintf( stderr, "%s: not a q2admin sync link\n", conn->name );
+				conn->closed = 1;
+				return;
+
+			case -1: // our own nonce, sent back to get our AUTH for it
+				fprintf( stderr, "%s: sent our HELLO back\n", conn->name );
+				conn->closed = 1;
+				return;
+			}
+
+			if( origin )
+				syncd_log( "%s: server %08x", conn->name, origin );
+			else
+				syncd_log( "%s: daemon", conn->name );
+
+			conn->hello = 1;
+			syncd_queue( conn, auth, q2y_put_auth( auth, opts.key, &conn->session ) );
+			break;
+
+		case Q2Y_AUTH:
+			if( !conn->hello || !q2y_check( conn->input + used, size, opts.key, &conn->session ) )
+			{
+				fprintf( stderr, "%s: does not have our key\n", conn->name );
+				conn->closed = 1;
+				return;
+			}
+
+			syncd_trust( conn );
+			break;
+
+		case Q2Y_SANCTION:
+			syncd_relay( conn, conn->input + used, size );
+			break;
+		}
+
+		used += size;
+	}
+
+	memmove( conn->input, conn->input + used, conn->have - used );
+	conn->have -= used;
+}
+
+static void syncd_accept( int fd )
+{
+	struct sockaddr_storage addr;
+	socklen_t               length = sizeof( addr );
+	char                    host[64], port[16], name[280];
+	syncd_conn_t *          conn;
+	int                     client, on = 1;
+
+	if( ( client = accept( fd, (struct sockaddr *)&addr, &length ) ) < 0 ) return;
+	fcntl( client, F_SETFL, O_NONBLOCK );
+
+	if( addr.ss_family == AF_UNIX || getnameinfo( (struct sockaddr *)&addr, length, host, sizeof( host ), port, sizeof( port ), NI_NUMERICHOST | NI_NUMERICSERV ) != 0 )
+		snprintf( name, sizeof( name ), "local #%d", client );
+	else
+	{
+		setsockopt( client, IPPROTO_TCP, TCP_NODELAY, &on, sizeof( on ) );
+		snprintf( name, sizeof( name ), "%s:%s", host, port );
+	}
+
+	if( ( conn = syncd_add( client, -1, name ) ) != NULL )
+	{
+		syncd_log( "%s: connected", conn->name );
+		syncd_greet( conn );
+	}
+}
+
+static void syncd_connect_peers()
+{
+	syncd_conn_t * conn;
+	time_t         now = time( NULL );
+	int            i, fd;
+
+	for( i = 0; i < opts.num_peers; ++i )
+	{
+		if( peer_up[i] || peer_retry[i] > now ) continue;
+
+		peer_retry[i] = now + SYNCD_RETRY_SECONDS;
+		if( ( fd = syncd_socket( opts.peers[i], 0 ) ) < 0 || ( conn = syncd_add( fd, i, opts.peers[i] ) ) == NULL ) continue;
+
+		conn->connecting = 1;
+		peer_up[i]       = 1;
+	}
+}
+
+static void syncd_connected( syncd_conn_t * conn )
+{
+	socklen_t length = sizeof( int );
+	int       error  = 0;
+
+	conn->connecting = 0;
+	if( getsockopt( conn->fd, SOL_SOCKET, SO_ERROR, &error, &length ) != 0 || error )
+	{
+		conn->closed = 1;
+		return;
+	}
+
+	syncd_log( "%s: connected", conn->name );
+	syncd_greet( conn );
+}
+
+//
+// Main
+//
+
+static void syncd_stop( int sig )
+{
+	(void)sig;
+	stopping = 1;
+}
+
+static void syncd_usage()
+{
+	fputs( "usage: q2admin-syncd [-v] [-k key] [-p peer]... address...\n"
+	       "  address    where servers connect, unix:/path or [host]:port\n"
+	       "  -k key     key every server and daemon linked has to have, their sync_key\n"
+	       "  -p peer    another daemon to pass sanctions to and from, same forms\n"
+	       "  -v         log connections and every sanction passed on\n"
+	       "Point each server's sync_address at a daemon on its host, and link the\n"
+	       "daemons with -p (one side of each link is enough). Without -k anyone\n"
+	       "who can reach a TCP address can send bans, so only listen on loopback\n"
+	       "or a private network then.\n",
+	       stderr );
+}
+
+int main( int argc, char ** argv )
+{
+	struct pollfd polls[SYNCD_MAX_LISTEN + SYNCD_MAX_CONNS];
+	int           i, n;
+
+	for( i = 1; i < argc; ++i )
+	{
+		if( !strcmp( argv[i], "-v" ) )
+			opts.verbose = 1;
+		else if( ( !strcmp( argv[i], "-k" ) || !strcmp( argv[i], "--key" ) ) && i + 1 < argc )
+			opts.key = argv[++i];
+		else if( ( !strcmp( argv[i], "-p" ) || !strcmp( argv[i], "--peer" ) ) && i + 1 < argc && opts.num_peers < SYNCD_MAX_PEERS )
+			opts.peers[opts.num_peers++] = argv[++i];
+		else if( argv[i][0] != '-' && opts.num_listen < SYNCD_MAX_LISTEN )
+			opts.listen[opts.num_listen++] = argv[i];
+		else
+		{
+			syncd_usage();
+			return 2;
+		}
+	}
+
+	if( !opts.num_listen && !opts.num_peers )
+	{
+		syncd_usage();
+		return 2;
+	}
+
+	if( !opts.key ) opts.key = "";
+
+	for( i = 0; i < opts.num_listen && !opts.key[0]; ++i )
+		if( strncmp( opts.listen[i], "unix:", 5 ) ) fprintf( stderr, "%s: listening without -k, anyone who can reach it can send bans\n", opts.listen[i] );
+
+	for( i = 0; i < opts.num_listen; ++i )
+	{
+		if( ( listen_fd[i] = syncd_socket( opts.listen[i], 1 ) ) < 0 )
+		{
+			fprintf( stderr, "%s: could not listen: %s\n", opts.listen[i], strerror( errno ) );
+			return 1;
+		}
+
+		syncd_log( "%s: listening", opts.listen[i] );
+	}
+
+	signal( SIGPIPE, SIG_IGN );
+	signal( SIGINT, syncd_stop );
+	signal( SIGTERM, syncd_stop );
+
+	while( !stopping )
+	{
+		syncd_connect_peers();
+
+		for( i = 0; i < opts.num_listen; ++i )
+		{
+			polls[i].fd     = listen_fd[i];
+			polls[i].events = POLLIN;
+		}
+
+		for( i = 0; i < num_conns; ++i )
+		{
+			polls[opts.num_listen + i].fd     = conns[i]->fd;
+			polls[opts.num_listen + i].events = conns[i]->connecting ? POLLOUT : POLLIN | ( conns[i]->outlen ? POLLOUT : 0 );
+		}
+
+		// conns added while handling these are polled from the next pass
+		n = num_conns;
+		if( poll( polls, (nfds_t)( opts.num_listen + n ), 1000 ) < 0 )
+		{
+			if( errno == EINTR ) continue;
+			perror( "poll" );
+			return 1;
+		}
+
+		for( i = 0; i < n; ++i )
+		{
+			short events = polls[opts.num_listen + i].revents;
+
+			if( !events || conns[i]->closed ) continue;
+
+			if( conns[i]->connecting )
+				syncd_connected( conns[i] );
+			else if( events & ( POLLIN | POLLHUP | POLLERR ) )
+				syncd_read( conns[i] );
+		}
+
+		for( i = 0; i < opts.num_listen; ++i )
+			if( polls[i].revents & POLLIN ) syncd_accept( listen_fd[i] );
+
+		for( i = 0; i < num_conns; ++i ) syncd_flush( conns[i] );
+
+		syncd_sweep();
+	}
+
+	for( i = 0; i < opts.num_listen; ++i )
+	{
+		close( listen_fd[i] );
+		if( !strncmp( opts.listen[i], "unix:", 5 ) ) unlink( opts.listen[i] + 5 );
+	}
+
+	return 0;
+}